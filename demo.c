@@ -1,7 +1,7 @@
 /* Demo program for the multi sender multi receiver queue.
  * 
  * The actual relevant source is in nmqueue.
- * Important tools are in receiverthread and senderthread.
+ * Important tools are in receiverthread, receiverpool and senderthread.
  * 
  * Julian Schutsch
  */
@@ -13,6 +13,7 @@
 #include "src/nmqueue.h"
 #include "src/senderthread.h"
 #include "src/receiverthread.h"
+#include "src/receiverpool.h"
 
 #define SENDERS 10
 #define RECEIVERS 20
@@ -20,7 +21,20 @@
 
 nmqueue_t queue;
 senderthread_t   senderThreads[SENDERS];
-receiverthread_t receiverThreads[RECEIVERS];
+receiverpool_t   receiverPool;
+
+/* Scale between one and RECEIVERS receivers depending on the load */
+static const receiverpoolconfig_t receiverPoolConfig =
+{
+    1,           /* minReceivers */
+    RECEIVERS,   /* maxReceivers */
+    16,          /* highOccupancy */
+    0,           /* lowOccupancy */
+    10*1000,     /* highDwell, 10ms */
+    100*1000,    /* sampleInterval, 100ms */
+    3,           /* spawnSamples */
+    50           /* retireSamples */
+};
 
 /* Make believe source */
 int get_external_data(char * buffer, int bufferSizeInBytes)
@@ -71,7 +85,7 @@ void consumer(source_t source,
              size_t    dataSize,
              void*     param)
 {
-    printf("Consume from %i in %i\n",source,(int)((size_t)(param)));
+    printf("Consume from %i\n",source);
     process_data( (char*)data, dataSize );
     free( data );
 }
@@ -91,13 +105,10 @@ int main(int argc, char** argv)
         }
     }
 
-    for( i=0; i<RECEIVERS ; ++i )
+    if( receiverpool_initialize( &receiverPool, &queue, consumer, NULL, &receiverPoolConfig ) != 0 )
     {
-        if( initializeReceiver( &receiverThreads[i], &queue, consumer, (void*)i ) != 0 )
-        {
-            perror("Receiver initialize failed\n");
-            exit(1);
-        }
+        perror("Receiver pool initialize failed\n");
+        exit(1);
     }
     
     for(;;)
@@ -112,10 +123,7 @@ int main(int argc, char** argv)
         finalizeSender( &senderThreads[i] );
     }
 
-    for( i=0; i<RECEIVERS ; ++i )
-    {
-        finalizeReceiver( &receiverThreads[i] );
-    }
+    receiverpool_finalize( &receiverPool );
 
     nmqueue_finalize(&queue);
 
@@ -0,0 +1,61 @@
+/* Replays a traffic recording through a nmqueue.
+ * 
+ * Usage: replay recording [speed] [senders] [receivers] [length]
+ * 
+ * speed 1 replays at the recorded speed, 2 twice as fast, 0 as fast as
+ * possible. The recording is created with trafficrecord_start.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "src/nmqueue.h"
+#include "tools/trafficrecord.h"
+#include "tools/trafficreplay.h"
+
+int main(int argc, char** argv)
+{
+    struct trafficrecord_entry_s* entries;
+    size_t                        count;
+    trafficreplay_stats_t         stats;
+    nmqueue_t                     queue;
+    double                        speed     = argc > 2 ? atof( argv[2] ) : 1.0;
+    size_t                        senders   = argc > 3 ? (size_t)atol( argv[3] ) : 1;
+    size_t                        receivers = argc > 4 ? (size_t)atol( argv[4] ) : 1;
+    size_t                        length    = argc > 5 ? (size_t)atol( argv[5] ) : 1024;
+    int                           err;
+
+    if( argc < 2 || senders == 0 || receivers == 0 || length < 2 )
+    {
+        printf("Usage: %s recording [speed] [senders] [receivers] [length]\n", argv[0]);
+        return 1;
+    }
+
+    if( (err=trafficrecord_load( argv[1], &entries, &count )) != NMQUEUEERROR_NOERROR )
+    {
+        printf("Failed to load %s: %s\n", argv[1], nmqueue_error_to_string(err));
+        return 1;
+    }
+
+    if( (err=nmqueue_initialize( &queue, length )) != NMQUEUEERROR_NOERROR )
+    {
+        printf("Failed to initialize nmqueue: %s\n", nmqueue_error_to_string(err));
+        return 1;
+    }
+
+    printf("Replaying %lu messages at speed %g with %lu senders, %lu receivers, length %lu\n",
+           (unsigned long)count, speed, (unsigned long)senders, (unsigned long)receivers, (unsigned long)length);
+
+    if( trafficreplay_run( &queue, entries, count, senders, receivers, speed, &stats ) != 0 )
+    {
+        printf("Replay failed\n");
+        return 1;
+    }
+
+    trafficreplay_print( stdout, &stats );
+
+    nmqueue_finalize( &queue );
+    trafficrecord_free( entries, count );
+
+    return 0;
+}
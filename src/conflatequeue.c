@@ -0,0 +1,271 @@
+#include "conflatequeue.h"
+#include "waitlist.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+#define CONFLATEQUEUE_INVARIANT(queue)\
+    assert( queue->entries != NULL );\
+    assert( queue->pendingCount <= queue->sourceCount );\
+    assert( (queue->pendingCount == 0) == (queue->head == queue->sourceCount) );
+
+int conflatequeue_initialize(conflatequeue_t* queue,
+                             size_t           sourceCount)
+{
+    size_t i;
+
+    assert( queue != NULL );
+    assert( sourceCount != 0 );
+
+    queue->sourceCount  = sourceCount;
+    queue->head         = sourceCount;
+    queue->tail         = sourceCount;
+    queue->pendingCount = 0;
+    queue->conflated    = 0;
+    queue->entries      = (struct conflatequeue_entry_s*)malloc( sourceCount*sizeof(struct conflatequeue_entry_s) );
+
+    queue->receivers.head  = NULL;
+    queue->receivers.tail  = NULL;
+    queue->aborts.threads  = NULL;
+    queue->aborts.count    = 0;
+    queue->aborts.capacity = 0;
+
+    if( queue->entries == NULL )
+    {
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+
+    for( i=0 ; i<sourceCount ; ++i )
+    {
+        queue->entries[i].data     = NULL;
+        queue->entries[i].dataSize = 0;
+        queue->entries[i].pending  = 0;
+        queue->entries[i].next     = sourceCount;
+    }
+
+    if( pthread_mutex_init( &queue->mutex, NULL ) != 0 )
+    {
+        free( queue->entries );
+        return NMQUEUEERROR_MUTEX_INITIALIZE_FAILED;
+    }
+
+    CONFLATEQUEUE_INVARIANT( queue );
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+void conflatequeue_finalize(conflatequeue_t* queue)
+{
+    assert( queue != NULL );
+    CONFLATEQUEUE_INVARIANT( queue );
+
+    pthread_mutex_destroy( &queue->mutex );
+
+    free( queue->entries );
+    free( queue->aborts.threads );
+}
+
+void conflatequeue_abort(conflatequeue_t* queue,
+                         void*            threadId)
+{
+    assert( queue != NULL );
+
+    pthread_mutex_lock( &queue->mutex );
+
+    /* Only the thread itself is woken, if it is not blocked its next call returns the abort */
+    if( !waitlist_abort( &queue->receivers, threadId ) )
+    {
+        waitlist_keep_abort( &queue->aborts, threadId );
+    }
+
+    pthread_mutex_unlock( &queue->mutex );
+}
+
+void conflatequeue_clear_abort(conflatequeue_t* queue,
+                               void*            threadId)
+{
+    assert( queue != NULL );
+
+    pthread_mutex_lock( &queue->mutex );
+    waitlist_take_abort( &queue->aborts, threadId );
+    pthread_mutex_unlock( &queue->mutex );
+}
+
+int conflatequeue_send(conflatequeue_t* queue,
+                       source_t         source,
+                       void*            data,
+                       size_t           dataSize,
+                       void**           oldData,
+                       size_t*          oldDataSize)
+{
+    struct conflatequeue_entry_s* entry;
+    int                           replaced;
+
+    assert( queue != NULL );
+    assert( source >= 0 && (size_t)source < queue->sourceCount );
+    assert( oldData != NULL );
+    assert( oldDataSize != NULL );
+    CONFLATEQUEUE_INVARIANT( queue );
+
+    entry = &queue->entries[source];
+
+    pthread_mutex_lock( &queue->mutex );
+
+    replaced = entry->pending;
+
+    if( replaced )
+    {
+        /* Replace in place, the source keeps its position */
+        *oldData     = entry->data;
+        *oldDataSize = entry->dataSize;
+        queue->conflated++;
+    }
+    else
+    {
+        *oldData     = NULL;
+        *oldDataSize = 0;
+
+        /* Append source to arrival order */
+        entry->pending = 1;
+        entry->next    = queue->sourceCount;
+        if( queue->head == queue->sourceCount )
+        {
+            queue->head = source;
+        }
+        else
+        {
+            queue->entries[queue->tail].next = source;
+        }
+        queue->tail = source;
+        queue->pendingCount++;
+    }
+
+    entry->data     = data;
+    entry->dataSize = dataSize;
+
+    CONFLATEQUEUE_INVARIANT( queue );
+
+    if( !replaced )
+    {
+        waitlist_wake( &queue->receivers, 1 );
+    }
+
+    pthread_mutex_unlock( &queue->mutex );
+
+    return replaced;
+}
+
+/* Blocks on the receivers until woken, queue has to be locked.
+ * Returns 1 if the thread got aborted. */
+static int waitOn(conflatequeue_t* queue,
+                  void*            threadId)
+{
+    struct nmqueue_waiter_s waiter;
+
+    waiter.threadId = threadId;
+    waiter.needed   = 1;
+    waiter.filter   = NULL;
+
+    /* Without a condition variable the caller polls */
+    if( !waitlist_block( &queue->mutex, &queue->receivers, &waiter ) )
+    {
+        return waitlist_take_abort( &queue->aborts, threadId );
+    }
+
+    /* Aborted after it was woken, before it could run */
+    return waiter.aborted || waitlist_take_abort( &queue->aborts, threadId );
+}
+
+/* Takes the oldest pending source, blocks while empty if block is set */
+static int receiveLatest(conflatequeue_t* queue,
+                         source_t*        source,
+                         void**           data,
+                         size_t*          dataSize,
+                         void*            threadId,
+                         int              block)
+{
+    struct conflatequeue_entry_s* entry;
+
+    assert( queue    != NULL );
+    assert( source   != NULL );
+    assert( data     != NULL );
+    assert( dataSize != NULL );
+    CONFLATEQUEUE_INVARIANT( queue );
+
+    pthread_mutex_lock( &queue->mutex );
+
+    /* aborted thread? */
+    if( waitlist_take_abort( &queue->aborts, threadId ) )
+    {
+        pthread_mutex_unlock( &queue->mutex );
+        return NMQUEUEERROR_ABORT;
+    }
+
+    while( queue->head == queue->sourceCount )
+    {
+        if( !block )
+        {
+            pthread_mutex_unlock( &queue->mutex );
+            return NMQUEUEERROR_EMPTY;
+        }
+
+        if( waitOn( queue, threadId ) )
+        {
+            /* A wakeup meant for this thread goes to the next one */
+            if( queue->head != queue->sourceCount )
+            {
+                waitlist_wake( &queue->receivers, 1 );
+            }
+            pthread_mutex_unlock( &queue->mutex );
+            return NMQUEUEERROR_ABORT;
+        }
+    }
+
+    entry = &queue->entries[queue->head];
+
+    *source   = (source_t)queue->head;
+    *data     = entry->data;
+    *dataSize = entry->dataSize;
+
+    entry->pending = 0;
+    entry->data    = NULL;
+    queue->head    = entry->next;
+    queue->pendingCount--;
+
+    CONFLATEQUEUE_INVARIANT( queue );
+
+    pthread_mutex_unlock( &queue->mutex );
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+int conflatequeue_receive(conflatequeue_t* queue,
+                          source_t*        source,
+                          void**           data,
+                          size_t*          dataSize,
+                          void*            threadId)
+{
+    return receiveLatest( queue, source, data, dataSize, threadId, 1 );
+}
+
+int conflatequeue_tryreceive(conflatequeue_t* queue,
+                             source_t*        source,
+                             void**           data,
+                             size_t*          dataSize,
+                             void*            threadId)
+{
+    return receiveLatest( queue, source, data, dataSize, threadId, 0 );
+}
+
+unsigned long conflatequeue_conflated(conflatequeue_t* queue)
+{
+    unsigned long conflated;
+
+    assert( queue != NULL );
+
+    pthread_mutex_lock( &queue->mutex );
+    conflated = queue->conflated;
+    pthread_mutex_unlock( &queue->mutex );
+
+    return conflated;
+}
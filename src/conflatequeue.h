@@ -0,0 +1,134 @@
+#ifndef _CONFLATEQUEUE_HEADER_
+#define _CONFLATEQUEUE_HEADER_
+
+#include "nmqueue.h"
+
+/*! Latest undelivered value of one source */
+struct conflatequeue_entry_s
+{
+    void*  data;     /*!< User data of the latest message */
+    size_t dataSize; /*!< Size of the latest message */
+    int    pending;  /*!< Set while a message of this source is queued */
+    size_t next;     /*!< Next source in arrival order, valid while pending */
+};
+
+/*! Queue keeping only the latest message of every source.
+ *  Sources are numbered 0..sourceCount-1. */
+typedef struct
+{
+   struct conflatequeue_entry_s* entries;      /*!< One entry per source */
+   size_t                        sourceCount;  /*!< Number of sources */
+   size_t                        head;         /*!< Oldest pending source, sourceCount if empty */
+   size_t                        tail;         /*!< Newest pending source */
+   size_t                        pendingCount; /*!< Number of pending sources */
+   unsigned long                 conflated;    /*!< Number of replaced messages */
+   pthread_mutex_t               mutex;        /*!< Mutex, has to be locked for all operations */
+   struct nmqueue_waitlist_s     receivers;    /*!< Receivers blocked on an empty queue */
+   struct nmqueue_aborts_s       aborts;       /*!< Threads to abort which were not blocked at the time */
+} conflatequeue_t;
+
+/*!
+ * \brief Initialize conflating queue.
+ * 
+ * The queue depth is bounded by sourceCount, sending never blocks.
+ * 
+ * \param queue       Pointer to a not initialized instance of conflatequeue_t
+ * \param sourceCount Number of sources, not 0
+ * \return            Error code, ERROR_NOERROR on success
+ */
+int conflatequeue_initialize(conflatequeue_t* queue,
+                             size_t           sourceCount);
+
+/*!
+ * \brief Finalize conflating queue.
+ * 
+ * Pending data is not released, see nmqueue_finalize.
+ * 
+ * \param queue Pointer to an initialized instance of conflatequeue_t
+ */
+void conflatequeue_finalize(conflatequeue_t* queue);
+
+/*!
+ * \brief Send abort message to one blocked thread.
+ * 
+ * Same as nmqueue_abort, only the specified thread is woken. If it is not
+ * blocked, the abort is kept until its next call.
+ * 
+ * \param queue    Pointer to an initialized instance of conflatequeue_t
+ * \param threadId Thread to abort
+ */
+void conflatequeue_abort(conflatequeue_t* queue,
+                         void*            threadId);
+
+/*!
+ * \brief Drop a pending abort.
+ * 
+ * Same as nmqueue_clear_abort.
+ * 
+ * \param queue    Pointer to an initialized instance of conflatequeue_t
+ * \param threadId Thread passed to conflatequeue_abort
+ */
+void conflatequeue_clear_abort(conflatequeue_t* queue,
+                               void*            threadId);
+
+/*!
+ * \brief Non blocking conflating send.
+ * 
+ * If source already has an undelivered message, the message is replaced
+ * in place and keeps its position in arrival order. The replaced data is
+ * returned through oldData and oldDataSize for release.
+ * 
+ * \param queue       Pointer to an initialized instance of conflatequeue_t
+ * \param source      Source in 0..sourceCount-1
+ * \param data        Any void*
+ * \param dataSize    Any size_t
+ * \param oldData     Reference to a void*, replaced data or NULL
+ * \param oldDataSize Reference to a size_t, replaced size or 0
+ * \return            1 if a message was replaced, 0 otherwise
+ */
+int conflatequeue_send(conflatequeue_t* queue,
+                       source_t         source,
+                       void*            data,
+                       size_t           dataSize,
+                       void**           oldData,
+                       size_t*          oldDataSize);
+
+/*!
+ * \brief Blocking receive of the latest message of the oldest pending source.
+ * 
+ * \param queue    Pointer to an initialized instance of conflatequeue_t
+ * \param source   Reference to a source_t
+ * \param data     Reference to a void*
+ * \param dataSize Reference to a size_t
+ * \return         Error code, ERROR_NOERROR on success
+ */
+int conflatequeue_receive(conflatequeue_t* queue,
+                          source_t*        source,
+                          void**           data,
+                          size_t*          dataSize,
+                          void*            threadId);
+
+/*!
+ * \brief Non blocking receive, returns ERROR_EMPTY instead of blocking.
+ * 
+ * \param queue    Pointer to an initialized instance of conflatequeue_t
+ * \param source   Reference to a source_t
+ * \param data     Reference to a void*
+ * \param dataSize Reference to a size_t
+ * \return         Error code, ERROR_NOERROR on success
+ */
+int conflatequeue_tryreceive(conflatequeue_t* queue,
+                             source_t*        source,
+                             void**           data,
+                             size_t*          dataSize,
+                             void*            threadId);
+
+/*!
+ * \brief Number of replaced messages since initialization.
+ * 
+ * \param queue Pointer to an initialized instance of conflatequeue_t
+ * \return      Number of conflated messages
+ */
+unsigned long conflatequeue_conflated(conflatequeue_t* queue);
+
+#endif
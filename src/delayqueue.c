@@ -0,0 +1,418 @@
+#include "delayqueue.h"
+
+#include <stdlib.h>
+#include <time.h>
+#include <assert.h>
+
+#define SLOTMASK ((uint64_t)DELAYQUEUE_SLOTS-1)
+
+/* Current CLOCK_MONOTONIC time in µs */
+static uint64_t monotonicNow(void)
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t)now.tv_sec*1000*1000+now.tv_nsec/1000;
+}
+
+/* Appends a node to a slot of the wheel */
+static void appendNode(delayqueue_t*             delayQueue,
+                       size_t                    level,
+                       size_t                    slot,
+                       struct delayqueue_node_s* node)
+{
+    struct delayqueue_slot_s* entry = &delayQueue->wheel[level][slot];
+
+    node->next = NULL;
+    if( entry->tail != NULL )
+    {
+        entry->tail->next = node;
+    }
+    else
+    {
+        entry->head = node;
+    }
+    entry->tail = node;
+
+    delayQueue->occupied[level] |= (uint64_t)1 << slot;
+}
+
+/* Removes all nodes from a slot and returns them as list */
+static struct delayqueue_node_s* takeSlot(delayqueue_t* delayQueue,
+                                          size_t        level,
+                                          size_t        slot)
+{
+    struct delayqueue_slot_s* entry = &delayQueue->wheel[level][slot];
+    struct delayqueue_node_s* nodes = entry->head;
+
+    entry->head = NULL;
+    entry->tail = NULL;
+    delayQueue->occupied[level] &= ~((uint64_t)1 << slot);
+
+    return nodes;
+}
+
+/* Puts a node into the level matching its distance to the current tick.
+ * Due nodes are moved to the ready messages, count is only needed then. */
+static void placeNode(delayqueue_t*             delayQueue,
+                      struct delayqueue_node_s* node,
+                      size_t*                   count)
+{
+    uint64_t delta;
+    uint64_t due   = node->due;
+    size_t   level = 0;
+
+    if( due <= delayQueue->current )
+    {
+        assert( count != NULL );
+
+        delayQueue->ready[(*count)++] = node->message;
+        delayQueue->pending--;
+
+        node->next       = delayQueue->free;
+        delayQueue->free = node;
+        return;
+    }
+
+    delta = due-delayQueue->current;
+
+    while( level+1 < DELAYQUEUE_LEVELS && delta >> (DELAYQUEUE_SLOTBITS*(level+1)) != 0 )
+    {
+        level++;
+    }
+
+    /* Beyond the last level, wait in its furthest slot and cascade again */
+    if( delta >> (DELAYQUEUE_SLOTBITS*DELAYQUEUE_LEVELS) != 0 )
+    {
+        due = delayQueue->current + ((uint64_t)1 << (DELAYQUEUE_SLOTBITS*DELAYQUEUE_LEVELS)) - 1;
+    }
+
+    appendNode( delayQueue, level, (size_t)((due >> (DELAYQUEUE_SLOTBITS*level)) & SLOTMASK), node );
+}
+
+/* Next tick with work, either a level 0 slot expiring or a higher
+ * level slot cascading down. UINT64_MAX if the wheel is empty. */
+static uint64_t nextEvent(delayqueue_t* delayQueue)
+{
+    uint64_t next = UINT64_MAX;
+    size_t   level;
+
+    for( level=0 ; level<DELAYQUEUE_LEVELS ; ++level )
+    {
+        unsigned shift    = DELAYQUEUE_SLOTBITS*level;
+        uint64_t occupied = delayQueue->occupied[level];
+        unsigned start;
+        uint64_t offset   = 1;
+        uint64_t tick;
+
+        if( occupied == 0 )
+        {
+            continue;
+        }
+
+        /* Rotate so bit 0 is the slot after the current one, the current
+         * slot itself is a full rotation ahead */
+        start    = (unsigned)(((delayQueue->current >> shift)+1) & SLOTMASK);
+        occupied = (occupied >> start) | (occupied << ((DELAYQUEUE_SLOTS-start) & SLOTMASK));
+
+        while( (occupied & 1) == 0 )
+        {
+            occupied >>= 1;
+            offset++;
+        }
+
+        tick = ((delayQueue->current >> shift)+offset) << shift;
+        if( tick < next )
+        {
+            next = tick;
+        }
+    }
+
+    return next;
+}
+
+/* Processes all ticks up to now, due messages are collected in ready */
+static void advance(delayqueue_t* delayQueue,
+                    uint64_t      now,
+                    size_t*       count)
+{
+    uint64_t tick;
+
+    while( (tick=nextEvent( delayQueue )) <= now )
+    {
+        size_t level;
+
+        delayQueue->current = tick;
+
+        /* Cascade from the top, slots starting at this tick move down */
+        for( level=DELAYQUEUE_LEVELS-1 ; level>0 ; --level )
+        {
+            unsigned shift = DELAYQUEUE_SLOTBITS*level;
+
+            if( (tick & (((uint64_t)1 << shift)-1)) == 0 )
+            {
+                struct delayqueue_node_s* node = takeSlot( delayQueue, level, (size_t)((tick >> shift) & SLOTMASK) );
+
+                while( node != NULL )
+                {
+                    struct delayqueue_node_s* next = node->next;
+                    placeNode( delayQueue, node, count );
+                    node = next;
+                }
+            }
+        }
+
+        /* Expire */
+        {
+            struct delayqueue_node_s* node = takeSlot( delayQueue, 0, (size_t)(tick & SLOTMASK) );
+
+            while( node != NULL )
+            {
+                struct delayqueue_node_s* next = node->next;
+                placeNode( delayQueue, node, count );
+                node = next;
+            }
+        }
+    }
+
+    if( now > delayQueue->current )
+    {
+        delayQueue->current = now;
+    }
+}
+
+/* Entry point for the driver thread */
+/* Sleeps until the earliest message matures and sends all due messages */
+static void* driverProc(void* delayQueueT)
+{
+    delayqueue_t* delayQueue = (delayqueue_t*)delayQueueT;
+
+    pthread_mutex_lock( &delayQueue->mutex );
+
+    while( !delayQueue->terminated )
+    {
+        size_t   count = 0;
+        uint64_t next;
+
+        advance( delayQueue, (monotonicNow()-delayQueue->base)/delayQueue->resolution, &count );
+
+        if( count != 0 )
+        {
+            size_t sent;
+
+            /* Senders need not wake the driver while it is busy */
+            delayQueue->wakeup = 0;
+
+            pthread_mutex_unlock( &delayQueue->mutex );
+            nmqueue_send_batch( delayQueue->target, delayQueue->ready, count, &sent, delayQueue );
+            pthread_mutex_lock( &delayQueue->mutex );
+            continue;
+        }
+
+        next = nextEvent( delayQueue );
+        delayQueue->wakeup = next;
+
+        if( next == UINT64_MAX )
+        {
+            pthread_cond_wait( &delayQueue->cond, &delayQueue->mutex );
+        }
+        else
+        {
+            uint64_t        deadline = delayQueue->base + next*delayQueue->resolution;
+            struct timespec timeout;
+
+            timeout.tv_sec  = (time_t)(deadline/(1000*1000));
+            timeout.tv_nsec = (long)(deadline%(1000*1000))*1000;
+
+            pthread_cond_timedwait( &delayQueue->cond, &delayQueue->mutex, &timeout );
+        }
+    }
+
+    pthread_mutex_unlock( &delayQueue->mutex );
+
+    return NULL;
+}
+
+int delayqueue_initialize(delayqueue_t* delayQueue,
+                          nmqueue_t*    target,
+                          size_t        capacity,
+                          unsigned long resolution)
+{
+    size_t i;
+
+    assert( delayQueue != NULL );
+    assert( target != NULL );
+    assert( capacity != 0 );
+    assert( resolution != 0 );
+
+    delayQueue->target     = target;
+    delayQueue->resolution = resolution;
+    delayQueue->base       = monotonicNow();
+    delayQueue->current    = 0;
+    delayQueue->wakeup     = 0;
+    delayQueue->capacity   = capacity;
+    delayQueue->pending    = 0;
+    delayQueue->terminated = 0;
+
+    for( i=0 ; i<DELAYQUEUE_LEVELS ; ++i )
+    {
+        size_t slot;
+        for( slot=0 ; slot<DELAYQUEUE_SLOTS ; ++slot )
+        {
+            delayQueue->wheel[i][slot].head = NULL;
+            delayQueue->wheel[i][slot].tail = NULL;
+        }
+        delayQueue->occupied[i] = 0;
+    }
+
+    delayQueue->nodes = (struct delayqueue_node_s*)malloc( capacity*sizeof(struct delayqueue_node_s) );
+    delayQueue->ready = (struct nmqueue_message_s*)malloc( capacity*sizeof(struct nmqueue_message_s) );
+
+    if( delayQueue->nodes == NULL || delayQueue->ready == NULL )
+    {
+        free( delayQueue->nodes );
+        free( delayQueue->ready );
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+
+    delayQueue->free = NULL;
+    for( i=capacity ; i!=0 ; --i )
+    {
+        delayQueue->nodes[i-1].next = delayQueue->free;
+        delayQueue->free            = &delayQueue->nodes[i-1];
+    }
+
+    if( pthread_mutex_init( &delayQueue->mutex, NULL ) != 0 )
+    {
+        free( delayQueue->nodes );
+        free( delayQueue->ready );
+        return NMQUEUEERROR_MUTEX_INITIALIZE_FAILED;
+    }
+
+    /* Deadlines are CLOCK_MONOTONIC */
+    {
+        pthread_condattr_t attr;
+        int                error = pthread_condattr_init( &attr );
+
+        if( error == 0 )
+        {
+            error = pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+            if( error == 0 )
+            {
+                error = pthread_cond_init( &delayQueue->cond, &attr );
+            }
+            pthread_condattr_destroy( &attr );
+        }
+
+        if( error != 0 )
+        {
+            pthread_mutex_destroy( &delayQueue->mutex );
+            free( delayQueue->nodes );
+            free( delayQueue->ready );
+            return NMQUEUEERROR_CONDVAR_INITIALIZE_FAILED;
+        }
+    }
+
+    if( pthread_create( &delayQueue->thread, NULL, driverProc, delayQueue ) != 0 )
+    {
+        pthread_cond_destroy( &delayQueue->cond );
+        pthread_mutex_destroy( &delayQueue->mutex );
+        free( delayQueue->nodes );
+        free( delayQueue->ready );
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+int delayqueue_send_at(delayqueue_t* delayQueue,
+                       source_t      source,
+                       void*         data,
+                       size_t        dataSize,
+                       uint64_t      notBefore)
+{
+    struct delayqueue_node_s* node;
+    uint64_t                  due = 0;
+
+    assert( delayQueue != NULL );
+
+    /* Round up, never deliver early */
+    if( notBefore > delayQueue->base )
+    {
+        due = (notBefore-delayQueue->base+delayQueue->resolution-1)/delayQueue->resolution;
+    }
+
+    pthread_mutex_lock( &delayQueue->mutex );
+
+    node = delayQueue->free;
+    if( node == NULL )
+    {
+        pthread_mutex_unlock( &delayQueue->mutex );
+        return NMQUEUEERROR_FULL;
+    }
+    delayQueue->free = node->next;
+
+    node->message.source   = source;
+    node->message.data     = data;
+    node->message.dataSize = dataSize;
+    node->message.expires  = 0;
+
+    /* Already due, expires with the next tick processed */
+    node->due = due > delayQueue->current ? due : delayQueue->current+1;
+
+    placeNode( delayQueue, node, NULL );
+    delayQueue->pending++;
+
+    /* Earlier than the driver planned to wake up */
+    if( node->due < delayQueue->wakeup )
+    {
+        pthread_cond_signal( &delayQueue->cond );
+    }
+
+    pthread_mutex_unlock( &delayQueue->mutex );
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+int delayqueue_send_after(delayqueue_t* delayQueue,
+                          source_t      source,
+                          void*         data,
+                          size_t        dataSize,
+                          uint64_t      delay)
+{
+    return delayqueue_send_at( delayQueue, source, data, dataSize, monotonicNow()+delay );
+}
+
+size_t delayqueue_pending(delayqueue_t* delayQueue)
+{
+    size_t pending;
+
+    assert( delayQueue != NULL );
+
+    pthread_mutex_lock( &delayQueue->mutex );
+    pending = delayQueue->pending;
+    pthread_mutex_unlock( &delayQueue->mutex );
+
+    return pending;
+}
+
+void delayqueue_finalize(delayqueue_t* delayQueue)
+{
+    assert( delayQueue != NULL );
+
+    pthread_mutex_lock( &delayQueue->mutex );
+    delayQueue->terminated = 1;
+    pthread_cond_signal( &delayQueue->cond );
+    pthread_mutex_unlock( &delayQueue->mutex );
+
+    /* The driver may be blocked on a full target */
+    nmqueue_abort( delayQueue->target, delayQueue );
+
+    pthread_join( delayQueue->thread, NULL );
+    nmqueue_clear_abort( delayQueue->target, delayQueue );
+
+    pthread_cond_destroy( &delayQueue->cond );
+    pthread_mutex_destroy( &delayQueue->mutex );
+
+    free( delayQueue->nodes );
+    free( delayQueue->ready );
+}
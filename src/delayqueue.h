@@ -0,0 +1,120 @@
+#ifndef _DELAYQUEUE_HEADER_
+#define _DELAYQUEUE_HEADER_
+
+#include "nmqueue.h"
+
+/*! Levels of the timing wheel */
+#define DELAYQUEUE_LEVELS 4
+/*! Slots per level as a power of two, one bit each in a uint64_t */
+#define DELAYQUEUE_SLOTBITS 6
+#define DELAYQUEUE_SLOTS (1<<DELAYQUEUE_SLOTBITS)
+
+/*! Delayed message, preallocated */
+struct delayqueue_node_s
+{
+    struct nmqueue_message_s  message; /*!< Message to send once due */
+    uint64_t                  due;     /*!< Tick the message matures at */
+    struct delayqueue_node_s* next;    /*!< Next node of the slot or free list */
+};
+
+/*! One slot of the timing wheel */
+struct delayqueue_slot_s
+{
+    struct delayqueue_node_s* head; /*!< First node, in order of insertion */
+    struct delayqueue_node_s* tail; /*!< Last node */
+};
+
+/*! Delay queue, a hierarchical timing wheel in front of a nmqueue_t */
+typedef struct
+{
+    nmqueue_t*                target;     /*!< Queue due messages are sent to */
+    unsigned long             resolution; /*!< Length of a tick in µs */
+    uint64_t                  base;       /*!< CLOCK_MONOTONIC time in µs of tick 0 */
+    uint64_t                  current;    /*!< Last processed tick */
+    uint64_t                  wakeup;     /*!< Tick the driver sleeps until, UINT64_MAX for none */
+    struct delayqueue_slot_s  wheel[DELAYQUEUE_LEVELS][DELAYQUEUE_SLOTS]; /*!< Slots per level */
+    uint64_t                  occupied[DELAYQUEUE_LEVELS]; /*!< Bit per non empty slot */
+    struct delayqueue_node_s* nodes;      /*!< capacity preallocated nodes */
+    struct delayqueue_node_s* free;       /*!< Unused nodes */
+    struct nmqueue_message_s* ready;      /*!< capacity entries, due messages handed to target */
+    size_t                    capacity;   /*!< Maximum number of delayed messages */
+    size_t                    pending;    /*!< Messages in the wheel */
+    pthread_t                 thread;     /*!< Driver thread */
+    pthread_mutex_t           mutex;      /*!< Protects the wheel */
+    pthread_cond_t            cond;       /*!< Signaled when the earliest message changed, uses CLOCK_MONOTONIC */
+    int                       terminated; /*!< Indicates the driver should shutdown */
+} delayqueue_t;
+
+/*!
+ * \brief Create delay queue.
+ *
+ * Starts a driver thread which sleeps until the earliest message matures
+ * and then sends all due messages to target at once. Messages are held in
+ * a timing wheel of DELAYQUEUE_LEVELS levels with DELAYQUEUE_SLOTS slots
+ * each, insert and expiry are O(1). Times are rounded up to resolution,
+ * a message is never delivered early.
+ *
+ * \param delayQueue Pointer to an uninitialized delayqueue_t
+ * \param target     Pointer to an initialized nmqueue_t
+ * \param capacity   Maximum number of delayed messages, not 0
+ * \param resolution Length of a tick in µs, not 0
+ * \return           Error code, ERROR_NOERROR on success
+ */
+int delayqueue_initialize(delayqueue_t* delayQueue,
+                          nmqueue_t*    target,
+                          size_t        capacity,
+                          unsigned long resolution);
+
+/*!
+ * \brief Send a message not before a given time.
+ *
+ * Messages due at the time of the call go to target with the next
+ * driver run.
+ *
+ * \param delayQueue Pointer to an initialized delayqueue_t
+ * \param source     Any source_t
+ * \param data       Any void*
+ * \param dataSize   Any size_t
+ * \param notBefore  CLOCK_MONOTONIC time in µs
+ * \return           Error code, ERROR_FULL if capacity messages are pending
+ */
+int delayqueue_send_at(delayqueue_t* delayQueue,
+                       source_t      source,
+                       void*         data,
+                       size_t        dataSize,
+                       uint64_t      notBefore);
+
+/*!
+ * \brief Send a message after a delay.
+ *
+ * \param delayQueue Pointer to an initialized delayqueue_t
+ * \param source     Any source_t
+ * \param data       Any void*
+ * \param dataSize   Any size_t
+ * \param delay      Delay in µs
+ * \return           Error code, ERROR_FULL if capacity messages are pending
+ */
+int delayqueue_send_after(delayqueue_t* delayQueue,
+                          source_t      source,
+                          void*         data,
+                          size_t        dataSize,
+                          uint64_t      delay);
+
+/*!
+ * \brief Number of messages not yet due.
+ *
+ * \param delayQueue Pointer to an initialized delayqueue_t
+ * \return           Pending messages
+ */
+size_t delayqueue_pending(delayqueue_t* delayQueue);
+
+/*!
+ * \brief Stop the driver and destroy the delay queue.
+ *
+ * Messages not yet due are discarded. The target queue is not touched.
+ *
+ * \param delayQueue Pointer to an initialized delayqueue_t
+ */
+void delayqueue_finalize(delayqueue_t* delayQueue);
+
+#endif
@@ -0,0 +1,131 @@
+#include "idlestrategy.h"
+
+#include <sched.h>
+#include <time.h>
+#include <assert.h>
+
+int idlestrategy_initialize(idlestrategy_t*     strategy,
+                            const idleconfig_t* config)
+{
+    assert( strategy != NULL );
+
+    if( config != NULL )
+    {
+        strategy->config = *config;
+    }
+    else
+    {
+        strategy->config.kind      = IDLESTRATEGY_SPIN;
+        strategy->config.spinCount = 0;
+        strategy->config.minSleep  = 0;
+        strategy->config.maxSleep  = 0;
+    }
+
+    assert( strategy->config.kind >= IDLESTRATEGY_SPIN && strategy->config.kind <= IDLESTRATEGY_BLOCK );
+    assert( strategy->config.minSleep <= strategy->config.maxSleep );
+    /* A backoff never sleeping would be a busy loop */
+    assert( strategy->config.kind != IDLESTRATEGY_BACKOFF || strategy->config.maxSleep != 0 );
+
+    strategy->idleCount = 0;
+    strategy->sleep     = strategy->config.minSleep;
+    strategy->ready     = 0;
+
+    if( pthread_mutex_init( &strategy->mutex, NULL ) != 0 )
+    {
+        return 1;
+    }
+
+    if( pthread_cond_init( &strategy->readyCond, NULL ) != 0 )
+    {
+        pthread_mutex_destroy( &strategy->mutex );
+        return 1;
+    }
+
+    return 0;
+}
+
+void idlestrategy_finalize(idlestrategy_t* strategy)
+{
+    assert( strategy != NULL );
+
+    pthread_cond_destroy( &strategy->readyCond );
+    pthread_mutex_destroy( &strategy->mutex );
+}
+
+void idlestrategy_idle(idlestrategy_t* strategy)
+{
+    assert( strategy != NULL );
+
+    switch( strategy->config.kind )
+    {
+        case IDLESTRATEGY_SPIN:
+            break;
+
+        case IDLESTRATEGY_SPINYIELD:
+            if( strategy->idleCount < strategy->config.spinCount )
+            {
+                strategy->idleCount++;
+            }
+            else
+            {
+                sched_yield();
+            }
+            break;
+
+        case IDLESTRATEGY_BACKOFF:
+            if( strategy->idleCount < strategy->config.spinCount )
+            {
+                strategy->idleCount++;
+            }
+            else
+            {
+                struct timespec remaining;
+                remaining.tv_sec  = strategy->sleep/(1000*1000);
+                remaining.tv_nsec = (strategy->sleep%(1000*1000))*1000;
+
+                while( ( remaining.tv_sec != 0 || remaining.tv_nsec != 0 ) &&
+                       nanosleep( &remaining, &remaining ) != 0 );
+
+                /* Double the delay for the next idle poll */
+                strategy->sleep = strategy->sleep != 0 ? strategy->sleep*2 : 1;
+                if( strategy->sleep > strategy->config.maxSleep )
+                {
+                    strategy->sleep = strategy->config.maxSleep;
+                }
+            }
+            break;
+
+        case IDLESTRATEGY_BLOCK:
+            pthread_mutex_lock( &strategy->mutex );
+            while( !strategy->ready )
+            {
+                pthread_cond_wait( &strategy->readyCond, &strategy->mutex );
+            }
+            strategy->ready = 0;
+            pthread_mutex_unlock( &strategy->mutex );
+            break;
+    }
+}
+
+void idlestrategy_reset(idlestrategy_t* strategy)
+{
+    assert( strategy != NULL );
+
+    strategy->idleCount = 0;
+    strategy->sleep     = strategy->config.minSleep;
+}
+
+void idlestrategy_signal(idlestrategy_t* strategy)
+{
+    assert( strategy != NULL );
+
+    if( strategy->config.kind != IDLESTRATEGY_BLOCK )
+    {
+        return;
+    }
+
+    pthread_mutex_lock( &strategy->mutex );
+    strategy->ready = 1;
+    pthread_cond_signal( &strategy->readyCond );
+    pthread_mutex_unlock( &strategy->mutex );
+}
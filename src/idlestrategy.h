@@ -0,0 +1,76 @@
+#ifndef _IDLESTRATEGY_HEADER_
+#define _IDLESTRATEGY_HEADER_
+
+#include <pthread.h>
+
+/*! Idle strategies */
+#define IDLESTRATEGY_SPIN      0 /*!< Poll again immediately, lowest latency, burns a core */
+#define IDLESTRATEGY_SPINYIELD 1 /*!< Poll spinCount times, then yield the processor on every poll */
+#define IDLESTRATEGY_BACKOFF   2 /*!< Poll spinCount times, then sleep with exponentially growing delay */
+#define IDLESTRATEGY_BLOCK     3 /*!< Sleep until the data source signals readiness */
+
+/*! Configuration of an idle strategy */
+typedef struct
+{
+    int           kind;      /*!< One of IDLESTRATEGY_* */
+    unsigned long spinCount; /*!< Idle polls before yielding or sleeping */
+    unsigned long minSleep;  /*!< First backoff sleep in µs */
+    unsigned long maxSleep;  /*!< Upper limit of backoff sleep in µs, not 0 for IDLESTRATEGY_BACKOFF */
+} idleconfig_t;
+
+/*! Idle strategy state, one per polling thread */
+typedef struct
+{
+    idleconfig_t    config;    /*!< Configuration */
+    unsigned long   idleCount; /*!< Number of consecutive idle polls */
+    unsigned long   sleep;     /*!< Next backoff sleep in µs */
+    int             ready;     /*!< Readiness signaled, IDLESTRATEGY_BLOCK only */
+    pthread_mutex_t mutex;     /*!< Protects ready */
+    pthread_cond_t  readyCond; /*!< Signaled on readiness */
+} idlestrategy_t;
+
+/*!
+ * \brief Initialize idle strategy.
+ * 
+ * \param strategy Pointer to an uninitialized idlestrategy_t
+ * \param config   Configuration, copied. NULL for IDLESTRATEGY_SPIN
+ * \return         0 on success, 1 on error
+ */
+int idlestrategy_initialize(idlestrategy_t*     strategy,
+                            const idleconfig_t* config);
+
+/*!
+ * \brief Finalize idle strategy.
+ * 
+ * \param strategy Pointer to an initialized idlestrategy_t
+ */
+void idlestrategy_finalize(idlestrategy_t* strategy);
+
+/*!
+ * \brief Idle after a poll found no work.
+ * 
+ * Spins, yields, sleeps or blocks depending on the strategy and the
+ * number of consecutive idle polls.
+ * 
+ * \param strategy Pointer to an initialized idlestrategy_t
+ */
+void idlestrategy_idle(idlestrategy_t* strategy);
+
+/*!
+ * \brief Reset after a poll found work.
+ * 
+ * \param strategy Pointer to an initialized idlestrategy_t
+ */
+void idlestrategy_reset(idlestrategy_t* strategy);
+
+/*!
+ * \brief Signal readiness.
+ * 
+ * Wakes a thread idling in IDLESTRATEGY_BLOCK. The readiness is remembered
+ * if the thread is not idling yet. Has no effect on other strategies.
+ * 
+ * \param strategy Pointer to an initialized idlestrategy_t
+ */
+void idlestrategy_signal(idlestrategy_t* strategy);
+
+#endif
@@ -0,0 +1,467 @@
+#include "inlinequeue.h"
+#include "waitlist.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define INLINEQUEUE_INVARIANT(queue)\
+    assert( queue->elements != NULL );\
+    assert( queue->writePosition-queue->readPosition <= queue->mask+1 );
+
+/* Free slots, queue has to be locked */
+#define INLINEQUEUE_FREE(queue) ( queue->mask+1-(queue->writePosition-queue->readPosition) )
+
+/* Blocks on a wait list until woken, queue has to be locked.
+ * Returns 1 if the thread got aborted. */
+static int waitOn(inlinequeue_t*             queue,
+                  struct nmqueue_waitlist_s* list,
+                  void*                      threadId)
+{
+    struct nmqueue_waiter_s waiter;
+
+    waiter.threadId = threadId;
+    waiter.needed   = 1;
+    waiter.filter   = NULL;
+
+    /* Without a condition variable the caller polls */
+    if( !waitlist_block( &queue->mutex, list, &waiter ) )
+    {
+        return waitlist_take_abort( &queue->aborts, threadId );
+    }
+
+    /* Aborted after it was woken, before it could run */
+    return waiter.aborted || waitlist_take_abort( &queue->aborts, threadId );
+}
+
+int inlinequeue_wait_writable(inlinequeue_t* queue,
+                              void*          threadId,
+                              int            block)
+{
+    if( waitlist_take_abort( &queue->aborts, threadId ) )
+    {
+        return NMQUEUEERROR_ABORT;
+    }
+
+    while( INLINEQUEUE_FREE(queue) == 0 )
+    {
+        if( !block )
+        {
+            return NMQUEUEERROR_FULL;
+        }
+
+        if( waitOn( queue, &queue->senders, threadId ) )
+        {
+            /* A wakeup meant for this thread goes to the next one */
+            if( INLINEQUEUE_FREE(queue) != 0 )
+            {
+                waitlist_wake( &queue->senders, 1 );
+            }
+            return NMQUEUEERROR_ABORT;
+        }
+    }
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+int inlinequeue_wait_readable(inlinequeue_t* queue,
+                              void*          threadId,
+                              int            block)
+{
+    if( waitlist_take_abort( &queue->aborts, threadId ) )
+    {
+        return NMQUEUEERROR_ABORT;
+    }
+
+    while( queue->readPosition == queue->writePosition )
+    {
+        if( !block )
+        {
+            return NMQUEUEERROR_EMPTY;
+        }
+
+        if( waitOn( queue, &queue->receivers, threadId ) )
+        {
+            /* A wakeup meant for this thread goes to the next one */
+            if( queue->readPosition != queue->writePosition )
+            {
+                waitlist_wake( &queue->receivers, 1 );
+            }
+            return NMQUEUEERROR_ABORT;
+        }
+    }
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+/* Copies count elements behind the write position, at most two runs due to wrap around */
+static void copyIn(inlinequeue_t* queue,
+                   const char*    elements,
+                   size_t         count)
+{
+    size_t slot  = queue->writePosition & queue->mask;
+    size_t first = queue->mask+1-slot;
+
+    if( first > count )
+    {
+        first = count;
+    }
+
+    memcpy( queue->elements+slot*queue->elementSize, elements, first*queue->elementSize );
+    memcpy( queue->elements, elements+first*queue->elementSize, (count-first)*queue->elementSize );
+
+    queue->writePosition += count;
+}
+
+/* Copies count elements from the read position, at most two runs due to wrap around */
+static void copyOut(inlinequeue_t* queue,
+                    char*          elements,
+                    size_t         count)
+{
+    size_t slot  = queue->readPosition & queue->mask;
+    size_t first = queue->mask+1-slot;
+
+    if( first > count )
+    {
+        first = count;
+    }
+
+    memcpy( elements, queue->elements+slot*queue->elementSize, first*queue->elementSize );
+    memcpy( elements+first*queue->elementSize, queue->elements, (count-first)*queue->elementSize );
+
+    queue->readPosition += count;
+}
+
+void inlinequeue_written(inlinequeue_t* queue,
+                         size_t         count)
+{
+    queue->writePosition += count;
+
+    INLINEQUEUE_INVARIANT( queue );
+
+    /* One receiver per element may continue */
+    waitlist_wake( &queue->receivers, count );
+}
+
+void inlinequeue_read(inlinequeue_t* queue,
+                      size_t         count)
+{
+    queue->readPosition += count;
+
+    INLINEQUEUE_INVARIANT( queue );
+
+    /* One sender per freed slot may continue */
+    waitlist_wake( &queue->senders, count );
+}
+
+int inlinequeue_initialize(inlinequeue_t* queue,
+                           void*          elements,
+                           size_t         elementSize,
+                           size_t         capacity)
+{
+    assert( queue != NULL );
+    assert( elements != NULL );
+    assert( elementSize != 0 );
+    assert( capacity != 0 && (capacity & (capacity-1)) == 0 );
+
+    queue->readPosition    = 0;
+    queue->writePosition   = 0;
+    queue->mask            = capacity-1;
+    queue->elementSize     = elementSize;
+    queue->elements        = (char*)elements;
+    queue->receivers.head  = NULL;
+    queue->receivers.tail  = NULL;
+    queue->senders.head    = NULL;
+    queue->senders.tail    = NULL;
+    queue->aborts.threads  = NULL;
+    queue->aborts.count    = 0;
+    queue->aborts.capacity = 0;
+
+    if( pthread_mutex_init( &queue->mutex, NULL ) != 0 )
+    {
+        return NMQUEUEERROR_MUTEX_INITIALIZE_FAILED;
+    }
+
+    INLINEQUEUE_INVARIANT( queue );
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+void inlinequeue_finalize(inlinequeue_t* queue)
+{
+    assert( queue != NULL );
+    INLINEQUEUE_INVARIANT( queue );
+
+    pthread_mutex_destroy( &queue->mutex );
+
+    free( queue->aborts.threads );
+}
+
+void inlinequeue_abort(inlinequeue_t* queue,
+                       void*          threadId)
+{
+    assert( queue != NULL );
+    INLINEQUEUE_INVARIANT( queue );
+
+    pthread_mutex_lock( &queue->mutex );
+
+    /* Only the thread itself is woken, if it is not blocked its next call returns the abort */
+    if( !waitlist_abort( &queue->receivers, threadId ) &&
+        !waitlist_abort( &queue->senders, threadId ) )
+    {
+        waitlist_keep_abort( &queue->aborts, threadId );
+    }
+
+    pthread_mutex_unlock( &queue->mutex );
+}
+
+void inlinequeue_clear_abort(inlinequeue_t* queue,
+                             void*          threadId)
+{
+    assert( queue != NULL );
+
+    pthread_mutex_lock( &queue->mutex );
+    waitlist_take_abort( &queue->aborts, threadId );
+    pthread_mutex_unlock( &queue->mutex );
+}
+
+/* Single element send, copies element or constructs it in place */
+static int sendElement(inlinequeue_t*          queue,
+                       const void*             element,
+                       inlinequeue_construct_t construct,
+                       void*                   param,
+                       void*                   threadId,
+                       int                     block)
+{
+    int err;
+
+    assert( queue != NULL );
+    INLINEQUEUE_INVARIANT( queue );
+
+    pthread_mutex_lock( &queue->mutex );
+
+    if( (err=inlinequeue_wait_writable( queue, threadId, block )) != NMQUEUEERROR_NOERROR )
+    {
+        pthread_mutex_unlock( &queue->mutex );
+        return err;
+    }
+
+    if( construct != NULL )
+    {
+        (*construct)( queue->elements+(queue->writePosition & queue->mask)*queue->elementSize, param );
+        queue->writePosition++;
+    }
+    else
+    {
+        copyIn( queue, (const char*)element, 1 );
+    }
+
+    INLINEQUEUE_INVARIANT( queue );
+
+    waitlist_wake( &queue->receivers, 1 );
+    pthread_mutex_unlock( &queue->mutex );
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+/* Single element receive, copies element or consumes it in place */
+static int receiveElement(inlinequeue_t*        queue,
+                          void*                 element,
+                          inlinequeue_consume_t consume,
+                          void*                 param,
+                          void*                 threadId,
+                          int                   block)
+{
+    int err;
+
+    assert( queue != NULL );
+    INLINEQUEUE_INVARIANT( queue );
+
+    pthread_mutex_lock( &queue->mutex );
+
+    if( (err=inlinequeue_wait_readable( queue, threadId, block )) != NMQUEUEERROR_NOERROR )
+    {
+        pthread_mutex_unlock( &queue->mutex );
+        return err;
+    }
+
+    if( consume != NULL )
+    {
+        (*consume)( queue->elements+(queue->readPosition & queue->mask)*queue->elementSize, param );
+        queue->readPosition++;
+    }
+    else
+    {
+        copyOut( queue, (char*)element, 1 );
+    }
+
+    INLINEQUEUE_INVARIANT( queue );
+
+    waitlist_wake( &queue->senders, 1 );
+    pthread_mutex_unlock( &queue->mutex );
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+int inlinequeue_send(inlinequeue_t* queue,
+                     const void*    element,
+                     void*          threadId)
+{
+    assert( element != NULL );
+    return sendElement( queue, element, NULL, NULL, threadId, 1 );
+}
+
+int inlinequeue_trysend(inlinequeue_t* queue,
+                        const void*    element,
+                        void*          threadId)
+{
+    assert( element != NULL );
+    return sendElement( queue, element, NULL, NULL, threadId, 0 );
+}
+
+int inlinequeue_emplace(inlinequeue_t*          queue,
+                        inlinequeue_construct_t construct,
+                        void*                   param,
+                        void*                   threadId)
+{
+    assert( construct != NULL );
+    return sendElement( queue, NULL, construct, param, threadId, 1 );
+}
+
+int inlinequeue_send_batch(inlinequeue_t* queue,
+                           const void*    elements,
+                           size_t         count,
+                           size_t*        sent,
+                           void*          threadId)
+{
+    const char* next = (const char*)elements;
+    int         err  = NMQUEUEERROR_NOERROR;
+
+    assert( queue != NULL );
+    assert( elements != NULL || count == 0 );
+    assert( sent != NULL );
+    INLINEQUEUE_INVARIANT( queue );
+
+    *sent = 0;
+
+    pthread_mutex_lock( &queue->mutex );
+
+    while( *sent != count )
+    {
+        size_t run;
+
+        if( (err=inlinequeue_wait_writable( queue, threadId, 1 )) != NMQUEUEERROR_NOERROR )
+        {
+            break;
+        }
+
+        run = INLINEQUEUE_FREE(queue);
+        if( run > count-*sent )
+        {
+            run = count-*sent;
+        }
+
+        copyIn( queue, next, run );
+        next  += run*queue->elementSize;
+        *sent += run;
+
+        INLINEQUEUE_INVARIANT( queue );
+
+        /* One receiver per element may continue */
+        waitlist_wake( &queue->receivers, run );
+    }
+
+    pthread_mutex_unlock( &queue->mutex );
+
+    return err;
+}
+
+int inlinequeue_receive(inlinequeue_t* queue,
+                        void*          element,
+                        void*          threadId)
+{
+    assert( element != NULL );
+    return receiveElement( queue, element, NULL, NULL, threadId, 1 );
+}
+
+int inlinequeue_tryreceive(inlinequeue_t* queue,
+                           void*          element,
+                           void*          threadId)
+{
+    assert( element != NULL );
+    return receiveElement( queue, element, NULL, NULL, threadId, 0 );
+}
+
+int inlinequeue_receive_in_place(inlinequeue_t*        queue,
+                                 inlinequeue_consume_t consume,
+                                 void*                 param,
+                                 void*                 threadId)
+{
+    assert( consume != NULL );
+    return receiveElement( queue, NULL, consume, param, threadId, 1 );
+}
+
+/* Batch receive of up to maxCount elements, blocks for the first one if block is set */
+static int receiveElements(inlinequeue_t* queue,
+                           void*          elements,
+                           size_t         maxCount,
+                           size_t*        count,
+                           void*          threadId,
+                           int            block)
+{
+    int    err;
+    size_t taken;
+
+    assert( queue != NULL );
+    assert( elements != NULL );
+    assert( maxCount != 0 );
+    assert( count != NULL );
+    INLINEQUEUE_INVARIANT( queue );
+
+    *count = 0;
+
+    pthread_mutex_lock( &queue->mutex );
+
+    if( (err=inlinequeue_wait_readable( queue, threadId, block )) != NMQUEUEERROR_NOERROR )
+    {
+        pthread_mutex_unlock( &queue->mutex );
+        return err;
+    }
+
+    taken = queue->writePosition-queue->readPosition;
+    if( taken > maxCount )
+    {
+        taken = maxCount;
+    }
+
+    copyOut( queue, (char*)elements, taken );
+
+    INLINEQUEUE_INVARIANT( queue );
+
+    /* One sender per freed slot may continue */
+    waitlist_wake( &queue->senders, taken );
+
+    pthread_mutex_unlock( &queue->mutex );
+
+    *count = taken;
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+int inlinequeue_receive_batch(inlinequeue_t* queue,
+                              void*          elements,
+                              size_t         maxCount,
+                              size_t*        count,
+                              void*          threadId)
+{
+    return receiveElements( queue, elements, maxCount, count, threadId, 1 );
+}
+
+int inlinequeue_tryreceive_batch(inlinequeue_t* queue,
+                                 void*          elements,
+                                 size_t         maxCount,
+                                 size_t*        count,
+                                 void*          threadId)
+{
+    return receiveElements( queue, elements, maxCount, count, threadId, 0 );
+}
@@ -0,0 +1,392 @@
+#ifndef _INLINEQUEUE_HEADER_
+#define _INLINEQUEUE_HEADER_
+
+#include "nmqueue.h"
+
+/*! Callback constructing an element in place, receives the slot and a parameter */
+typedef void (*inlinequeue_construct_t)(void*, void*);
+
+/*! Callback consuming an element in place, receives the slot and a parameter */
+typedef void (*inlinequeue_consume_t)(void*, void*);
+
+/*! Queue storing fixed size elements inline in the ring buffer.
+ *  Usually embedded in a typed queue declared by INLINEQUEUE_DECLARE,
+ *  which provides the storage and checks the element type. */
+typedef struct
+{
+   size_t                    readPosition;  /*!< Free running read counter, slot is readPosition & mask */
+   size_t                    writePosition; /*!< Free running write counter, slot is writePosition & mask */
+   size_t                    mask;          /*!< Capacity-1, capacity is a power of two */
+   size_t                    elementSize;   /*!< Size of one element in bytes */
+   char*                     elements;      /*!< Ring buffer of capacity*elementSize bytes, owned by the caller */
+   pthread_mutex_t           mutex;         /*!< Mutex, has to be locked for all ring buffer operations */
+   struct nmqueue_waitlist_s receivers;     /*!< Receivers blocked on an empty queue */
+   struct nmqueue_waitlist_s senders;       /*!< Senders blocked on a full queue */
+   struct nmqueue_aborts_s   aborts;        /*!< Threads to abort which were not blocked at the time */
+} inlinequeue_t;
+
+/*! Declares the typed queue name_t holding capacity elements of type and
+ *  its functions name_initialize, name_finalize, name_abort,
+ *  name_clear_abort, name_send, name_trysend, name_emplace,
+ *  name_send_batch, name_receive, name_tryreceive, name_receive_in_place,
+ *  name_receive_batch and name_tryreceive_batch. They match the
+ *  inlinequeue_* functions, but take name_t and type pointers. The
+ *  elements are part of name_t, capacity has to be a power of two, both
+ *  is checked at compile time. Used without a trailing semicolon, usually
+ *  in a header. */
+#define INLINEQUEUE_DECLARE( name, type, capacity ) \
+    typedef char name##_capacity_check[ (capacity) != 0 && ((capacity) & ((capacity)-1)) == 0 ? 1 : -1 ]; \
+    typedef struct \
+    { \
+        inlinequeue_t queue; \
+        type          elements[capacity]; \
+    } name##_t; \
+    int  name##_initialize(name##_t* queue); \
+    void name##_finalize(name##_t* queue); \
+    void name##_abort(name##_t* queue, void* threadId); \
+    void name##_clear_abort(name##_t* queue, void* threadId); \
+    int  name##_send(name##_t* queue, const type* element, void* threadId); \
+    int  name##_trysend(name##_t* queue, const type* element, void* threadId); \
+    int  name##_emplace(name##_t* queue, inlinequeue_construct_t construct, void* param, void* threadId); \
+    int  name##_send_batch(name##_t* queue, const type* elements, size_t count, size_t* sent, void* threadId); \
+    int  name##_receive(name##_t* queue, type* element, void* threadId); \
+    int  name##_tryreceive(name##_t* queue, type* element, void* threadId); \
+    int  name##_receive_in_place(name##_t* queue, inlinequeue_consume_t consume, void* param, void* threadId); \
+    int  name##_receive_batch(name##_t* queue, type* elements, size_t maxCount, size_t* count, void* threadId); \
+    int  name##_tryreceive_batch(name##_t* queue, type* elements, size_t maxCount, size_t* count, void* threadId);
+
+/*! Defines the functions of a typed queue, with the same arguments as
+ *  INLINEQUEUE_DECLARE in exactly one source file, without a trailing
+ *  semicolon. Elements are assigned by type, slots are indexed with the
+ *  constant capacity-1 mask. */
+#define INLINEQUEUE_DEFINE( name, type, capacity ) \
+    static int name##_sendElements(name##_t* queue, const type* elements, size_t count, size_t* sent, void* threadId, int block) \
+    { \
+        int err = NMQUEUEERROR_NOERROR; \
+        *sent = 0; \
+        pthread_mutex_lock( &queue->queue.mutex ); \
+        while( *sent != count && (err=inlinequeue_wait_writable( &queue->queue, threadId, block )) == NMQUEUEERROR_NOERROR ) \
+        { \
+            size_t run = (capacity)-(queue->queue.writePosition-queue->queue.readPosition); \
+            size_t i; \
+            if( run > count-*sent ) \
+            { \
+                run = count-*sent; \
+            } \
+            for( i=0 ; i<run ; ++i ) \
+            { \
+                queue->elements[ (queue->queue.writePosition+i) & ((capacity)-1) ] = elements[*sent+i]; \
+            } \
+            *sent += run; \
+            inlinequeue_written( &queue->queue, run ); \
+        } \
+        pthread_mutex_unlock( &queue->queue.mutex ); \
+        return err; \
+    } \
+    static int name##_receiveElements(name##_t* queue, type* elements, size_t maxCount, size_t* count, void* threadId, int block) \
+    { \
+        int    err; \
+        size_t i; \
+        *count = 0; \
+        pthread_mutex_lock( &queue->queue.mutex ); \
+        if( (err=inlinequeue_wait_readable( &queue->queue, threadId, block )) == NMQUEUEERROR_NOERROR ) \
+        { \
+            *count = queue->queue.writePosition-queue->queue.readPosition; \
+            if( *count > maxCount ) \
+            { \
+                *count = maxCount; \
+            } \
+            for( i=0 ; i<*count ; ++i ) \
+            { \
+                elements[i] = queue->elements[ (queue->queue.readPosition+i) & ((capacity)-1) ]; \
+            } \
+            inlinequeue_read( &queue->queue, *count ); \
+        } \
+        pthread_mutex_unlock( &queue->queue.mutex ); \
+        return err; \
+    } \
+    int name##_initialize(name##_t* queue) \
+    { \
+        return inlinequeue_initialize( &queue->queue, queue->elements, sizeof(type), capacity ); \
+    } \
+    void name##_finalize(name##_t* queue) \
+    { \
+        inlinequeue_finalize( &queue->queue ); \
+    } \
+    void name##_abort(name##_t* queue, void* threadId) \
+    { \
+        inlinequeue_abort( &queue->queue, threadId ); \
+    } \
+    void name##_clear_abort(name##_t* queue, void* threadId) \
+    { \
+        inlinequeue_clear_abort( &queue->queue, threadId ); \
+    } \
+    int name##_send(name##_t* queue, const type* element, void* threadId) \
+    { \
+        size_t sent; \
+        return name##_sendElements( queue, element, 1, &sent, threadId, 1 ); \
+    } \
+    int name##_trysend(name##_t* queue, const type* element, void* threadId) \
+    { \
+        size_t sent; \
+        return name##_sendElements( queue, element, 1, &sent, threadId, 0 ); \
+    } \
+    int name##_emplace(name##_t* queue, inlinequeue_construct_t construct, void* param, void* threadId) \
+    { \
+        return inlinequeue_emplace( &queue->queue, construct, param, threadId ); \
+    } \
+    int name##_send_batch(name##_t* queue, const type* elements, size_t count, size_t* sent, void* threadId) \
+    { \
+        return name##_sendElements( queue, elements, count, sent, threadId, 1 ); \
+    } \
+    int name##_receive(name##_t* queue, type* element, void* threadId) \
+    { \
+        size_t count; \
+        return name##_receiveElements( queue, element, 1, &count, threadId, 1 ); \
+    } \
+    int name##_tryreceive(name##_t* queue, type* element, void* threadId) \
+    { \
+        size_t count; \
+        return name##_receiveElements( queue, element, 1, &count, threadId, 0 ); \
+    } \
+    int name##_receive_in_place(name##_t* queue, inlinequeue_consume_t consume, void* param, void* threadId) \
+    { \
+        return inlinequeue_receive_in_place( &queue->queue, consume, param, threadId ); \
+    } \
+    int name##_receive_batch(name##_t* queue, type* elements, size_t maxCount, size_t* count, void* threadId) \
+    { \
+        return name##_receiveElements( queue, elements, maxCount, count, threadId, 1 ); \
+    } \
+    int name##_tryreceive_batch(name##_t* queue, type* elements, size_t maxCount, size_t* count, void* threadId) \
+    { \
+        return name##_receiveElements( queue, elements, maxCount, count, threadId, 0 ); \
+    }
+
+/*!
+ * \brief Initialize inline queue.
+ * 
+ * Uses a ring buffer of capacity elements of elementSize bytes each.
+ * Elements are copied into the ring, no per message allocation is required.
+ * 
+ * \param queue       Pointer to a not initialized instance of inlinequeue_t
+ * \param elements    Storage of capacity*elementSize bytes, valid until finalize
+ * \param elementSize Size of one element in bytes, not 0
+ * \param capacity    Number of elements, a power of two
+ * \return            Error code, ERROR_NOERROR on success
+ */
+int inlinequeue_initialize(inlinequeue_t* queue,
+                           void*          elements,
+                           size_t         elementSize,
+                           size_t         capacity);
+
+/*!
+ * \brief Finalize inline queue.
+ * 
+ * Elements still in the queue are discarded.
+ * 
+ * \param queue Pointer to an initialized instance of inlinequeue_t
+ */
+void inlinequeue_finalize(inlinequeue_t* queue);
+
+/*!
+ * \brief Send abort message to one blocked thread.
+ * 
+ * Same as nmqueue_abort, only the specified thread is woken. If it is not
+ * blocked, the abort is kept until its next call.
+ * 
+ * \param queue    Pointer to an initialized instance of inlinequeue_t
+ * \param threadId Thread to abort
+ */
+void inlinequeue_abort(inlinequeue_t* queue,
+                       void*          threadId);
+
+/*!
+ * \brief Drop a pending abort.
+ * 
+ * Same as nmqueue_clear_abort.
+ * 
+ * \param queue    Pointer to an initialized instance of inlinequeue_t
+ * \param threadId Thread passed to inlinequeue_abort
+ */
+void inlinequeue_clear_abort(inlinequeue_t* queue,
+                             void*          threadId);
+
+/*!
+ * \brief Blocking send, copies elementSize bytes from element.
+ * 
+ * \param queue    Pointer to an initialized instance of inlinequeue_t
+ * \param element  Element to copy into the queue
+ * \return         Error code, ERROR_NOERROR on success
+ */
+int inlinequeue_send(inlinequeue_t* queue,
+                     const void*    element,
+                     void*          threadId);
+
+/*!
+ * \brief Non blocking send, returns ERROR_FULL instead of blocking.
+ * 
+ * \param queue    Pointer to an initialized instance of inlinequeue_t
+ * \param element  Element to copy into the queue
+ * \return         Error code, ERROR_NOERROR on success
+ */
+int inlinequeue_trysend(inlinequeue_t* queue,
+                        const void*    element,
+                        void*          threadId);
+
+/*!
+ * \brief Blocking send constructing the element in place.
+ * 
+ * construct is called with the queue locked and the free slot, it must
+ * initialize the element and must not call into the queue.
+ * 
+ * \param queue     Pointer to an initialized instance of inlinequeue_t
+ * \param construct Callback initializing the slot
+ * \param param     Data passed to construct
+ * \return          Error code, ERROR_NOERROR on success
+ */
+int inlinequeue_emplace(inlinequeue_t*          queue,
+                        inlinequeue_construct_t construct,
+                        void*                   param,
+                        void*                   threadId);
+
+/*!
+ * \brief Blocking batch send.
+ * 
+ * Copies count consecutive elements, taking the lock once for every run
+ * of free slots. Blocks until all elements are in the queue.
+ * On ERROR_ABORT sent tells how many elements made it into the queue.
+ * 
+ * \param queue    Pointer to an initialized instance of inlinequeue_t
+ * \param elements Array of count elements
+ * \param count    Number of elements
+ * \param sent     Reference to a size_t, number of elements sent
+ * \return         Error code, ERROR_NOERROR on success
+ */
+int inlinequeue_send_batch(inlinequeue_t* queue,
+                           const void*    elements,
+                           size_t         count,
+                           size_t*        sent,
+                           void*          threadId);
+
+/*!
+ * \brief Blocking receive, copies elementSize bytes to element.
+ * 
+ * \param queue    Pointer to an initialized instance of inlinequeue_t
+ * \param element  Destination of at least elementSize bytes
+ * \return         Error code, ERROR_NOERROR on success
+ */
+int inlinequeue_receive(inlinequeue_t* queue,
+                        void*          element,
+                        void*          threadId);
+
+/*!
+ * \brief Non blocking receive, returns ERROR_EMPTY instead of blocking.
+ * 
+ * \param queue    Pointer to an initialized instance of inlinequeue_t
+ * \param element  Destination of at least elementSize bytes
+ * \return         Error code, ERROR_NOERROR on success
+ */
+int inlinequeue_tryreceive(inlinequeue_t* queue,
+                           void*          element,
+                           void*          threadId);
+
+/*!
+ * \brief Blocking receive consuming the element in place.
+ * 
+ * consume is called with the queue locked and the oldest slot, it must
+ * move the element out and must not call into the queue.
+ * 
+ * \param queue    Pointer to an initialized instance of inlinequeue_t
+ * \param consume  Callback consuming the slot
+ * \param param    Data passed to consume
+ * \return         Error code, ERROR_NOERROR on success
+ */
+int inlinequeue_receive_in_place(inlinequeue_t*        queue,
+                                 inlinequeue_consume_t consume,
+                                 void*                 param,
+                                 void*                 threadId);
+
+/*!
+ * \brief Blocking batch receive.
+ * 
+ * Copies up to maxCount available elements within one lock acquisition,
+ * blocks until at least one element is available.
+ * 
+ * \param queue    Pointer to an initialized instance of inlinequeue_t
+ * \param elements Destination of at least maxCount elements
+ * \param maxCount Maximum number of elements, not 0
+ * \param count    Reference to a size_t, number of elements received
+ * \return         Error code, ERROR_NOERROR on success
+ */
+int inlinequeue_receive_batch(inlinequeue_t* queue,
+                              void*          elements,
+                              size_t         maxCount,
+                              size_t*        count,
+                              void*          threadId);
+
+/*!
+ * \brief Non blocking batch receive, returns ERROR_EMPTY instead of blocking.
+ * 
+ * \param queue    Pointer to an initialized instance of inlinequeue_t
+ * \param elements Destination of at least maxCount elements
+ * \param maxCount Maximum number of elements, not 0
+ * \param count    Reference to a size_t, number of elements received
+ * \return         Error code, ERROR_NOERROR on success
+ */
+int inlinequeue_tryreceive_batch(inlinequeue_t* queue,
+                                 void*          elements,
+                                 size_t         maxCount,
+                                 size_t*        count,
+                                 void*          threadId);
+
+/*!
+ * \brief Wait for a free slot, used by the typed queues.
+ * 
+ * The mutex has to be locked and stays locked, also on errors.
+ * 
+ * \param queue    Pointer to an initialized instance of inlinequeue_t
+ * \param block    Blocks while full if set
+ * \return         Error code, ERROR_NOERROR if a slot is free, ERROR_FULL
+ *                 without block or ERROR_ABORT
+ */
+int inlinequeue_wait_writable(inlinequeue_t* queue,
+                              void*          threadId,
+                              int            block);
+
+/*!
+ * \brief Wait for an element, used by the typed queues.
+ * 
+ * The mutex has to be locked and stays locked, also on errors.
+ * 
+ * \param queue    Pointer to an initialized instance of inlinequeue_t
+ * \param block    Blocks while empty if set
+ * \return         Error code, ERROR_NOERROR if an element is available,
+ *                 ERROR_EMPTY without block or ERROR_ABORT
+ */
+int inlinequeue_wait_readable(inlinequeue_t* queue,
+                              void*          threadId,
+                              int            block);
+
+/*!
+ * \brief Publish count elements stored behind writePosition, used by the typed queues.
+ * 
+ * The mutex has to be locked, receivers are woken.
+ * 
+ * \param queue Pointer to an initialized instance of inlinequeue_t
+ * \param count Number of elements stored
+ */
+void inlinequeue_written(inlinequeue_t* queue,
+                         size_t         count);
+
+/*!
+ * \brief Release count elements taken from readPosition, used by the typed queues.
+ * 
+ * The mutex has to be locked, senders are woken.
+ * 
+ * \param queue Pointer to an initialized instance of inlinequeue_t
+ * \param count Number of elements taken
+ */
+void inlinequeue_read(inlinequeue_t* queue,
+                      size_t         count);
+
+#endif
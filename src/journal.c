@@ -0,0 +1,759 @@
+#include "journal.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define JOURNAL_RECORD  0x4e4d5152 /* Record header */
+#define JOURNAL_PADDING 0x4e4d5150 /* Rest of the segment is unused */
+
+/* Record sizes are multiples of 8 to keep headers aligned */
+#define JOURNAL_ALIGN(size) ( ((size)+7) & ~(size_t)7 )
+
+/* Header in front of every record payload */
+struct journal_record_s
+{
+    uint32_t magic;    /* JOURNAL_RECORD or JOURNAL_PADDING */
+    uint32_t checksum; /* FNV-1a over dataSize, source, offset and payload */
+    uint32_t dataSize; /* Payload size */
+    int32_t  source;   /* source_t of the message */
+    uint64_t offset;   /* Logical offset of this header, detects stale records */
+};
+
+#define JOURNAL_RECORDSIZE(dataSize) JOURNAL_ALIGN( sizeof(struct journal_record_s)+(dataSize) )
+
+/* FNV-1a over a byte range */
+static uint32_t checksumBytes(uint32_t    hash,
+                              const void* data,
+                              size_t      size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t               i;
+
+    for( i=0 ; i<size ; ++i )
+    {
+        hash = (hash^bytes[i])*16777619u;
+    }
+    return hash;
+}
+
+static uint32_t checksumRecord(const struct journal_record_s* record,
+                               const void*                    payload)
+{
+    uint32_t hash = 2166136261u;
+
+    hash = checksumBytes( hash, &record->dataSize, sizeof(record->dataSize) );
+    hash = checksumBytes( hash, &record->source, sizeof(record->source) );
+    hash = checksumBytes( hash, &record->offset, sizeof(record->offset) );
+    return checksumBytes( hash, payload, record->dataSize );
+}
+
+/* Name of a segment file, buffer must hold strlen(path)+32 bytes */
+static void segmentName(journal_t* journal,
+                        uint64_t   index,
+                        char*      name)
+{
+    sprintf( name, "%s/%08lu.seg", journal->path, (unsigned long)index );
+}
+
+/* Maps segment index, creating the file if create is set.
+ * Segments are mapped in order, index must follow the last mapped segment.
+ * Journal has to be locked. */
+static int mapSegment(journal_t* journal,
+                      uint64_t   index,
+                      int        create)
+{
+    struct journal_segment_s* segment;
+    struct stat               status;
+    char*                     name;
+    int                       fd;
+
+    if( journal->segmentCount == journal->segmentCapacity )
+    {
+        size_t                    capacity = journal->segmentCapacity*2+4;
+        struct journal_segment_s* segments = (struct journal_segment_s*)realloc( journal->segments, capacity*sizeof(struct journal_segment_s) );
+
+        if( segments == NULL )
+        {
+            return NMQUEUEERROR_OUTOFMEMORY;
+        }
+        journal->segments        = segments;
+        journal->segmentCapacity = capacity;
+    }
+
+    name = (char*)malloc( strlen( journal->path )+32 );
+    if( name == NULL )
+    {
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+    segmentName( journal, index, name );
+
+    fd = open( name, create ? O_RDWR|O_CREAT : O_RDWR, 0644 );
+    free( name );
+
+    if( fd < 0 )
+    {
+        return NMQUEUEERROR_IO;
+    }
+
+    /* New segments are zero filled, so scanning stops at their first header */
+    if( fstat( fd, &status ) != 0 ||
+        ( (size_t)status.st_size < journal->segmentSize &&
+          ( ftruncate( fd, journal->segmentSize ) != 0 || fdatasync( fd ) != 0 ) ) )
+    {
+        close( fd );
+        return NMQUEUEERROR_IO;
+    }
+
+    segment        = &journal->segments[journal->segmentCount];
+    segment->fd    = fd;
+    segment->index = index;
+    segment->base  = (char*)mmap( NULL, journal->segmentSize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0 );
+
+    if( segment->base == (char*)MAP_FAILED )
+    {
+        close( fd );
+        return NMQUEUEERROR_IO;
+    }
+
+    journal->segmentCount++;
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+/* Unmaps the oldest segment and deletes its file, journal has to be locked */
+static void retireSegment(journal_t* journal)
+{
+    char* name = (char*)malloc( strlen( journal->path )+32 );
+
+    munmap( journal->segments[0].base, journal->segmentSize );
+    close( journal->segments[0].fd );
+
+    if( name != NULL )
+    {
+        segmentName( journal, journal->segments[0].index, name );
+        unlink( name );
+        free( name );
+    }
+
+    journal->segmentCount--;
+    memmove( &journal->segments[0], &journal->segments[1], journal->segmentCount*sizeof(struct journal_segment_s) );
+}
+
+/* Deletes segment files following (direction 1) or preceding (direction -1)
+ * index until one is missing */
+static void removeSegments(journal_t* journal,
+                           uint64_t   index,
+                           int        direction)
+{
+    char* name = (char*)malloc( strlen( journal->path )+32 );
+
+    if( name == NULL )
+    {
+        return;
+    }
+
+    while( direction > 0 || index != 0 )
+    {
+        index += direction;
+        segmentName( journal, index, name );
+        if( unlink( name ) != 0 )
+        {
+            break;
+        }
+    }
+
+    free( name );
+}
+
+/* Mapped address of a logical offset, the segment must be mapped */
+static char* offsetAddress(journal_t* journal,
+                           uint64_t   offset)
+{
+    struct journal_segment_s* segment = &journal->segments[ offset/journal->segmentSize-journal->segments[0].index ];
+    return segment->base+offset%journal->segmentSize;
+}
+
+/* Offset of the next record after offset, offset if there is no valid record */
+static uint64_t nextRecord(journal_t* journal,
+                           uint64_t   offset,
+                           int        validate)
+{
+    uint64_t                 position = offset%journal->segmentSize;
+    struct journal_record_s* record;
+
+    if( journal->segmentSize-position < sizeof(struct journal_record_s) )
+    {
+        return offset-position+journal->segmentSize;
+    }
+
+    record = (struct journal_record_s*)offsetAddress( journal, offset );
+
+    if( record->magic == JOURNAL_PADDING && record->offset == offset )
+    {
+        return offset-position+journal->segmentSize;
+    }
+
+    if( validate &&
+        ( record->magic != JOURNAL_RECORD ||
+          record->offset != offset ||
+          position+JOURNAL_RECORDSIZE( record->dataSize ) > journal->segmentSize ||
+          record->checksum != checksumRecord( record, record+1 ) ) )
+    {
+        return offset;
+    }
+
+    return offset+JOURNAL_RECORDSIZE( record->dataSize );
+}
+
+/* Offset of the first record at or after offset, skips padding at the end of a segment.
+ * Journal has to be locked. */
+static uint64_t skipPadding(journal_t* journal,
+                            uint64_t   offset)
+{
+    uint64_t position = offset%journal->segmentSize;
+
+    if( offset < journal->writeOffset &&
+        ( journal->segmentSize-position < sizeof(struct journal_record_s) ||
+          ((struct journal_record_s*)offsetAddress( journal, offset ))->magic == JOURNAL_PADDING ) )
+    {
+        return offset-position+journal->segmentSize;
+    }
+    return offset;
+}
+
+/* Entry point for the flusher thread */
+/* Syncs appended records and the consumer offset until shutdown */
+static void* flusherProc(void* journalT)
+{
+    journal_t* journal = (journal_t*)journalT;
+    long       pageSize = sysconf( _SC_PAGESIZE );
+
+    pthread_mutex_lock( &journal->mutex );
+
+    for(;;)
+    {
+        uint64_t from;
+        uint64_t to;
+        uint64_t consumed;
+        int      terminated = journal->terminated;
+
+        /* Wait for the interval, the byte threshold or a request */
+        if( !terminated && !journal->flushRequested &&
+            ( journal->flushBytes == 0 || journal->writeOffset-journal->flushedOffset < journal->flushBytes ) )
+        {
+            struct timespec deadline;
+
+            clock_gettime( CLOCK_MONOTONIC, &deadline );
+            deadline.tv_sec  += journal->flushInterval/(1000*1000);
+            deadline.tv_nsec += (journal->flushInterval%(1000*1000))*1000;
+            if( deadline.tv_nsec >= 1000*1000*1000 )
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000*1000*1000;
+            }
+
+            pthread_cond_timedwait( &journal->flushCond, &journal->mutex, &deadline );
+            terminated = journal->terminated;
+        }
+
+        journal->flushRequested = 0;
+        from     = journal->flushedOffset;
+        to       = journal->writeOffset;
+        consumed = journal->consumedOffset;
+
+        pthread_mutex_unlock( &journal->mutex );
+
+        /* Group commit: one sync per touched segment for all records appended since the last flush */
+        while( from < to )
+        {
+            uint64_t end = from-from%journal->segmentSize+journal->segmentSize;
+            uint64_t start;
+            char*    base;
+
+            if( end > to )
+            {
+                end = to;
+            }
+
+            start = from-from%pageSize;
+
+            pthread_mutex_lock( &journal->mutex );
+            base = offsetAddress( journal, start );
+            pthread_mutex_unlock( &journal->mutex );
+
+            msync( base, end-start, MS_SYNC );
+            from = end;
+        }
+
+        if( *journal->offsetMap != consumed )
+        {
+            *journal->offsetMap = consumed;
+            msync( journal->offsetMap, sizeof(uint64_t), MS_SYNC );
+        }
+
+        pthread_mutex_lock( &journal->mutex );
+
+        journal->flushedOffset = to;
+        pthread_cond_broadcast( &journal->durableCond );
+
+        /* Delete segments which are consumed and flushed completely */
+        while( journal->segmentCount > 1 &&
+               journal->segments[0].index < consumed/journal->segmentSize &&
+               journal->segments[0].index < to/journal->segmentSize )
+        {
+            retireSegment( journal );
+        }
+
+        if( terminated )
+        {
+            break;
+        }
+    }
+
+    pthread_mutex_unlock( &journal->mutex );
+
+    return NULL;
+}
+
+/* Releases everything acquired by journal_open */
+static void releaseJournal(journal_t* journal)
+{
+    while( journal->segmentCount != 0 )
+    {
+        journal->segmentCount--;
+        munmap( journal->segments[journal->segmentCount].base, journal->segmentSize );
+        close( journal->segments[journal->segmentCount].fd );
+    }
+    free( journal->segments );
+    free( journal->pending );
+
+    if( journal->offsetMap != NULL )
+    {
+        munmap( journal->offsetMap, sizeof(uint64_t) );
+    }
+    if( journal->offsetFd >= 0 )
+    {
+        close( journal->offsetFd );
+    }
+    free( journal->path );
+}
+
+/* Maps the consumer offset file, creating it if missing */
+static int openOffset(journal_t* journal)
+{
+    char* name = (char*)malloc( strlen( journal->path )+32 );
+
+    if( name == NULL )
+    {
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+
+    sprintf( name, "%s/offset", journal->path );
+    journal->offsetFd = open( name, O_RDWR|O_CREAT, 0644 );
+    free( name );
+
+    if( journal->offsetFd < 0 || ftruncate( journal->offsetFd, sizeof(uint64_t) ) != 0 )
+    {
+        return NMQUEUEERROR_IO;
+    }
+
+    journal->offsetMap = (uint64_t*)mmap( NULL, sizeof(uint64_t), PROT_READ|PROT_WRITE, MAP_SHARED, journal->offsetFd, 0 );
+    if( journal->offsetMap == (uint64_t*)MAP_FAILED )
+    {
+        journal->offsetMap = NULL;
+        return NMQUEUEERROR_IO;
+    }
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+/* Maps existing segments from the consumer offset on and finds the end of the valid records */
+static int scanJournal(journal_t* journal)
+{
+    uint64_t offset = journal->consumedOffset;
+    int      err;
+
+    if( (err=mapSegment( journal, offset/journal->segmentSize, 1 )) != NMQUEUEERROR_NOERROR )
+    {
+        return err;
+    }
+
+    for(;;)
+    {
+        uint64_t next;
+
+        /* Next segment, if there is one */
+        if( offset/journal->segmentSize != journal->segments[journal->segmentCount-1].index )
+        {
+            if( mapSegment( journal, offset/journal->segmentSize, 0 ) != NMQUEUEERROR_NOERROR )
+            {
+                break;
+            }
+        }
+
+        next = nextRecord( journal, offset, 1 );
+        if( next == offset )
+        {
+            break;
+        }
+        offset = next;
+    }
+
+    journal->writeOffset   = offset;
+    journal->flushedOffset = offset;
+
+    /* Segments behind a torn record cannot hold valid records,
+     * segments before the consumer offset were not deleted before a crash */
+    removeSegments( journal, journal->segments[journal->segmentCount-1].index, 1 );
+    removeSegments( journal, journal->segments[0].index, -1 );
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+int journal_open(journal_t*    journal,
+                 const char*   path,
+                 size_t        segmentSize,
+                 unsigned long flushInterval,
+                 size_t        flushBytes)
+{
+    int err;
+
+    assert( journal != NULL );
+    assert( path != NULL );
+    assert( segmentSize > sizeof(struct journal_record_s) && segmentSize%8 == 0 );
+    assert( flushInterval != 0 );
+
+    journal->segmentSize     = segmentSize;
+    journal->flushInterval   = flushInterval;
+    journal->flushBytes      = flushBytes;
+    journal->segments        = NULL;
+    journal->segmentCount    = 0;
+    journal->segmentCapacity = 0;
+    journal->offsetFd        = -1;
+    journal->offsetMap       = NULL;
+    journal->pending         = NULL;
+    journal->pendingCount    = 0;
+    journal->pendingCapacity = 0;
+    journal->flushRequested  = 0;
+    journal->terminated      = 0;
+    journal->path            = (char*)malloc( strlen( path )+1 );
+
+    if( journal->path == NULL )
+    {
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+    strcpy( journal->path, path );
+
+    if( (err=openOffset( journal )) != NMQUEUEERROR_NOERROR )
+    {
+        releaseJournal( journal );
+        return err;
+    }
+
+    journal->consumedOffset = *journal->offsetMap;
+
+    if( (err=scanJournal( journal )) != NMQUEUEERROR_NOERROR )
+    {
+        releaseJournal( journal );
+        return err;
+    }
+
+    if( pthread_mutex_init( &journal->mutex, NULL ) != 0 )
+    {
+        releaseJournal( journal );
+        return NMQUEUEERROR_MUTEX_INITIALIZE_FAILED;
+    }
+
+    if( pthread_mutex_init( &journal->sendMutex, NULL ) != 0 )
+    {
+        pthread_mutex_destroy( &journal->mutex );
+        releaseJournal( journal );
+        return NMQUEUEERROR_MUTEX_INITIALIZE_FAILED;
+    }
+
+    /* Flush deadlines are CLOCK_MONOTONIC */
+    {
+        pthread_condattr_t attr;
+        int                error = pthread_condattr_init( &attr );
+
+        if( error == 0 )
+        {
+            error = pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+            if( error == 0 )
+            {
+                error = pthread_cond_init( &journal->flushCond, &attr );
+            }
+            pthread_condattr_destroy( &attr );
+        }
+
+        if( error != 0 )
+        {
+            pthread_mutex_destroy( &journal->sendMutex );
+            pthread_mutex_destroy( &journal->mutex );
+            releaseJournal( journal );
+            return NMQUEUEERROR_CONDVAR_INITIALIZE_FAILED;
+        }
+    }
+
+    if( pthread_cond_init( &journal->durableCond, NULL ) != 0 )
+    {
+        pthread_cond_destroy( &journal->flushCond );
+        pthread_mutex_destroy( &journal->sendMutex );
+        pthread_mutex_destroy( &journal->mutex );
+        releaseJournal( journal );
+        return NMQUEUEERROR_CONDVAR_INITIALIZE_FAILED;
+    }
+
+    if( pthread_create( &journal->flusher, NULL, flusherProc, journal ) != 0 )
+    {
+        pthread_cond_destroy( &journal->durableCond );
+        pthread_cond_destroy( &journal->flushCond );
+        pthread_mutex_destroy( &journal->sendMutex );
+        pthread_mutex_destroy( &journal->mutex );
+        releaseJournal( journal );
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+void journal_close(journal_t* journal)
+{
+    assert( journal != NULL );
+
+    /* The flusher does a last flush before it terminates */
+    pthread_mutex_lock( &journal->mutex );
+    journal->terminated = 1;
+    pthread_cond_signal( &journal->flushCond );
+    pthread_mutex_unlock( &journal->mutex );
+
+    pthread_join( journal->flusher, NULL );
+
+    pthread_cond_destroy( &journal->durableCond );
+    pthread_cond_destroy( &journal->flushCond );
+    pthread_mutex_destroy( &journal->sendMutex );
+    pthread_mutex_destroy( &journal->mutex );
+
+    releaseJournal( journal );
+}
+
+void journal_recover(journal_t*        journal,
+                     journal_recover_t recover,
+                     void*             param)
+{
+    uint64_t offset;
+
+    assert( journal != NULL );
+    assert( recover != NULL );
+
+    pthread_mutex_lock( &journal->mutex );
+
+    offset = journal->consumedOffset;
+
+    while( offset != journal->writeOffset )
+    {
+        if( journal->segmentSize-offset%journal->segmentSize >= sizeof(struct journal_record_s) )
+        {
+            struct journal_record_s* record = (struct journal_record_s*)offsetAddress( journal, offset );
+
+            if( record->magic == JOURNAL_RECORD )
+            {
+                pthread_mutex_unlock( &journal->mutex );
+                (*recover)( record->source, record+1, record->dataSize, param );
+                pthread_mutex_lock( &journal->mutex );
+            }
+        }
+
+        offset = nextRecord( journal, offset, 0 );
+    }
+
+    pthread_mutex_unlock( &journal->mutex );
+}
+
+int journal_append(journal_t*  journal,
+                   source_t    source,
+                   const void* data,
+                   size_t      dataSize,
+                   void**      payload)
+{
+    struct journal_record_s* record;
+    uint64_t                 position;
+    size_t                   recordSize = JOURNAL_RECORDSIZE( dataSize );
+
+    assert( journal != NULL );
+    assert( data != NULL || dataSize == 0 );
+    assert( payload != NULL );
+
+    if( recordSize > journal->segmentSize )
+    {
+        return NMQUEUEERROR_FULL;
+    }
+
+    pthread_mutex_lock( &journal->mutex );
+
+    position = journal->writeOffset%journal->segmentSize;
+
+    /* Record does not fit, continue with the next segment */
+    if( position+recordSize > journal->segmentSize )
+    {
+        if( journal->segmentSize-position >= sizeof(struct journal_record_s) )
+        {
+            record         = (struct journal_record_s*)offsetAddress( journal, journal->writeOffset );
+            record->magic  = JOURNAL_PADDING;
+            record->offset = journal->writeOffset;
+        }
+        journal->writeOffset += journal->segmentSize-position;
+        position = 0;
+    }
+
+    if( position == 0 &&
+        journal->writeOffset/journal->segmentSize != journal->segments[journal->segmentCount-1].index )
+    {
+        int err;
+
+        if( (err=mapSegment( journal, journal->writeOffset/journal->segmentSize, 1 )) != NMQUEUEERROR_NOERROR )
+        {
+            pthread_mutex_unlock( &journal->mutex );
+            return err;
+        }
+    }
+
+    record           = (struct journal_record_s*)offsetAddress( journal, journal->writeOffset );
+    record->dataSize = (uint32_t)dataSize;
+    record->source   = source;
+    record->offset   = journal->writeOffset;
+    memcpy( record+1, data, dataSize );
+    record->checksum = checksumRecord( record, record+1 );
+    record->magic    = JOURNAL_RECORD;
+
+    journal->writeOffset += recordSize;
+
+    if( journal->flushBytes != 0 &&
+        journal->writeOffset-journal->flushedOffset >= journal->flushBytes )
+    {
+        pthread_cond_signal( &journal->flushCond );
+    }
+
+    pthread_mutex_unlock( &journal->mutex );
+
+    *payload = record+1;
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+int journal_send(journal_t*  journal,
+                 nmqueue_t*  queue,
+                 source_t    source,
+                 const void* data,
+                 size_t      dataSize,
+                 void*       threadId)
+{
+    void* payload;
+    int   err;
+
+    assert( journal != NULL );
+    assert( queue != NULL );
+
+    /* The queue may block, so only the send order is serialized, not the journal */
+    pthread_mutex_lock( &journal->sendMutex );
+
+    if( (err=journal_append( journal, source, data, dataSize, &payload )) == NMQUEUEERROR_NOERROR )
+    {
+        err = nmqueue_send( queue, source, payload, dataSize, threadId );
+    }
+
+    pthread_mutex_unlock( &journal->sendMutex );
+
+    return err;
+}
+
+int journal_consume(journal_t* journal,
+                    void*      payload)
+{
+    struct journal_record_s* record = (struct journal_record_s*)payload-1;
+    struct journal_range_s   range;
+    size_t                   i;
+
+    assert( journal != NULL );
+    assert( record->magic == JOURNAL_RECORD );
+
+    range.start = record->offset;
+    range.end   = record->offset+JOURNAL_RECORDSIZE( record->dataSize );
+
+    pthread_mutex_lock( &journal->mutex );
+
+    if( range.end <= journal->consumedOffset )
+    {
+        pthread_mutex_unlock( &journal->mutex );
+        return NMQUEUEERROR_NOERROR;
+    }
+
+    /* Keep records behind a gap until the gap is consumed */
+    if( journal->pendingCount == journal->pendingCapacity )
+    {
+        size_t                  capacity = journal->pendingCapacity*2+16;
+        struct journal_range_s* pending  = (struct journal_range_s*)realloc( journal->pending, capacity*sizeof(struct journal_range_s) );
+
+        if( pending == NULL )
+        {
+            pthread_mutex_unlock( &journal->mutex );
+            return NMQUEUEERROR_OUTOFMEMORY;
+        }
+        journal->pending         = pending;
+        journal->pendingCapacity = capacity;
+    }
+
+    for( i=journal->pendingCount ; i!=0 && journal->pending[i-1].start > range.start ; --i )
+    {
+        journal->pending[i] = journal->pending[i-1];
+    }
+    journal->pending[i] = range;
+    journal->pendingCount++;
+
+    /* Advance over the consumed prefix */
+    for( i=0 ; i<journal->pendingCount && journal->pending[i].start <= skipPadding( journal, journal->consumedOffset ) ; ++i )
+    {
+        if( journal->pending[i].end > journal->consumedOffset )
+        {
+            journal->consumedOffset = journal->pending[i].end;
+        }
+    }
+    journal->pendingCount -= i;
+    memmove( &journal->pending[0], &journal->pending[i], journal->pendingCount*sizeof(struct journal_range_s) );
+
+    pthread_mutex_unlock( &journal->mutex );
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+void journal_sync(journal_t* journal)
+{
+    uint64_t target;
+
+    assert( journal != NULL );
+
+    pthread_mutex_lock( &journal->mutex );
+
+    target = journal->writeOffset;
+
+    if( journal->flushedOffset < target )
+    {
+        journal->flushRequested = 1;
+        pthread_cond_signal( &journal->flushCond );
+
+        while( journal->flushedOffset < target )
+        {
+            pthread_cond_wait( &journal->durableCond, &journal->mutex );
+        }
+    }
+
+    pthread_mutex_unlock( &journal->mutex );
+}
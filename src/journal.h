@@ -0,0 +1,161 @@
+#ifndef _JOURNAL_HEADER_
+#define _JOURNAL_HEADER_
+
+#include "nmqueue.h"
+
+/*! Callback for recovered records, receives source, data, dataSize and a parameter */
+typedef void (*journal_recover_t)(source_t, void*, size_t, void*);
+
+/*! Memory mapped segment file */
+struct journal_segment_s
+{
+    int      fd;    /*!< File descriptor */
+    char*    base;  /*!< Mapping of segmentSize bytes */
+    uint64_t index; /*!< Segment number, first byte is at index*segmentSize */
+};
+
+/*! Record consumed before all records in front of it */
+struct journal_range_s
+{
+    uint64_t start; /*!< Offset of the record */
+    uint64_t end;   /*!< Offset behind the record */
+};
+
+/*! Durable journal of messages.
+ *  Records are appended to memory mapped segment files, a flusher thread
+ *  writes them back in groups. All offsets are logical byte offsets over
+ *  the sequence of segments. */
+typedef struct
+{
+    char*                     path;              /*!< Directory of the segment files */
+    size_t                    segmentSize;       /*!< Size of one segment file */
+    unsigned long             flushInterval;     /*!< Maximum time between two flushes in µs */
+    size_t                    flushBytes;        /*!< Unflushed bytes triggering a flush */
+    struct journal_segment_s* segments;          /*!< Mapped segments, oldest first */
+    size_t                    segmentCount;      /*!< Number of mapped segments */
+    size_t                    segmentCapacity;   /*!< Allocated entries in segments */
+    uint64_t                  writeOffset;       /*!< Offset of the next record */
+    uint64_t                  flushedOffset;     /*!< Everything below is durable */
+    uint64_t                  consumedOffset;    /*!< Everything below is consumed */
+    struct journal_range_s*   pending;           /*!< Records consumed beyond consumedOffset, ordered by start */
+    size_t                    pendingCount;      /*!< Number of entries in pending */
+    size_t                    pendingCapacity;   /*!< Allocated entries in pending */
+    int                       offsetFd;          /*!< File descriptor of the consumer offset file */
+    uint64_t*                 offsetMap;         /*!< Mapping of the persisted consumer offset */
+    pthread_t                 flusher;           /*!< Flusher thread */
+    pthread_mutex_t           mutex;             /*!< Protects all offsets and segments */
+    pthread_mutex_t           sendMutex;         /*!< Keeps journal and queue order identical in journal_send */
+    pthread_cond_t            flushCond;         /*!< Signaled to request a flush */
+    pthread_cond_t            durableCond;       /*!< Signaled after every flush */
+    int                       flushRequested;    /*!< Flush requested by journal_sync */
+    int                       terminated;        /*!< Indicates the flusher should shutdown */
+} journal_t;
+
+/*!
+ * \brief Open or create a journal.
+ * 
+ * Maps the segments starting at the persisted consumer offset and scans
+ * them for valid records. A torn record at the end is discarded.
+ * A flusher thread syncs appended records every flushInterval or as soon
+ * as flushBytes are unflushed, whatever comes first.
+ * 
+ * \param journal       Pointer to an uninitialized journal_t
+ * \param path          Existing directory for the journal files
+ * \param segmentSize   Size of one segment file, a multiple of the page size
+ * \param flushInterval Maximum time between two flushes in µs, not 0
+ * \param flushBytes    Unflushed bytes triggering a flush, 0 for interval only
+ * \return              Error code, ERROR_NOERROR on success
+ */
+int journal_open(journal_t*    journal,
+                 const char*   path,
+                 size_t        segmentSize,
+                 unsigned long flushInterval,
+                 size_t        flushBytes);
+
+/*!
+ * \brief Flush and close a journal.
+ * 
+ * \param journal Pointer to an opened journal_t
+ */
+void journal_close(journal_t* journal);
+
+/*!
+ * \brief Call back for every unconsumed record.
+ * 
+ * Intended to be called right after journal_open, before any appends,
+ * usually to send the records into a queue again. data points into the
+ * journal and stays valid until the record is consumed.
+ * 
+ * \param journal  Pointer to an opened journal_t
+ * \param recover  Callback
+ * \param param    Data passed to callback
+ */
+void journal_recover(journal_t*        journal,
+                     journal_recover_t recover,
+                     void*             param);
+
+/*!
+ * \brief Append a record.
+ * 
+ * Copies dataSize bytes of data into the journal. The record becomes
+ * durable with the next flush.
+ * 
+ * \param journal  Pointer to an opened journal_t
+ * \param source   Any source_t
+ * \param data     Payload of dataSize bytes
+ * \param dataSize Payload size, must fit into a segment
+ * \param payload  Reference to a void*, receives the payload inside the journal
+ * \return         Error code, ERROR_NOERROR on success
+ */
+int journal_append(journal_t*  journal,
+                   source_t    source,
+                   const void* data,
+                   size_t      dataSize,
+                   void**      payload);
+
+/*!
+ * \brief Append a record and send it to a queue.
+ * 
+ * The message sent carries the payload inside the journal as data.
+ * Records enter the queue in journal order. Receivers have to call
+ * journal_consume with the received data once processed.
+ * 
+ * \param journal  Pointer to an opened journal_t
+ * \param queue    Pointer to an initialized nmqueue_t
+ * \param source   Any source_t
+ * \param data     Payload of dataSize bytes
+ * \param dataSize Payload size, must fit into a segment
+ * \return         Error code, ERROR_NOERROR on success
+ */
+int journal_send(journal_t*  journal,
+                 nmqueue_t*  queue,
+                 source_t    source,
+                 const void* data,
+                 size_t      dataSize,
+                 void*       threadId);
+
+/*!
+ * \brief Mark a record as consumed.
+ * 
+ * Records may be consumed in any order. The consumer offset only advances
+ * over records consumed without a gap, it is persisted with the next flush
+ * and segments behind it are deleted. Records consumed beyond a gap are
+ * recovered again after a restart.
+ * 
+ * \param journal Pointer to an opened journal_t
+ * \param payload Payload pointer returned by journal_append or received from journal_send
+ * \return        Error code, ERROR_NOERROR on success
+ */
+int journal_consume(journal_t* journal,
+                     void*      payload);
+
+/*!
+ * \brief Wait until every record appended so far is durable.
+ * 
+ * Requests an immediate flush. Concurrent callers share one flush.
+ * 
+ * \param journal Pointer to an opened journal_t
+ */
+void journal_sync(journal_t* journal);
+
+#endif
@@ -0,0 +1,172 @@
+#include "mpscqueue.h"
+
+#include <sched.h>
+#include <assert.h>
+
+int mpscqueue_initialize(mpscqueue_t*             queue,
+                         struct mpscqueue_node_s* stub)
+{
+    assert( queue != NULL );
+    assert( stub != NULL );
+
+    stub->next    = NULL;
+    queue->tail   = stub;
+    queue->head   = stub;
+    queue->parked = 0;
+    queue->abort  = 0;
+
+    if( pthread_mutex_init( &queue->mutex, NULL ) != 0 )
+    {
+        return NMQUEUEERROR_MUTEX_INITIALIZE_FAILED;
+    }
+
+    if( pthread_cond_init( &queue->cond, NULL ) != 0 )
+    {
+        pthread_mutex_destroy( &queue->mutex );
+        return NMQUEUEERROR_CONDVAR_INITIALIZE_FAILED;
+    }
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+struct mpscqueue_node_s* mpscqueue_finalize(mpscqueue_t* queue)
+{
+    assert( queue != NULL );
+    assert( queue->tail == queue->head );
+
+    pthread_cond_destroy( &queue->cond );
+    pthread_mutex_destroy( &queue->mutex );
+
+    return queue->tail;
+}
+
+void mpscqueue_send(mpscqueue_t*             queue,
+                    struct mpscqueue_node_s* node,
+                    source_t                 source,
+                    void*                    data,
+                    size_t                   dataSize)
+{
+    struct mpscqueue_node_s* previous;
+
+    assert( queue != NULL );
+    assert( node != NULL );
+
+    node->next             = NULL;
+    node->message.source   = source;
+    node->message.data     = data;
+    node->message.dataSize = dataSize;
+    node->message.expires  = 0;
+
+    /* The only read-modify-write, orders the node before parked is read */
+    previous = __atomic_exchange_n( &queue->head, node, __ATOMIC_SEQ_CST );
+
+    /* Until here the receiver sees a list with a gap and waits */
+    __atomic_store_n( &previous->next, node, __ATOMIC_RELEASE );
+
+    if( __atomic_load_n( &queue->parked, __ATOMIC_SEQ_CST ) )
+    {
+        pthread_mutex_lock( &queue->mutex );
+        if( queue->parked )
+        {
+            __atomic_store_n( &queue->parked, 0, __ATOMIC_RELAXED );
+            pthread_cond_signal( &queue->cond );
+        }
+        pthread_mutex_unlock( &queue->mutex );
+    }
+}
+
+/* Takes the next message if linked, loads and stores only.
+ * Returns ERROR_EMPTY if there is none or it is not linked yet. */
+static int takeMessage(mpscqueue_t*              queue,
+                       source_t*                 source,
+                       void**                    data,
+                       size_t*                   dataSize,
+                       struct mpscqueue_node_s** node)
+{
+    struct mpscqueue_node_s* tail = queue->tail;
+    struct mpscqueue_node_s* next = __atomic_load_n( &tail->next, __ATOMIC_ACQUIRE );
+
+    if( next == NULL )
+    {
+        return NMQUEUEERROR_EMPTY;
+    }
+
+    /* next becomes the consumed node in front, tail is free again */
+    *source   = next->message.source;
+    *data     = next->message.data;
+    *dataSize = next->message.dataSize;
+
+    queue->tail = next;
+    *node       = tail;
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+int mpscqueue_tryreceive(mpscqueue_t*              queue,
+                         source_t*                 source,
+                         void**                    data,
+                         size_t*                   dataSize,
+                         struct mpscqueue_node_s** node)
+{
+    assert( queue != NULL );
+
+    return takeMessage( queue, source, data, dataSize, node );
+}
+
+int mpscqueue_receive(mpscqueue_t*              queue,
+                      source_t*                 source,
+                      void**                    data,
+                      size_t*                   dataSize,
+                      struct mpscqueue_node_s** node)
+{
+    assert( queue != NULL );
+
+    for(;;)
+    {
+        if( takeMessage( queue, source, data, dataSize, node ) == NMQUEUEERROR_NOERROR )
+        {
+            return NMQUEUEERROR_NOERROR;
+        }
+
+        /* A sender exchanged head but did not link its node yet */
+        if( __atomic_load_n( &queue->head, __ATOMIC_ACQUIRE ) != queue->tail )
+        {
+            sched_yield();
+            continue;
+        }
+
+        pthread_mutex_lock( &queue->mutex );
+
+        if( queue->abort )
+        {
+            queue->abort = 0;
+            pthread_mutex_unlock( &queue->mutex );
+            return NMQUEUEERROR_ABORT;
+        }
+
+        /* Announce sleeping, then check again, pairs with the exchange in send */
+        __atomic_store_n( &queue->parked, 1, __ATOMIC_SEQ_CST );
+
+        if( __atomic_load_n( &queue->head, __ATOMIC_SEQ_CST ) == queue->tail )
+        {
+            while( queue->parked && !queue->abort )
+            {
+                pthread_cond_wait( &queue->cond, &queue->mutex );
+            }
+        }
+
+        __atomic_store_n( &queue->parked, 0, __ATOMIC_RELAXED );
+
+        pthread_mutex_unlock( &queue->mutex );
+    }
+}
+
+void mpscqueue_abort(mpscqueue_t* queue)
+{
+    assert( queue != NULL );
+
+    pthread_mutex_lock( &queue->mutex );
+    queue->abort = 1;
+    pthread_cond_signal( &queue->cond );
+    pthread_mutex_unlock( &queue->mutex );
+}
@@ -0,0 +1,116 @@
+#ifndef _MPSCQUEUE_HEADER_
+#define _MPSCQUEUE_HEADER_
+
+#include "nmqueue.h"
+
+/*! Assumed cache line size, producer and consumer side are kept apart */
+#define MPSCQUEUE_CACHELINE 64
+
+/*! Queue node, provided by the caller */
+struct mpscqueue_node_s
+{
+    struct mpscqueue_node_s* next;    /*!< Next node, used by mpscqueue */
+    struct nmqueue_message_s message; /*!< Message carried by the node */
+};
+
+/*! Unbounded queue for many senders and exactly one receiver.
+ *  The list always holds one consumed node in front, its successor
+ *  carries the next message. */
+typedef struct
+{
+    struct mpscqueue_node_s* tail;    /*!< Consumed node in front of the list, receiver only */
+    int                      parked;  /*!< Set while the receiver sleeps, accessed atomically */
+    int                      abort;   /*!< Set by mpscqueue_abort, protected by mutex */
+    pthread_mutex_t          mutex;   /*!< Protects abort and the sleeping receiver */
+    pthread_cond_t           cond;    /*!< Signaled to wake the receiver */
+    char                     padding[MPSCQUEUE_CACHELINE]; /*!< Keeps head off the receiver's cache line */
+    struct mpscqueue_node_s* head;    /*!< Last node, exchanged by senders */
+} mpscqueue_t;
+
+/*!
+ * \brief Initialize MPSC queue.
+ *
+ * \param queue Pointer to a not initialized instance of mpscqueue_t
+ * \param stub  Node in front of the empty list, owned by the queue until
+ *              handed back
+ * \return      Error code, ERROR_NOERROR on success
+ */
+int mpscqueue_initialize(mpscqueue_t*             queue,
+                         struct mpscqueue_node_s* stub);
+
+/*!
+ * \brief Finalize MPSC queue.
+ *
+ * The queue has to be empty.
+ *
+ * \param queue Pointer to an initialized instance of mpscqueue_t
+ * \return      Node held by the queue, now owned by the caller again
+ */
+struct mpscqueue_node_s* mpscqueue_finalize(mpscqueue_t* queue);
+
+/*!
+ * \brief Non blocking send, never fails.
+ *
+ * The node is owned by the queue until a receive hands it back.
+ * Costs one atomic exchange, plus a wakeup if the receiver sleeps.
+ *
+ * \param queue    Pointer to an initialized instance of mpscqueue_t
+ * \param node     Unused node
+ * \param source   Any source_t
+ * \param data     Any void*
+ * \param dataSize Any size_t
+ */
+void mpscqueue_send(mpscqueue_t*             queue,
+                    struct mpscqueue_node_s* node,
+                    source_t                 source,
+                    void*                    data,
+                    size_t                   dataSize);
+
+/*!
+ * \brief Blocking receive, single receiver only.
+ *
+ * The message is copied out. The node handed back is free for reuse, it
+ * is the node of the previous message or the stub, not the node which
+ * carried this message.
+ *
+ * \param queue    Pointer to an initialized instance of mpscqueue_t
+ * \param source   Reference to a source_t
+ * \param data     Reference to a void*
+ * \param dataSize Reference to a size_t
+ * \param node     Reference to a node pointer, receives the freed node
+ * \return         Error code, ERROR_NOERROR on success
+ */
+int mpscqueue_receive(mpscqueue_t*              queue,
+                      source_t*                 source,
+                      void**                    data,
+                      size_t*                   dataSize,
+                      struct mpscqueue_node_s** node);
+
+/*!
+ * \brief Non blocking receive, single receiver only.
+ *
+ * Same as mpscqueue_receive, but returns ERROR_EMPTY instead of blocking.
+ *
+ * \param queue    Pointer to an initialized instance of mpscqueue_t
+ * \param source   Reference to a source_t
+ * \param data     Reference to a void*
+ * \param dataSize Reference to a size_t
+ * \param node     Reference to a node pointer, receives the freed node
+ * \return         Error code, ERROR_NOERROR on success
+ */
+int mpscqueue_tryreceive(mpscqueue_t*              queue,
+                         source_t*                 source,
+                         void**                    data,
+                         size_t*                   dataSize,
+                         struct mpscqueue_node_s** node);
+
+/*!
+ * \brief Abort the receiver once.
+ *
+ * The blocking receive returns ERROR_ABORT once it finds the queue empty.
+ *
+ * \param queue Pointer to an initialized instance of mpscqueue_t
+ */
+void mpscqueue_abort(mpscqueue_t* queue);
+
+#endif
@@ -1,21 +1,56 @@
 #include "nmqueue.h"
+#include "nmqueueprobes.h"
+#include "spillfile.h"
+#include "waitlist.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* Huge pages are assumed to be 2MB, the default of the common platforms */
+#define NMQUEUE_HUGEPAGE_SIZE (2*1024*1024)
+
+/* Nodes addressable by NMQUEUE_ATTR_NUMA */
+#define NMQUEUE_MAX_NODES 1024
 
 #define NMQUEUE_INVARIANT(queue)\
     assert( queue->queue != NULL );\
     assert( queue->readPosition < queue->length );\
     assert( queue->writePosition < queue->length );
 
+/* Ends a bucket of the source index */
+#define NMQUEUE_INDEX_END  ((size_t)-1)
+/* Slot not in the source index, following parts of groups and taken slots */
+#define NMQUEUE_INDEX_NONE ((size_t)-2)
+
+/* Upper limit of the source index buckets */
+#define NMQUEUE_MAX_BUCKETS 1024
+
 static const char* errors[] = {
     "No Error",
     "Mutex initialize failed",
     "Conditional variable initialize failed",
     "Out of memory",
-    "Abort signal catched"};
+    "Abort signal catched",
+    "Queue empty",
+    "Queue full",
+    "Operation pending",
+    "I/O error",
+    "No credit left for source",
+    "Timed out"};
 
 static const char* invalidError = "Invalid error";
 
@@ -28,204 +63,2342 @@ const char* nmqueue_error_to_string(int err)
     return errors[err];
 }
 
-void nmqueue_abort(nmqueue_t* queue,
-                   void*      threadId)
+/* Appends an operation to a pending operation list */
+static void pushOperation(struct nmqueue_async_s** head,
+                          struct nmqueue_async_s** tail,
+                          struct nmqueue_async_s*  operation)
 {
-    assert( queue != NULL );
-    NMQUEUE_INVARIANT( queue )
+    operation->next = NULL;
+    if( *tail != NULL )
+    {
+        (*tail)->next = operation;
+    }
+    else
+    {
+        *head = operation;
+    }
+    *tail = operation;
+}
 
-    pthread_mutex_lock( &queue->mutex );
+/* Removes the first operation of a pending operation list */
+static struct nmqueue_async_s* popOperation(struct nmqueue_async_s** head,
+                                            struct nmqueue_async_s** tail)
+{
+    struct nmqueue_async_s* operation = *head;
 
-    queue->abort = threadId;
+    *head = operation->next;
+    if( *head == NULL )
+    {
+        *tail = NULL;
+    }
+    operation->next = NULL;
 
-    /* Wakeup both sending and receiving threads */
-    pthread_cond_broadcast( &queue->writtenCond );
-    pthread_cond_broadcast( &queue->readCond );
+    return operation;
+}
 
-    pthread_mutex_unlock( &queue->mutex );
+/* Resumes completed operations with their results set, queue must not be locked */
+static void resumeOperations(struct nmqueue_async_s* operation)
+{
+    while( operation != NULL )
+    {
+        /* resume may reuse the operation */
+        struct nmqueue_async_s* next = operation->next;
 
+        if( operation->executor != NULL )
+        {
+            (*operation->executor)( operation, operation->executorParam );
+        }
+        else
+        {
+            (*operation->resume)( operation );
+        }
+        operation = next;
+    }
 }
 
-int nmqueue_initialize(nmqueue_t* queue,
-                       size_t     length)
+/* Messages in the ring buffer, queue has to be locked. Avoids the division,
+ * it is evaluated for every probe. */
+static size_t occupancyOf(nmqueue_t* queue)
 {
-    assert( queue != NULL );
-    assert( length != 0 );
+    return queue->writePosition >= queue->readPosition ?
+           queue->writePosition-queue->readPosition :
+           queue->writePosition+queue->length-queue->readPosition;
+}
 
-    queue->writePosition = 0;
-    queue->readPosition  = 0;
-    queue->length        = length;
-    queue->queue         = (struct nmqueue_message_s*)malloc( length*sizeof(struct nmqueue_message_s) );
-    queue->abort         = (void*)(1);
+#ifdef NMQUEUE_USDT
+/* CLOCK_MONOTONIC in ns, for the wait duration passed to the wakeup probe */
+static uint64_t probeNanos(void)
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t)now.tv_sec*1000*1000*1000+now.tv_nsec;
+}
+#endif
+
+/* Free slots of the ring buffer, queue has to be locked */
+static size_t freeSlots(nmqueue_t* queue)
+{
+    return queue->length-1-occupancyOf( queue );
+}
+
+/* Wakes blocked senders in FIFO order while the free slots cover what
+ * they wait for, queue has to be locked */
+static void wakeSenders(nmqueue_t* queue)
+{
+    size_t available = freeSlots( queue );
 
-    if( queue->queue == NULL )
+    while( queue->senders.head != NULL && queue->senders.head->needed <= available )
     {
-        return NMQUEUEERROR_OUTOFMEMORY;
+        available -= queue->senders.head->needed;
+        waitlist_wake( &queue->senders, 1 );
+    }
+}
+
+/* Blocks the calling thread on a wait list until a waker removes it,
+ * queue has to be locked. needed is the number of free slots the thread
+ * waits for, filter the sources. Returns 1 if the thread got aborted. */
+static int waitOn(nmqueue_t*                 queue,
+                  struct nmqueue_waitlist_s* list,
+                  void*                      threadId,
+                  size_t                     needed,
+                  const nmqueue_filter_t*    filter)
+{
+    struct nmqueue_waiter_s waiter;
+    int                     aborted;
+#ifdef NMQUEUE_USDT
+    uint64_t                start = probeNanos();
+#endif
+
+    waiter.threadId = threadId;
+    waiter.needed   = needed;
+    waiter.filter   = filter;
+
+    /* Without a condition variable the caller polls */
+    if( !waitlist_block( &queue->mutex, list, &waiter ) )
+    {
+        return waitlist_take_abort( &queue->aborts, threadId );
+    }
+
+    /* Aborted after it was woken, before it could run */
+    aborted = waiter.aborted || waitlist_take_abort( &queue->aborts, threadId );
+
+    NMQUEUE_PROBE4( wakeup, queue,
+                    list == &queue->receivers ? 0 : list == &queue->senders ? 1 :
+                    list == &queue->filtered ? 3 : 2,
+                    probeNanos()-start, aborted );
+
+    return aborted;
+}
+
+/* Wakes threads selecting on waitsets of the queue, queue has to be locked */
+static void notifyWaitsets(nmqueue_t* queue)
+{
+    struct nmqueue_waitlink_s* link;
+
+    for( link=queue->waitsets ; link != NULL ; link=link->next )
+    {
+        pthread_mutex_lock( &link->waitset->mutex );
+        link->waitset->generation++;
+        waitlist_wake( &link->waitset->selectors, WAITLIST_ALL );
+        pthread_mutex_unlock( &link->waitset->mutex );
     }
+}
+
+/* Checks a source against a filter */
+static int matchesFilter(const nmqueue_filter_t* filter,
+                         source_t                source)
+{
+    size_t i;
 
-    /* Initialize mutex and conditional variables for both read and written */
+    if( filter->sources == NULL )
     {
-        int error;
+        return (*filter->predicate)( source, filter->predicateParam );
+    }
 
-        if ( pthread_mutex_init( &queue->mutex, NULL ) == 0 )
+    for( i=0 ; i<filter->sourceCount ; ++i )
+    {
+        if( filter->sources[i] == source )
         {
+            return 1;
+        }
+    }
+    return 0;
+}
 
-            if ( pthread_cond_init( &queue->writtenCond, NULL ) == 0 )
+/* Wakes the longest waiting filtered receiver matching source,
+ * queue has to be locked */
+static void wakeFiltered(nmqueue_t* queue,
+                         source_t   source)
+{
+    struct nmqueue_waiter_s* previous = NULL;
+    struct nmqueue_waiter_s* waiter;
+
+    for( waiter=queue->filtered.head ; waiter != NULL ; previous=waiter, waiter=waiter->next )
+    {
+        if( matchesFilter( waiter->filter, source ) )
+        {
+            if( previous != NULL )
             {
+                previous->next = waiter->next;
+            }
+            else
+            {
+                queue->filtered.head = waiter->next;
+            }
+            if( queue->filtered.tail == waiter )
+            {
+                queue->filtered.tail = previous;
+            }
 
-                if ( pthread_cond_init( &queue->readCond, NULL ) == 0 )
-                {
-                    NMQUEUE_INVARIANT(queue);
-                    return NMQUEUEERROR_NOERROR;
-                }
+            waiter->woken = 1;
+            pthread_cond_signal( waiter->cond );
+            return;
+        }
+    }
+}
+
+/* Index bucket of a source */
+static struct nmqueue_bucket_s* bucketOf(nmqueue_t* queue,
+                                         source_t   source)
+{
+    return &queue->buckets[ (size_t)(unsigned int)source & queue->bucketMask ];
+}
+
+/* Appends a written slot to the source index unless it continues a group,
+ * queue has to be locked. Wakes a filtered receiver waiting for it. */
+static void indexSlot(nmqueue_t* queue,
+                      size_t     position,
+                      int        first)
+{
+    struct nmqueue_bucket_s* bucket;
 
-                error = NMQUEUEERROR_CONDVAR_INITIALIZE_FAILED;
+    if( !first )
+    {
+        queue->indexNext[position] = NMQUEUE_INDEX_NONE;
+        return;
+    }
 
-                pthread_cond_destroy( &queue->writtenCond );
+    bucket = bucketOf( queue, queue->queue[position].source );
 
-            } else { error = NMQUEUEERROR_CONDVAR_INITIALIZE_FAILED; }
+    queue->indexNext[position] = NMQUEUE_INDEX_END;
+    if( bucket->tail != NMQUEUE_INDEX_END )
+    {
+        queue->indexNext[bucket->tail] = position;
+    }
+    else
+    {
+        bucket->head = position;
+    }
+    bucket->tail = position;
 
-            pthread_mutex_destroy( &queue->mutex );
+    if( queue->filtered.head != NULL )
+    {
+        wakeFiltered( queue, queue->queue[position].source );
+    }
+}
 
-        } else { error = NMQUEUEERROR_MUTEX_INITIALIZE_FAILED; }
+/* Removes an indexed slot from the source index, queue has to be locked */
+static void unindexSlot(nmqueue_t* queue,
+                        size_t     position)
+{
+    struct nmqueue_bucket_s* bucket   = bucketOf( queue, queue->queue[position].source );
+    size_t                   previous = NMQUEUE_INDEX_END;
+    size_t                   current;
 
-        free( queue->queue );
-        return error;
+    /* Usually the head, the oldest message of the bucket */
+    for( current=bucket->head ; current != position ; current=queue->indexNext[current] )
+    {
+        previous = current;
+    }
 
+    if( previous != NMQUEUE_INDEX_END )
+    {
+        queue->indexNext[previous] = queue->indexNext[position];
+    }
+    else
+    {
+        bucket->head = queue->indexNext[position];
+    }
+    if( bucket->tail == position )
+    {
+        bucket->tail = previous;
     }
 
+    queue->indexNext[position] = NMQUEUE_INDEX_NONE;
 }
 
-void nmqueue_finalize(nmqueue_t* queue)
+/* Removes the oldest message from the ring buffer together with slots
+ * taken by filtered receives behind it, queue has to be locked and must
+ * not be empty. The message stays valid until the queue is unlocked.
+ * Returns the number of freed slots. */
+static size_t advanceHead(nmqueue_t* queue)
 {
-    /* Carefull, threads active? TODO*/
-    assert( queue != NULL);
-    NMQUEUE_INVARIANT( queue );
+    size_t freed = 1;
 
-    pthread_cond_destroy( &queue->writtenCond );
-    pthread_cond_destroy( &queue->readCond );
-    pthread_mutex_destroy( &queue->mutex );
+    if( queue->indexNext[ queue->readPosition ] != NMQUEUE_INDEX_NONE )
+    {
+        unindexSlot( queue, queue->readPosition );
+    }
 
-    /* Actually the queue shouldn't be freed if there is still data to be processed,
-       but in case there still is, at least the entries are deleted.
-       
-       It is impossible to make assumptions about the data pointers since
-       they may not be allocated or may not even be used as pointers. => LEAK WARNING*/
+    queue->readPosition = (queue->readPosition+1) % queue->length;
 
-    free( queue->queue );
+    while( queue->readPosition != queue->writePosition && queue->queue[ queue->readPosition ].parts == 0 )
+    {
+        queue->readPosition = (queue->readPosition+1) % queue->length;
+        freed++;
+    }
 
+    return freed;
 }
 
-int nmqueue_send(nmqueue_t* queue,
-                 source_t   source,
-                 void*      data,
-                 size_t     dataSize,
-                 void*      threadId)
+/* Credit entry of a source, NULL if the source is not limited */
+static struct nmqueue_credit_s* sourceCredit(nmqueue_t* queue,
+                                             source_t   source)
 {
-    assert( queue != NULL );
-    NMQUEUE_INVARIANT( queue );
+    if( queue->credits == NULL || source < 0 || (size_t)source >= queue->creditSources )
+    {
+        return NULL;
+    }
+    return &queue->credits[source];
+}
 
-    pthread_mutex_lock( &queue->mutex );
+/* Checks whether a source may put another message into the ring buffer */
+static int hasCredit(nmqueue_t* queue,
+                     source_t   source)
+{
+    struct nmqueue_credit_s* credit = sourceCredit( queue, source );
 
-    /* aborted thread? */
-    if( queue->abort == threadId )
+    return credit == NULL || credit->outstanding < queue->creditLimit;
+}
+
+/* Accounts a message entering the ring buffer, queue has to be locked */
+static void takeCredit(nmqueue_t*                      queue,
+                       const struct nmqueue_message_s* message)
+{
+    struct nmqueue_credit_s* credit = sourceCredit( queue, message->source );
+
+    if( credit != NULL )
     {
-        printf("ABB:%p\n",queue->abort);
-        queue->abort = NULL;
-        pthread_mutex_unlock(&queue->mutex);
-        return NMQUEUEERROR_ABORT;
+        credit->outstanding++;
     }
+}
+
+/* Accounts a message leaving the ring buffer, queue has to be locked */
+static void releaseCredit(nmqueue_t*                      queue,
+                          const struct nmqueue_message_s* message)
+{
+    struct nmqueue_credit_s* credit = sourceCredit( queue, message->source );
 
-    /* Wait until writting is possible */
-    while ((queue->writePosition+1) % queue->length == queue->readPosition)
+    if( credit != NULL )
     {
-        pthread_cond_wait(&queue->readCond, &queue->mutex);
+        credit->outstanding--;
+        waitlist_wake( &credit->waiters, 1 );
+    }
+}
 
-        /* aborted thread? */
-        if( queue->abort == threadId )
-        {
-            queue->abort = NULL;
-            pthread_mutex_unlock(&queue->mutex);
-            return NMQUEUEERROR_ABORT;
-        }
+/* Writes a message or hands a single message to a suspended receive
+ * operation, queue has to be locked and must not be full. parts and expires
+ * replace the fields of message, parts of a group expire together, first
+ * is 0 for the following parts of a group. Groups always go into the ring
+ * buffer, serveReceivers passes them on. Waiting receivers are not
+ * signaled, except for filtered ones. Returns the operation to resume or NULL. */
+static struct nmqueue_async_s* storeMessage(nmqueue_t*                      queue,
+                                            const struct nmqueue_message_s* message,
+                                            size_t                          parts,
+                                            uint64_t                        expires,
+                                            int                             first)
+{
+    struct nmqueue_async_s*   operation = NULL;
+    struct nmqueue_message_s* stored;
+
+    if( queue->asyncReceivers != NULL && parts == 1 && first )
+    {
+        operation = popOperation( &queue->asyncReceivers, &queue->asyncReceiversTail );
+        stored    = operation->messages != NULL ? operation->messages : &operation->message;
+
+        operation->count = 1;
+        operation->error = NMQUEUEERROR_NOERROR;
+    }
+    else
+    {
+        takeCredit( queue, message );
+        stored = &queue->queue[ queue->writePosition ];
     }
 
-    /* Write message */
+    *stored = *message;
+    stored->sequence = queue->sequence++;
+    stored->parts    = parts;
+    stored->expires  = expires;
+
+    if( operation == NULL )
     {
-        struct nmqueue_message_s* message = &queue->queue[ queue->writePosition ];
+        indexSlot( queue, queue->writePosition, first );
+        queue->writePosition = (queue->writePosition+1) % queue->length;
+        NMQUEUE_INVARIANT( queue );
+    }
+
+    NMQUEUE_PROBE3( send, queue, stored->source, occupancyOf( queue ) );
 
-        message->source   = source;
-        message->data     = data;
-        message->dataSize = dataSize;
+    if( queue->tap != NULL )
+    {
+        (*queue->tap)( stored, queue->tapParam );
     }
 
-    queue->writePosition = (queue->writePosition+1) % queue->length;
-    NMQUEUE_INVARIANT( queue );
+    return operation;
+}
 
-    pthread_cond_signal(&queue->writtenCond);
+/* Moves suspended send operations into freed slots, in order until one
+ * whose source ran out of credits, queue has to be locked. Returns the
+ * operations to resume. */
+static struct nmqueue_async_s* refillMessages(nmqueue_t* queue)
+{
+    struct nmqueue_async_s* completed     = NULL;
+    struct nmqueue_async_s* completedTail = NULL;
+    size_t                  refilled      = 0;
 
-    pthread_mutex_unlock(&queue->mutex);
+    while( queue->asyncSenders != NULL &&
+           (queue->writePosition+1) % queue->length != queue->readPosition &&
+           hasCredit( queue, queue->asyncSenders->message.source ) )
+    {
+        struct nmqueue_async_s* operation = popOperation( &queue->asyncSenders, &queue->asyncSendersTail );
 
-    return NMQUEUEERROR_NOERROR;
+        operation->message.sequence = queue->sequence++;
+        operation->message.parts    = 1;
+        operation->error            = NMQUEUEERROR_NOERROR;
+
+        if( queue->tap != NULL )
+        {
+            (*queue->tap)( &operation->message, queue->tapParam );
+        }
+
+        takeCredit( queue, &operation->message );
+        queue->queue[ queue->writePosition ] = operation->message;
+        indexSlot( queue, queue->writePosition, 1 );
+        queue->writePosition = (queue->writePosition+1) % queue->length;
+
+        NMQUEUE_PROBE3( send, queue, operation->message.source, occupancyOf( queue ) );
+
+        pushOperation( &completed, &completedTail, operation );
+        refilled++;
+    }
 
+    if( completed != NULL )
+    {
+        NMQUEUE_INVARIANT( queue );
+        waitlist_wake( &queue->receivers, refilled );
+        notifyWaitsets( queue );
+    }
+
+    return completed;
 }
 
-int nmqueue_receive(nmqueue_t* queue,
-                    source_t*  source,
-                    void**     data,
-                    size_t*    dataSize,
-                    void*      threadId)
+/* Checks for messages in the spill file, queue has to be locked */
+static int spillPending(nmqueue_t* queue)
 {
-    assert( queue    != NULL );
-    assert( source   != NULL );
-    assert( data     != NULL );
-    assert( dataSize != NULL );
-    NMQUEUE_INVARIANT( queue );
+    return queue->spill != NULL && queue->spill->count != 0;
+}
 
-    pthread_mutex_lock( &queue->mutex );
+/* Appends count messages to the spill file as a whole, as one group if
+ * group is set. Payloads are released once written. Queue has to be locked. */
+static int spillMessages(nmqueue_t*                      queue,
+                         const struct nmqueue_message_s* messages,
+                         size_t                          count,
+                         int                             group)
+{
+    spillfile_mark_t mark;
+    size_t           i;
 
-    /* aborted thread? */
-    if( queue->abort == threadId)
+    /* The ring buffer holds length-1 messages, a larger group is never read back */
+    if( queue->spill == NULL || ( group && count >= queue->length ) )
     {
-        queue->abort = NULL;
-        pthread_mutex_unlock(&queue->mutex);
-        return NMQUEUEERROR_ABORT;
+        return NMQUEUEERROR_FULL;
     }
 
-    /* Wait until reading is possible */
-    while( queue->readPosition == queue->writePosition )
+    spillfile_mark( queue->spill, &mark );
+
+    for( i=0 ; i<count ; ++i )
     {
+        struct nmqueue_message_s spilled = messages[i];
 
-        pthread_cond_wait( &queue->writtenCond, &queue->mutex );
+        spilled.sequence = queue->sequence+i;
+        spilled.parts    = group ? count-i : 1;
+        spilled.expires  = group ? messages[0].expires : messages[i].expires;
 
-        /* aborted thread? */
-        if( queue->abort == threadId )
+        if( spillfile_append( queue->spill, &spilled ) != NMQUEUEERROR_NOERROR )
         {
-            queue->abort = NULL;
-            pthread_mutex_unlock(&queue->mutex);
-            return NMQUEUEERROR_ABORT;
+            spillfile_rewind( queue->spill, &mark );
+            return NMQUEUEERROR_FULL;
+        }
+    }
+
+    /* Enters the queue like a stored message, read back without these steps */
+    for( i=0 ; i<count ; ++i )
+    {
+        struct nmqueue_message_s spilled = messages[i];
+
+        spilled.sequence = queue->sequence++;
+        spilled.parts    = group ? count-i : 1;
+        spilled.expires  = group ? messages[0].expires : messages[i].expires;
+
+        takeCredit( queue, &spilled );
+
+        NMQUEUE_PROBE3( send, queue, spilled.source, occupancyOf( queue ) );
+
+        if( queue->tap != NULL )
+        {
+            (*queue->tap)( &spilled, queue->tapParam );
         }
 
+        if( spilled.dataSize != 0 )
+        {
+            (*queue->spillRelease)( spilled.source, spilled.data, spilled.dataSize, queue->spillParam );
+        }
     }
 
-    /* Read message */
+    queue->drops.spilled += count;
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+/* Moves spilled messages into free slots in order, groups as a whole.
+ * Payloads are copied into buffers of spillAlloc, on failure the messages
+ * stay in the spill file. Queue has to be locked. */
+static void unspillMessages(nmqueue_t* queue)
+{
+    size_t moved = 0;
+
+    while( spillPending( queue ) )
     {
-        struct nmqueue_message_s* message = &queue->queue[ queue->readPosition ];
+        size_t                   offset = spillfile_first( queue->spill );
+        struct nmqueue_message_s message;
+        size_t                   parts;
+        size_t                   i;
 
-        *source   = message->source;
-        *data     = message->data;
-        *dataSize = message->dataSize;
+        spillfile_read( queue->spill, offset, &message );
+        parts = message.parts;
 
-        queue->readPosition = (queue->readPosition+1) % queue->length;
+        if( freeSlots( queue ) < parts )
+        {
+            break;
+        }
+
+        /* Copy all parts behind writePosition, published at once below */
+        for( i=0 ; i<parts ; ++i )
+        {
+            struct nmqueue_message_s* slot = &queue->queue[ (queue->writePosition+i) % queue->length ];
+
+            offset = spillfile_read( queue->spill, offset, slot );
+
+            if( slot->dataSize != 0 )
+            {
+                void* data = (*queue->spillAlloc)( slot->dataSize, queue->spillParam );
+
+                if( data == NULL )
+                {
+                    break;
+                }
+
+                memcpy( data, slot->data, slot->dataSize );
+                slot->data = data;
+            }
+        }
+
+        if( i != parts )
+        {
+            while( i-- != 0 )
+            {
+                struct nmqueue_message_s* slot = &queue->queue[ (queue->writePosition+i) % queue->length ];
 
+                if( slot->dataSize != 0 )
+                {
+                    (*queue->spillRelease)( slot->source, slot->data, slot->dataSize, queue->spillParam );
+                }
+            }
+            break;
+        }
+
+        spillfile_remove( queue->spill, parts );
+
+        for( i=0 ; i<parts ; ++i )
+        {
+            indexSlot( queue, queue->writePosition, i == 0 );
+            queue->writePosition = (queue->writePosition+1) % queue->length;
+        }
+        moved += parts;
+    }
+
+    if( moved != 0 )
+    {
         NMQUEUE_INVARIANT( queue );
+        waitlist_wake( &queue->receivers, moved );
+        notifyWaitsets( queue );
+    }
+}
+
+/* Default spill allocator */
+static void* spillMalloc(size_t dataSize,
+                         void*  param)
+{
+    return malloc( dataSize );
+}
+
+/* Default spill release */
+static void spillFree(source_t source,
+                      void*    data,
+                      size_t   dataSize,
+                      void*    param)
+{
+    free( data );
+}
+
+void nmqueue_abort(nmqueue_t* queue,
+                   void*      threadId)
+{
+    size_t i;
+    int    blocked;
+
+    assert( queue != NULL );
+    NMQUEUE_INVARIANT( queue )
+
+    pthread_mutex_lock( &queue->mutex );
 
-        pthread_cond_signal(&queue->readCond);
+    blocked = waitlist_abort( &queue->receivers, threadId ) ||
+              waitlist_abort( &queue->filtered, threadId ) ||
+              waitlist_abort( &queue->senders, threadId );
 
+    /* Senders waiting for credits */
+    for( i=0 ; !blocked && i<queue->creditSources ; ++i )
+    {
+        blocked = waitlist_abort( &queue->credits[i].waiters, threadId );
     }
 
-    pthread_mutex_unlock(&queue->mutex);
+    /* Not blocked, keep the abort for its next call. The thread may
+     * select on the queue, its waitsets check it again. */
+    if( !blocked )
+    {
+        waitlist_keep_abort( &queue->aborts, threadId );
+        notifyWaitsets( queue );
+    }
 
-    return NMQUEUEERROR_NOERROR;
+    NMQUEUE_PROBE3( abort, queue, threadId, blocked );
 
+    pthread_mutex_unlock( &queue->mutex );
+
+}
+
+void nmqueue_clear_abort(nmqueue_t* queue,
+                         void*      threadId)
+{
+    assert( queue != NULL );
+
+    pthread_mutex_lock( &queue->mutex );
+    waitlist_take_abort( &queue->aborts, threadId );
+    pthread_mutex_unlock( &queue->mutex );
+}
+
+/* Binds a mapping to a NUMA node, returns 0 on success */
+static int bindNode(void*  ring,
+                    size_t size,
+                    int    node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+    unsigned long mask[ NMQUEUE_MAX_NODES/(8*sizeof(unsigned long)) ];
+    size_t        bits = 8*sizeof(unsigned long);
+
+    if( node < 0 || node >= NMQUEUE_MAX_NODES )
+    {
+        return -1;
+    }
+
+    memset( mask, 0, sizeof(mask) );
+    mask[ node/bits ] = 1UL << (node%bits);
+
+    /* The kernel takes one bit less than maxnode */
+    return (int)syscall( SYS_mbind, ring, size, MPOL_BIND, mask, (unsigned long)NMQUEUE_MAX_NODES+1, 0 );
+#else
+    return -1;
+#endif
+}
+
+/* Allocates the ring buffer as requested by attr, records the mapped size
+ * and the applied attributes. Returns NULL if there is no memory at all. */
+static struct nmqueue_message_s* allocateRing(nmqueue_t*            queue,
+                                              size_t                bytes,
+                                              const nmqueue_attr_t* attr)
+{
+    char*  ring     = (char*)MAP_FAILED;
+    size_t pageSize = (size_t)sysconf( _SC_PAGESIZE );
+    size_t size;
+
+    queue->ringMapped = 0;
+    queue->placement  = 0;
+
+    if( attr == NULL || attr->flags == 0 )
+    {
+        return (struct nmqueue_message_s*)malloc( bytes );
+    }
+
+    if( attr->flags & NMQUEUE_ATTR_HUGEPAGES )
+    {
+        size = (bytes+NMQUEUE_HUGEPAGE_SIZE-1) / NMQUEUE_HUGEPAGE_SIZE * NMQUEUE_HUGEPAGE_SIZE;
+
+#ifdef MAP_HUGETLB
+        /* Reserved huge pages first */
+        ring = (char*)mmap( NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0 );
+        if( ring != (char*)MAP_FAILED )
+        {
+            queue->placement |= NMQUEUE_ATTR_HUGEPAGES;
+        }
+#endif
+        if( ring == (char*)MAP_FAILED )
+        {
+            /* Transparent huge pages only back aligned huge page ranges,
+             * map one more huge page and trim the unaligned ends */
+            char* mapped = (char*)mmap( NULL, size+NMQUEUE_HUGEPAGE_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 );
+
+            if( mapped != (char*)MAP_FAILED )
+            {
+                size_t head = (NMQUEUE_HUGEPAGE_SIZE - (size_t)((unsigned long)mapped % NMQUEUE_HUGEPAGE_SIZE)) % NMQUEUE_HUGEPAGE_SIZE;
+
+                ring = mapped+head;
+                if( head != 0 )
+                {
+                    munmap( mapped, head );
+                }
+                munmap( ring+size, NMQUEUE_HUGEPAGE_SIZE-head );
+            }
+#ifdef MADV_HUGEPAGE
+            /* The kernel may still use normal pages, the advice is all that is known */
+            if( ring != (char*)MAP_FAILED && madvise( ring, size, MADV_HUGEPAGE ) == 0 )
+            {
+                queue->placement |= NMQUEUE_ATTR_HUGEPAGES;
+            }
+#endif
+        }
+    }
+    else
+    {
+        size = (bytes+pageSize-1) / pageSize * pageSize;
+        ring = (char*)mmap( NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 );
+    }
+
+    if( ring == (char*)MAP_FAILED )
+    {
+        queue->placement = 0;
+        return (struct nmqueue_message_s*)malloc( bytes );
+    }
+
+    queue->ringMapped = size;
+
+    /* Before the first touch, pages are placed when they are faulted in */
+    if( (attr->flags & NMQUEUE_ATTR_NUMA) && bindNode( ring, size, attr->numaNode ) == 0 )
+    {
+        queue->placement |= NMQUEUE_ATTR_NUMA;
+    }
+
+    if( attr->flags & NMQUEUE_ATTR_PREFAULT )
+    {
+        size_t offset;
+
+        for( offset=0 ; offset<size ; offset+=pageSize )
+        {
+            ((volatile char*)ring)[offset] = 0;
+        }
+        queue->placement |= NMQUEUE_ATTR_PREFAULT;
+    }
+
+    if( (attr->flags & NMQUEUE_ATTR_LOCK) && mlock( ring, size ) == 0 )
+    {
+        queue->placement |= NMQUEUE_ATTR_LOCK;
+    }
+
+    return (struct nmqueue_message_s*)ring;
+}
+
+/* Releases the ring buffer of allocateRing */
+static void releaseRing(nmqueue_t* queue)
+{
+    if( queue->ringMapped != 0 )
+    {
+        munmap( queue->queue, queue->ringMapped );
+    }
+    else
+    {
+        free( queue->queue );
+    }
+}
+
+int nmqueue_initialize(nmqueue_t* queue,
+                       size_t     length)
+{
+    return nmqueue_initialize_attr(queue, length, NULL);
+}
+
+int nmqueue_initialize_attr(nmqueue_t*            queue,
+                            size_t                length,
+                            const nmqueue_attr_t* attr)
+{
+    size_t buckets = 1;
+    size_t i;
+
+    assert( queue != NULL );
+    assert( length != 0 );
+
+    queue->writePosition = 0;
+    queue->readPosition  = 0;
+    queue->length        = length;
+    queue->queue         = allocateRing( queue, length*sizeof(struct nmqueue_message_s), attr );
+    queue->aborts.threads  = NULL;
+    queue->aborts.count    = 0;
+    queue->aborts.capacity = 0;
+
+    queue->receivers.head = NULL;
+    queue->receivers.tail = NULL;
+    queue->senders.head   = NULL;
+    queue->senders.tail   = NULL;
+    queue->filtered.head  = NULL;
+    queue->filtered.tail  = NULL;
+
+    /* About a bucket per slot, a queue rarely holds more sources */
+    while( buckets < length && buckets < NMQUEUE_MAX_BUCKETS )
+    {
+        buckets *= 2;
+    }
+    queue->indexNext  = (size_t*)malloc( length*sizeof(size_t) );
+    queue->buckets    = (struct nmqueue_bucket_s*)malloc( buckets*sizeof(struct nmqueue_bucket_s) );
+    queue->bucketMask = buckets-1;
+
+    queue->overflowPolicy = NMQUEUE_OVERFLOW_BLOCK;
+    queue->dropCallback   = NULL;
+    queue->dropParam      = NULL;
+    queue->tap            = NULL;
+    queue->tapParam       = NULL;
+    queue->waitsets       = NULL;
+    queue->drops.overflow  = 0;
+    queue->drops.expired   = 0;
+    queue->drops.rejected  = 0;
+    queue->drops.spilled   = 0;
+    queue->drops.oversized = 0;
+
+    queue->asyncReceivers     = NULL;
+    queue->asyncReceiversTail = NULL;
+    queue->asyncSenders       = NULL;
+    queue->asyncSendersTail   = NULL;
+
+    queue->credits       = NULL;
+    queue->creditSources = 0;
+    queue->creditLimit   = 0;
+
+    queue->sequence  = 0;
+    queue->skip      = NULL;
+    queue->skipParam = NULL;
+
+    queue->spill        = NULL;
+    queue->spillAlloc   = NULL;
+    queue->spillRelease = NULL;
+    queue->spillParam   = NULL;
+
+    if( queue->queue == NULL || queue->indexNext == NULL || queue->buckets == NULL )
+    {
+        if( queue->queue != NULL )
+        {
+            releaseRing( queue );
+        }
+        free( queue->indexNext );
+        free( queue->buckets );
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+
+    for( i=0 ; i<buckets ; ++i )
+    {
+        queue->buckets[i].head = NMQUEUE_INDEX_END;
+        queue->buckets[i].tail = NMQUEUE_INDEX_END;
+    }
+
+    /* Initialize mutex, blocked threads bring their own conditional variables */
+    if ( pthread_mutex_init( &queue->mutex, NULL ) != 0 )
+    {
+        releaseRing( queue );
+        free( queue->indexNext );
+        free( queue->buckets );
+        return NMQUEUEERROR_MUTEX_INITIALIZE_FAILED;
+    }
+
+    NMQUEUE_INVARIANT(queue);
+    return NMQUEUEERROR_NOERROR;
+
+}
+
+void nmqueue_finalize(nmqueue_t* queue)
+{
+    /* Carefull, threads active? TODO*/
+    assert( queue != NULL);
+    NMQUEUE_INVARIANT( queue );
+
+    pthread_mutex_destroy( &queue->mutex );
+
+    /* Actually the queue shouldn't be freed if there is still data to be processed,
+       but in case there still is, at least the entries are deleted.
+       
+       It is impossible to make assumptions about the data pointers since
+       they may not be allocated or may not even be used as pointers. => LEAK WARNING*/
+
+    releaseRing( queue );
+    free( queue->indexNext );
+    free( queue->buckets );
+    free( queue->aborts.threads );
+
+    /* Registrations left behind */
+    while( queue->waitsets != NULL )
+    {
+        struct nmqueue_waitlink_s* link = queue->waitsets;
+        queue->waitsets = link->next;
+        free( link );
+    }
+
+    free( queue->credits );
+
+    /* Spilled messages are leaked like the ones in the ring buffer */
+    if( queue->spill != NULL )
+    {
+        spillfile_close( queue->spill );
+        free( queue->spill );
+    }
+
+}
+
+/* Current CLOCK_MONOTONIC time in µs */
+static uint64_t monotonicNow(void)
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t)now.tv_sec*1000*1000+now.tv_nsec/1000;
+}
+
+/* Checks the time to live of a message, now is fetched on first use */
+static int isExpired(const struct nmqueue_message_s* message,
+                     uint64_t*                       now)
+{
+    if( message->expires == 0 )
+    {
+        return 0;
+    }
+    if( *now == 0 )
+    {
+        *now = monotonicNow();
+    }
+    return message->expires <= *now;
+}
+
+/* Counts and reports a dropped message, queue has to be locked */
+static void dropMessage(nmqueue_t*                      queue,
+                        const struct nmqueue_message_s* message,
+                        int                             reason)
+{
+    if( reason == NMQUEUE_DROP_EXPIRED )
+    {
+        queue->drops.expired++;
+    }
+    else if( reason == NMQUEUE_DROP_OVERSIZED )
+    {
+        queue->drops.oversized++;
+    }
+    else
+    {
+        queue->drops.overflow++;
+    }
+
+    if( queue->dropCallback != NULL )
+    {
+        (*queue->dropCallback)( message->source, message->data, message->dataSize, reason, queue->dropParam );
+    }
+
+    if( queue->skip != NULL )
+    {
+        (*queue->skip)( message->sequence, queue->skipParam );
+    }
+}
+
+/* Drops the oldest message together with the rest of its group,
+ * queue has to be locked and must not be empty */
+static void dropOldest(nmqueue_t* queue,
+                       uint64_t*  now)
+{
+    size_t parts = queue->queue[ queue->readPosition ].parts;
+
+    while( parts-- != 0 )
+    {
+        struct nmqueue_message_s* oldest = &queue->queue[ queue->readPosition ];
+
+        advanceHead( queue );
+        releaseCredit( queue, oldest );
+        dropMessage( queue, oldest,
+                     isExpired( oldest, now ) ? NMQUEUE_DROP_EXPIRED : NMQUEUE_DROP_OVERFLOW );
+    }
+}
+
+/* First of count messages whose source lacks a credit, count if all have one.
+ * Messages of the same source need a credit each. never is set if the
+ * limit is below what one source needs. Queue has to be locked. */
+static size_t lackingCredit(nmqueue_t*                      queue,
+                            const struct nmqueue_message_s* messages,
+                            size_t                          count,
+                            int*                            never)
+{
+    size_t i;
+    size_t j;
+
+    for( i=0 ; i<count ; ++i )
+    {
+        struct nmqueue_credit_s* credit = sourceCredit( queue, messages[i].source );
+        unsigned long            needed = 1;
+
+        if( credit == NULL )
+        {
+            continue;
+        }
+
+        for( j=0 ; j<i ; ++j )
+        {
+            if( messages[j].source == messages[i].source )
+            {
+                needed++;
+            }
+        }
+
+        if( credit->outstanding+needed > queue->creditLimit )
+        {
+            *never = needed > queue->creditLimit;
+            return i;
+        }
+    }
+
+    return count;
+}
+
+/* Appends a list of operations to another */
+static void appendOperations(struct nmqueue_async_s** list,
+                             struct nmqueue_async_s*  operations)
+{
+    while( *list != NULL )
+    {
+        list = &(*list)->next;
+    }
+    *list = operations;
+}
+
+/* Takes up to maxCount messages from the ring buffer, with group set
+ * exactly one group or single message. Sets err to ERROR_FULL if the
+ * first group exceeds maxCount. Expired messages are dropped on the way.
+ * Queue has to be locked. Returns the number taken, freed counts the freed slots. */
+static size_t takeMessages(nmqueue_t*                queue,
+                           struct nmqueue_message_s* messages,
+                           size_t                    maxCount,
+                           int                       group,
+                           uint64_t*                 now,
+                           size_t*                   freed,
+                           int*                      err)
+{
+    size_t taken = 0;
+
+    while( taken < maxCount && queue->readPosition != queue->writePosition )
+    {
+        struct nmqueue_message_s* message = &queue->queue[ queue->readPosition ];
+
+        /* Groups are not split, unless one alone exceeds maxCount */
+        if( message->parts > maxCount-taken && ( taken != 0 || group ) )
+        {
+            if( taken == 0 )
+            {
+                *err = NMQUEUEERROR_FULL;
+            }
+            break;
+        }
+
+        *freed += advanceHead( queue );
+        releaseCredit( queue, message );
+
+        if( isExpired( message, now ) )
+        {
+            dropMessage( queue, message, NMQUEUE_DROP_EXPIRED );
+        }
+        else
+        {
+            NMQUEUE_PROBE3( receive, queue, message->source, occupancyOf( queue ) );
+            messages[taken++] = *message;
+        }
+
+        /* A group receive ends with the last part */
+        if( group && taken != 0 && message->parts == 1 )
+        {
+            break;
+        }
+    }
+
+    return taken;
+}
+
+/* Completes suspended receive operations from the ring buffer after a
+ * group was written, group operations take the group as a whole, single
+ * ones a part each. Queue has to be locked. Returns the operations to resume. */
+static struct nmqueue_async_s* serveReceivers(nmqueue_t* queue)
+{
+    struct nmqueue_async_s* completed = NULL;
+    uint64_t                now       = 0;
+    size_t                  freed     = 0;
+
+    while( queue->asyncReceivers != NULL && queue->readPosition != queue->writePosition )
+    {
+        struct nmqueue_async_s* operation = queue->asyncReceivers;
+        int                     group     = operation->messages != NULL;
+        int                     err       = NMQUEUEERROR_NOERROR;
+        size_t                  taken;
+
+        taken = group ? takeMessages( queue, operation->messages, operation->maxCount, 1, &now, &freed, &err ) :
+                        takeMessages( queue, &operation->message, 1, 0, &now, &freed, &err );
+
+        /* Only expired messages */
+        if( taken == 0 && err == NMQUEUEERROR_NOERROR )
+        {
+            continue;
+        }
+
+        popOperation( &queue->asyncReceivers, &queue->asyncReceiversTail );
+        operation->count = taken;
+        operation->error = err;
+        appendOperations( &completed, operation );
+    }
+
+    NMQUEUE_INVARIANT( queue );
+
+    if( freed != 0 )
+    {
+        /* Same as receiveMessages */
+        unspillMessages( queue );
+        appendOperations( &completed, refillMessages( queue ) );
+        wakeSenders( queue );
+    }
+
+    return completed;
+}
+
+/* Sends count messages, blocks while full. Runs of messages fitting into
+ * the free slots are written within one lock acquisition.
+ * With group set, all messages are written at once into consecutive slots.
+ * With park set, a full queue suspends park instead of blocking, count must be 1. */
+static int sendMessages(nmqueue_t*                      queue,
+                        const struct nmqueue_message_s* messages,
+                        size_t                          count,
+                        size_t*                         sent,
+                        void*                           threadId,
+                        int                             group,
+                        struct nmqueue_async_s*         park)
+{
+    struct nmqueue_async_s* completed = NULL;
+    uint64_t                now       = 0;
+    int                     err       = NMQUEUEERROR_NOERROR;
+    size_t                  needed    = group ? count : 1;
+
+    assert( queue != NULL );
+    assert( park == NULL || count == 1 );
+    assert( needed < queue->length );
+    NMQUEUE_INVARIANT( queue );
+
+    *sent = 0;
+
+    pthread_mutex_lock( &queue->mutex );
+
+    /* aborted thread? */
+    if( park == NULL && waitlist_take_abort( &queue->aborts, threadId ) )
+    {
+        pthread_mutex_unlock(&queue->mutex);
+        return NMQUEUEERROR_ABORT;
+    }
+
+    while( *sent != count )
+    {
+        size_t written = 0;
+        int    spill   = 0;
+
+        /* Wait until the source has a credit and writting is possible */
+        for(;;)
+        {
+            int    never   = 0;
+            size_t lacking = group ? lackingCredit( queue, messages, count, &never ) :
+                             hasCredit( queue, messages[*sent].source ) ? count : *sent;
+
+            if( lacking != count )
+            {
+                struct nmqueue_credit_s* credit = sourceCredit( queue, messages[lacking].source );
+
+                if( never || park != NULL || queue->overflowPolicy != NMQUEUE_OVERFLOW_BLOCK )
+                {
+                    queue->drops.rejected++;
+                    err = NMQUEUEERROR_NOCREDIT;
+                    break;
+                }
+
+                NMQUEUE_PROBE3( block_full, queue, messages[lacking].source, occupancyOf( queue ) );
+
+                if( waitOn( queue, &credit->waiters, threadId, 1, NULL ) )
+                {
+                    err = NMQUEUEERROR_ABORT;
+                    break;
+                }
+            }
+            else
+            {
+                /* While messages are spilled, new ones are queued behind them */
+                if( spillPending( queue ) )
+                {
+                    unspillMessages( queue );
+                }
+
+                if( freeSlots( queue ) >= needed && !spillPending( queue ) )
+                {
+                    break;
+                }
+
+                if( queue->overflowPolicy == NMQUEUE_OVERFLOW_SPILL )
+                {
+                    spill = 1;
+                    break;
+                }
+
+                if( queue->overflowPolicy == NMQUEUE_OVERFLOW_OVERWRITE &&
+                    queue->readPosition != queue->writePosition )
+                {
+                    /* Drop the oldest message to make room */
+                    dropOldest( queue, &now );
+                    continue;
+                }
+
+                if( queue->overflowPolicy == NMQUEUE_OVERFLOW_REJECT )
+                {
+                    queue->drops.rejected++;
+                    err = NMQUEUEERROR_FULL;
+                    break;
+                }
+
+                if( park != NULL )
+                {
+                    pushOperation( &queue->asyncSenders, &queue->asyncSendersTail, park );
+                    err = NMQUEUEERROR_PENDING;
+                    break;
+                }
+
+                NMQUEUE_PROBE3( block_full, queue, messages[*sent].source, occupancyOf( queue ) );
+
+                if( waitOn( queue, &queue->senders, threadId, needed, NULL ) )
+                {
+                    err = NMQUEUEERROR_ABORT;
+                    break;
+                }
+            }
+        }
+
+        if( err == NMQUEUEERROR_ABORT )
+        {
+            struct nmqueue_credit_s* credit = sourceCredit( queue, messages[*sent].source );
+
+            /* A wakeup meant for this thread goes to the next one */
+            wakeSenders( queue );
+            if( credit != NULL && hasCredit( queue, messages[*sent].source ) )
+            {
+                waitlist_wake( &credit->waiters, 1 );
+            }
+        }
+
+        if( err != NMQUEUEERROR_NOERROR )
+        {
+            break;
+        }
+
+        if( spill )
+        {
+            size_t spilled = group ? count : 1;
+
+            if( (err=spillMessages( queue, &messages[*sent], spilled, group )) != NMQUEUEERROR_NOERROR )
+            {
+                queue->drops.rejected++;
+                break;
+            }
+            *sent += spilled;
+            continue;
+        }
+
+        /* Write messages while there is room, a group at once */
+        do
+        {
+            struct nmqueue_async_s* operation = group ?
+                storeMessage( queue, &messages[*sent], count-*sent, messages[0].expires, *sent == 0 ) :
+                storeMessage( queue, &messages[*sent], 1, messages[*sent].expires, 1 );
+
+            if( operation != NULL )
+            {
+                appendOperations( &completed, operation );
+            }
+            else
+            {
+                written++;
+            }
+            (*sent)++;
+        } while( *sent != count &&
+                 ( group || ( freeSlots( queue ) != 0 && hasCredit( queue, messages[*sent].source ) ) ) );
+
+        /* One receiver per message may continue */
+        if( written != 0 )
+        {
+            if( group )
+            {
+                appendOperations( &completed, serveReceivers( queue ) );
+            }
+            waitlist_wake( &queue->receivers, written );
+            notifyWaitsets( queue );
+        }
+    }
+
+    pthread_mutex_unlock(&queue->mutex);
+
+    resumeOperations( completed );
+
+    return err;
+
+}
+
+/* Single message wrapper around sendMessages */
+static int sendMessage(nmqueue_t*                      queue,
+                       const struct nmqueue_message_s* message,
+                       void*                           threadId,
+                       struct nmqueue_async_s*         park)
+{
+    size_t sent;
+    return sendMessages( queue, message, 1, &sent, threadId, 0, park );
+}
+
+int nmqueue_send(nmqueue_t* queue,
+                 source_t   source,
+                 void*      data,
+                 size_t     dataSize,
+                 void*      threadId)
+{
+    return nmqueue_send_ttl(queue, source, data, dataSize, 0, threadId);
+}
+
+int nmqueue_send_ttl(nmqueue_t* queue,
+                     source_t   source,
+                     void*      data,
+                     size_t     dataSize,
+                     uint64_t   timeToLive,
+                     void*      threadId)
+{
+    struct nmqueue_message_s message;
+
+    message.source   = source;
+    message.data     = data;
+    message.dataSize = dataSize;
+    message.expires  = timeToLive != 0 ? monotonicNow()+timeToLive : 0;
+
+    return sendMessage(queue, &message, threadId, NULL);
+}
+
+int nmqueue_send_batch(nmqueue_t*                      queue,
+                       const struct nmqueue_message_s* messages,
+                       size_t                          count,
+                       size_t*                         sent,
+                       void*                           threadId)
+{
+    return sendMessages(queue, messages, count, sent, threadId, 0, NULL);
+}
+
+int nmqueue_send_group(nmqueue_t*                      queue,
+                       const struct nmqueue_message_s* messages,
+                       size_t                          count,
+                       void*                           threadId)
+{
+    size_t sent;
+
+    assert( messages != NULL );
+    assert( count != 0 );
+
+    return sendMessages(queue, messages, count, &sent, threadId, 1, NULL);
+}
+
+/* Takes up to maxCount messages, blocks for the first one if block is set.
+ * Groups are only split if one alone exceeds maxCount, with group set
+ * exactly one group or single message is taken and ERROR_FULL returned
+ * if it exceeds maxCount.
+ * With park set, an empty queue suspends park instead of blocking.
+ * Expired messages are dropped on the way. */
+static int receiveMessages(nmqueue_t*                queue,
+                           struct nmqueue_message_s* messages,
+                           size_t                    maxCount,
+                           size_t*                   count,
+                           void*                     threadId,
+                           int                       block,
+                           int                       group,
+                           struct nmqueue_async_s*   park)
+{
+    size_t                  taken     = 0;
+    uint64_t                now       = 0;
+    int                     err       = NMQUEUEERROR_NOERROR;
+    struct nmqueue_async_s* completed = NULL;
+
+    assert( queue    != NULL );
+    assert( messages != NULL );
+    assert( maxCount != 0 );
+    assert( count    != NULL );
+    NMQUEUE_INVARIANT( queue );
+
+    pthread_mutex_lock( &queue->mutex );
+
+    /* aborted thread? */
+    if( park == NULL && waitlist_take_abort( &queue->aborts, threadId ) )
+    {
+        pthread_mutex_unlock(&queue->mutex);
+        return NMQUEUEERROR_ABORT;
+    }
+
+    for(;;)
+    {
+        size_t freed = 0;
+
+        /* Read all available messages up to maxCount */
+        taken = takeMessages( queue, messages, maxCount, group, &now, &freed, &err );
+
+        NMQUEUE_INVARIANT( queue );
+
+        if( freed != 0 )
+        {
+            /* Spilled messages take the freed slots first, then suspended send operations */
+            unspillMessages( queue );
+            appendOperations( &completed, refillMessages( queue ) );
+
+            /* Senders whose messages fit now may continue */
+            wakeSenders( queue );
+        }
+
+        if( taken != 0 || err != NMQUEUEERROR_NOERROR )
+        {
+            break;
+        }
+
+        /* Only expired messages, but refilled from suspended senders */
+        if( queue->readPosition != queue->writePosition )
+        {
+            continue;
+        }
+
+        /* Spilled messages left behind by a failed allocation */
+        if( spillPending( queue ) )
+        {
+            unspillMessages( queue );
+            if( queue->readPosition != queue->writePosition )
+            {
+                continue;
+            }
+        }
+
+        if( park != NULL )
+        {
+            pushOperation( &queue->asyncReceivers, &queue->asyncReceiversTail, park );
+            err = NMQUEUEERROR_PENDING;
+            break;
+        }
+
+        if( !block )
+        {
+            err = NMQUEUEERROR_EMPTY;
+            break;
+        }
+
+        NMQUEUE_PROBE2( block_empty, queue, occupancyOf( queue ) );
+
+        if( waitOn( queue, &queue->receivers, threadId, 1, NULL ) )
+        {
+            /* A wakeup meant for this thread goes to the next one */
+            if( queue->readPosition != queue->writePosition )
+            {
+                waitlist_wake( &queue->receivers, 1 );
+            }
+            err = NMQUEUEERROR_ABORT;
+            break;
+        }
+
+    }
+
+    pthread_mutex_unlock(&queue->mutex);
+
+    resumeOperations( completed );
+
+    *count = taken;
+
+    return err;
+
+}
+
+/* Single message wrapper around receiveMessages */
+static int receiveMessage(nmqueue_t* queue,
+                          source_t*  source,
+                          void**     data,
+                          size_t*    dataSize,
+                          void*      threadId,
+                          int        block)
+{
+    struct nmqueue_message_s message;
+    size_t                   count;
+    int                      err;
+
+    assert( source   != NULL );
+    assert( data     != NULL );
+    assert( dataSize != NULL );
+
+    if( (err=receiveMessages(queue, &message, 1, &count, threadId, block, 0, NULL)) != NMQUEUEERROR_NOERROR )
+    {
+        return err;
+    }
+
+    *source   = message.source;
+    *data     = message.data;
+    *dataSize = message.dataSize;
+
+    return NMQUEUEERROR_NOERROR;
+
+}
+
+int nmqueue_receive(nmqueue_t* queue,
+                    source_t*  source,
+                    void**     data,
+                    size_t*    dataSize,
+                    void*      threadId)
+{
+    return receiveMessage(queue, source, data, dataSize, threadId, 1);
+}
+
+int nmqueue_tryreceive(nmqueue_t* queue,
+                       source_t*  source,
+                       void**     data,
+                       size_t*    dataSize,
+                       void*      threadId)
+{
+    return receiveMessage(queue, source, data, dataSize, threadId, 0);
+}
+
+int nmqueue_receive_batch(nmqueue_t*                queue,
+                          struct nmqueue_message_s* messages,
+                          size_t                    maxCount,
+                          size_t*                   count,
+                          void*                     threadId)
+{
+    return receiveMessages(queue, messages, maxCount, count, threadId, 1, 0, NULL);
+}
+
+int nmqueue_tryreceive_batch(nmqueue_t*                queue,
+                             struct nmqueue_message_s* messages,
+                             size_t                    maxCount,
+                             size_t*                   count,
+                             void*                     threadId)
+{
+    return receiveMessages(queue, messages, maxCount, count, threadId, 0, 0, NULL);
+}
+
+int nmqueue_receive_group(nmqueue_t*                queue,
+                          struct nmqueue_message_s* messages,
+                          size_t                    maxCount,
+                          size_t*                   count,
+                          void*                     threadId)
+{
+    return receiveMessages(queue, messages, maxCount, count, threadId, 1, 1, NULL);
+}
+
+int nmqueue_tryreceive_group(nmqueue_t*                queue,
+                             struct nmqueue_message_s* messages,
+                             size_t                    maxCount,
+                             size_t*                   count,
+                             void*                     threadId)
+{
+    return receiveMessages(queue, messages, maxCount, count, threadId, 0, 1, NULL);
+}
+
+/* Oldest single message or first part of a group matching filter,
+ * queue has to be locked. Returns 0 if there is none. */
+static int findFiltered(nmqueue_t*              queue,
+                        const nmqueue_filter_t* filter,
+                        size_t*                 found)
+{
+    size_t position;
+    size_t age = 0;
+    size_t i;
+    int    any = 0;
+
+    /* A predicate can't use the index */
+    if( filter->sources == NULL )
+    {
+        for( position=queue->readPosition ; position != queue->writePosition ; position=(position+1) % queue->length )
+        {
+            if( queue->indexNext[position] != NMQUEUE_INDEX_NONE &&
+                (*filter->predicate)( queue->queue[position].source, filter->predicateParam ) )
+            {
+                *found = position;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    /* The first slot of the source in its bucket, the oldest of all sources wins */
+    for( i=0 ; i<filter->sourceCount ; ++i )
+    {
+        source_t source = filter->sources[i];
+
+        for( position=bucketOf( queue, source )->head ; position != NMQUEUE_INDEX_END ; position=queue->indexNext[position] )
+        {
+            if( queue->queue[position].source == source )
+            {
+                size_t distance = (position+queue->length-queue->readPosition) % queue->length;
+
+                if( !any || distance < age )
+                {
+                    *found = position;
+                    age    = distance;
+                    any    = 1;
+                }
+                break;
+            }
+        }
+    }
+
+    return any;
+}
+
+/* Takes parts slots from position on for a filtered receive, queue has to
+ * be locked. Slots behind the oldest message stay until it is received.
+ * Returns the number of freed slots. */
+static size_t takeSlots(nmqueue_t* queue,
+                        size_t     position,
+                        size_t     parts)
+{
+    size_t freed = 0;
+
+    if( position == queue->readPosition )
+    {
+        while( parts-- != 0 )
+        {
+            freed += advanceHead( queue );
+        }
+        return freed;
+    }
+
+    unindexSlot( queue, position );
+
+    while( parts-- != 0 )
+    {
+        queue->queue[position].parts = 0;
+        position = (position+1) % queue->length;
+    }
+
+    return 0;
+}
+
+/* Takes the oldest single message or group matching filter, blocks until
+ * there is one if block is set. Expired messages are dropped on the way. */
+static int receiveFiltered(nmqueue_t*                queue,
+                           const nmqueue_filter_t*   filter,
+                           struct nmqueue_message_s* messages,
+                           size_t                    maxCount,
+                           size_t*                   count,
+                           void*                     threadId,
+                           int                       block)
+{
+    size_t                  taken     = 0;
+    size_t                  freed     = 0;
+    uint64_t                now       = 0;
+    int                     err       = NMQUEUEERROR_NOERROR;
+    struct nmqueue_async_s* completed = NULL;
+
+    assert( queue    != NULL );
+    assert( filter   != NULL );
+    assert( filter->sources != NULL || filter->predicate != NULL );
+    assert( messages != NULL );
+    assert( maxCount != 0 );
+    assert( count    != NULL );
+    NMQUEUE_INVARIANT( queue );
+
+    pthread_mutex_lock( &queue->mutex );
+
+    /* aborted thread? */
+    if( waitlist_take_abort( &queue->aborts, threadId ) )
+    {
+        pthread_mutex_unlock(&queue->mutex);
+        return NMQUEUEERROR_ABORT;
+    }
+
+    for(;;)
+    {
+        size_t position;
+
+        if( findFiltered( queue, filter, &position ) )
+        {
+            size_t parts   = queue->queue[position].parts;
+            int    expired = isExpired( &queue->queue[position], &now );
+            size_t i;
+
+            if( !expired && parts > maxCount )
+            {
+                err = NMQUEUEERROR_FULL;
+                break;
+            }
+
+            for( i=0 ; i<parts ; ++i )
+            {
+                struct nmqueue_message_s* part = &queue->queue[ (position+i) % queue->length ];
+
+                releaseCredit( queue, part );
+
+                if( expired )
+                {
+                    dropMessage( queue, part, NMQUEUE_DROP_EXPIRED );
+                }
+                else
+                {
+                    NMQUEUE_PROBE3( receive, queue, part->source, occupancyOf( queue ) );
+                    messages[taken++] = *part;
+                }
+            }
+
+            freed += takeSlots( queue, position, parts );
+
+            if( !expired )
+            {
+                break;
+            }
+            continue;
+        }
+
+        if( !block )
+        {
+            err = NMQUEUEERROR_EMPTY;
+            break;
+        }
+
+        NMQUEUE_PROBE2( block_empty, queue, occupancyOf( queue ) );
+
+        if( waitOn( queue, &queue->filtered, threadId, 1, filter ) )
+        {
+            err = NMQUEUEERROR_ABORT;
+            break;
+        }
+    }
+
+    if( freed != 0 )
+    {
+        /* Same as receiveMessages */
+        unspillMessages( queue );
+        appendOperations( &completed, refillMessages( queue ) );
+        wakeSenders( queue );
+    }
+
+    pthread_mutex_unlock(&queue->mutex);
+
+    resumeOperations( completed );
+
+    *count = taken;
+
+    return err;
+}
+
+int nmqueue_drop_group(nmqueue_t* queue,
+                       size_t     maxCount)
+{
+    struct nmqueue_async_s* completed = NULL;
+    int                     err       = NMQUEUEERROR_EMPTY;
+
+    assert( queue != NULL );
+    NMQUEUE_INVARIANT( queue );
+
+    pthread_mutex_lock( &queue->mutex );
+
+    if( queue->readPosition != queue->writePosition &&
+        queue->queue[ queue->readPosition ].parts > maxCount )
+    {
+        size_t parts = queue->queue[ queue->readPosition ].parts;
+
+        while( parts-- != 0 )
+        {
+            struct nmqueue_message_s* part = &queue->queue[ queue->readPosition ];
+
+            advanceHead( queue );
+            releaseCredit( queue, part );
+            dropMessage( queue, part, NMQUEUE_DROP_OVERSIZED );
+        }
+
+        NMQUEUE_INVARIANT( queue );
+
+        unspillMessages( queue );
+        appendOperations( &completed, refillMessages( queue ) );
+        wakeSenders( queue );
+
+        err = NMQUEUEERROR_NOERROR;
+    }
+
+    pthread_mutex_unlock( &queue->mutex );
+
+    resumeOperations( completed );
+
+    return err;
+}
+
+int nmqueue_receive_filtered(nmqueue_t*                queue,
+                             const nmqueue_filter_t*   filter,
+                             struct nmqueue_message_s* messages,
+                             size_t                    maxCount,
+                             size_t*                   count,
+                             void*                     threadId)
+{
+    return receiveFiltered(queue, filter, messages, maxCount, count, threadId, 1);
+}
+
+int nmqueue_tryreceive_filtered(nmqueue_t*                queue,
+                                const nmqueue_filter_t*   filter,
+                                struct nmqueue_message_s* messages,
+                                size_t                    maxCount,
+                                size_t*                   count,
+                                void*                     threadId)
+{
+    return receiveFiltered(queue, filter, messages, maxCount, count, threadId, 0);
+}
+
+int nmqueue_placement(nmqueue_t* queue)
+{
+    assert( queue != NULL );
+
+    return queue->placement;
+}
+
+size_t nmqueue_occupancy(nmqueue_t* queue)
+{
+    size_t occupancy;
+
+    assert( queue != NULL );
+    NMQUEUE_INVARIANT( queue );
+
+    pthread_mutex_lock( &queue->mutex );
+    occupancy = occupancyOf( queue );
+    pthread_mutex_unlock( &queue->mutex );
+
+    return occupancy;
+}
+
+int nmqueue_send_async(nmqueue_t*              queue,
+                       struct nmqueue_async_s* operation)
+{
+    int err;
+
+    assert( operation != NULL );
+    assert( operation->resume != NULL );
+
+    /* Once parked, the operation belongs to the completing thread */
+    if( (err=sendMessage( queue, &operation->message, NULL, operation )) != NMQUEUEERROR_PENDING )
+    {
+        operation->error = err;
+    }
+    return err;
+}
+
+int nmqueue_receive_async(nmqueue_t*              queue,
+                          struct nmqueue_async_s* operation)
+{
+    size_t count;
+    int    err;
+
+    assert( operation != NULL );
+    assert( operation->resume != NULL );
+
+    operation->messages = NULL;
+    operation->maxCount = 1;
+
+    if( (err=receiveMessages( queue, &operation->message, 1, &count, NULL, 0, 0, operation )) != NMQUEUEERROR_PENDING )
+    {
+        operation->count = count;
+        operation->error = err;
+    }
+    return err;
+}
+
+int nmqueue_receive_group_async(nmqueue_t*                queue,
+                                struct nmqueue_async_s*   operation,
+                                struct nmqueue_message_s* messages,
+                                size_t                    maxCount)
+{
+    size_t count;
+    int    err;
+
+    assert( operation != NULL );
+    assert( operation->resume != NULL );
+    assert( messages != NULL );
+
+    operation->messages = messages;
+    operation->maxCount = maxCount;
+
+    if( (err=receiveMessages( queue, messages, maxCount, &count, NULL, 0, 1, operation )) != NMQUEUEERROR_PENDING )
+    {
+        operation->count = count;
+        operation->error = err;
+    }
+    return err;
+}
+
+/* Unlinks an operation from a pending operation list, returns 1 if found */
+static int removeOperation(struct nmqueue_async_s** head,
+                           struct nmqueue_async_s** tail,
+                           struct nmqueue_async_s*  operation)
+{
+    struct nmqueue_async_s* previous = NULL;
+    struct nmqueue_async_s* current  = *head;
+
+    while( current != NULL && current != operation )
+    {
+        previous = current;
+        current  = current->next;
+    }
+
+    if( current == NULL )
+    {
+        return 0;
+    }
+
+    if( previous != NULL )
+    {
+        previous->next = current->next;
+    }
+    else
+    {
+        *head = current->next;
+    }
+
+    if( *tail == current )
+    {
+        *tail = previous;
+    }
+
+    current->next = NULL;
+    return 1;
+}
+
+int nmqueue_cancel_async(nmqueue_t*              queue,
+                         struct nmqueue_async_s* operation)
+{
+    int cancelled;
+
+    assert( queue     != NULL );
+    assert( operation != NULL );
+
+    pthread_mutex_lock( &queue->mutex );
+
+    cancelled = removeOperation( &queue->asyncReceivers, &queue->asyncReceiversTail, operation ) ||
+                removeOperation( &queue->asyncSenders, &queue->asyncSendersTail, operation );
+
+    pthread_mutex_unlock( &queue->mutex );
+
+    if( cancelled )
+    {
+        operation->error = NMQUEUEERROR_ABORT;
+    }
+
+    return cancelled;
+}
+
+void nmqueue_set_overflow(nmqueue_t* queue,
+                          int        overflowPolicy)
+{
+    assert( queue != NULL );
+    assert( overflowPolicy >= NMQUEUE_OVERFLOW_BLOCK && overflowPolicy <= NMQUEUE_OVERFLOW_SPILL );
+
+    pthread_mutex_lock( &queue->mutex );
+    queue->overflowPolicy = overflowPolicy;
+
+    /* Blocked senders have to reconsider */
+    waitlist_wake( &queue->senders, WAITLIST_ALL );
+    {
+        size_t i;
+        for( i=0 ; i<queue->creditSources ; ++i )
+        {
+            waitlist_wake( &queue->credits[i].waiters, WAITLIST_ALL );
+        }
+    }
+    pthread_mutex_unlock( &queue->mutex );
+}
+
+int nmqueue_set_spill(nmqueue_t*           queue,
+                      const char*          path,
+                      size_t               spillSize,
+                      nmqueue_spillalloc_t spillAlloc,
+                      nmqueue_release_t    release,
+                      void*                spillParam)
+{
+    spillfile_t* spill;
+    int          err;
+
+    assert( queue != NULL );
+    assert( queue->spill == NULL );
+
+    spill = (spillfile_t*)malloc( sizeof(spillfile_t) );
+    if( spill == NULL )
+    {
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+
+    if( (err=spillfile_open( spill, path, spillSize )) != NMQUEUEERROR_NOERROR )
+    {
+        free( spill );
+        return err;
+    }
+
+    pthread_mutex_lock( &queue->mutex );
+    queue->spill        = spill;
+    queue->spillAlloc   = spillAlloc != NULL ? spillAlloc : spillMalloc;
+    queue->spillRelease = release != NULL ? release : spillFree;
+    queue->spillParam   = spillParam;
+    pthread_mutex_unlock( &queue->mutex );
+
+    nmqueue_set_overflow( queue, NMQUEUE_OVERFLOW_SPILL );
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+int nmqueue_set_credits(nmqueue_t*    queue,
+                        size_t        sourceCount,
+                        unsigned long limit)
+{
+    struct nmqueue_async_s*  completed;
+    struct nmqueue_credit_s* credits = NULL;
+    size_t                   sources = 0;
+    size_t                   position;
+
+    assert( queue != NULL );
+
+    if( sourceCount != 0 && limit != 0 )
+    {
+        credits = (struct nmqueue_credit_s*)malloc( sourceCount*sizeof(struct nmqueue_credit_s) );
+        if( credits == NULL )
+        {
+            return NMQUEUEERROR_OUTOFMEMORY;
+        }
+
+        for( sources=0 ; sources<sourceCount ; ++sources )
+        {
+            credits[sources].outstanding  = 0;
+            credits[sources].waiters.head = NULL;
+            credits[sources].waiters.tail = NULL;
+        }
+    }
+
+    pthread_mutex_lock( &queue->mutex );
+
+    /* Swap tables, the old one is destroyed below */
+    {
+        struct nmqueue_credit_s* swapCredits = queue->credits;
+        size_t                   swapSources = queue->creditSources;
+
+        queue->credits       = credits;
+        queue->creditSources = sources;
+        queue->creditLimit   = limit;
+
+        credits = swapCredits;
+        sources = swapSources;
+    }
+
+    /* Messages already queued use up credits */
+    for( position=queue->readPosition ; position!=queue->writePosition ; position=(position+1)%queue->length )
+    {
+        /* Not slots already taken by filtered receives */
+        if( queue->queue[position].parts != 0 )
+        {
+            takeCredit( queue, &queue->queue[position] );
+        }
+    }
+
+    if( spillPending( queue ) )
+    {
+        size_t offset = spillfile_first( queue->spill );
+
+        for( position=0 ; position<queue->spill->count ; ++position )
+        {
+            struct nmqueue_message_s spilled;
+
+            offset = spillfile_read( queue->spill, offset, &spilled );
+            takeCredit( queue, &spilled );
+        }
+    }
+
+    /* Waiting senders check the new limits, suspended ones are refilled */
+    for( position=0 ; position<sources ; ++position )
+    {
+        waitlist_wake( &credits[position].waiters, WAITLIST_ALL );
+    }
+    completed = refillMessages( queue );
+
+    pthread_mutex_unlock( &queue->mutex );
+
+    free( credits );
+    resumeOperations( completed );
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+void nmqueue_set_drop(nmqueue_t*     queue,
+                      nmqueue_drop_t dropCallback,
+                      void*          dropParam)
+{
+    assert( queue != NULL );
+
+    pthread_mutex_lock( &queue->mutex );
+    queue->dropCallback = dropCallback;
+    queue->dropParam    = dropParam;
+    pthread_mutex_unlock( &queue->mutex );
+}
+
+void nmqueue_get_drops(nmqueue_t*       queue,
+                       nmqueue_drops_t* drops)
+{
+    assert( queue != NULL );
+    assert( drops != NULL );
+
+    pthread_mutex_lock( &queue->mutex );
+    *drops = queue->drops;
+    pthread_mutex_unlock( &queue->mutex );
+}
+
+void nmqueue_set_tap(nmqueue_t*    queue,
+                     nmqueue_tap_t tap,
+                     void*         tapParam)
+{
+    assert( queue != NULL );
+
+    pthread_mutex_lock( &queue->mutex );
+    queue->tap      = tap;
+    queue->tapParam = tapParam;
+    pthread_mutex_unlock( &queue->mutex );
+}
+
+/* Sequence number of the oldest message in the ring, queue has to be locked */
+static uint64_t oldestSequence(nmqueue_t* queue)
+{
+    if( queue->readPosition == queue->writePosition )
+    {
+        return queue->sequence;
+    }
+    return queue->queue[ queue->readPosition ].sequence;
+}
+
+uint64_t nmqueue_sequence(nmqueue_t* queue)
+{
+    uint64_t sequence;
+
+    assert( queue != NULL );
+
+    pthread_mutex_lock( &queue->mutex );
+    sequence = oldestSequence( queue );
+    pthread_mutex_unlock( &queue->mutex );
+
+    return sequence;
+}
+
+void nmqueue_set_skip(nmqueue_t*     queue,
+                      nmqueue_skip_t skip,
+                      void*          skipParam,
+                      uint64_t       first)
+{
+    assert( queue != NULL );
+
+    pthread_mutex_lock( &queue->mutex );
+
+    queue->skip      = skip;
+    queue->skipParam = skipParam;
+
+    /* Catch up on messages which left since first was taken */
+    if( skip != NULL )
+    {
+        uint64_t oldest = oldestSequence( queue );
+
+        for( ; first < oldest ; ++first )
+        {
+            (*skip)( first, skipParam );
+        }
+    }
+
+    pthread_mutex_unlock( &queue->mutex );
+}
+
+int nmqueue_waitset_initialize(nmqueue_waitset_t* waitset)
+{
+    assert( waitset != NULL );
+
+    waitset->selectors.head  = NULL;
+    waitset->selectors.tail  = NULL;
+    waitset->generation      = 0;
+    waitset->aborts.threads  = NULL;
+    waitset->aborts.count    = 0;
+    waitset->aborts.capacity = 0;
+    waitset->rotation        = 0;
+
+    if( pthread_mutex_init( &waitset->mutex, NULL ) != 0 )
+    {
+        return NMQUEUEERROR_MUTEX_INITIALIZE_FAILED;
+    }
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+void nmqueue_waitset_finalize(nmqueue_waitset_t* waitset)
+{
+    assert( waitset != NULL );
+
+    free( waitset->aborts.threads );
+    pthread_mutex_destroy( &waitset->mutex );
+}
+
+int nmqueue_waitset_attach(nmqueue_waitset_t* waitset,
+                           nmqueue_t*         queue)
+{
+    struct nmqueue_waitlink_s* link;
+
+    assert( waitset != NULL );
+    assert( queue != NULL );
+
+    link = (struct nmqueue_waitlink_s*)malloc( sizeof(struct nmqueue_waitlink_s) );
+    if( link == NULL )
+    {
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+
+    link->waitset = waitset;
+
+    pthread_mutex_lock( &queue->mutex );
+    link->next      = queue->waitsets;
+    queue->waitsets = link;
+    pthread_mutex_unlock( &queue->mutex );
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+void nmqueue_waitset_detach(nmqueue_waitset_t* waitset,
+                            nmqueue_t*         queue)
+{
+    struct nmqueue_waitlink_s** link;
+
+    assert( waitset != NULL );
+    assert( queue != NULL );
+
+    pthread_mutex_lock( &queue->mutex );
+
+    for( link=&queue->waitsets ; *link != NULL ; link=&(*link)->next )
+    {
+        if( (*link)->waitset == waitset )
+        {
+            struct nmqueue_waitlink_s* found = *link;
+            *link = found->next;
+            free( found );
+            break;
+        }
+    }
+
+    pthread_mutex_unlock( &queue->mutex );
+}
+
+void nmqueue_waitset_abort(nmqueue_waitset_t* waitset,
+                           void*              threadId)
+{
+    assert( waitset != NULL );
+
+    pthread_mutex_lock( &waitset->mutex );
+    if( !waitlist_abort( &waitset->selectors, threadId ) )
+    {
+        waitlist_keep_abort( &waitset->aborts, threadId );
+    }
+    pthread_mutex_unlock( &waitset->mutex );
+}
+
+void nmqueue_waitset_clear_abort(nmqueue_waitset_t* waitset,
+                                 void*              threadId)
+{
+    assert( waitset != NULL );
+
+    pthread_mutex_lock( &waitset->mutex );
+    waitlist_take_abort( &waitset->aborts, threadId );
+    pthread_mutex_unlock( &waitset->mutex );
+}
+
+int nmqueue_select(nmqueue_waitset_t* waitset,
+                   nmqueue_t**        queues,
+                   size_t             count,
+                   int                priority,
+                   size_t*            index,
+                   source_t*          source,
+                   void**             data,
+                   size_t*            dataSize,
+                   void*              threadId)
+{
+    assert( waitset != NULL );
+    assert( queues != NULL );
+    assert( count != 0 );
+    assert( index != NULL );
+
+    for(;;)
+    {
+        unsigned long generation;
+        size_t        first;
+        size_t        i;
+        int           aborted;
+
+        /* Remember the generation before checking, a write in between is not lost */
+        pthread_mutex_lock( &waitset->mutex );
+
+        if( waitlist_take_abort( &waitset->aborts, threadId ) )
+        {
+            pthread_mutex_unlock( &waitset->mutex );
+            return NMQUEUEERROR_ABORT;
+        }
+
+        generation = waitset->generation;
+        first      = priority ? 0 : waitset->rotation++ % count;
+
+        pthread_mutex_unlock( &waitset->mutex );
+
+        /* A pending abort of a queue is returned by its tryreceive */
+        for( i=0 ; i<count ; ++i )
+        {
+            size_t current = (first+i) % count;
+            int    err     = nmqueue_tryreceive( queues[current], source, data, dataSize, threadId );
+
+            if( err != NMQUEUEERROR_EMPTY )
+            {
+                *index = current;
+                return err;
+            }
+        }
+
+        /* Everything empty, wait for a write or an abort on any queue */
+        pthread_mutex_lock( &waitset->mutex );
+
+        aborted = waitlist_take_abort( &waitset->aborts, threadId );
+
+        if( !aborted && waitset->generation == generation )
+        {
+            struct nmqueue_waiter_s waiter;
+
+            waiter.threadId = threadId;
+            waiter.needed   = 0;
+            waiter.filter   = NULL;
+
+            aborted = waitlist_block( &waitset->mutex, &waitset->selectors, &waiter ) && waiter.aborted;
+        }
+
+        pthread_mutex_unlock( &waitset->mutex );
+
+        if( aborted )
+        {
+            return NMQUEUEERROR_ABORT;
+        }
+    }
 }
@@ -2,6 +2,7 @@
 #define _NMQUEUE_HEADER_
 
 #include <pthread.h>
+#include <inttypes.h>
 
 /*! Error numbers */
 #define NMQUEUEERROR_NOERROR 0
@@ -9,10 +10,55 @@
 #define NMQUEUEERROR_CONDVAR_INITIALIZE_FAILED 2
 #define NMQUEUEERROR_OUTOFMEMORY 3
 #define NMQUEUEERROR_ABORT 4
-#define NMQUEUEERROR_MAX 4
+#define NMQUEUEERROR_EMPTY 5
+#define NMQUEUEERROR_FULL 6
+#define NMQUEUEERROR_PENDING 7
+#define NMQUEUEERROR_IO 8
+#define NMQUEUEERROR_NOCREDIT 9
+#define NMQUEUEERROR_TIMEOUT 10
+#define NMQUEUEERROR_MAX 10
+
+/*! Overflow policies, applied when a message is sent to a full queue */
+#define NMQUEUE_OVERFLOW_BLOCK     0 /*!< Block the sender until a slot is free */
+#define NMQUEUE_OVERFLOW_REJECT    1 /*!< Return ERROR_FULL, the new message is not queued */
+#define NMQUEUE_OVERFLOW_OVERWRITE 2 /*!< Drop the oldest message to make room */
+#define NMQUEUE_OVERFLOW_SPILL     3 /*!< Append to the spill file, see nmqueue_set_spill */
+
+/*! Ring buffer placement, requested by nmqueue_attr_t and applied where possible */
+#define NMQUEUE_ATTR_HUGEPAGES 1 /*!< Huge pages, MAP_HUGETLB or transparent huge pages */
+#define NMQUEUE_ATTR_PREFAULT  2 /*!< Touch every page at initialization */
+#define NMQUEUE_ATTR_LOCK      4 /*!< Lock the pages in memory with mlock */
+#define NMQUEUE_ATTR_NUMA      8 /*!< Bind the pages to numaNode with mbind */
+
+/*! Reasons passed to the drop callback */
+#define NMQUEUE_DROP_OVERFLOW  0 /*!< Overwritten by NMQUEUE_OVERFLOW_OVERWRITE */
+#define NMQUEUE_DROP_EXPIRED   1 /*!< Time to live exceeded before it was received */
+#define NMQUEUE_DROP_OVERSIZED 2 /*!< Part of a group too large for its receiver, see nmqueue_drop_group */
 
 typedef int source_t;
 
+/*! Callback for dropped messages, receives source, data, dataSize,
+ *  reason and the callback parameter. Called with the queue locked,
+ *  it must not call into the queue. */
+typedef void (*nmqueue_drop_t)(source_t, void*, size_t, int, void*);
+
+/*! Drop counters */
+typedef struct
+{
+    unsigned long overflow;  /*!< Messages overwritten by NMQUEUE_OVERFLOW_OVERWRITE */
+    unsigned long expired;   /*!< Messages dropped because of their time to live */
+    unsigned long rejected;  /*!< Sends rejected by NMQUEUE_OVERFLOW_REJECT or a full spill file */
+    unsigned long spilled;   /*!< Messages written to the spill file, not dropped */
+    unsigned long oversized; /*!< Parts of groups dropped by nmqueue_drop_group */
+} nmqueue_drops_t;
+
+/*! Initialization attributes, see nmqueue_initialize_attr */
+typedef struct
+{
+    int flags;    /*!< Requested NMQUEUE_ATTR_* */
+    int numaNode; /*!< Node for NMQUEUE_ATTR_NUMA */
+} nmqueue_attr_t;
+
 /*! Queue ring buffer entry */
 struct nmqueue_message_s
 {
@@ -20,6 +66,125 @@ struct nmqueue_message_s
     void*    data;
     size_t   dataSize;
     source_t source;
+    uint64_t expires; /*!< CLOCK_MONOTONIC time in µs after which the message is dropped, 0 for none */
+    uint64_t sequence; /*!< Assigned by the queue when sent, consecutive in queue order */
+    size_t   parts;    /*!< Assigned by the queue, parts of the group from this message on, 1 for single messages */
+};
+
+struct nmqueue_async_s;
+
+/*! Executor callback for asynchronous operations.
+ *  Receives the completed operation and the executor parameter and has to
+ *  call operation->resume(operation) on a thread of its choice. */
+typedef void (*nmqueue_executor_t)(struct nmqueue_async_s*, void*);
+
+/*! Asynchronous send or receive operation, owned by the caller */
+struct nmqueue_async_s
+{
+    struct nmqueue_message_s  message;                /*!< Message to send or received message */
+    struct nmqueue_message_s* messages;               /*!< Parts of a group receive, NULL for a single message */
+    size_t                    maxCount;               /*!< Capacity of messages */
+    size_t                    count;                  /*!< Parts received into messages */
+    int                       error;                  /*!< Result once resumed */
+    void (*resume)(struct nmqueue_async_s*);          /*!< Continuation, called once the operation completed */
+    void*                     param;                  /*!< User data, no meaning to the nmqueue implementation */
+    nmqueue_executor_t        executor;               /*!< Executor running resume, NULL to resume on the completing thread */
+    void*                     executorParam;          /*!< Parameter to executor */
+    struct nmqueue_async_s*   next;                   /*!< Pending operation list, used by nmqueue */
+};
+
+/*! Callback observing every message entering the queue, receives the
+ *  message and the callback parameter. Called with the queue locked in
+ *  queue order, it must not call into the queue. */
+typedef void (*nmqueue_tap_t)(const struct nmqueue_message_s*, void*);
+
+/*! Callback for sequence numbers of messages leaving the queue without
+ *  being received, receives the sequence number and the callback
+ *  parameter. Called with the queue locked, it must not call into the queue. */
+typedef void (*nmqueue_skip_t)(uint64_t, void*);
+
+/*! Allocates the buffer of a message read back from the spill file,
+ *  receives dataSize and the callback parameter. Returns NULL on failure.
+ *  Called with the queue locked, it must not call into the queue. */
+typedef void* (*nmqueue_spillalloc_t)(size_t, void*);
+
+/*! Releases the buffer of a message whose payload was written to the
+ *  spill file, receives source, data, dataSize and the callback parameter.
+ *  Called with the queue locked, it must not call into the queue. */
+typedef void (*nmqueue_release_t)(source_t, void*, size_t, void*);
+
+struct spillfile_s;
+
+/*! Predicate of a source filter, receives a source and the predicate
+ *  parameter and returns non zero for a match. Called with the queue
+ *  locked, it must not call into the queue. */
+typedef int (*nmqueue_predicate_t)(source_t, void*);
+
+/*! Source filter of nmqueue_receive_filtered, a set of sources or a predicate */
+typedef struct
+{
+    const source_t*     sources;        /*!< Matching sources, NULL to use predicate */
+    size_t              sourceCount;    /*!< Entries of sources, 1 for a single source */
+    nmqueue_predicate_t predicate;      /*!< Used without sources */
+    void*               predicateParam; /*!< Parameter to predicate */
+} nmqueue_filter_t;
+
+/*! Thread blocked on a queue, lives on the stack of the blocked thread */
+struct nmqueue_waiter_s
+{
+    pthread_cond_t*          cond;     /*!< Signaled to wake exactly this thread, owned by the thread */
+    void*                    threadId; /*!< Identifies the thread for nmqueue_abort */
+    size_t                   needed;   /*!< Free slots a blocked sender waits for */
+    const nmqueue_filter_t*  filter;   /*!< Sources a filtered receiver waits for, NULL for others */
+    int                      woken;    /*!< Set once a waker removed it from its list */
+    int                      aborted;  /*!< Set if the waker was nmqueue_abort */
+    struct nmqueue_waiter_s* next;     /*!< Next blocked thread of the list */
+};
+
+/*! Blocked threads, woken in FIFO order */
+struct nmqueue_waitlist_s
+{
+    struct nmqueue_waiter_s* head; /*!< Longest waiting thread, woken first */
+    struct nmqueue_waiter_s* tail; /*!< Last blocked thread */
+};
+
+/*! Aborts sent to threads which were not blocked at the time */
+struct nmqueue_aborts_s
+{
+    void** threads;  /*!< Threads to abort */
+    size_t count;    /*!< Entries in threads */
+    size_t capacity; /*!< Allocated entries of threads */
+};
+
+/*! Wakeup object shared by several queues, see nmqueue_select */
+typedef struct
+{
+    pthread_mutex_t           mutex;      /*!< Protects all fields */
+    struct nmqueue_waitlist_s selectors;  /*!< Threads blocked in nmqueue_select, all are woken per notification */
+    unsigned long             generation; /*!< Incremented on every notification */
+    struct nmqueue_aborts_s   aborts;     /*!< Aborts of threads which were not selecting */
+    size_t                    rotation;   /*!< First queue to check without priority */
+} nmqueue_waitset_t;
+
+/*! Registration of a waitset with a queue */
+struct nmqueue_waitlink_s
+{
+    nmqueue_waitset_t*         waitset; /*!< Registered waitset */
+    struct nmqueue_waitlink_s* next;    /*!< Next registration of the queue */
+};
+
+/*! Indexed slots of the sources of one hash bucket, in queue order */
+struct nmqueue_bucket_s
+{
+    size_t head; /*!< Oldest slot */
+    size_t tail; /*!< Newest slot */
+};
+
+/*! Credit state of one source */
+struct nmqueue_credit_s
+{
+    unsigned long             outstanding; /*!< Messages of the source in the ring buffer or spill file */
+    struct nmqueue_waitlist_s waiters;     /*!< Senders waiting for a credit of the source */
 };
 
 /*! Queue data structure */
@@ -28,11 +193,38 @@ typedef struct
    size_t readPosition;             /*!< Ring buffer read position, must be in 0..length-1 */
    size_t writePosition;            /*!< Ring buffer write position, must be in 0..length-1 */
    size_t length;                   /*!< Ring buffer size in elements */
-   void*  abort;                    /*!< Pointer to identify the thread to abort */
+   struct nmqueue_aborts_s aborts;  /*!< Threads to abort which were not blocked at the time */
    struct nmqueue_message_s* queue; /*!< Ring buffer */
+   size_t ringMapped;               /*!< Bytes mapped for the ring buffer, 0 if it is from malloc */
+   int    placement;                /*!< NMQUEUE_ATTR_* applied to the ring buffer */
    pthread_mutex_t    mutex;        /*!< Mutex, has to be locked for all ring buffer operations */
-   pthread_cond_t     writtenCond;  /*!< Condition to be signaled on every write */
-   pthread_cond_t     readCond;     /*!< Condition to be signaled on every read */ 
+   struct nmqueue_waitlist_s receivers; /*!< Receivers blocked on an empty queue, one is woken per write */
+   struct nmqueue_waitlist_s senders;   /*!< Senders blocked on a full queue, one is woken per read */
+   struct nmqueue_waitlist_s filtered;  /*!< Filtered receivers, one is woken per matching write */
+   size_t*            indexNext;      /*!< Per slot, next indexed slot of its bucket */
+   struct nmqueue_bucket_s* buckets;  /*!< Index of single messages and first parts of groups by source */
+   size_t             bucketMask;     /*!< Number of buckets-1, a power of two minus one */
+   int                overflowPolicy; /*!< One of NMQUEUE_OVERFLOW_* */
+   nmqueue_drop_t     dropCallback;   /*!< Called for every dropped message, may be NULL */
+   void*              dropParam;      /*!< Parameter to dropCallback */
+   nmqueue_drops_t    drops;          /*!< Drop counters */
+   nmqueue_tap_t      tap;            /*!< Called for every message entering the queue, may be NULL */
+   void*              tapParam;       /*!< Parameter to tap */
+   struct nmqueue_waitlink_s* waitsets; /*!< Waitsets notified on every write */
+   struct nmqueue_async_s* asyncReceivers;     /*!< Suspended receive operations, only while the ring is empty */
+   struct nmqueue_async_s* asyncReceiversTail; /*!< Last suspended receive operation */
+   struct nmqueue_async_s* asyncSenders;       /*!< Suspended send operations, only while the ring is full */
+   struct nmqueue_async_s* asyncSendersTail;   /*!< Last suspended send operation */
+   struct nmqueue_credit_s* credits;   /*!< creditSources entries, NULL without credit limits */
+   size_t             creditSources;   /*!< Sources 0..creditSources-1 are limited */
+   unsigned long      creditLimit;     /*!< Maximum messages of one limited source in the ring buffer */
+   uint64_t           sequence;        /*!< Sequence number of the next message */
+   nmqueue_skip_t     skip;            /*!< Called for every dropped message, may be NULL */
+   void*              skipParam;       /*!< Parameter to skip */
+   struct spillfile_s* spill;          /*!< Overflow storage behind the ring buffer, NULL without */
+   nmqueue_spillalloc_t spillAlloc;    /*!< Allocates payloads read back from spill */
+   nmqueue_release_t  spillRelease;    /*!< Releases payloads written to spill */
+   void*              spillParam;      /*!< Parameter to spillAlloc and spillRelease */
 } nmqueue_t;
 
 /*!
@@ -50,6 +242,38 @@ typedef struct
 int nmqueue_initialize(nmqueue_t* queue,
                        size_t     length);
 
+/*!
+ * \brief Initialize message queue with placement attributes.
+ * 
+ * Same as nmqueue_initialize, but the ring buffer is mapped as requested
+ * by attr to avoid page faults and TLB misses during traffic. Every
+ * attribute is applied if possible and silently left out otherwise:
+ * huge pages fall back from MAP_HUGETLB to transparent huge pages to
+ * normal pages, mlock and mbind may lack permission or support.
+ * nmqueue_placement tells what was applied. Transparent huge pages are
+ * requested for a huge page aligned range with madvise, the kernel still
+ * decides whether it backs the range with huge pages.
+ * 
+ * \param queue  Pointer to a not initialized instance of nmqueue_t
+ * \param length Length of the bounded ring buffer, not 0
+ * \param attr   Requested placement, NULL to allocate with malloc
+ * 
+ * \return      Error code, ERROR_NOERROR on success.
+ */
+
+int nmqueue_initialize_attr(nmqueue_t*            queue,
+                            size_t                length,
+                            const nmqueue_attr_t* attr);
+
+/*!
+ * \brief Placement of the ring buffer.
+ * 
+ * \param queue Pointer to an initialized instance of nmqueue_t
+ * \return      NMQUEUE_ATTR_* applied at initialization
+ */
+
+int nmqueue_placement(nmqueue_t* queue);
+
 /*!
  * \brief Finalize message queue.
  * 
@@ -64,7 +288,9 @@ void nmqueue_finalize(nmqueue_t* queue);
  * \brief Send abort message to one blocked thread.
  * 
  * Sends an abort message to one blocked thread.
- * This will wakeup every thread working on the queue for a short moment.
+ * Only the specified thread is woken, if it is blocked. Otherwise the
+ * abort is kept until its next call, aborts for several threads may be
+ * pending at once.
  * Will cause the nmqueue_send and nmqueue_receive to return ERROR_ABORT
  * in the specified thread once.
  * 
@@ -74,6 +300,21 @@ void nmqueue_finalize(nmqueue_t* queue);
 void nmqueue_abort(nmqueue_t* queue,
                    void*      threadId);
 
+/*!
+ * \brief Drop a pending abort.
+ * 
+ * An abort sent to a thread which was not blocked stays pending until its
+ * next call. Threads which end without another call leave it behind, it
+ * would hit the next thread reusing the same threadId. Call this once the
+ * aborted thread ended.
+ * 
+ * \param queue    Pointer to an initialized instance of nmqueue_t
+ * \param threadId Thread passed to nmqueue_abort
+ */
+
+void nmqueue_clear_abort(nmqueue_t* queue,
+                         void*      threadId);
+
 /*!
  * \brief Blocking message send to queue.
  * 
@@ -81,6 +322,9 @@ void nmqueue_abort(nmqueue_t* queue,
  * If this buffer is full, send blocks. It waits for a signal from
  * a receiving thread or an abort signal to unblock.
  * An abort signal is indicated by ERROR_ABORT.
+ * With NMQUEUE_OVERFLOW_REJECT a full queue returns ERROR_FULL instead,
+ * with NMQUEUE_OVERFLOW_OVERWRITE the oldest message is dropped,
+ * with NMQUEUE_OVERFLOW_SPILL it is appended to the spill file.
  * 
  * \param queue    Pointer to an initialized instance of nmqueue_t
  * \param source   Any source_t
@@ -95,6 +339,74 @@ int nmqueue_send(nmqueue_t* queue,
                  size_t     dataSize,
                  void*      threadId);
 
+/*!
+ * \brief Blocking message send with time to live.
+ * 
+ * Same as nmqueue_send, but the message is dropped instead of received
+ * once it waited longer than timeToLive in the queue.
+ * 
+ * \param queue      Pointer to an initialized instance of nmqueue_t
+ * \param source     Any source_t
+ * \param data       Any void*
+ * \param dataSize   Any size_t
+ * \param timeToLive Time to live in µs, 0 for none
+ * \return           Error code, ERROR_NOERROR on success
+ */
+
+int nmqueue_send_ttl(nmqueue_t* queue,
+                     source_t   source,
+                     void*      data,
+                     size_t     dataSize,
+                     uint64_t   timeToLive,
+                     void*      threadId);
+
+/*!
+ * \brief Blocking send of several messages to queue.
+ * 
+ * Sends messages in order as if nmqueue_send was called for each,
+ * but writes as many as fit into the ring buffer within one lock
+ * acquisition and wakes receivers once per run.
+ * messages[i].expires has to be set, 0 for no time to live.
+ * On ERROR_FULL or ERROR_ABORT, sent tells how many messages went out.
+ * 
+ * \param queue    Pointer to an initialized instance of nmqueue_t
+ * \param messages Array of count messages
+ * \param count    Number of messages to send
+ * \param sent     Reference to a size_t, number of messages sent
+ * \return         Error code, ERROR_NOERROR on success
+ */
+
+int nmqueue_send_batch(nmqueue_t*                      queue,
+                       const struct nmqueue_message_s* messages,
+                       size_t                          count,
+                       size_t*                         sent,
+                       void*                           threadId);
+
+/*!
+ * \brief Blocking send of a multi-part message group.
+ * 
+ * Waits until count slots are free and all sources have their credits,
+ * then writes all parts into consecutive slots within one lock
+ * acquisition, no other message gets between them. Either all parts are
+ * sent or none. messages[0].expires applies to all parts, a group is
+ * dropped as a whole when overwritten. Receivers see the number of parts
+ * left in nmqueue_message_s::parts.
+ * nmqueue_receive_group, nmqueue_receive_group_async and batch receives
+ * hand out whole groups, nmqueue_receive and nmqueue_receive_async take
+ * the parts one by one.
+ * 
+ * \param queue    Pointer to an initialized instance of nmqueue_t
+ * \param messages Array of count parts
+ * \param count    Number of parts, less than the queue length
+ * \return         Error code, ERROR_NOERROR on success, ERROR_FULL or
+ *                 ERROR_NOCREDIT without blocking overflow policy
+ */
+
+int nmqueue_send_group(nmqueue_t*                      queue,
+                       const struct nmqueue_message_s* messages,
+                       size_t                          count,
+                       void*                           threadId);
+
 /*!
  * \brief Blocking message receive from queue.
  * 
@@ -102,6 +414,7 @@ int nmqueue_send(nmqueue_t* queue,
  * If no message is available, receive blocks. It waits for a signal from
  * a sending thread or an abort signal to unblock.
  * An abort signal is indicated by ERROR_ABORT.
+ * Expired messages are dropped instead of returned.
  * 
  * \param queue    Pointer to an initialized instance of nmqueue_t
  * \param source   Reference to a source_t
@@ -116,6 +429,500 @@ int nmqueue_receive(nmqueue_t* queue,
                     size_t*    dataSize,
                     void*      threadId);
 
+/*!
+ * \brief Blocking batch receive from queue.
+ * 
+ * Takes up to maxCount of the oldest messages from the bounded ring buffer
+ * within a single lock acquisition. If no message is available, receive
+ * blocks until at least one message arrives or an abort signal unblocks it.
+ * An abort signal is indicated by ERROR_ABORT.
+ * Message groups are not split, unless a group alone exceeds maxCount.
+ * 
+ * \param queue    Pointer to an initialized instance of nmqueue_t
+ * \param messages Array of at least maxCount entries, receives the messages
+ * \param maxCount Maximum number of messages to take, not 0
+ * \param count    Reference to a size_t, number of messages taken
+ * \return         Error code, ERROR_NOERROR on success
+ */
+
+int nmqueue_receive_batch(nmqueue_t*                queue,
+                          struct nmqueue_message_s* messages,
+                          size_t                    maxCount,
+                          size_t*                   count,
+                          void*                     threadId);
+
+/*!
+ * \brief Non blocking message receive from queue.
+ * 
+ * Same as nmqueue_receive, but returns ERROR_EMPTY instead of blocking
+ * if no message is available.
+ * 
+ * \param queue    Pointer to an initialized instance of nmqueue_t
+ * \param source   Reference to a source_t
+ * \param data     Reference to a void*
+ * \param dataSize Refence to a size_t
+ * \return         Error code, ERROR_NOERROR on success
+ */
+
+int nmqueue_tryreceive(nmqueue_t* queue,
+                       source_t*  source,
+                       void**     data,
+                       size_t*    dataSize,
+                       void*      threadId);
+
+/*!
+ * \brief Non blocking batch receive from queue.
+ * 
+ * Same as nmqueue_receive_batch, but returns ERROR_EMPTY instead of blocking
+ * if no message is available.
+ * 
+ * \param queue    Pointer to an initialized instance of nmqueue_t
+ * \param messages Array of at least maxCount entries, receives the messages
+ * \param maxCount Maximum number of messages to take, not 0
+ * \param count    Reference to a size_t, number of messages taken
+ * \return         Error code, ERROR_NOERROR on success
+ */
+
+int nmqueue_tryreceive_batch(nmqueue_t*                queue,
+                             struct nmqueue_message_s* messages,
+                             size_t                    maxCount,
+                             size_t*                   count,
+                             void*                     threadId);
+
+/*!
+ * \brief Blocking receive of one message group.
+ * 
+ * Takes all parts of the oldest group, or the oldest single message,
+ * within a single lock acquisition. Blocks while the queue is empty.
+ * 
+ * \param queue    Pointer to an initialized instance of nmqueue_t
+ * \param messages Array of at least maxCount entries, receives the parts
+ * \param maxCount Largest group expected, not 0
+ * \param count    Reference to a size_t, number of parts taken
+ * \return         Error code, ERROR_FULL if the group has more than
+ *                 maxCount parts, it stays in the queue
+ */
+
+int nmqueue_receive_group(nmqueue_t*                queue,
+                          struct nmqueue_message_s* messages,
+                          size_t                    maxCount,
+                          size_t*                   count,
+                          void*                     threadId);
+
+/*!
+ * \brief Non blocking receive of one message group.
+ * 
+ * Same as nmqueue_receive_group, but returns ERROR_EMPTY instead of
+ * blocking if no message is available.
+ * 
+ * \param queue    Pointer to an initialized instance of nmqueue_t
+ * \param messages Array of at least maxCount entries, receives the parts
+ * \param maxCount Largest group expected, not 0
+ * \param count    Reference to a size_t, number of parts taken
+ * \return         Error code, ERROR_NOERROR on success
+ */
+
+int nmqueue_tryreceive_group(nmqueue_t*                queue,
+                             struct nmqueue_message_s* messages,
+                             size_t                    maxCount,
+                             size_t*                   count,
+                             void*                     threadId);
+
+/*!
+ * \brief Drop the oldest group if it is too large to receive.
+ * 
+ * A group receive returns ERROR_FULL for a group with more than maxCount
+ * parts and leaves it in the queue. This drops all its parts with reason
+ * NMQUEUE_DROP_OVERSIZED, so the receiver can continue with the next
+ * message. Nothing happens if another receiver took the group meanwhile.
+ * 
+ * \param queue    Pointer to an initialized instance of nmqueue_t
+ * \param maxCount Largest group the receiver takes
+ * \return         Error code, ERROR_NOERROR if a group was dropped,
+ *                 ERROR_EMPTY if the oldest message is no such group
+ */
+
+int nmqueue_drop_group(nmqueue_t* queue,
+                       size_t     maxCount);
+
+/*!
+ * \brief Blocking receive of the oldest message of some sources.
+ * 
+ * Takes the oldest single message or group whose source matches filter,
+ * a group matches by the source of its first part. Older messages of
+ * other sources stay in the queue in order for other receivers, their
+ * slots are freed once those are received.
+ * A set of sources is looked up through a per source index of the ring
+ * buffer, a predicate is evaluated for every message from the oldest on.
+ * Blocks until a matching message is sent. Messages in a spill file are
+ * found once they are back in the ring buffer.
+ * 
+ * \param queue    Pointer to an initialized instance of nmqueue_t
+ * \param filter   Sources to receive, has to stay valid during the call
+ * \param messages Array of at least maxCount entries, receives the parts
+ * \param maxCount Largest group expected, not 0
+ * \param count    Reference to a size_t, number of parts taken
+ * \return         Error code, ERROR_FULL if the group has more than
+ *                 maxCount parts, it stays in the queue
+ */
+
+int nmqueue_receive_filtered(nmqueue_t*                queue,
+                             const nmqueue_filter_t*   filter,
+                             struct nmqueue_message_s* messages,
+                             size_t                    maxCount,
+                             size_t*                   count,
+                             void*                     threadId);
+
+/*!
+ * \brief Non blocking receive of the oldest message of some sources.
+ * 
+ * Same as nmqueue_receive_filtered, but returns ERROR_EMPTY instead of
+ * blocking if no message matches.
+ * 
+ * \param queue    Pointer to an initialized instance of nmqueue_t
+ * \param filter   Sources to receive
+ * \param messages Array of at least maxCount entries, receives the parts
+ * \param maxCount Largest group expected, not 0
+ * \param count    Reference to a size_t, number of parts taken
+ * \return         Error code, ERROR_NOERROR on success
+ */
+
+int nmqueue_tryreceive_filtered(nmqueue_t*                queue,
+                                const nmqueue_filter_t*   filter,
+                                struct nmqueue_message_s* messages,
+                                size_t                    maxCount,
+                                size_t*                   count,
+                                void*                     threadId);
+
+/*!
+ * \brief Asynchronous message send to queue.
+ * 
+ * Sends operation->message without blocking the calling thread.
+ * operation->message.expires has to be set, 0 for no time to live.
+ * If the ring buffer has space, the message is written immediately and
+ * ERROR_NOERROR is returned, resume is not called.
+ * Otherwise the operation is suspended and ERROR_PENDING is returned,
+ * unless the overflow policy rejects or overwrites.
+ * Once a receiver frees a slot the message is written and operation->resume
+ * is called through operation->executor.
+ * The operation must stay valid until it is resumed or cancelled.
+ * 
+ * \param queue     Pointer to an initialized instance of nmqueue_t
+ * \param operation Operation with message, resume and executor set
+ * \return          ERROR_NOERROR if completed, ERROR_PENDING if suspended
+ */
+
+int nmqueue_send_async(nmqueue_t*              queue,
+                       struct nmqueue_async_s* operation);
+
+/*!
+ * \brief Asynchronous message receive from queue.
+ * 
+ * Receives into operation->message without blocking the calling thread.
+ * If a message is available it is taken immediately and ERROR_NOERROR is
+ * returned, resume is not called.
+ * Otherwise the operation is suspended and ERROR_PENDING is returned.
+ * The next sent message is handed directly to the oldest suspended
+ * operation and operation->resume is called through operation->executor.
+ * The operation must stay valid until it is resumed or cancelled.
+ * 
+ * \param queue     Pointer to an initialized instance of nmqueue_t
+ * \param operation Operation with resume and executor set
+ * \return          ERROR_NOERROR if completed, ERROR_PENDING if suspended
+ */
+
+int nmqueue_receive_async(nmqueue_t*              queue,
+                          struct nmqueue_async_s* operation);
+
+/*!
+ * \brief Asynchronous receive of a multi-part message group.
+ * 
+ * Receives one group or single message into messages without blocking the
+ * calling thread, like nmqueue_receive_group. The number of parts is
+ * stored in operation->count.
+ * If the queue is empty the operation is suspended and ERROR_PENDING is
+ * returned. A group sent meanwhile is handed to the oldest suspended
+ * operation as a whole, never spread over several operations.
+ * A group exceeding maxCount is left in the queue and the operation is
+ * resumed with ERROR_FULL.
+ * The operation and messages must stay valid until it is resumed or cancelled.
+ * 
+ * \param queue     Pointer to an initialized instance of nmqueue_t
+ * \param operation Operation with resume and executor set
+ * \param messages  Array receiving the parts
+ * \param maxCount  Capacity of messages
+ * \return          ERROR_NOERROR if completed, ERROR_PENDING if suspended,
+ *                  ERROR_FULL if the group exceeds maxCount
+ */
+
+int nmqueue_receive_group_async(nmqueue_t*                queue,
+                                struct nmqueue_async_s*   operation,
+                                struct nmqueue_message_s* messages,
+                                size_t                    maxCount);
+
+/*!
+ * \brief Cancel a suspended asynchronous operation.
+ * 
+ * \param queue     Pointer to an initialized instance of nmqueue_t
+ * \param operation Operation passed to nmqueue_send_async or nmqueue_receive_async
+ * \return          1 if the operation was cancelled and will not be resumed,
+ *                  0 if it already completed
+ */
+
+int nmqueue_cancel_async(nmqueue_t*              queue,
+                         struct nmqueue_async_s* operation);
+
+/*!
+ * \brief Limit the number of undelivered messages per source.
+ * 
+ * Each source 0..sourceCount-1 may have at most limit messages in the
+ * ring buffer, other sources are not limited. The rest of the ring buffer
+ * stays shared. A sender whose source ran out of credits waits for a
+ * message of the same source to be received, independent of free slots.
+ * With NMQUEUE_OVERFLOW_REJECT or NMQUEUE_OVERFLOW_OVERWRITE and for
+ * asynchronous sends, ERROR_NOCREDIT is returned instead and the send is
+ * counted as rejected. A suspended asynchronous send is written once its
+ * source has a credit again, the ones suspended after it wait in order.
+ * Messages already in the ring buffer are counted. Senders waiting for a
+ * credit are woken to check the new limits.
+ * 
+ * \param queue       Pointer to an initialized instance of nmqueue_t
+ * \param sourceCount Number of limited sources, 0 to remove all limits
+ * \param limit       Credits per source, 0 to remove all limits
+ * \return            Error code, ERROR_NOERROR on success
+ */
+
+int nmqueue_set_credits(nmqueue_t*    queue,
+                        size_t        sourceCount,
+                        unsigned long limit);
+
+/*!
+ * \brief Set the overflow policy.
+ * 
+ * \param queue          Pointer to an initialized instance of nmqueue_t
+ * \param overflowPolicy One of NMQUEUE_OVERFLOW_*, NMQUEUE_OVERFLOW_BLOCK by default
+ */
+
+void nmqueue_set_overflow(nmqueue_t* queue,
+                          int        overflowPolicy);
+
+/*!
+ * \brief Spill overflowing messages to a file.
+ * 
+ * Creates the spill file and sets NMQUEUE_OVERFLOW_SPILL. Messages sent
+ * while the ring buffer is full, or while older messages are still in the
+ * spill file, are appended to it instead of blocking the sender. dataSize
+ * bytes of the payload are copied into the file and the data is handed to
+ * release. Messages with dataSize 0 keep their data pointer as is.
+ * Receivers free slots, which are refilled from the spill file in order
+ * with payloads copied into buffers from spillAlloc. Receivers can't tell
+ * spilled messages apart, so payloads should come from the same allocator.
+ * Groups are spilled and read back as a whole.
+ * If the spill file is full, the send fails with ERROR_FULL and is
+ * counted as rejected. Spilled messages count for nmqueue_set_credits but
+ * not for nmqueue_occupancy. May be called once, the file is removed by
+ * nmqueue_finalize.
+ * 
+ * \param queue      Pointer to an initialized instance of nmqueue_t
+ * \param path       Name of the spill file, an existing file is truncated
+ * \param spillSize  Size of the spill file, a multiple of the page size
+ * \param spillAlloc Allocator for read back payloads, NULL for malloc
+ * \param release    Called for spilled payloads, also with buffers of
+ *                   spillAlloc on errors, NULL for free
+ * \param spillParam Data passed to spillAlloc and release
+ * \return           Error code, ERROR_NOERROR on success
+ */
+
+int nmqueue_set_spill(nmqueue_t*           queue,
+                      const char*          path,
+                      size_t               spillSize,
+                      nmqueue_spillalloc_t spillAlloc,
+                      nmqueue_release_t    release,
+                      void*                spillParam);
+
+/*!
+ * \brief Set the drop callback.
+ * 
+ * The callback receives every overwritten or expired message, usually to
+ * release its data.
+ * 
+ * \param queue        Pointer to an initialized instance of nmqueue_t
+ * \param dropCallback Callback, NULL to disable
+ * \param dropParam    Data passed to dropCallback
+ */
+
+void nmqueue_set_drop(nmqueue_t*     queue,
+                      nmqueue_drop_t dropCallback,
+                      void*          dropParam);
+
+/*!
+ * \brief Read the drop counters.
+ * 
+ * \param queue Pointer to an initialized instance of nmqueue_t
+ * \param drops Reference to a nmqueue_drops_t
+ */
+
+void nmqueue_get_drops(nmqueue_t*       queue,
+                       nmqueue_drops_t* drops);
+
+/*!
+ * \brief Set the tap callback.
+ * 
+ * The tap observes every message entering the queue, for example to
+ * record traffic. It must be cheap since it runs inside the lock.
+ * 
+ * \param queue    Pointer to an initialized instance of nmqueue_t
+ * \param tap      Callback, NULL to disable
+ * \param tapParam Data passed to tap
+ */
+
+void nmqueue_set_tap(nmqueue_t*    queue,
+                     nmqueue_tap_t tap,
+                     void*         tapParam);
+
+/*!
+ * \brief Sequence number of the oldest message in the queue.
+ * 
+ * Every message gets the next sequence number when it is sent, starting
+ * at 0. Receivers find it in nmqueue_message_s::sequence.
+ * 
+ * \param queue Pointer to an initialized instance of nmqueue_t
+ * \return      Sequence number of the oldest message in the ring buffer,
+ *               or of the next message sent if it is empty
+ */
+
+uint64_t nmqueue_sequence(nmqueue_t* queue);
+
+/*!
+ * \brief Set the skip callback.
+ * 
+ * The callback learns about every sequence number which will never be
+ * received since its message was dropped. Together with the received
+ * sequence numbers this covers every sequence number without gaps, as
+ * needed to restore the order after parallel processing.
+ * Sequence numbers from first up to the oldest message in the queue are
+ * reported immediately, pass the result of an earlier nmqueue_sequence
+ * to also cover messages dropped in between.
+ * 
+ * \param queue     Pointer to an initialized instance of nmqueue_t
+ * \param skip      Callback, NULL to disable
+ * \param skipParam Data passed to skip
+ * \param first     First sequence number of interest
+ */
+
+void nmqueue_set_skip(nmqueue_t*     queue,
+                      nmqueue_skip_t skip,
+                      void*          skipParam,
+                      uint64_t       first);
+
+/*!
+ * \brief Initialize a waitset.
+ * 
+ * \param waitset Pointer to an uninitialized nmqueue_waitset_t
+ * \return        Error code, ERROR_NOERROR on success
+ */
+
+int nmqueue_waitset_initialize(nmqueue_waitset_t* waitset);
+
+/*!
+ * \brief Finalize a waitset, it must not be attached to any queue.
+ * 
+ * \param waitset Pointer to an initialized nmqueue_waitset_t
+ */
+
+void nmqueue_waitset_finalize(nmqueue_waitset_t* waitset);
+
+/*!
+ * \brief Register a waitset with a queue.
+ * 
+ * Every message written to the queue wakes threads selecting on the waitset.
+ * 
+ * \param waitset Pointer to an initialized nmqueue_waitset_t
+ * \param queue   Pointer to an initialized instance of nmqueue_t
+ * \return        Error code, ERROR_NOERROR on success
+ */
+
+int nmqueue_waitset_attach(nmqueue_waitset_t* waitset,
+                           nmqueue_t*         queue);
+
+/*!
+ * \brief Unregister a waitset from a queue.
+ * 
+ * \param waitset Pointer to an attached nmqueue_waitset_t
+ * \param queue   Pointer to an initialized instance of nmqueue_t
+ */
+
+void nmqueue_waitset_detach(nmqueue_waitset_t* waitset,
+                            nmqueue_t*         queue);
+
+/*!
+ * \brief Send abort message to one thread blocked in nmqueue_select.
+ * 
+ * If the thread is not selecting at the time, the abort is kept until
+ * its next nmqueue_select.
+ * 
+ * \param waitset  Pointer to an initialized nmqueue_waitset_t
+ * \param threadId Selecting thread to abort
+ */
+
+void nmqueue_waitset_abort(nmqueue_waitset_t* waitset,
+                           void*              threadId);
+
+/*!
+ * \brief Drop a pending waitset abort.
+ * 
+ * \param waitset  Pointer to an initialized nmqueue_waitset_t
+ * \param threadId Thread passed to nmqueue_waitset_abort
+ */
+
+void nmqueue_waitset_clear_abort(nmqueue_waitset_t* waitset,
+                                 void*              threadId);
+
+/*!
+ * \brief Blocking receive from the first of several queues with a message.
+ * 
+ * All queues must be attached to waitset. With priority set, queues are
+ * checked in array order, so earlier queues are served first. Otherwise the
+ * first queue checked rotates for fairness.
+ * Blocks on the waitset while all queues are empty, an abort signal through
+ * nmqueue_waitset_abort or nmqueue_abort on one of the queues unblocks it.
+ * An abort through a queue is taken when that queue is checked, a message
+ * found on a queue checked before it is returned first.
+ * 
+ * \param waitset  Pointer to an initialized nmqueue_waitset_t
+ * \param queues   Array of count queues
+ * \param count    Number of queues, not 0
+ * \param priority Nonzero to check queues in array order
+ * \param index    Reference to a size_t, index of the queue received from
+ * \param source   Reference to a source_t
+ * \param data     Reference to a void*
+ * \param dataSize Reference to a size_t
+ * \return         Error code, ERROR_NOERROR on success
+ */
+
+int nmqueue_select(nmqueue_waitset_t* waitset,
+                   nmqueue_t**        queues,
+                   size_t             count,
+                   int                priority,
+                   size_t*            index,
+                   source_t*          source,
+                   void**             data,
+                   size_t*            dataSize,
+                   void*              threadId);
+
+/*!
+ * \brief Number of messages waiting in the queue.
+ * 
+ * The value is a snapshot and may be outdated once returned.
+ * Slots taken by nmqueue_receive_filtered count until the messages
+ * before them are received.
+ * 
+ * \param queue Pointer to an initialized instance of nmqueue_t
+ * \return      Number of messages in the ring buffer
+ */
+
+size_t nmqueue_occupancy(nmqueue_t* queue);
+
 /*!
  * \brief Converts a nmqueue error to string.
  * 
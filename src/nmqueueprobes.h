@@ -0,0 +1,35 @@
+#ifndef _NMQUEUEPROBES_HEADER_
+#define _NMQUEUEPROBES_HEADER_
+
+/*
+ * USDT static tracepoints, provider "nmqueue". Built with NMQUEUE_USDT
+ * (set by the Makefile when sys/sdt.h is found) each probe is a nop until
+ * a tracer attaches, but its arguments are still computed, keep them
+ * cheap. Without NMQUEUE_USDT the probes vanish.
+ *
+ *   send(queue, source, occupancy)               message entered the queue
+ *   receive(queue, source, occupancy)            message was taken by a receiver
+ *   block_full(queue, source, occupancy)         sender blocks on a full queue or missing credit
+ *   block_empty(queue, occupancy)                receiver blocks on an empty queue
+ *   wakeup(queue, kind, waitNs, aborted)         blocked thread continues, kind 0 receiver,
+ *                                                1 sender, 2 credit, 3 filtered receiver
+ *   abort(queue, threadId, blocked)              nmqueue_abort, blocked 0 if it is kept pending
+ */
+
+#ifdef NMQUEUE_USDT
+
+#include <sys/sdt.h>
+
+#define NMQUEUE_PROBE2( name, a, b )       DTRACE_PROBE2( nmqueue, name, a, b )
+#define NMQUEUE_PROBE3( name, a, b, c )    DTRACE_PROBE3( nmqueue, name, a, b, c )
+#define NMQUEUE_PROBE4( name, a, b, c, d ) DTRACE_PROBE4( nmqueue, name, a, b, c, d )
+
+#else
+
+#define NMQUEUE_PROBE2( name, a, b )       do{}while(0)
+#define NMQUEUE_PROBE3( name, a, b, c )    do{}while(0)
+#define NMQUEUE_PROBE4( name, a, b, c, d ) do{}while(0)
+
+#endif
+
+#endif
@@ -0,0 +1,196 @@
+#include "orderedreceiver.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+/* Records the first error and stops releasing, nothing after a sequence
+ * number the reorder buffer lost could be released any more */
+static void failDelivery(orderedreceiver_t* receiver,
+                         int                err)
+{
+    int noError = NMQUEUEERROR_NOERROR;
+
+    __atomic_compare_exchange_n( &receiver->error, &noError, err, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED );
+    reorderbuffer_abort( &receiver->reorder );
+}
+
+/* Skips a sequence number, stops the group if it cannot be recorded */
+static void skipSequence(orderedreceiver_t* receiver,
+                         uint64_t           sequence)
+{
+    int err;
+
+    if( (err=reorderbuffer_skip( &receiver->reorder, sequence )) != NMQUEUEERROR_NOERROR )
+    {
+        failDelivery( receiver, err );
+    }
+}
+
+/* Skip callback of the queue, forwards dropped sequence numbers */
+static void skipDropped(uint64_t sequence,
+                        void*    param)
+{
+    skipSequence( (orderedreceiver_t*)param, sequence );
+}
+
+/* Entry point for receiving threads */
+/* Processes batches and hands the results to the reorder buffer */
+static void* workerProc(void* workerT)
+{
+    struct orderedreceiver_worker_s* worker   = (struct orderedreceiver_worker_s*)workerT;
+    orderedreceiver_t*               receiver = worker->group;
+
+    for(;;)
+    {
+        size_t count;
+        size_t i;
+
+        if( nmqueue_receive_batch( receiver->queue, worker->batch, receiver->batchSize,
+                                   &count, worker ) != NMQUEUEERROR_NOERROR )
+        {
+            break;
+        }
+
+        for( i=0 ; i<count ; ++i )
+        {
+            struct nmqueue_message_s* message = &worker->batch[i];
+
+            if( (*receiver->process)( &message->source, &message->data, &message->dataSize,
+                                      receiver->processParam ) == ORDEREDRECEIVER_FORWARD )
+            {
+                if( reorderbuffer_complete( &receiver->reorder, message->sequence, message->source,
+                                            message->data, message->dataSize ) != NMQUEUEERROR_NOERROR )
+                {
+                    return NULL;
+                }
+            }
+            else
+            {
+                skipSequence( receiver, message->sequence );
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/* Entry point for the releasing thread */
+static void* releaserProc(void* receiverT)
+{
+    orderedreceiver_t* receiver = (orderedreceiver_t*)receiverT;
+
+    reorderbuffer_run( &receiver->reorder );
+
+    return NULL;
+}
+
+/* Stops and joins the started workers and the releaser */
+static void stopThreads(orderedreceiver_t* receiver)
+{
+    size_t i;
+
+    reorderbuffer_abort( &receiver->reorder );
+
+    for( i=0 ; i<receiver->count ; ++i )
+    {
+        nmqueue_abort( receiver->queue, &receiver->workers[i] );
+        pthread_join( receiver->workers[i].thread, NULL );
+        nmqueue_clear_abort( receiver->queue, &receiver->workers[i] );
+        free( receiver->workers[i].batch );
+    }
+    receiver->count = 0;
+
+    pthread_join( receiver->releaser, NULL );
+
+    nmqueue_set_skip( receiver->queue, NULL, NULL, 0 );
+}
+
+int orderedreceiver_initialize(orderedreceiver_t*        receiver,
+                               nmqueue_t*                queue,
+                               size_t                    receivers,
+                               size_t                    batchSize,
+                               size_t                    window,
+                               orderedreceiver_process_t process,
+                               void*                     processParam,
+                               receiver_dest_t           dest,
+                               void*                     destParam)
+{
+    uint64_t first;
+    int      err;
+
+    assert( receiver != NULL );
+    assert( queue != NULL );
+    assert( receivers != 0 );
+    assert( batchSize != 0 );
+    assert( process != NULL );
+
+    receiver->queue        = queue;
+    receiver->process      = process;
+    receiver->processParam = processParam;
+    receiver->count        = 0;
+    receiver->batchSize    = batchSize;
+    receiver->error        = NMQUEUEERROR_NOERROR;
+
+    receiver->workers = (struct orderedreceiver_worker_s*)malloc( receivers*sizeof(struct orderedreceiver_worker_s) );
+    if( receiver->workers == NULL )
+    {
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+
+    /* Start with the oldest message, drops until the skip callback is set are caught up */
+    first = nmqueue_sequence( queue );
+
+    if( (err=reorderbuffer_initialize( &receiver->reorder, window, first, dest, destParam )) != NMQUEUEERROR_NOERROR )
+    {
+        free( receiver->workers );
+        return err;
+    }
+
+    nmqueue_set_skip( queue, skipDropped, receiver, first );
+
+    if( pthread_create( &receiver->releaser, NULL, releaserProc, receiver ) != 0 )
+    {
+        nmqueue_set_skip( queue, NULL, NULL, 0 );
+        reorderbuffer_finalize( &receiver->reorder );
+        free( receiver->workers );
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+
+    while( receiver->count < receivers )
+    {
+        struct orderedreceiver_worker_s* worker = &receiver->workers[receiver->count];
+
+        worker->group = receiver;
+        worker->batch = (struct nmqueue_message_s*)malloc( batchSize*sizeof(struct nmqueue_message_s) );
+
+        if( worker->batch == NULL ||
+            pthread_create( &worker->thread, NULL, workerProc, worker ) != 0 )
+        {
+            free( worker->batch );
+            stopThreads( receiver );
+            reorderbuffer_finalize( &receiver->reorder );
+            free( receiver->workers );
+            return NMQUEUEERROR_OUTOFMEMORY;
+        }
+
+        receiver->count++;
+    }
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+void orderedreceiver_finalize(orderedreceiver_t* receiver)
+{
+    assert( receiver != NULL );
+
+    stopThreads( receiver );
+    reorderbuffer_finalize( &receiver->reorder );
+    free( receiver->workers );
+}
+
+int orderedreceiver_error(orderedreceiver_t* receiver)
+{
+    assert( receiver != NULL );
+
+    return __atomic_load_n( &receiver->error, __ATOMIC_ACQUIRE );
+}
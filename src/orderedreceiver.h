@@ -0,0 +1,92 @@
+#ifndef _ORDEREDRECEIVER_HEADER_
+#define _ORDEREDRECEIVER_HEADER_
+
+#include "reorderbuffer.h"
+
+/*! Results of the process callback */
+#define ORDEREDRECEIVER_FORWARD 0 /*!< Release the message to dest */
+#define ORDEREDRECEIVER_DROP    1 /*!< Discard the message, keeps its place in the order */
+
+/*! Callback processing a message in parallel.
+ *  May replace source, data and dataSize by the result, returns
+ *  ORDEREDRECEIVER_FORWARD or ORDEREDRECEIVER_DROP. */
+typedef int (*orderedreceiver_process_t)(source_t*, void**, size_t*, void*);
+
+struct orderedreceiver_s;
+
+/*! One receiving thread */
+struct orderedreceiver_worker_s
+{
+    struct orderedreceiver_s* group;  /*!< Owning group */
+    pthread_t                 thread; /*!< Thread */
+    struct nmqueue_message_s* batch;  /*!< batchSize messages */
+};
+
+/*! Receivers processing in parallel and releasing in send order */
+typedef struct orderedreceiver_s
+{
+    nmqueue_t*                       queue;        /*!< Queue */
+    orderedreceiver_process_t        process;      /*!< Parallel callback */
+    void*                            processParam; /*!< Parameter to process */
+    reorderbuffer_t                  reorder;      /*!< Restores the order */
+    struct orderedreceiver_worker_s* workers;      /*!< Receiving threads */
+    size_t                           count;        /*!< Number of started workers */
+    size_t                           batchSize;    /*!< Messages taken at once per worker */
+    pthread_t                        releaser;     /*!< Runs reorderbuffer_run */
+    int                              error;        /*!< First error that stopped the release, accessed atomically */
+} orderedreceiver_t;
+
+/*!
+ * \brief Create ordered receivers.
+ *
+ * receivers threads take messages from queue, call process for them in
+ * parallel and hand the results to a reorder buffer of window entries,
+ * which calls dest strictly in the order the messages were sent.
+ * Dropped messages of the queue and messages process dropped keep their
+ * place in the order. A worker more than window messages ahead of the
+ * oldest unfinished message waits.
+ * The group has to be the only receiver of queue.
+ *
+ * \param receiver     Pointer to an uninitialized orderedreceiver_t
+ * \param queue        Pointer to an initialized nmqueue_t
+ * \param receivers    Number of threads, not 0
+ * \param batchSize    Messages taken at once per thread, not 0
+ * \param window       Capacity of the reorder buffer, not 0
+ * \param process      Callback called in parallel
+ * \param processParam Data passed to process
+ * \param dest         Callback called in order
+ * \param destParam    Data passed to dest
+ * \return             Error code, ERROR_NOERROR on success
+ */
+int orderedreceiver_initialize(orderedreceiver_t*        receiver,
+                               nmqueue_t*                queue,
+                               size_t                    receivers,
+                               size_t                    batchSize,
+                               size_t                    window,
+                               orderedreceiver_process_t process,
+                               void*                     processParam,
+                               receiver_dest_t           dest,
+                               void*                     destParam);
+
+/*!
+ * \brief Stop all threads and destroy the group.
+ *
+ * Results not released yet are discarded.
+ *
+ * \param receiver Pointer to an initialized orderedreceiver_t
+ */
+void orderedreceiver_finalize(orderedreceiver_t* receiver);
+
+/*!
+ * \brief Error that stopped the ordered release.
+ *
+ * A sequence number the reorder buffer cannot record as skipped, e.g.
+ * for lack of memory, would hold back every later result. The group then
+ * stops releasing and its workers end, the error is kept here.
+ *
+ * \param receiver Pointer to an initialized orderedreceiver_t
+ * \return         ERROR_NOERROR while results are released, the first error otherwise
+ */
+int orderedreceiver_error(orderedreceiver_t* receiver);
+
+#endif
@@ -0,0 +1,333 @@
+#include "pipeline.h"
+
+#include <stdlib.h>
+#include <time.h>
+#include <assert.h>
+
+/* Monotonic time in ns */
+static uint64_t monotonicNanos(void)
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t)now.tv_sec*1000*1000*1000 + (uint64_t)now.tv_nsec;
+}
+
+/* First stage of the group stage belongs to */
+static size_t groupHead(pipeline_t* pipeline,
+                        size_t      stage)
+{
+    while( pipeline->stages[stage].fuse )
+    {
+        stage--;
+    }
+    return stage;
+}
+
+/* Runs a batch through one stage, keeps forwarded messages in order.
+ * Returns the number of forwarded messages. */
+static size_t runStage(struct pipeline_stage_s*  stage,
+                       struct nmqueue_message_s* batch,
+                       size_t                    count)
+{
+    size_t   i;
+    size_t   kept  = 0;
+    uint64_t start = monotonicNanos();
+    uint64_t busy;
+
+    for( i=0 ; i<count ; ++i )
+    {
+        if( (*stage->stage)( &batch[i].source, &batch[i].data, &batch[i].dataSize, stage->param ) == PIPELINE_FORWARD )
+        {
+            batch[kept++] = batch[i];
+        }
+    }
+
+    busy = monotonicNanos()-start;
+
+    pthread_mutex_lock( &stage->mutex );
+    stage->messages += count;
+    stage->dropped  += count-kept;
+    stage->busy     += busy;
+    pthread_mutex_unlock( &stage->mutex );
+
+    return kept;
+}
+
+/* Entry point for worker threads */
+/* Receives batches, runs them through the group and hands them on until aborted */
+static void* workerProc(void* workerT)
+{
+    struct pipeline_worker_s* worker   = (struct pipeline_worker_s*)workerT;
+    pipeline_t*               pipeline = worker->pipeline;
+    struct pipeline_stage_s*  head     = &pipeline->stages[worker->first];
+
+    for(;;)
+    {
+        size_t count;
+        size_t sent;
+        size_t occupancy;
+        size_t stage;
+
+        if( nmqueue_receive_batch( worker->input, worker->batch, pipeline->batchSize,
+                                   &count, worker ) != NMQUEUEERROR_NOERROR )
+        {
+            break;
+        }
+
+        /* Occupancy as seen by the arriving batch */
+        occupancy = count+nmqueue_occupancy( worker->input );
+
+        pthread_mutex_lock( &head->mutex );
+        head->occupancySum += occupancy;
+        head->occupancySamples++;
+        pthread_mutex_unlock( &head->mutex );
+
+        for( stage=worker->first ; stage<worker->last && count!=0 ; ++stage )
+        {
+            count = runStage( &pipeline->stages[stage], worker->batch, count );
+        }
+
+        if( worker->output != NULL && count != 0 &&
+            nmqueue_send_batch( worker->output, worker->batch, count, &sent, worker ) != NMQUEUEERROR_NOERROR )
+        {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/* Stops and joins all started workers, first to last */
+static void stopWorkers(pipeline_t* pipeline)
+{
+    size_t i;
+
+    for( i=0 ; i<pipeline->workerCount ; ++i )
+    {
+        struct pipeline_worker_s* worker = &pipeline->workers[i];
+
+        nmqueue_abort( worker->input, worker );
+        if( worker->output != NULL )
+        {
+            nmqueue_abort( worker->output, worker );
+        }
+        pthread_join( worker->thread, NULL );
+        nmqueue_clear_abort( worker->input, worker );
+        if( worker->output != NULL )
+        {
+            nmqueue_clear_abort( worker->output, worker );
+        }
+        free( worker->batch );
+    }
+
+    pipeline->workerCount = 0;
+}
+
+/* Undoes a failed pipeline_start, the pipeline can be started again */
+static void abortStart(pipeline_t* pipeline)
+{
+    stopWorkers( pipeline );
+    free( pipeline->workers );
+    pipeline->workers = NULL;
+    pipeline->started = 0;
+}
+
+int pipeline_initialize(pipeline_t* pipeline,
+                        size_t      queueLength,
+                        size_t      batchSize)
+{
+    assert( pipeline != NULL );
+    assert( queueLength >= 2 );
+    assert( batchSize != 0 );
+
+    pipeline->queueLength = queueLength;
+    pipeline->batchSize   = batchSize;
+    pipeline->stageCount  = 0;
+    pipeline->workers     = NULL;
+    pipeline->workerCount = 0;
+    pipeline->started     = 0;
+
+    return 0;
+}
+
+int pipeline_add_stage(pipeline_t*      pipeline,
+                       pipeline_stage_t stage,
+                       void*            param,
+                       size_t           threads,
+                       int              fuse)
+{
+    struct pipeline_stage_s* entry;
+
+    assert( pipeline != NULL );
+    assert( stage != NULL );
+    assert( pipeline->workers == NULL );
+
+    if( pipeline->stageCount == PIPELINE_MAXSTAGES )
+    {
+        return 1;
+    }
+
+    entry = &pipeline->stages[pipeline->stageCount];
+
+    entry->stage            = stage;
+    entry->param            = param;
+    entry->threads          = threads;
+    entry->fuse             = pipeline->stageCount != 0 && fuse;
+    entry->messages         = 0;
+    entry->dropped          = 0;
+    entry->busy             = 0;
+    entry->occupancySum     = 0;
+    entry->occupancySamples = 0;
+
+    assert( entry->fuse || threads != 0 );
+
+    if( pthread_mutex_init( &entry->mutex, NULL ) != 0 )
+    {
+        return 1;
+    }
+
+    if( !entry->fuse &&
+        nmqueue_initialize( &pipeline->queues[pipeline->stageCount], pipeline->queueLength ) != NMQUEUEERROR_NOERROR )
+    {
+        pthread_mutex_destroy( &entry->mutex );
+        return 1;
+    }
+
+    pipeline->stageCount++;
+
+    return 0;
+}
+
+int pipeline_start(pipeline_t* pipeline,
+                   nmqueue_t*  output)
+{
+    size_t first;
+    size_t total = 0;
+
+    assert( pipeline != NULL );
+    assert( pipeline->stageCount != 0 );
+    assert( pipeline->workers == NULL );
+
+    for( first=0 ; first<pipeline->stageCount ; ++first )
+    {
+        if( !pipeline->stages[first].fuse )
+        {
+            total += pipeline->stages[first].threads;
+        }
+    }
+
+    pipeline->workers = (struct pipeline_worker_s*)malloc( total*sizeof(struct pipeline_worker_s) );
+    if( pipeline->workers == NULL )
+    {
+        return 1;
+    }
+
+    pipeline->started = monotonicNanos();
+
+    first = 0;
+    while( first < pipeline->stageCount )
+    {
+        size_t last = first+1;
+        size_t i;
+
+        while( last < pipeline->stageCount && pipeline->stages[last].fuse )
+        {
+            last++;
+        }
+
+        for( i=0 ; i<pipeline->stages[first].threads ; ++i )
+        {
+            struct pipeline_worker_s* worker = &pipeline->workers[pipeline->workerCount];
+
+            worker->pipeline = pipeline;
+            worker->first    = first;
+            worker->last     = last;
+            worker->input    = &pipeline->queues[first];
+            worker->output   = last < pipeline->stageCount ? &pipeline->queues[last] : output;
+            worker->batch    = (struct nmqueue_message_s*)malloc( pipeline->batchSize*sizeof(struct nmqueue_message_s) );
+
+            if( worker->batch == NULL )
+            {
+                abortStart( pipeline );
+                return 1;
+            }
+
+            if( pthread_create( &worker->thread, NULL, workerProc, worker ) != 0 )
+            {
+                free( worker->batch );
+                abortStart( pipeline );
+                return 1;
+            }
+
+            pipeline->workerCount++;
+        }
+
+        first = last;
+    }
+
+    return 0;
+}
+
+nmqueue_t* pipeline_input(pipeline_t* pipeline)
+{
+    assert( pipeline != NULL );
+    assert( pipeline->stageCount != 0 );
+
+    return &pipeline->queues[0];
+}
+
+void pipeline_stats(pipeline_t*       pipeline,
+                    size_t            stage,
+                    pipeline_stats_t* stats)
+{
+    struct pipeline_stage_s* entry;
+    struct pipeline_stage_s* head;
+    double                   seconds;
+
+    assert( pipeline != NULL );
+    assert( stage < pipeline->stageCount );
+    assert( stats != NULL );
+
+    entry = &pipeline->stages[stage];
+    head  = &pipeline->stages[groupHead( pipeline, stage )];
+
+    pthread_mutex_lock( &entry->mutex );
+    stats->messages = entry->messages;
+    stats->dropped  = entry->dropped;
+    stats->busy     = entry->busy;
+    pthread_mutex_unlock( &entry->mutex );
+
+    pthread_mutex_lock( &head->mutex );
+    stats->occupancy = head->occupancySamples != 0 ? (double)head->occupancySum/head->occupancySamples : 0.0;
+    pthread_mutex_unlock( &head->mutex );
+
+    stats->elapsed     = pipeline->started != 0 ? monotonicNanos()-pipeline->started : 0;
+    seconds            = (double)stats->elapsed/(1000.0*1000.0*1000.0);
+    stats->throughput  = seconds > 0.0 ? stats->messages/seconds : 0.0;
+    stats->utilization = stats->elapsed != 0 ? (double)stats->busy/((double)stats->elapsed*head->threads) : 0.0;
+
+    /* Little's law: dwell = occupancy / arrival rate */
+    stats->dwell = stats->throughput > 0.0 ? stats->occupancy/stats->throughput*1000.0*1000.0 : 0.0;
+}
+
+void pipeline_finalize(pipeline_t* pipeline)
+{
+    size_t i;
+
+    assert( pipeline != NULL );
+
+    stopWorkers( pipeline );
+    free( pipeline->workers );
+    pipeline->workers = NULL;
+
+    for( i=0 ; i<pipeline->stageCount ; ++i )
+    {
+        if( !pipeline->stages[i].fuse )
+        {
+            nmqueue_finalize( &pipeline->queues[i] );
+        }
+        pthread_mutex_destroy( &pipeline->stages[i].mutex );
+    }
+
+    pipeline->stageCount = 0;
+}
@@ -0,0 +1,156 @@
+#ifndef _PIPELINE_HEADER_
+#define _PIPELINE_HEADER_
+
+#include "nmqueue.h"
+
+/*! Maximum number of stages of one pipeline */
+#define PIPELINE_MAXSTAGES 16
+
+/*! Stage results */
+#define PIPELINE_FORWARD 0 /*!< Pass the message on to the next stage */
+#define PIPELINE_DROP    1 /*!< Discard the message */
+
+/*! Stage function.
+ *  May modify source, data and dataSize in place before they are passed
+ *  on, returns PIPELINE_FORWARD or PIPELINE_DROP. */
+typedef int (*pipeline_stage_t)(source_t*, void**, size_t*, void*);
+
+/*! Statistics of one stage */
+typedef struct
+{
+    unsigned long messages;    /*!< Messages processed, including dropped ones */
+    unsigned long dropped;     /*!< Messages the stage returned PIPELINE_DROP for */
+    uint64_t      busy;        /*!< Time spent in the stage function in ns */
+    uint64_t      elapsed;     /*!< Time since pipeline_start in ns */
+    double        throughput;  /*!< Messages per second over elapsed */
+    double        utilization; /*!< busy divided by elapsed of all threads running the stage */
+    double        occupancy;   /*!< Mean occupancy of the input queue of the stage */
+    double        dwell;       /*!< Estimated time a message waits in the input queue in µs */
+} pipeline_stats_t;
+
+/*! A stage and its counters */
+struct pipeline_stage_s
+{
+    pipeline_stage_t stage;            /*!< Stage function */
+    void*            param;            /*!< Parameter to stage function */
+    size_t           threads;          /*!< Worker threads, taken from the first stage of a fused group */
+    int              fuse;             /*!< Runs on the threads of the previous stage */
+    pthread_mutex_t  mutex;            /*!< Protects the counters */
+    unsigned long    messages;         /*!< Messages processed */
+    unsigned long    dropped;          /*!< Messages dropped */
+    uint64_t         busy;             /*!< Time spent in the stage function in ns */
+    uint64_t         occupancySum;     /*!< Sum of sampled input occupancies */
+    unsigned long    occupancySamples; /*!< Number of occupancy samples */
+};
+
+struct pipeline_s;
+
+/*! A worker thread running a group of fused stages */
+struct pipeline_worker_s
+{
+    struct pipeline_s* pipeline; /*!< Owning pipeline */
+    size_t             first;    /*!< First stage of the group */
+    size_t             last;     /*!< One past the last stage of the group */
+    nmqueue_t*         input;    /*!< Queue the group receives from */
+    nmqueue_t*         output;   /*!< Queue the group sends to, NULL for none */
+    pthread_t          thread;   /*!< Thread */
+    struct nmqueue_message_s* batch; /*!< batchSize messages */
+};
+
+/*! Pipeline */
+typedef struct pipeline_s
+{
+    size_t                    queueLength;  /*!< Length of the queues between stages */
+    size_t                    batchSize;    /*!< Messages handed off at once */
+    struct pipeline_stage_s   stages[PIPELINE_MAXSTAGES]; /*!< Stages */
+    nmqueue_t                 queues[PIPELINE_MAXSTAGES]; /*!< Input queues, used for the first stage of each group only */
+    size_t                    stageCount;   /*!< Number of stages */
+    struct pipeline_worker_s* workers;      /*!< Worker threads */
+    size_t                    workerCount;  /*!< Number of started workers */
+    uint64_t                  started;      /*!< Monotonic time of pipeline_start in ns */
+} pipeline_t;
+
+/*!
+ * \brief Create an empty pipeline.
+ *
+ * The first stage receives from the input queue, see pipeline_input. Every
+ * stage not fused with its predecessor receives from its own queue of
+ * queueLength. Workers take up to batchSize messages at once, run them
+ * through all stages of their group and hand them to the next queue with
+ * a single nmqueue_send_batch.
+ *
+ * \param pipeline    Pointer to an uninitialized pipeline_t
+ * \param queueLength Length of the queues between stages, at least 2
+ * \param batchSize   Messages handed off at once, not 0
+ * \return            0 on success, 1 on error
+ */
+int pipeline_initialize(pipeline_t* pipeline,
+                        size_t      queueLength,
+                        size_t      batchSize);
+
+/*!
+ * \brief Append a stage.
+ *
+ * A fused stage runs on the threads of the previous stage directly after
+ * it, without a queue in between. Use this for cheap stages where the
+ * handoff costs more than the work. threads is ignored for fused stages.
+ * Stages can only be added before pipeline_start.
+ *
+ * \param pipeline Pointer to an initialized pipeline_t
+ * \param stage    Stage function
+ * \param param    Data passed to stage function
+ * \param threads  Worker threads for the stage, not 0
+ * \param fuse     1 to fuse with the previous stage, ignored for the first stage
+ * \return         0 on success, 1 on error
+ */
+int pipeline_add_stage(pipeline_t*      pipeline,
+                       pipeline_stage_t stage,
+                       void*            param,
+                       size_t           threads,
+                       int              fuse);
+
+/*!
+ * \brief Start the worker threads.
+ *
+ * Messages leaving the last stage are sent to output in batches.
+ *
+ * \param pipeline Pointer to an initialized pipeline_t with at least one stage
+ * \param output   Pointer to an initialized nmqueue_t, NULL to discard
+ * \return         0 on success, 1 on error
+ */
+int pipeline_start(pipeline_t* pipeline,
+                   nmqueue_t*  output);
+
+/*!
+ * \brief Queue feeding the first stage.
+ *
+ * \param pipeline Pointer to an initialized pipeline_t
+ * \return         Queue to send messages into the pipeline to
+ */
+nmqueue_t* pipeline_input(pipeline_t* pipeline);
+
+/*!
+ * \brief Statistics of one stage.
+ *
+ * Fused stages report the input queue of their group. Comparing
+ * utilization and dwell across stages points at the bottleneck.
+ *
+ * \param pipeline Pointer to a started pipeline_t
+ * \param stage    Index of the stage, in order of pipeline_add_stage
+ * \param stats    Reference to a pipeline_stats_t
+ */
+void pipeline_stats(pipeline_t*       pipeline,
+                    size_t            stage,
+                    pipeline_stats_t* stats);
+
+/*!
+ * \brief Stop all workers and destroy the pipeline.
+ *
+ * Stages are stopped from first to last. Messages still in the pipeline
+ * are discarded. The output queue is not touched.
+ *
+ * \param pipeline Pointer to an initialized pipeline_t
+ */
+void pipeline_finalize(pipeline_t* pipeline);
+
+#endif
@@ -0,0 +1,269 @@
+#include "receiverpool.h"
+
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include <assert.h>
+
+/* Receiver callback, counts and forwards to the pool callback */
+static void poolDest(source_t source,
+                     void*    data,
+                     size_t   dataSize,
+                     void*    param)
+{
+    struct receiverpool_slot_s* slot = (struct receiverpool_slot_s*)param;
+
+    __atomic_fetch_add( &slot->delivered, 1, __ATOMIC_RELAXED );
+    (*slot->pool->receiverDest)(source, data, dataSize, slot->pool->receiverDestParam);
+}
+
+/* Start one more receiver, monitor thread only */
+static int spawnReceiver(receiverpool_t* pool)
+{
+    struct receiverpool_slot_s* slot = &pool->slots[pool->count];
+
+    slot->pool          = pool;
+    slot->delivered     = 0;
+    slot->lastDelivered = 0;
+
+    if( initializeReceiver( &pool->receivers[pool->count], pool->queue, poolDest, slot ) != 0 )
+    {
+        return 1;
+    }
+
+    pthread_mutex_lock( &pool->mutex );
+    pool->count++;
+    pthread_mutex_unlock( &pool->mutex );
+
+    return 0;
+}
+
+/* Stop the most recently started receiver, monitor thread only */
+static void retireReceiver(receiverpool_t* pool)
+{
+    pthread_mutex_lock( &pool->mutex );
+    pool->count--;
+    pthread_mutex_unlock( &pool->mutex );
+
+    finalizeReceiver( &pool->receivers[pool->count] );
+}
+
+/* Messages delivered by all receivers since the last call */
+static unsigned long collectDelivered(receiverpool_t* pool)
+{
+    size_t        i;
+    unsigned long delivered = 0;
+
+    for( i=0 ; i<pool->count ; ++i )
+    {
+        unsigned long current = __atomic_load_n( &pool->slots[i].delivered, __ATOMIC_RELAXED );
+        delivered += current-pool->slots[i].lastDelivered;
+        pool->slots[i].lastDelivered = current;
+    }
+
+    return delivered;
+}
+
+/* Entry point for the monitor thread */
+/* Samples the queue and scales the receivers until shutdown */
+static void* monitorProc(void* poolT)
+{
+    receiverpool_t* pool = (receiverpool_t*)poolT;
+    unsigned long   busySamples = 0;
+    unsigned long   idleSamples = 0;
+    struct timespec deadline;
+
+    clock_gettime( CLOCK_MONOTONIC, &deadline );
+
+    pthread_mutex_lock( &pool->mutex );
+
+    while( !pool->terminated )
+    {
+        deadline.tv_sec  += pool->config.sampleInterval/(1000*1000);
+        deadline.tv_nsec += (pool->config.sampleInterval%(1000*1000))*1000;
+        if( deadline.tv_nsec >= 1000*1000*1000 )
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000*1000*1000;
+        }
+
+        while( !pool->terminated &&
+               pthread_cond_timedwait( &pool->terminateCond, &pool->mutex, &deadline ) != ETIMEDOUT );
+
+        if( pool->terminated )
+        {
+            break;
+        }
+
+        pthread_mutex_unlock( &pool->mutex );
+
+        /* Take a sample */
+        {
+            size_t        occupancy = nmqueue_occupancy( pool->queue );
+            unsigned long delivered = collectDelivered( pool );
+            int           busy      = occupancy > pool->config.highOccupancy;
+
+            /* Little's law: dwell = occupancy / delivery rate */
+            if( !busy && pool->config.highDwell != 0 && occupancy != 0 )
+            {
+                busy = delivered == 0 ||
+                       (double)occupancy*pool->config.sampleInterval/delivered > pool->config.highDwell;
+            }
+
+            if( busy )
+            {
+                idleSamples = 0;
+                if( ++busySamples >= pool->config.spawnSamples &&
+                    pool->count < pool->config.maxReceivers )
+                {
+                    spawnReceiver( pool );
+                    busySamples = 0;
+                }
+            }
+            else if( occupancy <= pool->config.lowOccupancy )
+            {
+                busySamples = 0;
+                if( ++idleSamples >= pool->config.retireSamples &&
+                    pool->count > pool->config.minReceivers )
+                {
+                    retireReceiver( pool );
+                    idleSamples = 0;
+                }
+            }
+            else
+            {
+                busySamples = 0;
+                idleSamples = 0;
+            }
+        }
+
+        pthread_mutex_lock( &pool->mutex );
+    }
+
+    pthread_mutex_unlock( &pool->mutex );
+
+    return NULL;
+}
+
+int receiverpool_initialize(receiverpool_t*             pool,
+                            nmqueue_t*                  queue,
+                            receiver_dest_t             receiverDest,
+                            void*                       receiverDestParam,
+                            const receiverpoolconfig_t* config)
+{
+    assert( pool   != NULL );
+    assert( queue  != NULL );
+    assert( config != NULL );
+    assert( config->minReceivers != 0 );
+    assert( config->minReceivers <= config->maxReceivers );
+    assert( config->lowOccupancy <= config->highOccupancy );
+    assert( config->sampleInterval != 0 );
+
+    pool->config            = *config;
+    pool->queue             = queue;
+    pool->receiverDest      = receiverDest;
+    pool->receiverDestParam = receiverDestParam;
+    pool->count             = 0;
+    pool->terminated        = 0;
+
+    pool->receivers = (receiverthread_t*)malloc( config->maxReceivers*sizeof(receiverthread_t) );
+    pool->slots     = (struct receiverpool_slot_s*)malloc( config->maxReceivers*sizeof(struct receiverpool_slot_s) );
+
+    if( pool->receivers == NULL || pool->slots == NULL )
+    {
+        free( pool->receivers );
+        free( pool->slots );
+        return 1;
+    }
+
+    if( pthread_mutex_init( &pool->mutex, NULL ) != 0 )
+    {
+        free( pool->receivers );
+        free( pool->slots );
+        return 1;
+    }
+
+    /* Sample deadlines are CLOCK_MONOTONIC */
+    {
+        pthread_condattr_t attr;
+        int                error = pthread_condattr_init( &attr );
+
+        if( error == 0 )
+        {
+            error = pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+            if( error == 0 )
+            {
+                error = pthread_cond_init( &pool->terminateCond, &attr );
+            }
+            pthread_condattr_destroy( &attr );
+        }
+
+        if( error != 0 )
+        {
+            pthread_mutex_destroy( &pool->mutex );
+            free( pool->receivers );
+            free( pool->slots );
+            return 1;
+        }
+    }
+
+    while( pool->count < config->minReceivers )
+    {
+        if( spawnReceiver( pool ) != 0 )
+        {
+            break;
+        }
+    }
+
+    if( pool->count < config->minReceivers ||
+        pthread_create( &pool->monitor, NULL, monitorProc, pool ) != 0 )
+    {
+        while( pool->count != 0 )
+        {
+            retireReceiver( pool );
+        }
+        pthread_cond_destroy( &pool->terminateCond );
+        pthread_mutex_destroy( &pool->mutex );
+        free( pool->receivers );
+        free( pool->slots );
+        return 1;
+    }
+
+    return 0;
+}
+
+size_t receiverpool_size(receiverpool_t* pool)
+{
+    size_t count;
+
+    assert( pool != NULL );
+
+    pthread_mutex_lock( &pool->mutex );
+    count = pool->count;
+    pthread_mutex_unlock( &pool->mutex );
+
+    return count;
+}
+
+void receiverpool_finalize(receiverpool_t* pool)
+{
+    assert( pool != NULL );
+
+    pthread_mutex_lock( &pool->mutex );
+    pool->terminated = 1;
+    pthread_cond_signal( &pool->terminateCond );
+    pthread_mutex_unlock( &pool->mutex );
+
+    pthread_join( pool->monitor, NULL );
+
+    while( pool->count != 0 )
+    {
+        retireReceiver( pool );
+    }
+
+    pthread_cond_destroy( &pool->terminateCond );
+    pthread_mutex_destroy( &pool->mutex );
+
+    free( pool->receivers );
+    free( pool->slots );
+}
@@ -0,0 +1,83 @@
+#ifndef _RECEIVERPOOL_HEADER_
+#define _RECEIVERPOOL_HEADER_
+
+#include "receiverthread.h"
+
+/*! Scaling parameters of a receiver pool */
+typedef struct
+{
+    size_t        minReceivers;   /*!< Receivers kept running at all times, not 0 */
+    size_t        maxReceivers;   /*!< Upper limit of receivers, at least minReceivers */
+    size_t        highOccupancy;  /*!< Occupancy above which the queue counts as busy */
+    size_t        lowOccupancy;   /*!< Occupancy at or below which the queue counts as idle */
+    unsigned long highDwell;      /*!< Estimated dwell time in µs above which the queue counts as busy, 0 to disable */
+    unsigned long sampleInterval; /*!< Time between two samples in µs */
+    unsigned long spawnSamples;   /*!< Consecutive busy samples before a receiver is spawned */
+    unsigned long retireSamples;  /*!< Consecutive idle samples before a receiver is retired */
+} receiverpoolconfig_t;
+
+struct receiverpool_s;
+
+/*! Per receiver bookkeeping, passed as parameter to the receiver thread */
+struct receiverpool_slot_s
+{
+    struct receiverpool_s* pool;          /*!< Owning pool */
+    unsigned long          delivered;     /*!< Messages delivered, atomic, written by the receiver only */
+    unsigned long          lastDelivered; /*!< delivered at the last sample */
+};
+
+/*! Receiver pool */
+typedef struct receiverpool_s
+{
+    receiverpoolconfig_t        config;            /*!< Scaling parameters */
+    nmqueue_t*                  queue;             /*!< Queue */
+    receiver_dest_t             receiverDest;      /*!< Callback */
+    void*                       receiverDestParam; /*!< Parameter to callback */
+    receiverthread_t*           receivers;         /*!< maxReceivers receiver threads */
+    struct receiverpool_slot_s* slots;             /*!< maxReceivers slots */
+    size_t                      count;             /*!< Running receivers */
+    pthread_t                   monitor;           /*!< Thread sampling the queue */
+    pthread_mutex_t             mutex;             /*!< Protects count and terminated */
+    pthread_cond_t              terminateCond;     /*!< Signaled on shutdown */
+    int                         terminated;        /*!< Indicates the monitor should shutdown */
+} receiverpool_t;
+
+/*!
+ * \brief Create receiver pool.
+ * 
+ * Starts minReceivers receiver threads and a monitor thread sampling the
+ * queue every sampleInterval. A receiver is spawned once the queue was busy
+ * for spawnSamples consecutive samples and retired once it was idle for
+ * retireSamples consecutive samples. Samples between the low and high
+ * watermark reset both counters.
+ * The dwell time is estimated as occupancy divided by the delivery rate.
+ * 
+ * \param pool              Pointer to an uninitialized receiverpool_t
+ * \param queue             Pointer to an initialized nmqueue_t
+ * \param receiverDest      Callback
+ * \param receiverDestParam Data passed to callback
+ * \param config            Scaling parameters, copied
+ * \return                  0 on success, 1 on error
+ */
+int receiverpool_initialize(receiverpool_t*             pool,
+                            nmqueue_t*                  queue,
+                            receiver_dest_t             receiverDest,
+                            void*                       receiverDestParam,
+                            const receiverpoolconfig_t* config);
+
+/*!
+ * \brief Number of running receivers.
+ * 
+ * \param pool Pointer to an initialized receiverpool_t
+ * \return     Number of receiver threads
+ */
+size_t receiverpool_size(receiverpool_t* pool);
+
+/*!
+ * \brief Destroy receiver pool and all its receivers.
+ * 
+ * \param pool Pointer to an initialized receiverpool_t
+ */
+void receiverpool_finalize(receiverpool_t* pool);
+
+#endif
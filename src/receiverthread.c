@@ -1,10 +1,13 @@
 #include "receiverthread.h"
 
+#include <stdlib.h>
+
 /* Entry point for receiver thread */
 /* Will forward received data until shutdown */
 static void * receiverProc(void * receiverT)
 {
     receiverthread_t* receiverThread=(receiverthread_t*) receiverT;
+    int               block = receiverThread->idle.config.kind == IDLESTRATEGY_BLOCK;
 
     while( !receiverThread->terminated )
     {
@@ -14,15 +17,32 @@ static void * receiverProc(void * receiverT)
 
         int err;
 
-        if( (err=nmqueue_receive(receiverThread->queue,
-                                 &source,
-                                 &data,
-                                 &dataSize,
-                                 receiverThread
-                                )) == 0 )
+        if( block )
+        {
+            err = nmqueue_receive(receiverThread->queue,
+                                  &source,
+                                  &data,
+                                  &dataSize,
+                                  receiverThread);
+        }
+        else
         {
+            err = nmqueue_tryreceive(receiverThread->queue,
+                                     &source,
+                                     &data,
+                                     &dataSize,
+                                     receiverThread);
+        }
+
+        if( err == 0 )
+        {
+            idlestrategy_reset( &receiverThread->idle );
             (*receiverThread->receiverDest)(source, data, dataSize, receiverThread->receiverDestParam);
         }
+        else if( err == NMQUEUEERROR_EMPTY )
+        {
+            idlestrategy_idle( &receiverThread->idle );
+        }
 
     }
 
@@ -30,24 +50,176 @@ static void * receiverProc(void * receiverT)
 
 }
 
-int initializeReceiver(receiverthread_t* receiverThread,
-                       nmqueue_t*        queue,
-                       receiver_dest_t   receiverDest,
-                       void*             receiverDestParam)
+/* Entry point for batch receiver thread */
+/* Will forward batches of received data until shutdown */
+static void * batchReceiverProc(void * receiverT)
+{
+    receiverthread_t* receiverThread=(receiverthread_t*) receiverT;
+    int               block = receiverThread->idle.config.kind == IDLESTRATEGY_BLOCK;
+
+    while( !receiverThread->terminated )
+    {
+        size_t count;
+        int    err;
+
+        if( receiverThread->group )
+        {
+            err = block ? nmqueue_receive_group(receiverThread->queue,
+                                                receiverThread->batch,
+                                                receiverThread->batchSize,
+                                                &count,
+                                                receiverThread)
+                        : nmqueue_tryreceive_group(receiverThread->queue,
+                                                   receiverThread->batch,
+                                                   receiverThread->batchSize,
+                                                   &count,
+                                                   receiverThread);
+        }
+        else if( block )
+        {
+            err = nmqueue_receive_batch(receiverThread->queue,
+                                        receiverThread->batch,
+                                        receiverThread->batchSize,
+                                        &count,
+                                        receiverThread);
+        }
+        else
+        {
+            err = nmqueue_tryreceive_batch(receiverThread->queue,
+                                           receiverThread->batch,
+                                           receiverThread->batchSize,
+                                           &count,
+                                           receiverThread);
+        }
+
+        if( err == 0 )
+        {
+            idlestrategy_reset( &receiverThread->idle );
+            (*receiverThread->receiverBatchDest)(receiverThread->batch, count, receiverThread->receiverDestParam);
+        }
+        else if( err == NMQUEUEERROR_FULL )
+        {
+            /* Group larger than the batch, it would block the queue forever */
+            nmqueue_drop_group( receiverThread->queue, receiverThread->batchSize );
+        }
+        else if( err == NMQUEUEERROR_EMPTY )
+        {
+            idlestrategy_idle( &receiverThread->idle );
+        }
+
+    }
+
+    return NULL;
+
+}
+
+/* Common initialization, batchSize 0 creates a single message receiver,
+ * group receives one message group per batch */
+static int startReceiver(receiverthread_t*     receiverThread,
+                         nmqueue_t*            queue,
+                         receiver_dest_t       receiverDest,
+                         receiver_batch_dest_t receiverBatchDest,
+                         void*                 receiverDestParam,
+                         size_t                batchSize,
+                         int                   group,
+                         const idleconfig_t*   idle)
 {
+    idleconfig_t blockConfig;
+
     receiverThread->queue        = queue;
     receiverThread->terminated   = 0;
 
     receiverThread->receiverDest      = receiverDest;
+    receiverThread->receiverBatchDest = receiverBatchDest;
     receiverThread->receiverDestParam = receiverDestParam;
+    receiverThread->batchSize         = batchSize;
+    receiverThread->batch             = NULL;
+    receiverThread->group             = group;
+
+    /* Receivers block inside the queue by default */
+    if( idle == NULL )
+    {
+        blockConfig.kind      = IDLESTRATEGY_BLOCK;
+        blockConfig.spinCount = 0;
+        blockConfig.minSleep  = 0;
+        blockConfig.maxSleep  = 0;
+        idle = &blockConfig;
+    }
+
+    if( batchSize != 0 )
+    {
+        receiverThread->batch = (struct nmqueue_message_s*)malloc( batchSize*sizeof(struct nmqueue_message_s) );
+        if( receiverThread->batch == NULL )
+        {
+            return 1;
+        }
+    }
 
-    if( pthread_create( &receiverThread->thread, NULL, receiverProc, receiverThread ) != 0 )
+    if( idlestrategy_initialize( &receiverThread->idle, idle ) != 0 )
     {
+        free( receiverThread->batch );
+        receiverThread->batch = NULL;
+        return 1;
+    }
+
+    if( pthread_create( &receiverThread->thread, NULL,
+                        batchSize != 0 ? batchReceiverProc : receiverProc,
+                        receiverThread ) != 0 )
+    {
+        idlestrategy_finalize( &receiverThread->idle );
+        free( receiverThread->batch );
+        receiverThread->batch = NULL;
         return 1;
     }
     return 0;
 }
 
+int initializeReceiver(receiverthread_t* receiverThread,
+                       nmqueue_t*        queue,
+                       receiver_dest_t   receiverDest,
+                       void*             receiverDestParam)
+{
+    return startReceiver(receiverThread, queue, receiverDest, NULL, receiverDestParam, 0, 0, NULL);
+}
+
+int initializeReceiverIdle(receiverthread_t*   receiverThread,
+                           nmqueue_t*          queue,
+                           receiver_dest_t     receiverDest,
+                           void*               receiverDestParam,
+                           const idleconfig_t* idle)
+{
+    return startReceiver(receiverThread, queue, receiverDest, NULL, receiverDestParam, 0, 0, idle);
+}
+
+int initializeBatchReceiver(receiverthread_t*     receiverThread,
+                            nmqueue_t*            queue,
+                            receiver_batch_dest_t receiverBatchDest,
+                            void*                 receiverDestParam,
+                            size_t                batchSize)
+{
+    return startReceiver(receiverThread, queue, NULL, receiverBatchDest, receiverDestParam, batchSize, 0, NULL);
+}
+
+int initializeBatchReceiverIdle(receiverthread_t*     receiverThread,
+                                nmqueue_t*            queue,
+                                receiver_batch_dest_t receiverBatchDest,
+                                void*                 receiverDestParam,
+                                size_t                batchSize,
+                                const idleconfig_t*   idle)
+{
+    return startReceiver(receiverThread, queue, NULL, receiverBatchDest, receiverDestParam, batchSize, 0, idle);
+}
+
+int initializeGroupReceiver(receiverthread_t*     receiverThread,
+                            nmqueue_t*            queue,
+                            receiver_batch_dest_t receiverBatchDest,
+                            void*                 receiverDestParam,
+                            size_t                maxParts,
+                            const idleconfig_t*   idle)
+{
+    return startReceiver(receiverThread, queue, NULL, receiverBatchDest, receiverDestParam, maxParts, 1, idle);
+}
+
 void finalizeReceiver(receiverthread_t* receiverThread)
 {
     receiverThread->terminated = 1;
@@ -55,6 +227,12 @@ void finalizeReceiver(receiverthread_t* receiverThread)
     nmqueue_abort( receiverThread->queue, receiverThread );
 
     pthread_join( receiverThread->thread, NULL );
+    nmqueue_clear_abort( receiverThread->queue, receiverThread );
+
+    idlestrategy_finalize( &receiverThread->idle );
+
+    free( receiverThread->batch );
+    receiverThread->batch = NULL;
 
     return;
 }
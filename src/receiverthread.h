@@ -2,17 +2,27 @@
 #define _RECEIVERTHREAD_HEADER_
 
 #include "nmqueue.h"
+#include "idlestrategy.h"
 
 /*! Callback function pointer for receiving thread. */
 typedef void (*receiver_dest_t)(source_t, void*, size_t, void*);
 
+/*! Callback function pointer for batch receiving thread.
+ *  Receives an array of messages and the number of entries. */
+typedef void (*receiver_batch_dest_t)(struct nmqueue_message_s*, size_t, void*);
+
 typedef struct
 {
-    pthread_t       thread;            /*!< Thread */
-    receiver_dest_t receiverDest;      /*!< Callback */
-    void*           receiverDestParam; /*!< Parameter to callback */
-    nmqueue_t*      queue;             /*!< Queue */
-    volatile int    terminated;        /*!< Indicates the thread should shutdown */
+    pthread_t             thread;            /*!< Thread */
+    receiver_dest_t       receiverDest;      /*!< Callback, NULL for batch receivers */
+    receiver_batch_dest_t receiverBatchDest; /*!< Batch callback, NULL for single message receivers */
+    void*                 receiverDestParam; /*!< Parameter to callback */
+    struct nmqueue_message_s* batch;         /*!< Batch buffer, NULL for single message receivers */
+    size_t                batchSize;         /*!< Number of entries in batch */
+    int                   group;             /*!< Batches are single message groups */
+    nmqueue_t*            queue;             /*!< Queue */
+    idlestrategy_t        idle;              /*!< Strategy used while the queue is empty */
+    volatile int          terminated;        /*!< Indicates the thread should shutdown */
 } receiverthread_t;
 
 /*!
@@ -32,6 +42,89 @@ int initializeReceiver(receiverthread_t* receiverThread,
                        receiver_dest_t   receiverDest,
                        void*             receiverDestParam);
 
+/*!
+ * \brief Create batch receiver thread.
+ * 
+ * Create a receiver thread which drains up to batchSize available messages
+ * per lock acquisition. receiverBatchDest will be called once for every
+ * drained batch. The message array is only valid during the callback.
+ * 
+ * \param receiverThread     Pointer to uninitialized receiverthread_t
+ * \param queue              Pointer to initialized nmqueue_t
+ * \param receiverBatchDest  Batch callback
+ * \param receiverDestParam  Data passed to callback
+ * \param batchSize          Maximum number of messages per batch, not 0
+ * \return                   0 on success, 1 on error
+ */
+int initializeBatchReceiver(receiverthread_t*     receiverThread,
+                            nmqueue_t*            queue,
+                            receiver_batch_dest_t receiverBatchDest,
+                            void*                 receiverDestParam,
+                            size_t                batchSize);
+
+/*!
+ * \brief Create receiver thread with an idle strategy.
+ * 
+ * Same as initializeReceiver. With IDLESTRATEGY_BLOCK the thread blocks
+ * inside nmqueue_receive while the queue is empty, any other strategy polls
+ * the queue with nmqueue_tryreceive and idles between empty polls.
+ * 
+ * \param receiverThread     Pointer to uninitialized receiverthread_t
+ * \param queue              Pointer to initialized nmqueue_t
+ * \param receiverDest       Callback
+ * \param receiverDestParam  Data passed to callback
+ * \param idle               Idle strategy configuration, NULL for IDLESTRATEGY_BLOCK
+ * \return                   0 on success, 1 on error
+ */
+int initializeReceiverIdle(receiverthread_t*   receiverThread,
+                           nmqueue_t*          queue,
+                           receiver_dest_t     receiverDest,
+                           void*               receiverDestParam,
+                           const idleconfig_t* idle);
+
+/*!
+ * \brief Create batch receiver thread with an idle strategy.
+ * 
+ * Same as initializeBatchReceiver, idle is handled as in initializeReceiverIdle.
+ * 
+ * \param receiverThread     Pointer to uninitialized receiverthread_t
+ * \param queue              Pointer to initialized nmqueue_t
+ * \param receiverBatchDest  Batch callback
+ * \param receiverDestParam  Data passed to callback
+ * \param batchSize          Maximum number of messages per batch, not 0
+ * \param idle               Idle strategy configuration, NULL for IDLESTRATEGY_BLOCK
+ * \return                   0 on success, 1 on error
+ */
+int initializeBatchReceiverIdle(receiverthread_t*     receiverThread,
+                                nmqueue_t*            queue,
+                                receiver_batch_dest_t receiverBatchDest,
+                                void*                 receiverDestParam,
+                                size_t                batchSize,
+                                const idleconfig_t*   idle);
+
+/*!
+ * \brief Create group receiver thread.
+ * 
+ * Same as initializeBatchReceiverIdle but every batch is exactly one message
+ * group as sent by nmqueue_send_group, or one single message. Groups with
+ * more than maxParts parts are dropped by nmqueue_drop_group, the drop
+ * callback of the queue sees them with reason NMQUEUE_DROP_OVERSIZED.
+ * 
+ * \param receiverThread     Pointer to uninitialized receiverthread_t
+ * \param queue              Pointer to initialized nmqueue_t
+ * \param receiverBatchDest  Batch callback, called once per group
+ * \param receiverDestParam  Data passed to callback
+ * \param maxParts           Maximum number of parts per group, not 0
+ * \param idle               Idle strategy configuration, NULL for IDLESTRATEGY_BLOCK
+ * \return                   0 on success, 1 on error
+ */
+int initializeGroupReceiver(receiverthread_t*     receiverThread,
+                            nmqueue_t*            queue,
+                            receiver_batch_dest_t receiverBatchDest,
+                            void*                 receiverDestParam,
+                            size_t                maxParts,
+                            const idleconfig_t*   idle);
+
 /*!
  * \brief Destroy receiver thread.
  * 
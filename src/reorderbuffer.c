@@ -0,0 +1,311 @@
+#include "reorderbuffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Entry of a sequence number within the window */
+static struct reorderbuffer_entry_s* entryOf(reorderbuffer_t* buffer,
+                                             uint64_t         sequence)
+{
+    return &buffer->entries[ sequence % buffer->capacity ];
+}
+
+/* Checks whether the next sequence number is done, buffer has to be locked */
+static int nextDone(reorderbuffer_t* buffer)
+{
+    if( entryOf( buffer, buffer->next )->state != REORDERBUFFER_EMPTY )
+    {
+        return 1;
+    }
+    return buffer->skipCount != 0 && buffer->skips[0].first == buffer->next;
+}
+
+/* Releases done sequence numbers in order, buffer has to be locked.
+ * The lock is dropped while dest runs, only one thread releases at a time. */
+static void releaseResults(reorderbuffer_t* buffer)
+{
+    int moved = 0;
+
+    if( buffer->releasing )
+    {
+        return;
+    }
+    buffer->releasing = 1;
+
+    while( nextDone( buffer ) )
+    {
+        struct reorderbuffer_entry_s* entry = entryOf( buffer, buffer->next );
+
+        buffer->next++;
+        moved = 1;
+
+        if( entry->state == REORDERBUFFER_READY )
+        {
+            source_t source   = entry->source;
+            void*    data     = entry->data;
+            size_t   dataSize = entry->dataSize;
+
+            entry->state = REORDERBUFFER_EMPTY;
+
+            /* Completes waiting for the window may go on meanwhile */
+            pthread_cond_broadcast( &buffer->windowCond );
+            moved = 0;
+
+            pthread_mutex_unlock( &buffer->mutex );
+            (*buffer->dest)( source, data, dataSize, buffer->destParam );
+            pthread_mutex_lock( &buffer->mutex );
+        }
+        else if( entry->state == REORDERBUFFER_SKIPPED )
+        {
+            entry->state = REORDERBUFFER_EMPTY;
+        }
+        else
+        {
+            /* Front of the skipped ranges */
+            if( buffer->skips[0].first++ == buffer->skips[0].last )
+            {
+                buffer->skipCount--;
+                memmove( buffer->skips, buffer->skips+1, buffer->skipCount*sizeof(struct reorderbuffer_range_s) );
+            }
+        }
+    }
+
+    if( moved )
+    {
+        pthread_cond_broadcast( &buffer->windowCond );
+    }
+
+    buffer->releasing = 0;
+}
+
+/* Adds a sequence number beyond the window to the sorted skipped ranges,
+ * buffer has to be locked */
+static int addSkip(reorderbuffer_t* buffer,
+                   uint64_t         sequence)
+{
+    size_t position = buffer->skipCount;
+
+    /* Usually the last range, queue drops arrive in ascending order */
+    while( position != 0 && buffer->skips[position-1].first > sequence )
+    {
+        position--;
+    }
+
+    /* Extend a neighbour */
+    if( position != 0 && buffer->skips[position-1].last+1 == sequence )
+    {
+        buffer->skips[position-1].last = sequence;
+
+        /* Closed the gap to the following range */
+        if( position != buffer->skipCount && buffer->skips[position].first == sequence+1 )
+        {
+            buffer->skips[position-1].last = buffer->skips[position].last;
+            buffer->skipCount--;
+            memmove( buffer->skips+position, buffer->skips+position+1,
+                     (buffer->skipCount-position)*sizeof(struct reorderbuffer_range_s) );
+        }
+        return NMQUEUEERROR_NOERROR;
+    }
+
+    if( position != buffer->skipCount && buffer->skips[position].first == sequence+1 )
+    {
+        buffer->skips[position].first = sequence;
+        return NMQUEUEERROR_NOERROR;
+    }
+
+    if( buffer->skipCount == buffer->skipCapacity )
+    {
+        size_t                        skipCapacity = buffer->skipCapacity != 0 ? 2*buffer->skipCapacity : 8;
+        struct reorderbuffer_range_s* skips        = (struct reorderbuffer_range_s*)realloc(
+            buffer->skips, skipCapacity*sizeof(struct reorderbuffer_range_s) );
+
+        if( skips == NULL )
+        {
+            return NMQUEUEERROR_OUTOFMEMORY;
+        }
+
+        buffer->skips        = skips;
+        buffer->skipCapacity = skipCapacity;
+    }
+
+    memmove( buffer->skips+position+1, buffer->skips+position,
+             (buffer->skipCount-position)*sizeof(struct reorderbuffer_range_s) );
+    buffer->skips[position].first = sequence;
+    buffer->skips[position].last  = sequence;
+    buffer->skipCount++;
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+int reorderbuffer_initialize(reorderbuffer_t* buffer,
+                             size_t           capacity,
+                             uint64_t         firstSequence,
+                             receiver_dest_t  dest,
+                             void*            destParam)
+{
+    size_t i;
+
+    assert( buffer != NULL );
+    assert( capacity != 0 );
+    assert( dest != NULL );
+
+    buffer->capacity     = capacity;
+    buffer->next         = firstSequence;
+    buffer->skips        = NULL;
+    buffer->skipCount    = 0;
+    buffer->skipCapacity = 0;
+    buffer->dest         = dest;
+    buffer->destParam    = destParam;
+    buffer->releasing    = 0;
+    buffer->aborted      = 0;
+
+    buffer->entries = (struct reorderbuffer_entry_s*)malloc( capacity*sizeof(struct reorderbuffer_entry_s) );
+    if( buffer->entries == NULL )
+    {
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+
+    for( i=0 ; i<capacity ; ++i )
+    {
+        buffer->entries[i].state = REORDERBUFFER_EMPTY;
+    }
+
+    if( pthread_mutex_init( &buffer->mutex, NULL ) != 0 )
+    {
+        free( buffer->entries );
+        return NMQUEUEERROR_MUTEX_INITIALIZE_FAILED;
+    }
+
+    if( pthread_cond_init( &buffer->windowCond, NULL ) != 0 )
+    {
+        pthread_mutex_destroy( &buffer->mutex );
+        free( buffer->entries );
+        return NMQUEUEERROR_CONDVAR_INITIALIZE_FAILED;
+    }
+
+    if( pthread_cond_init( &buffer->releaseCond, NULL ) != 0 )
+    {
+        pthread_cond_destroy( &buffer->windowCond );
+        pthread_mutex_destroy( &buffer->mutex );
+        free( buffer->entries );
+        return NMQUEUEERROR_CONDVAR_INITIALIZE_FAILED;
+    }
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+void reorderbuffer_finalize(reorderbuffer_t* buffer)
+{
+    assert( buffer != NULL );
+
+    pthread_cond_destroy( &buffer->releaseCond );
+    pthread_cond_destroy( &buffer->windowCond );
+    pthread_mutex_destroy( &buffer->mutex );
+
+    free( buffer->entries );
+    free( buffer->skips );
+}
+
+int reorderbuffer_complete(reorderbuffer_t* buffer,
+                           uint64_t         sequence,
+                           source_t         source,
+                           void*            data,
+                           size_t           dataSize)
+{
+    struct reorderbuffer_entry_s* entry;
+
+    assert( buffer != NULL );
+
+    pthread_mutex_lock( &buffer->mutex );
+
+    assert( sequence >= buffer->next );
+
+    /* Wait until the sequence number is within the window */
+    while( sequence-buffer->next >= buffer->capacity )
+    {
+        if( buffer->aborted )
+        {
+            pthread_mutex_unlock( &buffer->mutex );
+            return NMQUEUEERROR_ABORT;
+        }
+        pthread_cond_wait( &buffer->windowCond, &buffer->mutex );
+    }
+
+    entry = entryOf( buffer, sequence );
+
+    entry->state    = REORDERBUFFER_READY;
+    entry->source   = source;
+    entry->data     = data;
+    entry->dataSize = dataSize;
+
+    releaseResults( buffer );
+
+    pthread_mutex_unlock( &buffer->mutex );
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+int reorderbuffer_skip(reorderbuffer_t* buffer,
+                       uint64_t         sequence)
+{
+    assert( buffer != NULL );
+
+    pthread_mutex_lock( &buffer->mutex );
+
+    if( sequence < buffer->next )
+    {
+        /* Already behind */
+    }
+    else if( sequence-buffer->next < buffer->capacity )
+    {
+        entryOf( buffer, sequence )->state = REORDERBUFFER_SKIPPED;
+    }
+    else if( addSkip( buffer, sequence ) != NMQUEUEERROR_NOERROR )
+    {
+        pthread_mutex_unlock( &buffer->mutex );
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+
+    /* Nobody may be around to release what follows */
+    if( !buffer->releasing && nextDone( buffer ) )
+    {
+        pthread_cond_signal( &buffer->releaseCond );
+    }
+
+    pthread_mutex_unlock( &buffer->mutex );
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+void reorderbuffer_run(reorderbuffer_t* buffer)
+{
+    assert( buffer != NULL );
+
+    pthread_mutex_lock( &buffer->mutex );
+
+    while( !buffer->aborted )
+    {
+        if( !buffer->releasing && nextDone( buffer ) )
+        {
+            releaseResults( buffer );
+        }
+        else
+        {
+            pthread_cond_wait( &buffer->releaseCond, &buffer->mutex );
+        }
+    }
+
+    pthread_mutex_unlock( &buffer->mutex );
+}
+
+void reorderbuffer_abort(reorderbuffer_t* buffer)
+{
+    assert( buffer != NULL );
+
+    pthread_mutex_lock( &buffer->mutex );
+    buffer->aborted = 1;
+    pthread_cond_broadcast( &buffer->windowCond );
+    pthread_cond_broadcast( &buffer->releaseCond );
+    pthread_mutex_unlock( &buffer->mutex );
+}
@@ -0,0 +1,121 @@
+#ifndef _REORDERBUFFER_HEADER_
+#define _REORDERBUFFER_HEADER_
+
+#include "receiverthread.h"
+
+/*! Entry states */
+#define REORDERBUFFER_EMPTY   0 /*!< Not completed yet */
+#define REORDERBUFFER_READY   1 /*!< Completed, waiting for its predecessors */
+#define REORDERBUFFER_SKIPPED 2 /*!< Completed without result */
+
+/*! Result waiting for release */
+struct reorderbuffer_entry_s
+{
+    int      state;    /*!< One of REORDERBUFFER_* */
+    source_t source;   /*!< Result source */
+    void*    data;     /*!< Result data */
+    size_t   dataSize; /*!< Result dataSize */
+};
+
+/*! Skipped sequence numbers beyond the window, first..last */
+struct reorderbuffer_range_s
+{
+    uint64_t first; /*!< First skipped sequence number */
+    uint64_t last;  /*!< Last skipped sequence number */
+};
+
+/*! Bounded buffer releasing results in sequence order */
+typedef struct
+{
+    struct reorderbuffer_entry_s* entries;       /*!< capacity entries, sequence number modulo capacity */
+    size_t                        capacity;      /*!< Window size */
+    uint64_t                      next;          /*!< Sequence number released next */
+    struct reorderbuffer_range_s* skips;         /*!< Skipped ranges beyond the window, sorted */
+    size_t                        skipCount;     /*!< Entries in skips */
+    size_t                        skipCapacity;  /*!< Allocated entries of skips */
+    receiver_dest_t               dest;          /*!< Called in sequence order */
+    void*                         destParam;     /*!< Parameter to dest */
+    int                           releasing;     /*!< Set while a thread calls dest */
+    int                           aborted;       /*!< Set by reorderbuffer_abort */
+    pthread_mutex_t               mutex;         /*!< Protects all fields */
+    pthread_cond_t                windowCond;    /*!< Signaled when the window moves */
+    pthread_cond_t                releaseCond;   /*!< Signaled when a skip made results releasable */
+} reorderbuffer_t;
+
+/*!
+ * \brief Create reorder buffer.
+ *
+ * \param buffer        Pointer to an uninitialized reorderbuffer_t
+ * \param capacity      Window size, results more than capacity ahead of
+ *                      the next release wait, not 0
+ * \param firstSequence Sequence number released first
+ * \param dest          Called for every result in sequence order, by one thread at a time
+ * \param destParam     Data passed to dest
+ * \return              Error code, ERROR_NOERROR on success
+ */
+int reorderbuffer_initialize(reorderbuffer_t* buffer,
+                             size_t           capacity,
+                             uint64_t         firstSequence,
+                             receiver_dest_t  dest,
+                             void*            destParam);
+
+/*!
+ * \brief Destroy reorder buffer, unreleased results are discarded.
+ *
+ * \param buffer Pointer to an initialized reorderbuffer_t
+ */
+void reorderbuffer_finalize(reorderbuffer_t* buffer);
+
+/*!
+ * \brief Hand in the result of a sequence number.
+ *
+ * Blocks while sequence is capacity or more ahead of the next release.
+ * The calling thread may end up calling dest for this and following
+ * results.
+ *
+ * \param buffer   Pointer to an initialized reorderbuffer_t
+ * \param sequence Sequence number of the result
+ * \param source   Any source_t
+ * \param data     Any void*
+ * \param dataSize Any size_t
+ * \return         Error code, ERROR_ABORT after reorderbuffer_abort
+ */
+int reorderbuffer_complete(reorderbuffer_t* buffer,
+                           uint64_t         sequence,
+                           source_t         source,
+                           void*            data,
+                           size_t           dataSize);
+
+/*!
+ * \brief Mark a sequence number as done without result.
+ *
+ * Never blocks and never calls dest, results it makes releasable are
+ * left to reorderbuffer_run. Skips beyond the window are kept aside as
+ * sorted ranges, skips may arrive in any order.
+ *
+ * \param buffer   Pointer to an initialized reorderbuffer_t
+ * \param sequence Sequence number without result
+ * \return         Error code, ERROR_OUTOFMEMORY if it could not be kept aside
+ */
+int reorderbuffer_skip(reorderbuffer_t* buffer,
+                       uint64_t         sequence);
+
+/*!
+ * \brief Release results made releasable by skips.
+ *
+ * Runs until reorderbuffer_abort, meant for a dedicated thread.
+ *
+ * \param buffer Pointer to an initialized reorderbuffer_t
+ */
+void reorderbuffer_run(reorderbuffer_t* buffer);
+
+/*!
+ * \brief Make all waiting and future blocking completes return ERROR_ABORT.
+ *
+ * Also ends reorderbuffer_run.
+ *
+ * \param buffer Pointer to an initialized reorderbuffer_t
+ */
+void reorderbuffer_abort(reorderbuffer_t* buffer);
+
+#endif
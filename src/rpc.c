@@ -0,0 +1,347 @@
+/* syscall is a GNU extension, defined before any system header */
+#define _GNU_SOURCE
+
+#include "rpc.h"
+
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+/* Current CLOCK_MONOTONIC time in µs */
+static uint64_t monotonicNow(void)
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t)now.tv_sec*1000*1000+now.tv_nsec/1000;
+}
+
+/* Sleeps while the slot is RPC_WAITING, at most until deadline (µs, 0 for none).
+ * May return early, the caller checks the state again. */
+static void sleepOnSlot(rpc_t*             rpc,
+                        struct rpc_slot_s* slot,
+                        uint64_t           deadline)
+{
+    struct timespec  relative;
+    struct timespec* timeout = NULL;
+
+    if( deadline != 0 )
+    {
+        uint64_t now = monotonicNow();
+
+        if( now >= deadline )
+        {
+            return;
+        }
+        relative.tv_sec  = (deadline-now)/(1000*1000);
+        relative.tv_nsec = ((deadline-now)%(1000*1000))*1000;
+        timeout          = &relative;
+    }
+
+#ifdef __linux__
+    syscall( SYS_futex, &slot->state, FUTEX_WAIT_PRIVATE, RPC_WAITING, timeout, NULL, 0 );
+#else
+    pthread_mutex_lock( &rpc->mutex );
+    if( __atomic_load_n( &slot->state, __ATOMIC_ACQUIRE ) == RPC_WAITING )
+    {
+        if( timeout != NULL )
+        {
+            struct timespec absolute;
+
+            clock_gettime( CLOCK_REALTIME, &absolute );
+            absolute.tv_sec  += timeout->tv_sec;
+            absolute.tv_nsec += timeout->tv_nsec;
+            if( absolute.tv_nsec >= 1000*1000*1000 )
+            {
+                absolute.tv_sec++;
+                absolute.tv_nsec -= 1000*1000*1000;
+            }
+            pthread_cond_timedwait( &rpc->cond, &rpc->mutex, &absolute );
+        }
+        else
+        {
+            pthread_cond_wait( &rpc->cond, &rpc->mutex );
+        }
+    }
+    pthread_mutex_unlock( &rpc->mutex );
+#endif
+}
+
+/* Wakes the caller sleeping on a slot which just left RPC_WAITING.
+ * The slot may already be reused, waiters check their state again. */
+static void wakeSlot(rpc_t*             rpc,
+                     struct rpc_slot_s* slot)
+{
+#ifdef __linux__
+    syscall( SYS_futex, &slot->state, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0 );
+#else
+    pthread_mutex_lock( &rpc->mutex );
+    pthread_cond_broadcast( &rpc->cond );
+    pthread_mutex_unlock( &rpc->mutex );
+#endif
+}
+
+/* Takes a free slot from the pool, NULL if all are taken */
+static struct rpc_slot_s* claimSlot(rpc_t* rpc)
+{
+    size_t start = __atomic_fetch_add( &rpc->hint, 1, __ATOMIC_RELAXED );
+    size_t i;
+
+    for( i=0 ; i<rpc->slotCount ; ++i )
+    {
+        struct rpc_slot_s* slot     = &rpc->slots[ (start+i) % rpc->slotCount ];
+        int                expected = RPC_FREE;
+
+        if( __atomic_load_n( &slot->state, __ATOMIC_RELAXED ) == RPC_FREE &&
+            __atomic_compare_exchange_n( &slot->state, &expected, RPC_PENDING, 0,
+                                         __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) )
+        {
+            return slot;
+        }
+    }
+
+    return NULL;
+}
+
+int rpc_initialize(rpc_t*     rpc,
+                   nmqueue_t* queue,
+                   size_t     slotCount)
+{
+    size_t i;
+
+    assert( rpc != NULL );
+    assert( queue != NULL );
+    assert( slotCount != 0 );
+
+    rpc->queue     = queue;
+    rpc->slotCount = slotCount;
+    rpc->hint      = 0;
+    rpc->slots     = (struct rpc_slot_s*)malloc( slotCount*sizeof(struct rpc_slot_s) );
+
+    if( rpc->slots == NULL )
+    {
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+
+    for( i=0 ; i<slotCount ; ++i )
+    {
+        rpc->slots[i].state = RPC_FREE;
+    }
+
+#ifndef __linux__
+    if( pthread_mutex_init( &rpc->mutex, NULL ) != 0 )
+    {
+        free( rpc->slots );
+        return NMQUEUEERROR_MUTEX_INITIALIZE_FAILED;
+    }
+
+    if( pthread_cond_init( &rpc->cond, NULL ) != 0 )
+    {
+        pthread_mutex_destroy( &rpc->mutex );
+        free( rpc->slots );
+        return NMQUEUEERROR_CONDVAR_INITIALIZE_FAILED;
+    }
+#endif
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+void rpc_finalize(rpc_t* rpc)
+{
+    assert( rpc != NULL );
+
+#ifndef __linux__
+    pthread_cond_destroy( &rpc->cond );
+    pthread_mutex_destroy( &rpc->mutex );
+#endif
+
+    free( rpc->slots );
+}
+
+int rpc_begin(rpc_t*              rpc,
+              source_t            source,
+              void*               data,
+              size_t              dataSize,
+              void*               threadId,
+              struct rpc_slot_s** slot)
+{
+    struct rpc_slot_s* claimed;
+    int                result;
+
+    assert( rpc != NULL );
+    assert( slot != NULL );
+
+    claimed = claimSlot( rpc );
+    if( claimed == NULL )
+    {
+        return NMQUEUEERROR_FULL;
+    }
+
+    claimed->source   = source;
+    claimed->data     = data;
+    claimed->dataSize = dataSize;
+
+    /* The queue lock publishes the request to the receiver */
+    result = nmqueue_send( rpc->queue, source, claimed, 0, threadId );
+    if( result != NMQUEUEERROR_NOERROR )
+    {
+        __atomic_store_n( &claimed->state, RPC_FREE, __ATOMIC_RELEASE );
+        return result;
+    }
+
+    *slot = claimed;
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+int rpc_wait(rpc_t*             rpc,
+             struct rpc_slot_s* slot,
+             uint64_t           timeout,
+             source_t*          replySource,
+             void**             replyData,
+             size_t*            replyDataSize)
+{
+    uint64_t deadline = timeout != 0 ? monotonicNow()+timeout : 0;
+
+    assert( rpc != NULL );
+    assert( slot != NULL );
+
+    for(;;)
+    {
+        int state = __atomic_load_n( &slot->state, __ATOMIC_ACQUIRE );
+
+        if( state == RPC_DONE )
+        {
+            *replySource   = slot->replySource;
+            *replyData     = slot->replyData;
+            *replyDataSize = slot->replyDataSize;
+
+            __atomic_store_n( &slot->state, RPC_FREE, __ATOMIC_RELEASE );
+            return NMQUEUEERROR_NOERROR;
+        }
+
+        /* Cancelled by another thread, the reply frees the slot */
+        if( state == RPC_CANCELLED )
+        {
+            return NMQUEUEERROR_ABORT;
+        }
+
+        if( deadline != 0 && monotonicNow() >= deadline )
+        {
+            if( __atomic_compare_exchange_n( &slot->state, &state, RPC_CANCELLED, 0,
+                                             __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) )
+            {
+                return NMQUEUEERROR_TIMEOUT;
+            }
+            continue;
+        }
+
+        /* Tell rpc_reply a wakeup is needed */
+        if( state == RPC_PENDING &&
+            !__atomic_compare_exchange_n( &slot->state, &state, RPC_WAITING, 0,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) )
+        {
+            continue;
+        }
+
+        sleepOnSlot( rpc, slot, deadline );
+    }
+}
+
+int rpc_call(rpc_t*    rpc,
+             source_t  source,
+             void*     data,
+             size_t    dataSize,
+             uint64_t  timeout,
+             source_t* replySource,
+             void**    replyData,
+             size_t*   replyDataSize,
+             void*     threadId)
+{
+    struct rpc_slot_s* slot;
+    int                result = rpc_begin( rpc, source, data, dataSize, threadId, &slot );
+
+    if( result != NMQUEUEERROR_NOERROR )
+    {
+        return result;
+    }
+
+    return rpc_wait( rpc, slot, timeout, replySource, replyData, replyDataSize );
+}
+
+int rpc_cancel(rpc_t*             rpc,
+               struct rpc_slot_s* slot)
+{
+    int state;
+
+    assert( rpc != NULL );
+    assert( slot != NULL );
+
+    state = __atomic_load_n( &slot->state, __ATOMIC_ACQUIRE );
+
+    for(;;)
+    {
+        if( state == RPC_DONE )
+        {
+            return NMQUEUEERROR_PENDING;
+        }
+
+        assert( state == RPC_PENDING || state == RPC_WAITING );
+
+        if( __atomic_compare_exchange_n( &slot->state, &state, RPC_CANCELLED, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) )
+        {
+            if( state == RPC_WAITING )
+            {
+                wakeSlot( rpc, slot );
+            }
+            return NMQUEUEERROR_NOERROR;
+        }
+    }
+}
+
+int rpc_reply(rpc_t*             rpc,
+              struct rpc_slot_s* slot,
+              source_t           replySource,
+              void*              replyData,
+              size_t             replyDataSize)
+{
+    int state;
+
+    assert( rpc != NULL );
+    assert( slot != NULL );
+
+    /* Only read by the caller once the state is RPC_DONE */
+    slot->replySource   = replySource;
+    slot->replyData     = replyData;
+    slot->replyDataSize = replyDataSize;
+
+    state = __atomic_load_n( &slot->state, __ATOMIC_ACQUIRE );
+
+    for(;;)
+    {
+        if( state == RPC_CANCELLED )
+        {
+            __atomic_store_n( &slot->state, RPC_FREE, __ATOMIC_RELEASE );
+            return NMQUEUEERROR_ABORT;
+        }
+
+        assert( state == RPC_PENDING || state == RPC_WAITING );
+
+        if( __atomic_compare_exchange_n( &slot->state, &state, RPC_DONE, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) )
+        {
+            if( state == RPC_WAITING )
+            {
+                wakeSlot( rpc, slot );
+            }
+            return NMQUEUEERROR_NOERROR;
+        }
+    }
+}
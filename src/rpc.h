@@ -0,0 +1,169 @@
+#ifndef _RPC_HEADER_
+#define _RPC_HEADER_
+
+#include "nmqueue.h"
+
+/*! Reply slot states */
+#define RPC_FREE      0 /*!< In the pool */
+#define RPC_PENDING   1 /*!< Request sent, nobody waits for the reply */
+#define RPC_WAITING   2 /*!< Request sent, caller sleeps on state */
+#define RPC_DONE      3 /*!< Reply stored, not collected yet */
+#define RPC_CANCELLED 4 /*!< Caller gave up, the reply frees the slot */
+
+/*! Request with its reply slot, sent as message data.
+ *  Requests and replies are passed by reference, nothing is copied. */
+struct rpc_slot_s
+{
+    int      state;         /*!< One of RPC_*, accessed atomically, futex word on Linux */
+    source_t source;        /*!< Request source */
+    void*    data;          /*!< Request data */
+    size_t   dataSize;      /*!< Request dataSize */
+    source_t replySource;   /*!< Reply source, written by rpc_reply */
+    void*    replyData;     /*!< Reply data, written by rpc_reply */
+    size_t   replyDataSize; /*!< Reply dataSize, written by rpc_reply */
+};
+
+/*! Request/reply layer over a queue with a preallocated pool of reply slots */
+typedef struct
+{
+    nmqueue_t*         queue;     /*!< Queue carrying the requests */
+    struct rpc_slot_s* slots;     /*!< Slot pool */
+    size_t             slotCount; /*!< Number of slots */
+    size_t             hint;      /*!< Where the next free slot is searched, accessed atomically */
+#ifndef __linux__
+    pthread_mutex_t    mutex;     /*!< Used with cond instead of futexes */
+    pthread_cond_t     cond;      /*!< Broadcasted on every completed or cancelled waiting slot */
+#endif
+} rpc_t;
+
+/*!
+ * \brief Create request/reply layer.
+ *
+ * \param rpc       Pointer to an uninitialized rpc_t
+ * \param queue     Pointer to an initialized nmqueue_t, requests are sent there
+ * \param slotCount Number of calls which may be outstanding at once, not 0
+ * \return          Error code, ERROR_NOERROR on success
+ */
+int rpc_initialize(rpc_t*     rpc,
+                   nmqueue_t* queue,
+                   size_t     slotCount);
+
+/*!
+ * \brief Destroy request/reply layer.
+ *
+ * No call may be outstanding, requests still in the queue point to freed
+ * slots afterwards.
+ *
+ * \param rpc Pointer to an initialized rpc_t
+ */
+void rpc_finalize(rpc_t* rpc);
+
+/*!
+ * \brief Send a request without waiting for the reply.
+ *
+ * Takes a free slot without locking or allocation and sends it as the
+ * data of a message with the given source and dataSize 0. The receiving
+ * side casts the message data to struct rpc_slot_s* and answers with
+ * rpc_reply. Requests dropped by the queue (time to live, overwrite)
+ * keep their slot until rpc_finalize, use a blocking or rejecting queue.
+ *
+ * \param rpc      Pointer to an initialized rpc_t
+ * \param source   Any source_t
+ * \param data     Any void*, available as slot->data to the receiver
+ * \param dataSize Any size_t
+ * \param threadId Used for nmqueue_send
+ * \param slot     Reference to a slot pointer, receives the call's slot
+ * \return         Error code, ERROR_FULL if all slots are taken, or the
+ *                 error of nmqueue_send
+ */
+int rpc_begin(rpc_t*              rpc,
+              source_t            source,
+              void*               data,
+              size_t              dataSize,
+              void*               threadId,
+              struct rpc_slot_s** slot);
+
+/*!
+ * \brief Wait for the reply of a request sent with rpc_begin.
+ *
+ * Sleeps on the slot only, the queue is not involved. On ERROR_NOERROR the
+ * slot is back in the pool. On ERROR_TIMEOUT or ERROR_ABORT the call is
+ * cancelled, the slot must not be used anymore.
+ *
+ * \param rpc           Pointer to an initialized rpc_t
+ * \param slot          Slot returned by rpc_begin
+ * \param timeout       Time in µs, 0 to wait forever
+ * \param replySource   Reference to a source_t
+ * \param replyData     Reference to a void*
+ * \param replyDataSize Reference to a size_t
+ * \return              Error code, ERROR_TIMEOUT once timeout passed,
+ *                      ERROR_ABORT if rpc_cancel was called meanwhile
+ */
+int rpc_wait(rpc_t*             rpc,
+             struct rpc_slot_s* slot,
+             uint64_t           timeout,
+             source_t*          replySource,
+             void**             replyData,
+             size_t*            replyDataSize);
+
+/*!
+ * \brief Blocking call, rpc_begin followed by rpc_wait.
+ *
+ * \param rpc           Pointer to an initialized rpc_t
+ * \param source        Any source_t
+ * \param data          Any void*
+ * \param dataSize      Any size_t
+ * \param timeout       Time in µs to wait for the reply, 0 to wait forever
+ * \param replySource   Reference to a source_t
+ * \param replyData     Reference to a void*
+ * \param replyDataSize Reference to a size_t
+ * \param threadId      Used for nmqueue_send
+ * \return              Error code, see rpc_begin and rpc_wait
+ */
+int rpc_call(rpc_t*    rpc,
+             source_t  source,
+             void*     data,
+             size_t    dataSize,
+             uint64_t  timeout,
+             source_t* replySource,
+             void**    replyData,
+             size_t*   replyDataSize,
+             void*     threadId);
+
+/*!
+ * \brief Cancel an outstanding call.
+ *
+ * May be called from any thread until rpc_wait returned. A caller
+ * waiting in rpc_wait wakes up with ERROR_ABORT. The slot returns to the
+ * pool once the reply arrives.
+ *
+ * \param rpc  Pointer to an initialized rpc_t
+ * \param slot Slot returned by rpc_begin
+ * \return     Error code, ERROR_PENDING if the reply arrived first and
+ *             still has to be collected with rpc_wait
+ */
+int rpc_cancel(rpc_t*             rpc,
+               struct rpc_slot_s* slot);
+
+/*!
+ * \brief Answer a request.
+ *
+ * Called by the receiver of the request message. Wakes the caller only
+ * if it sleeps.
+ *
+ * \param rpc           Pointer to an initialized rpc_t
+ * \param slot          Message data of the request
+ * \param replySource   Any source_t
+ * \param replyData     Any void*
+ * \param replyDataSize Any size_t
+ * \return              Error code, ERROR_ABORT if the call was cancelled,
+ *                      the reply is not delivered and stays with the caller
+ *                      of rpc_reply
+ */
+int rpc_reply(rpc_t*             rpc,
+              struct rpc_slot_s* slot,
+              source_t           replySource,
+              void*              replyData,
+              size_t             replyDataSize);
+
+#endif
@@ -1,5 +1,62 @@
 #include "senderthread.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Current CLOCK_MONOTONIC time in µs */
+static uint64_t senderNow(void)
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t)now.tv_sec*1000*1000+now.tv_nsec/1000;
+}
+
+/* Sends the collected messages. A message the queue rejects is dropped as
+ * for single messages and the ones behind it are sent on, an abort keeps
+ * the rest for finalizeSender once terminated. */
+static void flushBatch(senderthread_t* senderThread)
+{
+    while( senderThread->batched != 0 )
+    {
+        size_t sent;
+        int    err = nmqueue_send_batch(senderThread->queue, senderThread->batch, senderThread->batched, &sent, senderThread);
+
+        if( err != NMQUEUEERROR_NOERROR && err != NMQUEUEERROR_ABORT )
+        {
+            /* batch[sent] was rejected, the queue counted the drop */
+            sent++;
+        }
+
+        senderThread->batched -= sent;
+        memmove( senderThread->batch, senderThread->batch+sent, senderThread->batched*sizeof(struct nmqueue_message_s) );
+
+        if( err == NMQUEUEERROR_ABORT && senderThread->terminated )
+        {
+            break;
+        }
+    }
+}
+
+/* Collects a message */
+static void batchMessage(senderthread_t* senderThread,
+                         source_t        source,
+                         void*           data,
+                         size_t          dataSize)
+{
+    struct nmqueue_message_s* message = &senderThread->batch[ senderThread->batched ];
+
+    message->source   = source;
+    message->data     = data;
+    message->dataSize = dataSize;
+    message->expires  = 0;
+
+    if( senderThread->batched++ == 0 )
+    {
+        senderThread->batchStart = senderNow();
+    }
+}
+
 /* Thread entry point for sending thread */
 /* Will keep checking wether data is available for sending until shutdown */
 static void* senderProc(void * senderT)
@@ -14,9 +71,32 @@ static void* senderProc(void * senderT)
         size_t   dataSize;
         if( (*senderThread->dataSource)(&source, &data, &dataSize, senderThread->dataSourceParam) == 0 )
         {
-            /* Send message. Return value ignored since NMQUEUEERROR_ABORT will be indicated by
-             * senderThread->terminated as well. */
-            nmqueue_send(senderThread->queue, source, data, dataSize, senderThread);
+            idlestrategy_reset( &senderThread->idle );
+
+            if( senderThread->batch != NULL )
+            {
+                batchMessage( senderThread, source, data, dataSize );
+
+                /* Full, or the oldest message waited long enough */
+                if( senderThread->batched == senderThread->batchSize ||
+                    senderNow()-senderThread->batchStart >= senderThread->flushLatency )
+                {
+                    flushBatch( senderThread );
+                }
+            }
+            else
+            {
+                /* Send message. Return value ignored since NMQUEUEERROR_ABORT will be indicated by
+                 * senderThread->terminated as well. */
+                nmqueue_send(senderThread->queue, source, data, dataSize, senderThread);
+            }
+        }
+        else if( !senderThread->terminated )
+        {
+            /* Nothing more to combine with */
+            flushBatch( senderThread );
+
+            idlestrategy_idle( &senderThread->idle );
         }
 
     }
@@ -29,6 +109,18 @@ int initializeSender(senderthread_t* senderThread,
                      nmqueue_t*      queue,
                      sender_source_t dataSource,
                      void*           dataSourceParam)
+{
+    return initializeSenderIdle(senderThread, queue, dataSource, dataSourceParam, NULL);
+}
+
+/* Common initialization, batchSize 0 sends every message on its own */
+static int startSender(senderthread_t*     senderThread,
+                       nmqueue_t*          queue,
+                       sender_source_t     dataSource,
+                       void*               dataSourceParam,
+                       size_t              batchSize,
+                       unsigned long       flushLatency,
+                       const idleconfig_t* idle)
 {
     senderThread->queue      = queue;
     senderThread->terminated = 0;
@@ -36,18 +128,78 @@ int initializeSender(senderthread_t* senderThread,
     senderThread->dataSource      = dataSource;
     senderThread->dataSourceParam = dataSourceParam;
 
+    senderThread->batch        = NULL;
+    senderThread->batchSize    = batchSize;
+    senderThread->batched      = 0;
+    senderThread->flushLatency = flushLatency;
+    senderThread->batchStart   = 0;
+
+    if( batchSize != 0 )
+    {
+        senderThread->batch = (struct nmqueue_message_s*)malloc( batchSize*sizeof(struct nmqueue_message_s) );
+        if( senderThread->batch == NULL )
+        {
+            return 1;
+        }
+    }
+
+    if( idlestrategy_initialize( &senderThread->idle, idle ) != 0 )
+    {
+        free( senderThread->batch );
+        senderThread->batch = NULL;
+        return 1;
+    }
+
     if ( pthread_create( &senderThread->thread, NULL, senderProc, senderThread ) != 0 )
     {
+        idlestrategy_finalize( &senderThread->idle );
+        free( senderThread->batch );
+        senderThread->batch = NULL;
         return 1;
     }
 
     return 0;
 }
 
+int initializeSenderIdle(senderthread_t*     senderThread,
+                         nmqueue_t*          queue,
+                         sender_source_t     dataSource,
+                         void*               dataSourceParam,
+                         const idleconfig_t* idle)
+{
+    return startSender(senderThread, queue, dataSource, dataSourceParam, 0, 0, idle);
+}
+
+int initializeBatchSender(senderthread_t*     senderThread,
+                          nmqueue_t*          queue,
+                          sender_source_t     dataSource,
+                          void*               dataSourceParam,
+                          size_t              batchSize,
+                          unsigned long       flushLatency,
+                          const idleconfig_t* idle)
+{
+    return startSender(senderThread, queue, dataSource, dataSourceParam, batchSize, flushLatency, idle);
+}
+
+void senderthread_signal(senderthread_t* senderThread)
+{
+    idlestrategy_signal( &senderThread->idle );
+}
+
 void finalizeSender(senderthread_t* senderThread)
 {
     senderThread->terminated = 1;
+    idlestrategy_signal( &senderThread->idle );
     nmqueue_abort( senderThread->queue, senderThread );
 
     pthread_join( senderThread->thread, NULL );
+    nmqueue_clear_abort( senderThread->queue, senderThread );
+
+    /* Messages the thread collected but could not send before it ended */
+    flushBatch( senderThread );
+
+    idlestrategy_finalize( &senderThread->idle );
+
+    free( senderThread->batch );
+    senderThread->batch = NULL;
 }
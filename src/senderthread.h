@@ -1,6 +1,7 @@
 #ifndef _SENDERTHREAD_HEADER_
 #define _SENDERTHREAD_HEADER_
 #include "nmqueue.h"
+#include "idlestrategy.h"
 
 #define SENDERTHREAD_NODATA 1
 #define SENDERTHREAD_DATA   0
@@ -15,6 +16,12 @@ typedef struct
     sender_source_t  dataSource;      /*!< Callback */
     void *           dataSourceParam; /*!< Parameter to callback */
     nmqueue_t*       queue;           /*!< Queue */
+    idlestrategy_t   idle;            /*!< Strategy used when dataSource has no data */
+    struct nmqueue_message_s* batch;  /*!< Messages not yet sent, NULL without batching */
+    size_t           batchSize;       /*!< Number of entries in batch */
+    size_t           batched;         /*!< Messages in batch */
+    unsigned long    flushLatency;    /*!< Maximum time in µs a message stays in batch */
+    uint64_t         batchStart;      /*!< CLOCK_MONOTONIC time in µs of the oldest message in batch */
     volatile int     terminated;      /*!< Indicates the thread should shutdown */
 } senderthread_t;
 
@@ -22,6 +29,7 @@ typedef struct
  * \brief Create a sending thread.
  * 
  * Create a sending thread. dataSource will be called for new data to send.
+ * The thread busy spins while dataSource has no data.
  * 
  * \param senderThread    Pointer to an uninitialized senderthread_t
  * \param queue           Pointer to an initialized nmqueue_t
@@ -34,9 +42,70 @@ int initializeSender(senderthread_t* senderThread,
                      sender_source_t dataSource,
                      void*           dataSourceParam);
 
+/*!
+ * \brief Create a sending thread with an idle strategy.
+ * 
+ * Same as initializeSender, but idle decides what the thread does while
+ * dataSource returns SENDERTHREAD_NODATA. With IDLESTRATEGY_BLOCK the
+ * source has to call senderthread_signal once new data is available.
+ * 
+ * \param senderThread    Pointer to an uninitialized senderthread_t
+ * \param queue           Pointer to an initialized nmqueue_t
+ * \param dataSource      Callback
+ * \param dataSourceParam Data passed to callback
+ * \param idle            Idle strategy configuration, NULL for busy spinning
+ * \return                0 on success, 1 on error
+ */
+int initializeSenderIdle(senderthread_t*     senderThread,
+                         nmqueue_t*          queue,
+                         sender_source_t     dataSource,
+                         void*               dataSourceParam,
+                         const idleconfig_t* idle);
+
+/*!
+ * \brief Create a sending thread which sends in batches.
+ * 
+ * Same as initializeSenderIdle, but produced messages are collected and
+ * sent with nmqueue_send_batch, taking the queue lock once per batch.
+ * A batch is sent once it holds batchSize messages, once dataSource has
+ * no data or once its oldest message waited flushLatency, which is checked
+ * after every message collected. A message the queue rejects is dropped as
+ * with nmqueue_send, the rest of its batch is still sent. Messages still
+ * collected when the thread is destroyed are sent by finalizeSender.
+ * 
+ * \param senderThread    Pointer to an uninitialized senderthread_t
+ * \param queue           Pointer to an initialized nmqueue_t
+ * \param dataSource      Callback
+ * \param dataSourceParam Data passed to callback
+ * \param batchSize       Maximum number of messages per batch, not 0
+ * \param flushLatency    Maximum time in µs a message is held back
+ * \param idle            Idle strategy configuration, NULL for busy spinning
+ * \return                0 on success, 1 on error
+ */
+int initializeBatchSender(senderthread_t*     senderThread,
+                          nmqueue_t*          queue,
+                          sender_source_t     dataSource,
+                          void*               dataSourceParam,
+                          size_t              batchSize,
+                          unsigned long       flushLatency,
+                          const idleconfig_t* idle);
+
+/*!
+ * \brief Signal that the data source has new data.
+ * 
+ * Wakes a sending thread idling with IDLESTRATEGY_BLOCK.
+ * 
+ * \param senderThread Pointer to initialized senderthread_t
+ */
+void senderthread_signal(senderthread_t* senderThread);
+
 /*!
  * \brief Destroy sending thread.
  * 
+ * A send blocked on a full queue is aborted. Messages a batch sender
+ * collected are sent afterwards from the calling thread, which blocks
+ * while the queue is full, so receivers have to keep running.
+ * 
  * \param senderThread Pointer to initialized senderthread_t
  */
 void finalizeSender(senderthread_t* senderThread);
@@ -0,0 +1,513 @@
+#include "socketbridge.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* Current CLOCK_MONOTONIC time in µs */
+static uint64_t monotonicNow(void)
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t)now.tv_sec*1000*1000+now.tv_nsec/1000;
+}
+
+/* Fills a socket address, returns 1 if path does not fit */
+static int socketAddress(struct sockaddr_un* address,
+                         const char*         path)
+{
+    if( strlen( path ) >= sizeof(address->sun_path) )
+    {
+        return 1;
+    }
+
+    memset( address, 0, sizeof(*address) );
+    address->sun_family = AF_UNIX;
+    strcpy( address->sun_path, path );
+
+    return 0;
+}
+
+int socketbridge_listen(const char* path)
+{
+    struct sockaddr_un address;
+    int                fd;
+
+    assert( path != NULL );
+
+    if( socketAddress( &address, path ) != 0 )
+    {
+        return -1;
+    }
+
+    fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( fd < 0 )
+    {
+        return -1;
+    }
+
+    unlink( path );
+
+    if( bind( fd, (struct sockaddr*)&address, sizeof(address) ) != 0 ||
+        listen( fd, 1 ) != 0 )
+    {
+        close( fd );
+        return -1;
+    }
+
+    return fd;
+}
+
+int socketbridge_connect(const char* path)
+{
+    struct sockaddr_un address;
+    int                fd;
+
+    assert( path != NULL );
+
+    if( socketAddress( &address, path ) != 0 )
+    {
+        return -1;
+    }
+
+    fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( fd < 0 )
+    {
+        return -1;
+    }
+
+    if( connect( fd, (struct sockaddr*)&address, sizeof(address) ) != 0 )
+    {
+        close( fd );
+        return -1;
+    }
+
+    return fd;
+}
+
+/* Adds header and payload of messages[first..first+count-1] to the iovec */
+static size_t frameMessages(socketbridge_sender_t* bridge,
+                            size_t                 first,
+                            size_t                 count)
+{
+    size_t i;
+    size_t bytes = 0;
+
+    for( i=first ; i<first+count ; ++i )
+    {
+        struct nmqueue_message_s*     message = &bridge->messages[i];
+        struct socketbridge_header_s* header  = &bridge->headers[i];
+
+        header->source = message->source;
+        header->flags  = message->data == NULL ? SOCKETBRIDGE_NOPAYLOAD : 0;
+        header->size   = message->dataSize;
+
+        bridge->iov[2*i].iov_base   = header;
+        bridge->iov[2*i].iov_len    = sizeof(*header);
+        bridge->iov[2*i+1].iov_base = message->data;
+        bridge->iov[2*i+1].iov_len  = message->data == NULL ? 0 : message->dataSize;
+
+        bytes += bridge->iov[2*i].iov_len+bridge->iov[2*i+1].iov_len;
+    }
+
+    return bytes;
+}
+
+/* Writes count frames, restarting after partial writes.
+ * Returns ERROR_NOERROR or ERROR_IO. */
+static int writeFrames(socketbridge_sender_t* bridge,
+                       size_t                 count)
+{
+    struct iovec* iov      = bridge->iov;
+    int           iovCount = (int)(2*count);
+    int           err      = NMQUEUEERROR_NOERROR;
+    size_t        i;
+
+    while( iovCount != 0 )
+    {
+        ssize_t written = writev( bridge->fd, iov, iovCount );
+
+        if( written < 0 )
+        {
+            if( errno == EINTR )
+            {
+                continue;
+            }
+            err = NMQUEUEERROR_IO;
+            break;
+        }
+
+        bridge->writes++;
+
+        /* Skip what went out */
+        while( iovCount != 0 && (size_t)written >= iov->iov_len )
+        {
+            written -= iov->iov_len;
+            iov++;
+            iovCount--;
+        }
+        if( iovCount != 0 )
+        {
+            iov->iov_base  = (char*)iov->iov_base+written;
+            iov->iov_len  -= written;
+        }
+    }
+
+    for( i=0 ; i<count ; ++i )
+    {
+        if( bridge->release != NULL )
+        {
+            struct nmqueue_message_s* message = &bridge->messages[i];
+            (*bridge->release)( message->source, message->data, message->dataSize, bridge->releaseParam );
+        }
+    }
+
+    if( err == NMQUEUEERROR_NOERROR )
+    {
+        bridge->sent += count;
+    }
+
+    return err;
+}
+
+/* Entry point for the sending thread */
+/* Collects messages until a flush condition holds and writes them */
+static void* senderProc(void* bridgeT)
+{
+    socketbridge_sender_t* bridge = (socketbridge_sender_t*)bridgeT;
+    size_t                 frames = 0;
+    size_t                 bytes  = 0;
+    uint64_t               first  = 0;
+
+    for(;;)
+    {
+        size_t count = 0;
+        int    flush = 0;
+
+        if( frames == 0 )
+        {
+            if( bridge->terminated )
+            {
+                break;
+            }
+
+            if( nmqueue_receive_batch( bridge->queue, bridge->messages, SOCKETBRIDGE_MAXFRAMES,
+                                       &count, bridge ) != NMQUEUEERROR_NOERROR )
+            {
+                continue;
+            }
+            first = monotonicNow();
+        }
+        else
+        {
+            int err = nmqueue_tryreceive_batch( bridge->queue, &bridge->messages[frames],
+                                                SOCKETBRIDGE_MAXFRAMES-frames, &count, bridge );
+
+            if( err == NMQUEUEERROR_EMPTY )
+            {
+                /* Wait for more within the latency bound */
+                if( bridge->config.latency == 0 || bridge->terminated ||
+                    monotonicNow()-first >= bridge->config.latency )
+                {
+                    flush = 1;
+                }
+                else
+                {
+                    idlestrategy_idle( &bridge->idle );
+                }
+            }
+            else if( err != NMQUEUEERROR_NOERROR )
+            {
+                flush = 1;
+            }
+        }
+
+        if( count != 0 )
+        {
+            idlestrategy_reset( &bridge->idle );
+            bytes  += frameMessages( bridge, frames, count );
+            frames += count;
+        }
+
+        if( flush || bytes >= bridge->config.flushBytes || frames == SOCKETBRIDGE_MAXFRAMES )
+        {
+            if( writeFrames( bridge, frames ) != NMQUEUEERROR_NOERROR )
+            {
+                bridge->error = NMQUEUEERROR_IO;
+                break;
+            }
+            frames = 0;
+            bytes  = 0;
+        }
+    }
+
+    return NULL;
+}
+
+int socketbridge_sender_initialize(socketbridge_sender_t*      bridge,
+                                   nmqueue_t*                  queue,
+                                   int                         fd,
+                                   const socketbridgeconfig_t* config,
+                                   socketbridge_release_t      release,
+                                   void*                       releaseParam)
+{
+    idleconfig_t idle;
+
+    assert( bridge != NULL );
+    assert( queue  != NULL );
+    assert( config != NULL );
+
+    bridge->queue        = queue;
+    bridge->fd           = fd;
+    bridge->config       = *config;
+    bridge->release      = release;
+    bridge->releaseParam = releaseParam;
+    bridge->terminated   = 0;
+    bridge->error        = NMQUEUEERROR_NOERROR;
+    bridge->sent         = 0;
+    bridge->writes       = 0;
+
+    /* Sleep in small steps compared to the latency bound */
+    idle.kind      = IDLESTRATEGY_BACKOFF;
+    idle.spinCount = 16;
+    idle.minSleep  = 1;
+    idle.maxSleep  = config->latency/8+1;
+
+    if( idlestrategy_initialize( &bridge->idle, &idle ) != 0 )
+    {
+        return NMQUEUEERROR_MUTEX_INITIALIZE_FAILED;
+    }
+
+    if( pthread_create( &bridge->thread, NULL, senderProc, bridge ) != 0 )
+    {
+        idlestrategy_finalize( &bridge->idle );
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+void socketbridge_sender_finalize(socketbridge_sender_t* bridge)
+{
+    assert( bridge != NULL );
+
+    bridge->terminated = 1;
+    nmqueue_abort( bridge->queue, bridge );
+    pthread_join( bridge->thread, NULL );
+    nmqueue_clear_abort( bridge->queue, bridge );
+
+    idlestrategy_finalize( &bridge->idle );
+}
+
+/* Makes room for at least size bytes in the read buffer */
+static int growBuffer(socketbridge_receiver_t* bridge,
+                      size_t                   size)
+{
+    size_t bufferSize = bridge->bufferSize;
+    char*  buffer;
+
+    while( bufferSize < size )
+    {
+        bufferSize *= 2;
+    }
+
+    buffer = (char*)realloc( bridge->buffer, bufferSize );
+    if( buffer == NULL )
+    {
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+
+    bridge->buffer     = buffer;
+    bridge->bufferSize = bufferSize;
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+/* Sends the decoded batch, frees payloads which did not make it */
+static int flushBatch(socketbridge_receiver_t* bridge,
+                      size_t                   count)
+{
+    size_t sent;
+    int    err = nmqueue_send_batch( bridge->queue, bridge->batch, count, &sent, bridge );
+
+    while( sent != count )
+    {
+        free( bridge->batch[sent++].data );
+    }
+
+    return err;
+}
+
+/* Decodes all complete frames in the buffer.
+ * Returns the number of consumed bytes, sets err on failure. */
+static size_t decodeFrames(socketbridge_receiver_t* bridge,
+                           int*                     err)
+{
+    size_t position = 0;
+    size_t count    = 0;
+
+    while( bridge->filled-position >= sizeof(struct socketbridge_header_s) )
+    {
+        struct socketbridge_header_s header;
+        struct nmqueue_message_s*    message = &bridge->batch[count];
+        size_t                       payload;
+
+        memcpy( &header, bridge->buffer+position, sizeof(header) );
+        payload = (header.flags & SOCKETBRIDGE_NOPAYLOAD) ? 0 : (size_t)header.size;
+
+        if( bridge->filled-position < sizeof(header)+payload )
+        {
+            /* Incomplete frame larger than the buffer */
+            if( sizeof(header)+payload > bridge->bufferSize )
+            {
+                *err = growBuffer( bridge, sizeof(header)+payload );
+            }
+            break;
+        }
+
+        message->source   = header.source;
+        message->dataSize = (size_t)header.size;
+        message->expires  = 0;
+        message->data     = NULL;
+
+        if( !(header.flags & SOCKETBRIDGE_NOPAYLOAD) )
+        {
+            message->data = malloc( payload != 0 ? payload : 1 );
+            if( message->data == NULL )
+            {
+                *err = NMQUEUEERROR_OUTOFMEMORY;
+                break;
+            }
+            memcpy( message->data, bridge->buffer+position+sizeof(header), payload );
+        }
+
+        position += sizeof(header)+payload;
+        count++;
+        bridge->received++;
+
+        if( count == SOCKETBRIDGE_MAXFRAMES )
+        {
+            *err  = flushBatch( bridge, count );
+            count = 0;
+            if( *err != NMQUEUEERROR_NOERROR )
+            {
+                break;
+            }
+        }
+    }
+
+    if( count != 0 )
+    {
+        int sendErr = flushBatch( bridge, count );
+        if( *err == NMQUEUEERROR_NOERROR )
+        {
+            *err = sendErr;
+        }
+    }
+
+    return position;
+}
+
+/* Entry point for the receiving thread */
+/* Reads and decodes until the end of the stream */
+static void* receiverProc(void* bridgeT)
+{
+    socketbridge_receiver_t* bridge = (socketbridge_receiver_t*)bridgeT;
+
+    while( !bridge->terminated )
+    {
+        ssize_t received;
+        size_t  consumed;
+        int     err = NMQUEUEERROR_NOERROR;
+
+        received = read( bridge->fd, bridge->buffer+bridge->filled, bridge->bufferSize-bridge->filled );
+
+        if( received < 0 && errno == EINTR )
+        {
+            continue;
+        }
+        if( received <= 0 )
+        {
+            if( received < 0 )
+            {
+                bridge->error = NMQUEUEERROR_IO;
+            }
+            break;
+        }
+
+        bridge->reads++;
+        bridge->filled += (size_t)received;
+
+        consumed = decodeFrames( bridge, &err );
+
+        memmove( bridge->buffer, bridge->buffer+consumed, bridge->filled-consumed );
+        bridge->filled -= consumed;
+
+        if( err != NMQUEUEERROR_NOERROR )
+        {
+            if( err != NMQUEUEERROR_ABORT )
+            {
+                bridge->error = err;
+            }
+            break;
+        }
+
+        if( bridge->filled == bridge->bufferSize &&
+            growBuffer( bridge, bridge->bufferSize+1 ) != NMQUEUEERROR_NOERROR )
+        {
+            bridge->error = NMQUEUEERROR_OUTOFMEMORY;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+int socketbridge_receiver_initialize(socketbridge_receiver_t* bridge,
+                                     nmqueue_t*               queue,
+                                     int                      fd)
+{
+    assert( bridge != NULL );
+    assert( queue  != NULL );
+
+    bridge->queue      = queue;
+    bridge->fd         = fd;
+    bridge->bufferSize = 64*1024;
+    bridge->filled     = 0;
+    bridge->terminated = 0;
+    bridge->error      = NMQUEUEERROR_NOERROR;
+    bridge->received   = 0;
+    bridge->reads      = 0;
+    bridge->buffer     = (char*)malloc( bridge->bufferSize );
+
+    if( bridge->buffer == NULL )
+    {
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+
+    if( pthread_create( &bridge->thread, NULL, receiverProc, bridge ) != 0 )
+    {
+        free( bridge->buffer );
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+void socketbridge_receiver_finalize(socketbridge_receiver_t* bridge)
+{
+    assert( bridge != NULL );
+
+    bridge->terminated = 1;
+    shutdown( bridge->fd, SHUT_RD );
+    nmqueue_abort( bridge->queue, bridge );
+    pthread_join( bridge->thread, NULL );
+    nmqueue_clear_abort( bridge->queue, bridge );
+
+    free( bridge->buffer );
+}
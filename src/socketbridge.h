@@ -0,0 +1,148 @@
+#ifndef _SOCKETBRIDGE_HEADER_
+#define _SOCKETBRIDGE_HEADER_
+
+#include "nmqueue.h"
+#include "idlestrategy.h"
+
+#include <sys/uio.h>
+
+/*! Frames sent with one writev */
+#define SOCKETBRIDGE_MAXFRAMES 256
+
+/*! Frame flags */
+#define SOCKETBRIDGE_NOPAYLOAD 1 /*!< data was NULL, only dataSize is transferred */
+
+/*! Frame header, followed by size payload bytes unless SOCKETBRIDGE_NOPAYLOAD is set.
+ *  Host byte order, both ends run on the same host. */
+struct socketbridge_header_s
+{
+    int32_t  source; /*!< Message source */
+    uint32_t flags;  /*!< SOCKETBRIDGE_* flags */
+    uint64_t size;   /*!< Message dataSize */
+};
+
+/*! Callback for sent messages, receives source, data, dataSize and the
+ *  callback parameter. Called once the payload was written to the socket. */
+typedef void (*socketbridge_release_t)(source_t, void*, size_t, void*);
+
+/*! Sending side configuration */
+typedef struct
+{
+    size_t        flushBytes; /*!< Framed bytes which trigger a write */
+    unsigned long latency;    /*!< Time in µs a framed message waits for more, 0 to write once the queue is empty */
+} socketbridgeconfig_t;
+
+/*! Sending side, drains a queue into a socket */
+typedef struct
+{
+    nmqueue_t*                   queue;        /*!< Drained queue */
+    int                          fd;           /*!< Connected stream socket */
+    socketbridgeconfig_t         config;       /*!< Configuration */
+    socketbridge_release_t       release;      /*!< Called for written messages, may be NULL */
+    void*                        releaseParam; /*!< Parameter to release */
+    struct nmqueue_message_s     messages[SOCKETBRIDGE_MAXFRAMES]; /*!< Framed messages */
+    struct socketbridge_header_s headers[SOCKETBRIDGE_MAXFRAMES];  /*!< Their headers */
+    struct iovec                 iov[2*SOCKETBRIDGE_MAXFRAMES];    /*!< Header and payload per frame */
+    idlestrategy_t               idle;         /*!< Used while waiting for more messages within latency */
+    pthread_t                    thread;       /*!< Thread */
+    volatile int                 terminated;   /*!< Indicates the thread should shutdown */
+    int                          error;        /*!< ERROR_IO once the socket failed */
+    unsigned long                sent;         /*!< Messages written */
+    unsigned long                writes;       /*!< writev calls */
+} socketbridge_sender_t;
+
+/*! Receiving side, decodes a socket into a queue */
+typedef struct
+{
+    nmqueue_t*                queue;      /*!< Queue decoded messages are sent to */
+    int                       fd;         /*!< Connected stream socket */
+    char*                     buffer;     /*!< Read buffer */
+    size_t                    bufferSize; /*!< Size of buffer, grows for large frames */
+    size_t                    filled;     /*!< Bytes in buffer */
+    struct nmqueue_message_s  batch[SOCKETBRIDGE_MAXFRAMES]; /*!< Decoded messages */
+    pthread_t                 thread;     /*!< Thread */
+    volatile int              terminated; /*!< Indicates the thread should shutdown */
+    int                       error;      /*!< ERROR_IO once the socket failed */
+    unsigned long             received;   /*!< Messages decoded */
+    unsigned long             reads;      /*!< read calls */
+} socketbridge_receiver_t;
+
+/*!
+ * \brief Listen on a unix domain socket.
+ *
+ * An existing socket file at path is replaced.
+ *
+ * \param path Socket path
+ * \return     Listening socket, -1 on error
+ */
+int socketbridge_listen(const char* path);
+
+/*!
+ * \brief Connect to a unix domain socket.
+ *
+ * \param path Socket path
+ * \return     Connected socket, -1 on error
+ */
+int socketbridge_connect(const char* path);
+
+/*!
+ * \brief Start the sending side.
+ *
+ * A thread takes messages from queue in batches, frames them as header
+ * plus dataSize bytes read from data and writes up to
+ * SOCKETBRIDGE_MAXFRAMES frames with one writev. A write happens once
+ * flushBytes are framed, SOCKETBRIDGE_MAXFRAMES frames are pending or
+ * the oldest pending frame waited latency µs for more messages.
+ *
+ * \param bridge       Pointer to an uninitialized socketbridge_sender_t
+ * \param queue        Pointer to an initialized nmqueue_t
+ * \param fd           Connected stream socket, not closed by the bridge
+ * \param config       Configuration, copied
+ * \param release      Called for every written message, may be NULL
+ * \param releaseParam Data passed to release
+ * \return             Error code, ERROR_NOERROR on success
+ */
+int socketbridge_sender_initialize(socketbridge_sender_t*      bridge,
+                                   nmqueue_t*                  queue,
+                                   int                         fd,
+                                   const socketbridgeconfig_t* config,
+                                   socketbridge_release_t      release,
+                                   void*                       releaseParam);
+
+/*!
+ * \brief Stop the sending side.
+ *
+ * Pending frames are written, messages left in the queue stay there.
+ *
+ * \param bridge Pointer to an initialized socketbridge_sender_t
+ */
+void socketbridge_sender_finalize(socketbridge_sender_t* bridge);
+
+/*!
+ * \brief Start the receiving side.
+ *
+ * A thread reads from fd, decodes the frames and sends the messages to
+ * queue in batches. Payloads are copied to memory allocated with malloc,
+ * the receiver of the message has to free data. Messages sent with data
+ * NULL arrive with data NULL and the original dataSize.
+ * The thread ends at the end of the stream.
+ *
+ * \param bridge Pointer to an uninitialized socketbridge_receiver_t
+ * \param queue  Pointer to an initialized nmqueue_t
+ * \param fd     Connected stream socket, not closed by the bridge
+ * \return       Error code, ERROR_NOERROR on success
+ */
+int socketbridge_receiver_initialize(socketbridge_receiver_t* bridge,
+                                     nmqueue_t*               queue,
+                                     int                      fd);
+
+/*!
+ * \brief Stop the receiving side.
+ *
+ * Shuts down reading on fd and waits for the thread.
+ *
+ * \param bridge Pointer to an initialized socketbridge_receiver_t
+ */
+void socketbridge_receiver_finalize(socketbridge_receiver_t* bridge);
+
+#endif
@@ -0,0 +1,227 @@
+#include "spillfile.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Record sizes are multiples of 8 to keep headers aligned */
+#define SPILLFILE_ALIGN(size) ( ((size)+7) & ~(size_t)7 )
+
+/* Header in front of every record payload */
+struct spillfile_record_s
+{
+    uint64_t size;     /* Size of header and payload, 0 marks the unused end of the file */
+    uint64_t sequence; /* Fields of the message */
+    uint64_t expires;
+    uint64_t dataSize;
+    uint64_t parts;
+    void*    data;     /* Data pointer of messages without payload */
+    source_t source;
+};
+
+#define SPILLFILE_RECORDSIZE(dataSize) SPILLFILE_ALIGN( sizeof(struct spillfile_record_s)+(dataSize) )
+
+/* Offset of a record, skipping the unused end of the file */
+static size_t recordOffset(spillfile_t* spill,
+                           size_t       offset)
+{
+    if( spill->size-offset < sizeof(struct spillfile_record_s) ||
+        ((struct spillfile_record_s*)(spill->base+offset))->size == 0 )
+    {
+        return 0;
+    }
+    return offset;
+}
+
+/* Appends a record, returns 0 if it does not fit */
+static int appendRecord(spillfile_t*                    spill,
+                        const struct nmqueue_message_s* message)
+{
+    size_t                     size = SPILLFILE_RECORDSIZE( message->dataSize );
+    struct spillfile_record_s* record;
+
+    if( spill->count != 0 && spill->tail == spill->head )
+    {
+        return 0;
+    }
+
+    if( spill->tail >= spill->head && spill->size-spill->tail < size )
+    {
+        /* Continue at the start of the file */
+        if( size > spill->head )
+        {
+            return 0;
+        }
+        if( spill->size-spill->tail >= sizeof(struct spillfile_record_s) )
+        {
+            ((struct spillfile_record_s*)(spill->base+spill->tail))->size = 0;
+        }
+        spill->tail = 0;
+    }
+    else if( spill->tail < spill->head && spill->head-spill->tail < size )
+    {
+        return 0;
+    }
+
+    record = (struct spillfile_record_s*)(spill->base+spill->tail);
+
+    record->size     = size;
+    record->sequence = message->sequence;
+    record->expires  = message->expires;
+    record->dataSize = message->dataSize;
+    record->parts    = message->parts;
+    record->data     = message->dataSize != 0 ? NULL : message->data;
+    record->source   = message->source;
+
+    if( message->dataSize != 0 )
+    {
+        memcpy( record+1, message->data, message->dataSize );
+    }
+
+    spill->tail += size;
+    spill->count++;
+
+    return 1;
+}
+
+int spillfile_open(spillfile_t* spill,
+                   const char*  path,
+                   size_t       size)
+{
+    assert( spill != NULL );
+    assert( path != NULL );
+    assert( size > sizeof(struct spillfile_record_s) && size%8 == 0 );
+
+    spill->size  = size;
+    spill->head  = 0;
+    spill->tail  = 0;
+    spill->count = 0;
+
+    spill->path = (char*)malloc( strlen( path )+1 );
+    if( spill->path == NULL )
+    {
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+    strcpy( spill->path, path );
+
+    spill->fd = open( path, O_RDWR|O_CREAT|O_TRUNC, 0600 );
+    if( spill->fd < 0 )
+    {
+        free( spill->path );
+        return NMQUEUEERROR_IO;
+    }
+
+    if( ftruncate( spill->fd, size ) != 0 )
+    {
+        close( spill->fd );
+        unlink( spill->path );
+        free( spill->path );
+        return NMQUEUEERROR_IO;
+    }
+
+    spill->base = (char*)mmap( NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, spill->fd, 0 );
+    if( spill->base == (char*)MAP_FAILED )
+    {
+        close( spill->fd );
+        unlink( spill->path );
+        free( spill->path );
+        return NMQUEUEERROR_IO;
+    }
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+void spillfile_close(spillfile_t* spill)
+{
+    assert( spill != NULL );
+
+    munmap( spill->base, spill->size );
+    close( spill->fd );
+    unlink( spill->path );
+    free( spill->path );
+}
+
+int spillfile_append(spillfile_t*                    spill,
+                     const struct nmqueue_message_s* message)
+{
+    assert( spill != NULL );
+    assert( message != NULL );
+
+    return appendRecord( spill, message ) ? NMQUEUEERROR_NOERROR : NMQUEUEERROR_FULL;
+}
+
+void spillfile_mark(spillfile_t*      spill,
+                    spillfile_mark_t* mark)
+{
+    assert( spill != NULL );
+    assert( mark != NULL );
+
+    mark->head  = spill->head;
+    mark->tail  = spill->tail;
+    mark->count = spill->count;
+}
+
+void spillfile_rewind(spillfile_t*            spill,
+                      const spillfile_mark_t* mark)
+{
+    assert( spill != NULL );
+    assert( mark != NULL );
+
+    spill->head  = mark->head;
+    spill->tail  = mark->tail;
+    spill->count = mark->count;
+}
+
+size_t spillfile_first(spillfile_t* spill)
+{
+    assert( spill != NULL );
+    assert( spill->count != 0 );
+
+    return recordOffset( spill, spill->head );
+}
+
+size_t spillfile_read(spillfile_t*              spill,
+                      size_t                    offset,
+                      struct nmqueue_message_s* message)
+{
+    struct spillfile_record_s* record;
+
+    assert( spill != NULL );
+    assert( message != NULL );
+
+    offset = recordOffset( spill, offset );
+    record = (struct spillfile_record_s*)(spill->base+offset);
+
+    message->sequence = record->sequence;
+    message->expires  = record->expires;
+    message->dataSize = (size_t)record->dataSize;
+    message->parts    = (size_t)record->parts;
+    message->data     = record->dataSize != 0 ? (void*)(record+1) : record->data;
+    message->source   = record->source;
+
+    return offset+(size_t)record->size;
+}
+
+void spillfile_remove(spillfile_t* spill,
+                      size_t       count)
+{
+    assert( spill != NULL );
+    assert( count <= spill->count );
+
+    while( count-- != 0 )
+    {
+        spill->head = recordOffset( spill, spill->head );
+        spill->head += (size_t)((struct spillfile_record_s*)(spill->base+spill->head))->size;
+        spill->count--;
+    }
+
+    /* Start over at the beginning once empty */
+    if( spill->count == 0 )
+    {
+        spill->head = 0;
+        spill->tail = 0;
+    }
+}
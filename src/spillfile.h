@@ -0,0 +1,116 @@
+#ifndef _SPILLFILE_HEADER_
+#define _SPILLFILE_HEADER_
+
+#include "nmqueue.h"
+
+/*! Overflow storage of a queue.
+ *  A memory mapped file used as a circular log of messages with their
+ *  payload inline. Records are appended at tail and taken from head in
+ *  the same order. Not thread safe, the queue serializes all calls. */
+typedef struct spillfile_s
+{
+    char*  path;  /*!< Name of the file, removed on close */
+    int    fd;    /*!< File descriptor */
+    char*  base;  /*!< Mapping of size bytes */
+    size_t size;  /*!< Size of the file */
+    size_t head;  /*!< Offset of the oldest record */
+    size_t tail;  /*!< Offset behind the newest record */
+    size_t count; /*!< Number of records */
+} spillfile_t;
+
+/*! Position to undo appends, see spillfile_mark */
+typedef struct
+{
+    size_t head;  /*!< Saved head */
+    size_t tail;  /*!< Saved tail */
+    size_t count; /*!< Saved count */
+} spillfile_mark_t;
+
+/*!
+ * \brief Create a spill file.
+ *
+ * An existing file is truncated, the file is removed by spillfile_close.
+ *
+ * \param spill Pointer to an uninitialized spillfile_t
+ * \param path  Name of the file
+ * \param size  Size of the file, a multiple of the page size
+ * \return      Error code, ERROR_NOERROR on success
+ */
+int spillfile_open(spillfile_t* spill,
+                   const char*  path,
+                   size_t       size);
+
+/*!
+ * \brief Unmap and remove a spill file.
+ *
+ * \param spill Pointer to an opened spillfile_t
+ */
+void spillfile_close(spillfile_t* spill);
+
+/*!
+ * \brief Append a message.
+ *
+ * dataSize bytes of the payload are copied into the file, a payload of
+ * size 0 keeps the data pointer itself. All other fields are stored as
+ * they are.
+ *
+ * \param spill   Pointer to an opened spillfile_t
+ * \param message Message to append
+ * \return        Error code, ERROR_FULL if it does not fit
+ */
+int spillfile_append(spillfile_t*                    spill,
+                     const struct nmqueue_message_s* message);
+
+/*!
+ * \brief Remember the current end of the file.
+ *
+ * \param spill Pointer to an opened spillfile_t
+ * \param mark  Receives the position
+ */
+void spillfile_mark(spillfile_t*      spill,
+                    spillfile_mark_t* mark);
+
+/*!
+ * \brief Remove everything appended since spillfile_mark.
+ *
+ * No records may have been removed in between.
+ *
+ * \param spill Pointer to an opened spillfile_t
+ * \param mark  Position from spillfile_mark
+ */
+void spillfile_rewind(spillfile_t*            spill,
+                      const spillfile_mark_t* mark);
+
+/*!
+ * \brief Offset of the oldest record.
+ *
+ * \param spill Pointer to an opened spillfile_t, not empty
+ * \return      Offset to pass to spillfile_read
+ */
+size_t spillfile_first(spillfile_t* spill);
+
+/*!
+ * \brief Read a record.
+ *
+ * The data of a message with a payload points into the file and stays
+ * valid until the record is removed.
+ *
+ * \param spill   Pointer to an opened spillfile_t
+ * \param offset  Offset of a record
+ * \param message Receives the stored message
+ * \return        Offset of the following record
+ */
+size_t spillfile_read(spillfile_t*              spill,
+                      size_t                    offset,
+                      struct nmqueue_message_s* message);
+
+/*!
+ * \brief Remove the oldest records.
+ *
+ * \param spill Pointer to an opened spillfile_t
+ * \param count Number of records, not more than stored
+ */
+void spillfile_remove(spillfile_t* spill,
+                      size_t       count);
+
+#endif
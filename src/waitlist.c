@@ -0,0 +1,188 @@
+#include "waitlist.h"
+
+#include <stdlib.h>
+#include <sched.h>
+
+static pthread_once_t condKeyCreated = PTHREAD_ONCE_INIT;
+
+static pthread_key_t condKey;           /* Condition variable of each thread */
+static int           condKeyError = 0; /* Result of pthread_key_create */
+
+/* Destructor of condKey, called at thread exit */
+static void destroyCond(void* cond)
+{
+    pthread_cond_destroy( (pthread_cond_t*)cond );
+    free( cond );
+}
+
+static void createCondKey(void)
+{
+    condKeyError = pthread_key_create( &condKey, destroyCond );
+}
+
+/* Condition variable of the calling thread, initialized at its first block
+ * and reused for every later one. A thread blocks on one list at a time. */
+static pthread_cond_t* threadCond(void)
+{
+    pthread_cond_t* cond;
+
+    pthread_once( &condKeyCreated, createCondKey );
+    if( condKeyError != 0 )
+    {
+        return NULL;
+    }
+
+    cond = (pthread_cond_t*)pthread_getspecific( condKey );
+    if( cond == NULL )
+    {
+        cond = (pthread_cond_t*)malloc( sizeof(pthread_cond_t) );
+        if( cond == NULL )
+        {
+            return NULL;
+        }
+        if( pthread_cond_init( cond, NULL ) != 0 )
+        {
+            free( cond );
+            return NULL;
+        }
+        if( pthread_setspecific( condKey, cond ) != 0 )
+        {
+            destroyCond( cond );
+            return NULL;
+        }
+    }
+
+    return cond;
+}
+
+void waitlist_wake(struct nmqueue_waitlist_s* list,
+                   size_t                     count)
+{
+    while( count != 0 && list->head != NULL )
+    {
+        struct nmqueue_waiter_s* waiter = list->head;
+
+        list->head = waiter->next;
+        if( list->head == NULL )
+        {
+            list->tail = NULL;
+        }
+
+        waiter->woken = 1;
+        pthread_cond_signal( waiter->cond );
+        count--;
+    }
+}
+
+int waitlist_abort(struct nmqueue_waitlist_s* list,
+                   void*                      threadId)
+{
+    struct nmqueue_waiter_s* previous = NULL;
+    struct nmqueue_waiter_s* waiter;
+
+    for( waiter=list->head ; waiter != NULL ; previous=waiter, waiter=waiter->next )
+    {
+        if( waiter->threadId == threadId )
+        {
+            if( previous != NULL )
+            {
+                previous->next = waiter->next;
+            }
+            else
+            {
+                list->head = waiter->next;
+            }
+            if( list->tail == waiter )
+            {
+                list->tail = previous;
+            }
+
+            waiter->woken   = 1;
+            waiter->aborted = 1;
+            pthread_cond_signal( waiter->cond );
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int waitlist_block(pthread_mutex_t*           mutex,
+                   struct nmqueue_waitlist_s* list,
+                   struct nmqueue_waiter_s*   waiter)
+{
+    waiter->cond = threadCond();
+    if( waiter->cond == NULL )
+    {
+        pthread_mutex_unlock( mutex );
+        sched_yield();
+        pthread_mutex_lock( mutex );
+        return 0;
+    }
+
+    waiter->woken   = 0;
+    waiter->aborted = 0;
+    waiter->next    = NULL;
+
+    if( list->tail != NULL )
+    {
+        list->tail->next = waiter;
+    }
+    else
+    {
+        list->head = waiter;
+    }
+    list->tail = waiter;
+
+    while( !waiter->woken )
+    {
+        pthread_cond_wait( waiter->cond, mutex );
+    }
+
+    return 1;
+}
+
+int waitlist_take_abort(struct nmqueue_aborts_s* aborts,
+                        void*                    threadId)
+{
+    size_t i;
+
+    for( i=0 ; i<aborts->count ; ++i )
+    {
+        if( aborts->threads[i] == threadId )
+        {
+            aborts->threads[i] = aborts->threads[--aborts->count];
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void waitlist_keep_abort(struct nmqueue_aborts_s* aborts,
+                         void*                    threadId)
+{
+    size_t i;
+
+    for( i=0 ; i<aborts->count && aborts->threads[i] != threadId ; ++i );
+
+    if( i == aborts->count )
+    {
+        if( aborts->count == aborts->capacity )
+        {
+            size_t capacity = aborts->capacity != 0 ? 2*aborts->capacity : 4;
+            void** threads  = (void**)realloc( aborts->threads, capacity*sizeof(void*) );
+
+            if( threads != NULL )
+            {
+                aborts->threads  = threads;
+                aborts->capacity = capacity;
+            }
+        }
+
+        if( aborts->count != aborts->capacity )
+        {
+            aborts->threads[aborts->count++] = threadId;
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef _WAITLIST_HEADER_
+#define _WAITLIST_HEADER_
+
+#include "nmqueue.h"
+
+/*! Wake all threads of a wait list */
+#define WAITLIST_ALL ((size_t)-1)
+
+/*!
+ * \brief Wake blocked threads in FIFO order.
+ * 
+ * Woken threads are removed from the list, so none is signaled twice.
+ * The mutex protecting the list has to be locked.
+ * 
+ * \param list  Wait list
+ * \param count Number of threads to wake, WAITLIST_ALL for all
+ */
+void waitlist_wake(struct nmqueue_waitlist_s* list,
+                   size_t                     count);
+
+/*!
+ * \brief Wake one blocked thread with an abort.
+ * 
+ * The mutex protecting the list has to be locked.
+ * 
+ * \param list     Wait list
+ * \param threadId Thread to abort
+ * \return         1 if the thread was blocked on the list
+ */
+int waitlist_abort(struct nmqueue_waitlist_s* list,
+                   void*                      threadId);
+
+/*!
+ * \brief Block the calling thread on a wait list.
+ * 
+ * Appends waiter and waits until a waker removes it. threadId, needed and
+ * filter have to be set by the caller, waiter->aborted tells whether the
+ * waker was waitlist_abort.
+ * 
+ * \param mutex  Mutex protecting the list, locked
+ * \param list   Wait list
+ * \param waiter Wait node on the stack of the calling thread
+ * \return       0 without a condition variable, the mutex was released
+ *               for a moment and the caller has to poll
+ */
+int waitlist_block(pthread_mutex_t*           mutex,
+                   struct nmqueue_waitlist_s* list,
+                   struct nmqueue_waiter_s*   waiter);
+
+/*!
+ * \brief Consume a pending abort.
+ * 
+ * The mutex of the owner has to be locked.
+ * 
+ * \param aborts   Pending aborts
+ * \param threadId Thread to check
+ * \return         1 if there was one
+ */
+int waitlist_take_abort(struct nmqueue_aborts_s* aborts,
+                        void*                    threadId);
+
+/*!
+ * \brief Keep an abort for the next call of a thread.
+ * 
+ * A thread has at most one pending abort. The mutex of the owner has to
+ * be locked.
+ * 
+ * \param aborts   Pending aborts
+ * \param threadId Thread to abort
+ */
+void waitlist_keep_abort(struct nmqueue_aborts_s* aborts,
+                         void*                    threadId);
+
+#endif
@@ -0,0 +1,164 @@
+/* Test program for aborts and the wake order of blocked receivers */
+#include "src/nmqueue.h"
+#include "tests/testcheck.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+
+#define RECEIVERS 4
+#define ROUNDS    3
+
+nmqueue_t queue;
+
+/* Result of one blocked receiver */
+typedef struct
+{
+    pthread_t thread;
+    int       err;   /* Result of nmqueue_receive */
+    void*     data;  /* Received data */
+} receiverdata_t;
+
+/* Receivers of the wake order test */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    long            receiver[RECEIVERS*ROUNDS]; /* Receiver of every message, -1 until received */
+} orderdata_t;
+
+orderdata_t order;
+
+/* Entry point for single receivers, the thread id is the receiverdata_t */
+static void* receiverProc(void* param)
+{
+    receiverdata_t* rdata = (receiverdata_t*)param;
+    source_t        source;
+    size_t          dataSize;
+
+    rdata->err = nmqueue_receive( &queue, &source, &rdata->data, &dataSize, rdata );
+    return NULL;
+}
+
+/* Entry point for the wake order receivers, blocks again after every message */
+static void* orderProc(void* param)
+{
+    long     receiver = (long)param;
+    source_t source;
+    void*    data;
+    size_t   dataSize;
+    int      i;
+
+    for( i=0 ; i<ROUNDS ; ++i )
+    {
+        nmqueue_receive( &queue, &source, &data, &dataSize, NULL );
+
+        pthread_mutex_lock( &order.mutex );
+        order.receiver[(long)data] = receiver;
+        pthread_mutex_unlock( &order.mutex );
+    }
+
+    return NULL;
+}
+
+/* Gives threads time to block */
+static void settle(void)
+{
+    struct timespec delay = { 0, 50*1000*1000 };
+    nanosleep( &delay, NULL );
+}
+
+/* Waits up to 2s for message to be received, returns its receiver */
+static long receiverOf(long message)
+{
+    long receiver = -1;
+    int  waited;
+
+    for( waited=0 ; waited<2000 && receiver == -1 ; ++waited )
+    {
+        struct timespec delay = { 0, 1000*1000 };
+
+        pthread_mutex_lock( &order.mutex );
+        receiver = order.receiver[message];
+        pthread_mutex_unlock( &order.mutex );
+
+        if( receiver == -1 )
+        {
+            nanosleep( &delay, NULL );
+        }
+    }
+
+    return receiver;
+}
+
+int main(int argc, char* argv[])
+{
+    receiverdata_t first;
+    receiverdata_t second;
+    pthread_t      receivers[RECEIVERS];
+    long           errors;
+    long           i;
+
+    (void)argc;
+    (void)argv;
+
+    nmqueue_initialize( &queue, 16 );
+
+    /* Abort wakes only its target */
+    pthread_create( &first.thread, NULL, receiverProc, &first );
+    pthread_create( &second.thread, NULL, receiverProc, &second );
+    settle();
+    nmqueue_abort( &queue, &first );
+    pthread_join( first.thread, NULL );
+    check( "targeted abort", first.err == NMQUEUEERROR_ABORT );
+
+    nmqueue_send( &queue, 0, (void*)&second, 0, NULL );
+    pthread_join( second.thread, NULL );
+    check( "other receiver keeps waiting", second.err == NMQUEUEERROR_NOERROR && second.data == &second );
+
+    /* Abort before the call is kept, a cleared one is not */
+    nmqueue_abort( &queue, &first );
+    receiverProc( &first );
+    check( "abort before receive", first.err == NMQUEUEERROR_ABORT );
+
+    nmqueue_abort( &queue, &first );
+    nmqueue_clear_abort( &queue, &first );
+    nmqueue_send( &queue, 0, (void*)&first, 0, NULL );
+    receiverProc( &first );
+    check( "cleared abort", first.err == NMQUEUEERROR_NOERROR && first.data == &first );
+
+    /* Receivers block one after the other and are woken in that order,
+     * every round they block again in the same order */
+    pthread_mutex_init( &order.mutex, NULL );
+    for( i=0 ; i<RECEIVERS*ROUNDS ; ++i )
+    {
+        order.receiver[i] = -1;
+    }
+    for( i=0 ; i<RECEIVERS ; ++i )
+    {
+        pthread_create( &receivers[i], NULL, orderProc, (void*)i );
+        settle();
+    }
+
+    errors = 0;
+    for( i=0 ; i<RECEIVERS*ROUNDS ; ++i )
+    {
+        nmqueue_send( &queue, 0, (void*)i, 0, NULL );
+        if( receiverOf( i ) != i % RECEIVERS )
+        {
+            errors++;
+        }
+        /* Until the receiver blocked again */
+        settle();
+    }
+    for( i=0 ; i<RECEIVERS ; ++i )
+    {
+        pthread_join( receivers[i], NULL );
+    }
+    pthread_mutex_destroy( &order.mutex );
+    check( "fifo wake order", errors == 0 );
+
+    nmqueue_finalize( &queue );
+
+    return checkResult();
+}
@@ -0,0 +1,238 @@
+/* Test program for asynchronous sends and receives of single messages and groups */
+#include "src/nmqueue.h"
+#include "tests/testcheck.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define MAXPARTS 8
+
+#define PENDING_OF(err) ((err) == NMQUEUEERROR_PENDING)
+
+nmqueue_t queue;
+
+/* Continuation, counts the resumptions in param */
+static void resume(struct nmqueue_async_s* operation)
+{
+    (*(int*)operation->param)++;
+}
+
+static void prepare(struct nmqueue_async_s* operation,
+                    int*                    resumed)
+{
+    *resumed                 = 0;
+    operation->resume        = resume;
+    operation->param         = resumed;
+    operation->executor      = NULL;
+    operation->executorParam = NULL;
+}
+
+/* Prepares a send operation of data */
+static void prepareSend(struct nmqueue_async_s* operation,
+                        int*                    resumed,
+                        long                    data)
+{
+    prepare( operation, resumed );
+    operation->message.source   = 0;
+    operation->message.data     = (void*)data;
+    operation->message.dataSize = 0;
+    operation->message.expires  = 0;
+}
+
+/* Takes the next message without blocking, checks its data */
+static int receiveNext(long data)
+{
+    struct nmqueue_message_s message;
+
+    return nmqueue_tryreceive( &queue, &message.source, &message.data, &message.dataSize, NULL ) == NMQUEUEERROR_NOERROR &&
+           message.data == (void*)data;
+}
+
+/* Sends a group of count parts carrying id */
+static int sendGroup(size_t count,
+                     long   id)
+{
+    struct nmqueue_message_s parts[MAXPARTS];
+    size_t                   i;
+
+    for( i=0 ; i<count ; ++i )
+    {
+        parts[i].source   = (source_t)i;
+        parts[i].data     = (void*)id;
+        parts[i].dataSize = count;
+        parts[i].expires  = 0;
+    }
+    return nmqueue_send_group( &queue, parts, count, NULL );
+}
+
+/* Checks that messages hold the last count parts of a group of total
+ * parts carrying id, in order */
+static int groupParts(const struct nmqueue_message_s* messages,
+                      size_t                          count,
+                      size_t                          total,
+                      long                            id)
+{
+    size_t i;
+
+    for( i=0 ; i<count ; ++i )
+    {
+        if( messages[i].data != (void*)id || messages[i].dataSize != total ||
+            messages[i].source != (source_t)(total-count+i) || messages[i].parts != count-i ||
+            messages[i].sequence != messages[0].sequence+i )
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Single messages on a queue with three usable slots */
+static void runMessages(void)
+{
+    struct nmqueue_async_s operations[3];
+    int                    resumed[3];
+    int                    pending;
+    int                    err;
+    long                   i;
+
+    nmqueue_initialize( &queue, 4 );
+
+    /* Immediate completion from the ring buffer */
+    nmqueue_send( &queue, 1, (void*)1, 0, NULL );
+    prepare( &operations[0], &resumed[0] );
+    err = nmqueue_receive_async( &queue, &operations[0] );
+    check( "message taken at once", err == NMQUEUEERROR_NOERROR && resumed[0] == 0 &&
+                                    operations[0].error == NMQUEUEERROR_NOERROR &&
+                                    operations[0].message.data == (void*)1 );
+
+    /* A sent message resumes the oldest suspended receive */
+    prepare( &operations[0], &resumed[0] );
+    prepare( &operations[1], &resumed[1] );
+    pending  = PENDING_OF( nmqueue_receive_async( &queue, &operations[0] ) );
+    pending += PENDING_OF( nmqueue_receive_async( &queue, &operations[1] ) );
+    check( "receives suspended", pending == 2 );
+
+    nmqueue_send( &queue, 2, (void*)2, 0, NULL );
+    check( "oldest receive resumed", resumed[0] == 1 && resumed[1] == 0 &&
+                                     operations[0].error == NMQUEUEERROR_NOERROR &&
+                                     operations[0].message.source == 2 && operations[0].message.data == (void*)2 );
+    nmqueue_send( &queue, 3, (void*)3, 0, NULL );
+    check( "next receive resumed", resumed[1] == 1 && operations[1].message.data == (void*)3 &&
+                                   nmqueue_occupancy( &queue ) == 0 );
+
+    /* Sends suspended on a full queue are written as slots get free */
+    for( i=10 ; i<13 ; ++i )
+    {
+        nmqueue_send( &queue, 0, (void*)i, 0, NULL );
+    }
+    prepareSend( &operations[0], &resumed[0], 20 );
+    prepareSend( &operations[1], &resumed[1], 21 );
+    pending  = PENDING_OF( nmqueue_send_async( &queue, &operations[0] ) );
+    pending += PENDING_OF( nmqueue_send_async( &queue, &operations[1] ) );
+    check( "sends suspended", pending == 2 );
+
+    check( "oldest send resumed", receiveNext( 10 ) && resumed[0] == 1 && resumed[1] == 0 &&
+                                  operations[0].error == NMQUEUEERROR_NOERROR );
+    check( "next send resumed", receiveNext( 11 ) && resumed[1] == 1 );
+    check( "sent in order", receiveNext( 12 ) && receiveNext( 20 ) && receiveNext( 21 ) );
+
+    /* Cancelled operations are not resumed */
+    prepare( &operations[0], &resumed[0] );
+    nmqueue_receive_async( &queue, &operations[0] );
+    check( "cancel", nmqueue_cancel_async( &queue, &operations[0] ) == 1 && operations[0].error == NMQUEUEERROR_ABORT );
+    nmqueue_send( &queue, 4, (void*)4, 0, NULL );
+    check( "cancelled stays untouched", resumed[0] == 0 && nmqueue_occupancy( &queue ) == 1 );
+
+    nmqueue_finalize( &queue );
+}
+
+/* Groups go to one operation as a whole */
+static void runGroups(void)
+{
+    struct nmqueue_async_s   operations[3];
+    struct nmqueue_message_s received[3][MAXPARTS];
+    int                      resumed[3];
+    struct nmqueue_message_s message;
+    size_t                   count;
+    int                      pending;
+    int                      err;
+
+    nmqueue_initialize( &queue, 32 );
+
+    /* Immediate completion from the ring buffer */
+    prepare( &operations[0], &resumed[0] );
+    sendGroup( 4, 1 );
+    err = nmqueue_receive_group_async( &queue, &operations[0], received[0], MAXPARTS );
+    check( "group taken at once", err == NMQUEUEERROR_NOERROR && resumed[0] == 0 &&
+                                  operations[0].count == 4 && groupParts( received[0], 4, 4, 1 ) );
+
+    /* A group sent to suspended operations goes to the oldest as a whole */
+    prepare( &operations[0], &resumed[0] );
+    prepare( &operations[1], &resumed[1] );
+    prepare( &operations[2], &resumed[2] );
+    pending  = PENDING_OF( nmqueue_receive_group_async( &queue, &operations[0], received[0], MAXPARTS ) );
+    pending += PENDING_OF( nmqueue_receive_group_async( &queue, &operations[1], received[1], MAXPARTS ) );
+    pending += PENDING_OF( nmqueue_receive_group_async( &queue, &operations[2], received[2], 2 ) );
+    check( "suspended", pending == 3 );
+
+    sendGroup( 3, 2 );
+    check( "group resumes one operation", resumed[0] == 1 && resumed[1] == 0 && resumed[2] == 0 &&
+                                          operations[0].error == NMQUEUEERROR_NOERROR &&
+                                          operations[0].count == 3 && groupParts( received[0], 3, 3, 2 ) );
+    check( "nothing left behind", nmqueue_tryreceive( &queue, &message.source, &message.data,
+                                                      &message.dataSize, NULL ) == NMQUEUEERROR_EMPTY );
+
+    /* A single message completes a group operation with one part */
+    nmqueue_send( &queue, 9, (void*)3, 0, NULL );
+    check( "single message", resumed[1] == 1 && resumed[2] == 0 && operations[1].count == 1 &&
+                             received[1][0].data == (void*)3 && received[1][0].parts == 1 );
+
+    /* A group larger than maxCount stays in the queue */
+    sendGroup( 3, 4 );
+    check( "oversized group", resumed[2] == 1 && operations[2].error == NMQUEUEERROR_FULL &&
+                              operations[2].count == 0 );
+    err = nmqueue_tryreceive_group( &queue, received[2], MAXPARTS, &count, NULL );
+    check( "oversized group left queued", err == NMQUEUEERROR_NOERROR && count == 3 && groupParts( received[2], 3, 3, 4 ) );
+
+    /* A single receive takes one part, the next group operation the rest,
+     * the operation behind them waits for the next group */
+    prepare( &operations[0], &resumed[0] );
+    prepare( &operations[1], &resumed[1] );
+    prepare( &operations[2], &resumed[2] );
+    pending  = PENDING_OF( nmqueue_receive_async( &queue, &operations[0] ) );
+    pending += PENDING_OF( nmqueue_receive_group_async( &queue, &operations[1], received[1], MAXPARTS ) );
+    pending += PENDING_OF( nmqueue_receive_group_async( &queue, &operations[2], received[2], MAXPARTS ) );
+    check( "mixed suspended", pending == 3 );
+
+    sendGroup( 5, 5 );
+    check( "single receive takes one part", resumed[0] == 1 && operations[0].count == 1 &&
+                                            operations[0].message.data == (void*)5 &&
+                                            operations[0].message.parts == 5 );
+    check( "group receive takes the rest", resumed[1] == 1 && operations[1].count == 4 &&
+                                           groupParts( received[1], 4, 5, 5 ) &&
+                                           received[1][0].sequence == operations[0].message.sequence+1 );
+    check( "later operation still suspended", resumed[2] == 0 );
+
+    sendGroup( 2, 6 );
+    check( "next group", resumed[2] == 1 && operations[2].count == 2 && groupParts( received[2], 2, 2, 6 ) );
+
+    /* Cancelled operations are not resumed */
+    prepare( &operations[0], &resumed[0] );
+    nmqueue_receive_group_async( &queue, &operations[0], received[0], MAXPARTS );
+    check( "cancel", nmqueue_cancel_async( &queue, &operations[0] ) == 1 && operations[0].error == NMQUEUEERROR_ABORT );
+    sendGroup( 2, 7 );
+    check( "cancelled stays untouched", resumed[0] == 0 && nmqueue_occupancy( &queue ) == 2 );
+
+    nmqueue_finalize( &queue );
+}
+
+int main(int argc, char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    runMessages();
+    runGroups();
+
+    return checkResult();
+}
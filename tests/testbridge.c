@@ -0,0 +1,197 @@
+/* Test program comparing the socket bridge with the in-process queue */
+#include "src/nmqueue.h"
+#include "src/receiverthread.h"
+#include "src/senderthread.h"
+#include "src/socketbridge.h"
+
+#include "tools/measureutil.h"
+#include "tools/tscclock.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+nmqueue_t input;
+nmqueue_t output;
+
+/* Data passed to the sending thread */
+typedef struct
+{
+    long   sent;  /* Number of sent messages */
+    long   count; /* Number of messages to be send */
+    size_t size;  /* Payload size, at least sizeof(int64_t) */
+} producerdata_t;
+
+/* Data passed to the receiving thread */
+typedef struct
+{
+    volatile long count; /* Number of received messages */
+    int64_t*      delta; /* Array: Time from send to receive of each message */
+} consumerdata_t;
+
+/* Idle strategy of the sending thread once all messages are sent */
+static const idleconfig_t producerIdle = { IDLESTRATEGY_SPINYIELD, 0, 0, 0 };
+
+/* Current time in µs */
+static int64_t now(void)
+{
+    return (int64_t)tscclock_us();
+}
+
+/* Callback for sending thread, payload starts with the send time */
+int producer(source_t* source,
+             void**    data,
+             size_t*   dataSize,
+             void*     param)
+{
+    producerdata_t* pdata = (producerdata_t*)param;
+    int64_t         sendTime;
+
+    if( pdata->sent == pdata->count )
+    {
+        return SENDERTHREAD_NODATA;
+    }
+
+    *source   = 0;
+    *data     = malloc( pdata->size );
+    *dataSize = pdata->size;
+
+    memset( *data, 0, pdata->size );
+    sendTime = now();
+    memcpy( *data, &sendTime, sizeof(sendTime) );
+
+    pdata->sent++;
+
+    return SENDERTHREAD_DATA;
+}
+
+/* Callback for receiving thread */
+void consumer(source_t source,
+              void*    data,
+              size_t   dataSize,
+              void*    param)
+{
+    consumerdata_t* cdata = (consumerdata_t*)param;
+    int64_t         sendTime;
+
+    memcpy( &sendTime, data, sizeof(sendTime) );
+    cdata->delta[cdata->count] = now()-sendTime;
+    free( data );
+
+    cdata->count++;
+}
+
+/* Callback for the bridge, payloads are written */
+void release(source_t source,
+             void*    data,
+             size_t   dataSize,
+             void*    param)
+{
+    free( data );
+}
+
+/*
+ * Sends count messages of size bytes, either through the queue only or
+ * through queue, socket bridge and a second queue.
+ */
+void testbridge(size_t size,
+                long   count,
+                int    bridged)
+{
+    static const socketbridgeconfig_t config = { 64*1024, 0 };
+
+    senderthread_t          sender;
+    receiverthread_t        receiver;
+    socketbridge_sender_t   bridgeSender;
+    socketbridge_receiver_t bridgeReceiver;
+    producerdata_t          pdata;
+    consumerdata_t          cdata;
+    int                     fds[2];
+    int64_t                 start;
+    int64_t                 total;
+
+    /* Fresh queues, no aborts left over from the previous run */
+    if( nmqueue_initialize( &input, 1024 ) != NMQUEUEERROR_NOERROR ||
+        nmqueue_initialize( &output, 1024 ) != NMQUEUEERROR_NOERROR )
+    {
+        printf("Failed to initialize nmqueue\n");
+        return;
+    }
+
+    pdata.sent  = 0;
+    pdata.count = count;
+    pdata.size  = size;
+    cdata.count = 0;
+    cdata.delta = (int64_t*)malloc( count*sizeof(int64_t) );
+
+    if( bridged )
+    {
+        if( socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) != 0 )
+        {
+            printf("Failed to create socket pair\n");
+            nmqueue_finalize( &output );
+            nmqueue_finalize( &input );
+            free( cdata.delta );
+            return;
+        }
+        socketbridge_receiver_initialize( &bridgeReceiver, &output, fds[1] );
+        socketbridge_sender_initialize( &bridgeSender, &input, fds[0], &config, release, NULL );
+    }
+
+    initializeReceiver( &receiver, bridged ? &output : &input, consumer, &cdata );
+
+    start = now();
+    initializeSenderIdle( &sender, &input, producer, &pdata, &producerIdle );
+
+    while( cdata.count != count )
+    {
+        sched_yield();
+    }
+
+    total = now()-start;
+
+    finalizeSender( &sender );
+    finalizeReceiver( &receiver );
+
+    printf("%-10s %7lu bytes: %9.0f msg/s %8.1f MB/s latency %li µs +- %li",
+           bridged ? "bridge" : "in-process", (unsigned long)size,
+           (double)count*1000*1000/total, (double)count*size/total,
+           (long)mu_mean( cdata.delta, count ), (long)mu_deviation( cdata.delta, count ) );
+
+    if( bridged )
+    {
+        socketbridge_sender_finalize( &bridgeSender );
+        close( fds[0] );
+        socketbridge_receiver_finalize( &bridgeReceiver );
+        close( fds[1] );
+        printf(", %.1f messages per write", (double)bridgeSender.sent/bridgeSender.writes);
+    }
+
+    printf("\n");
+
+    nmqueue_finalize( &output );
+    nmqueue_finalize( &input );
+
+    free( cdata.delta );
+}
+
+int main()
+{
+    static const size_t sizes[] = { 16, 256, 4096, 65536 };
+    size_t i;
+
+    tscclock_initialize();
+
+    for( i=0 ; i<sizeof(sizes)/sizeof(sizes[0]) ; ++i )
+    {
+        long count = sizes[i] >= 4096 ? 20000 : 100000;
+
+        testbridge( sizes[i], count, 0 );
+        testbridge( sizes[i], count, 1 );
+    }
+
+    return 0;
+}
@@ -0,0 +1,27 @@
+/* Result reporting shared by the test programs */
+#ifndef _TESTCHECK_HEADER_
+#define _TESTCHECK_HEADER_
+
+#include <stdio.h>
+
+static int failed; /* Set once a check failed */
+
+/* Prints the result of one check */
+static void check(const char* name,
+                  int         ok)
+{
+    printf( "%-40s %s\n", name, ok ? "ok" : "FAILED" );
+    if( !ok )
+    {
+        failed = 1;
+    }
+}
+
+/* Prints the overall result, returns the exit code of the test program */
+static int checkResult(void)
+{
+    printf( failed ? "FAILED\n" : "OK\n" );
+    return failed;
+}
+
+#endif
@@ -0,0 +1,133 @@
+/* Test program for the conflating queue */
+#include "src/nmqueue.h"
+#include "src/conflatequeue.h"
+#include "tests/testcheck.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+
+#define SOURCES 4
+
+conflatequeue_t queue;
+
+/* Result of one blocked receiver, the thread id is the receiverdata_t */
+typedef struct
+{
+    pthread_t thread;
+    int       err;    /* Result of conflatequeue_receive */
+    source_t  source; /* Received source */
+    void*     data;   /* Received data */
+} receiverdata_t;
+
+/* Gives threads time to block */
+static void settle(void)
+{
+    struct timespec delay = { 0, 50*1000*1000 };
+    nanosleep( &delay, NULL );
+}
+
+/* Entry point for blocked receivers */
+static void* receiverProc(void* param)
+{
+    receiverdata_t* rdata = (receiverdata_t*)param;
+    size_t          dataSize;
+
+    rdata->err = conflatequeue_receive( &queue, &rdata->source, &rdata->data, &dataSize, rdata );
+    return NULL;
+}
+
+/* Sends data for source, ignores the replaced data */
+static int sendData(source_t source,
+                    long     data)
+{
+    void*  oldData;
+    size_t oldDataSize;
+
+    return conflatequeue_send( &queue, source, (void*)data, 0, &oldData, &oldDataSize );
+}
+
+/* Takes the next message without blocking, checks source and data */
+static int receiveNext(source_t source,
+                       long     data)
+{
+    source_t received;
+    void*    receivedData;
+    size_t   dataSize;
+
+    return conflatequeue_tryreceive( &queue, &received, &receivedData, &dataSize, NULL ) == NMQUEUEERROR_NOERROR &&
+           received == source && receivedData == (void*)data;
+}
+
+int main(int argc, char* argv[])
+{
+    receiverdata_t first;
+    receiverdata_t second;
+    source_t       source;
+    void*          data;
+    void*          oldData;
+    size_t         oldDataSize;
+    size_t         dataSize;
+
+    (void)argc;
+    (void)argv;
+
+    conflatequeue_initialize( &queue, SOURCES );
+
+    check( "empty", conflatequeue_tryreceive( &queue, &source, &data, &dataSize, NULL ) == NMQUEUEERROR_EMPTY );
+
+    /* A newer message replaces the older one of the same source */
+    check( "first message kept", conflatequeue_send( &queue, 1, (void*)10, 1, &oldData, &oldDataSize ) == 0 &&
+                                 oldData == NULL && oldDataSize == 0 );
+    check( "older message returned", conflatequeue_send( &queue, 1, (void*)11, 2, &oldData, &oldDataSize ) == 1 &&
+                                     oldData == (void*)10 && oldDataSize == 1 );
+    check( "latest message received", conflatequeue_tryreceive( &queue, &source, &data, &dataSize, NULL ) == NMQUEUEERROR_NOERROR &&
+                                      source == 1 && data == (void*)11 && dataSize == 2 );
+    check( "replaced one is gone", conflatequeue_tryreceive( &queue, &source, &data, &dataSize, NULL ) == NMQUEUEERROR_EMPTY );
+
+    /* Sources are kept apart, a replaced one keeps its position */
+    sendData( 0, 20 );
+    sendData( 3, 30 );
+    sendData( 2, 40 );
+    sendData( 3, 31 );
+    sendData( 0, 21 );
+    check( "replaced in place", receiveNext( 0, 21 ) && receiveNext( 3, 31 ) && receiveNext( 2, 40 ) );
+    check( "conflated count", conflatequeue_conflated( &queue ) == 3 );
+
+    /* A blocked receiver wakes on a send */
+    pthread_create( &first.thread, NULL, receiverProc, &first );
+    settle();
+    sendData( 2, 50 );
+    pthread_join( first.thread, NULL );
+    check( "blocking receive", first.err == NMQUEUEERROR_NOERROR && first.source == 2 && first.data == (void*)50 );
+
+    /* Abort wakes only its target */
+    pthread_create( &first.thread, NULL, receiverProc, &first );
+    pthread_create( &second.thread, NULL, receiverProc, &second );
+    settle();
+    conflatequeue_abort( &queue, &first );
+    pthread_join( first.thread, NULL );
+    check( "targeted abort", first.err == NMQUEUEERROR_ABORT );
+
+    sendData( 1, 60 );
+    pthread_join( second.thread, NULL );
+    check( "other receiver keeps waiting", second.err == NMQUEUEERROR_NOERROR && second.data == (void*)60 );
+
+    /* Aborts before the call are kept per thread, a cleared one is not */
+    conflatequeue_abort( &queue, &first );
+    conflatequeue_abort( &queue, &second );
+    receiverProc( &first );
+    receiverProc( &second );
+    check( "aborts before receive", first.err == NMQUEUEERROR_ABORT && second.err == NMQUEUEERROR_ABORT );
+
+    conflatequeue_abort( &queue, &first );
+    conflatequeue_clear_abort( &queue, &first );
+    sendData( 0, 70 );
+    receiverProc( &first );
+    check( "cleared abort", first.err == NMQUEUEERROR_NOERROR && first.data == (void*)70 );
+
+    conflatequeue_finalize( &queue );
+
+    return checkResult();
+}
@@ -0,0 +1,113 @@
+/* Test program for asynchronous senders under a credit limit */
+#include "src/nmqueue.h"
+#include "tests/testcheck.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define LENGTH    4  /* Three usable slots */
+#define LIMITED   0  /* Source with a credit limit */
+#define UNLIMITED 5  /* Source beyond the limited ones */
+#define SENDS     3
+
+nmqueue_t queue;
+
+/* Continuation, counts the resumptions in param */
+static void resume(struct nmqueue_async_s* operation)
+{
+    (*(int*)operation->param)++;
+}
+
+/* Suspends SENDS sends of LIMITED behind a queue full of UNLIMITED
+ * messages, returns the number suspended */
+static int suspendSends(struct nmqueue_async_s* operations,
+                        int*                    resumed)
+{
+    int pending = 0;
+    int i;
+
+    for( i=0 ; i<LENGTH-1 ; ++i )
+    {
+        nmqueue_send( &queue, UNLIMITED, NULL, 0, NULL );
+    }
+
+    for( i=0 ; i<SENDS ; ++i )
+    {
+        resumed[i]                     = 0;
+        operations[i].message.source   = LIMITED;
+        operations[i].message.data     = (void*)(long)(10+i);
+        operations[i].message.dataSize = 0;
+        operations[i].message.expires  = 0;
+        operations[i].resume           = resume;
+        operations[i].param            = &resumed[i];
+        operations[i].executor         = NULL;
+        operations[i].executorParam    = NULL;
+
+        if( nmqueue_send_async( &queue, &operations[i] ) == NMQUEUEERROR_PENDING )
+        {
+            pending++;
+        }
+    }
+
+    return pending;
+}
+
+/* Takes the next message without blocking, checks source and data */
+static int receiveNext(source_t source,
+                       long     data)
+{
+    source_t received;
+    void*    receivedData;
+    size_t   dataSize;
+
+    return nmqueue_tryreceive( &queue, &received, &receivedData, &dataSize, NULL ) == NMQUEUEERROR_NOERROR &&
+           received == source && receivedData == (void*)data;
+}
+
+/* Receives the UNLIMITED messages, which refills two of the sends */
+static int receiveUnlimited(void)
+{
+    int ok = 1;
+    int i;
+
+    for( i=0 ; i<LENGTH-1 ; ++i )
+    {
+        ok = receiveNext( UNLIMITED, 0 ) && ok;
+    }
+
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    struct nmqueue_async_s operations[SENDS];
+    int                    resumed[SENDS];
+
+    (void)argc;
+    (void)argv;
+
+    nmqueue_initialize( &queue, LENGTH );
+    nmqueue_set_credits( &queue, 2, 2 );
+
+    /* A free slot is not enough without a credit */
+    check( "suspended", suspendSends( operations, resumed ) == SENDS );
+    check( "full queue drained", receiveUnlimited() );
+    check( "refilled within the limit", resumed[0] == 1 && resumed[1] == 1 && resumed[2] == 0 &&
+                                        nmqueue_occupancy( &queue ) == 2 );
+
+    /* A received message of the source returns its credit */
+    check( "oldest received", receiveNext( LIMITED, 10 ) );
+    check( "refilled with the credit", resumed[2] == 1 && operations[2].error == NMQUEUEERROR_NOERROR );
+    check( "sent in order", receiveNext( LIMITED, 11 ) && receiveNext( LIMITED, 12 ) );
+
+    /* A raised limit refills right away */
+    check( "suspended again", suspendSends( operations, resumed ) == SENDS );
+    check( "drained again", receiveUnlimited() && resumed[2] == 0 );
+    nmqueue_set_credits( &queue, 2, 3 );
+    check( "refilled by a raised limit", resumed[2] == 1 && nmqueue_occupancy( &queue ) == 3 );
+    check( "still in order", receiveNext( LIMITED, 10 ) && receiveNext( LIMITED, 11 ) && receiveNext( LIMITED, 12 ) );
+
+    nmqueue_finalize( &queue );
+
+    return checkResult();
+}
@@ -0,0 +1,136 @@
+/* Test program for delay queue ordering across timing wheel levels */
+#include "src/nmqueue.h"
+#include "src/delayqueue.h"
+#include "tests/testcheck.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#define RESOLUTION 1000 /* Tick in µs */
+#define CAPACITY   1024
+#define RANDOM     300  /* Messages at pseudo random delays */
+
+nmqueue_t    queue;
+delayqueue_t delayQueue;
+
+/* Delays in ticks at the edges of the first three levels */
+static const uint64_t boundaries[] = { 0, 1, 2, 63, 64, 65, 127, 128, 129, 4095, 4096, 4097 };
+
+#define BOUNDARIES (sizeof(boundaries)/sizeof(boundaries[0]))
+#define MESSAGES   (2*(BOUNDARIES+RANDOM))
+
+uint64_t notBefore[MESSAGES]; /* Requested time of every message */
+uint64_t due[MESSAGES];       /* Requested time, or the send time if that is later */
+
+/* Current CLOCK_MONOTONIC time in µs */
+static uint64_t monotonicNow(void)
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t)now.tv_sec*1000*1000+now.tv_nsec/1000;
+}
+
+/* Sends half of the messages starting with index first, boundary delays
+ * and pseudo random ones in random order, not aligned to a tick */
+static long sendHalf(size_t first)
+{
+    uint64_t now    = monotonicNow();
+    long     errors = 0;
+    size_t   i;
+
+    for( i=0 ; i<BOUNDARIES+RANDOM ; ++i )
+    {
+        size_t   index = first+i;
+        uint64_t ticks = i < BOUNDARIES ? boundaries[i] : (uint64_t)((i*7919) % 300);
+
+        notBefore[index] = now+ticks*RESOLUTION+(uint64_t)((index*37) % RESOLUTION);
+
+        /* A few are due already */
+        if( index % 101 == 0 )
+        {
+            notBefore[index] = now-RESOLUTION;
+        }
+
+        due[index] = notBefore[index] > monotonicNow() ? notBefore[index] : monotonicNow();
+
+        if( delayqueue_send_at( &delayQueue, 0, (void*)index, 0, notBefore[index] ) != NMQUEUEERROR_NOERROR )
+        {
+            errors++;
+        }
+    }
+
+    return errors;
+}
+
+int main(int argc, char* argv[])
+{
+    struct timespec pause = { 0, 37*1000*1000 };
+    uint64_t        previous = 0;
+    uint64_t        latest   = 0;
+    long            early    = 0;
+    long            order    = 0;
+    long            errors;
+    size_t          i;
+
+    (void)argc;
+    (void)argv;
+
+    nmqueue_initialize( &queue, 2*CAPACITY );
+    delayqueue_initialize( &delayQueue, &queue, CAPACITY, RESOLUTION );
+
+    /* The second half starts at a tick in the middle of a level 0 rotation */
+    errors = sendHalf( 0 );
+    nanosleep( &pause, NULL );
+    errors += sendHalf( BOUNDARIES+RANDOM );
+    check( "send", errors == 0 );
+
+    for( i=0 ; i<MESSAGES ; ++i )
+    {
+        source_t source;
+        void*    data;
+        size_t   dataSize;
+        size_t   index;
+        uint64_t now;
+
+        nmqueue_receive( &queue, &source, &data, &dataSize, NULL );
+        now   = monotonicNow();
+        index = (size_t)data;
+
+        if( now < notBefore[index] )
+        {
+            early++;
+        }
+
+        /* Only messages due within the same tick may pass each other */
+        if( i != 0 && previous >= due[index]+RESOLUTION )
+        {
+            order++;
+        }
+        previous = due[index];
+
+        if( now-notBefore[index] > latest && now > notBefore[index] )
+        {
+            latest = now-notBefore[index];
+        }
+    }
+
+    printf( "%lu messages, latest %lu µs after due\n", (unsigned long)MESSAGES, (unsigned long)latest );
+    check( "never early", early == 0 );
+    check( "due order across levels", order == 0 );
+    check( "nothing pending", delayqueue_pending( &delayQueue ) == 0 );
+
+    /* Capacity */
+    errors = 0;
+    for( i=0 ; i<CAPACITY ; ++i )
+    {
+        errors += delayqueue_send_after( &delayQueue, 0, NULL, 0, 60*1000*1000 ) != NMQUEUEERROR_NOERROR;
+    }
+    check( "full at capacity", errors == 0 && delayqueue_pending( &delayQueue ) == CAPACITY &&
+                               delayqueue_send_after( &delayQueue, 0, NULL, 0, 1000 ) == NMQUEUEERROR_FULL );
+
+    delayqueue_finalize( &delayQueue );
+    nmqueue_finalize( &queue );
+
+    return checkResult();
+}
@@ -3,7 +3,7 @@
 #include "src/receiverthread.h"
 #include "src/senderthread.h"
 
-#include "tools/timespecutil.h"
+#include "tools/tscclock.h"
 
 #include <stdlib.h>
 #include <semaphore.h>
@@ -42,6 +42,9 @@ producerdata_t* producerData;
 /* Data array for all receiving threads */
 consumerdata_t* consumerData;
 
+/* Idle strategy of the sending threads once all messages are sent */
+static const idleconfig_t producerIdle = { IDLESTRATEGY_SPINYIELD, 0, 0, 0 };
+
 /* Callback for sending thread */
 int producer(source_t* source,
              void**    data,
@@ -66,10 +69,6 @@ int producer(source_t* source,
 
         return 0;
     }
-    else
-    {
-        sched_yield();
-    }
 
     return 1;
 }
@@ -91,6 +90,20 @@ void consumer(source_t source,
 
 }
 
+/* Callback for batch receiving thread */
+void batchConsumer(struct nmqueue_message_s* messages,
+                   size_t                    count,
+                   void*                     param)
+{
+    size_t i;
+
+    for( i=0 ; i<count ; ++i )
+    {
+        consumer(messages[i].source, messages[i].data, messages[i].dataSize, param);
+    }
+
+}
+
 /* Get the number of messages received by all threads */
 long getTotalConsumed(unsigned int consumers)
 {
@@ -110,7 +123,9 @@ long getTotalConsumed(unsigned int consumers)
  */
 void testnm(unsigned int n,
             unsigned int m,
-            long count)
+            long count,
+            size_t batchSize,       /*< 0 for single message receivers */
+            size_t senderBatchSize) /*< 0 for single message senders */
 {
 
     int i;
@@ -141,31 +156,42 @@ void testnm(unsigned int n,
     /* Create sending threads */
     for( i=0 ; i<n ; ++i )
     {
-        initializeSender(&senders[i], &queue, producer, &producerData[i]);
+        if( senderBatchSize == 0 )
+        {
+            initializeSenderIdle(&senders[i], &queue, producer, &producerData[i], &producerIdle);
+        }
+        else
+        {
+            initializeBatchSender(&senders[i], &queue, producer, &producerData[i], senderBatchSize, 100, &producerIdle);
+        }
     }
 
     /* Create receiving threads */
     for( i=0 ; i<m ; ++i )
     {
-        initializeReceiver(&receivers[i], &queue, consumer, &consumerData[i]);
+        if( batchSize == 0 )
+        {
+            initializeReceiver(&receivers[i], &queue, consumer, &consumerData[i]);
+        }
+        else
+        {
+            initializeBatchReceiver(&receivers[i], &queue, batchConsumer, &consumerData[i], batchSize);
+        }
     }
 
     /* Run test */
     started = 1;
     {
-        struct timespec starttime;
-        struct timespec stoptime;
+        uint64_t starttime;
         int64_t delta;
-        clock_gettime( CLOCK_MONOTONIC, &starttime );
+        starttime = tscclock_ticks();
 
         do
         {
             sched_yield();
         } while(getTotalConsumed(m)<n*count);
 
-        clock_gettime( CLOCK_MONOTONIC, &stoptime );
-
-        delta = timespec_to_us( stoptime )-timespec_to_us( starttime );
+        delta = (int64_t)( tscclock_ticks_to_ns( tscclock_ticks()-starttime )/1000 );
 
         printf("Total time consumed %li µs\n", (long int)delta);
 
@@ -222,6 +248,8 @@ void testnm(unsigned int n,
 
 int main()
 {
+    tscclock_initialize();
+
     {
         int err;
         if( (err=nmqueue_initialize(&queue,1024)) != NMQUEUEERROR_NOERROR)
@@ -230,7 +258,9 @@ int main()
         }
     }
 
-    testnm(PRODUCER_COUNT, CONSUMER_COUNT, 1000000);
+    testnm(PRODUCER_COUNT, CONSUMER_COUNT, 1000000, 0, 0);
+    testnm(PRODUCER_COUNT, CONSUMER_COUNT, 1000000, 64, 0);
+    testnm(PRODUCER_COUNT, CONSUMER_COUNT, 1000000, 64, 64);
 
     nmqueue_finalize(&queue);
 
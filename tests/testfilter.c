@@ -0,0 +1,249 @@
+/* Test program for filtered receivers mixed with unfiltered ones */
+#include "src/nmqueue.h"
+#include "tests/testcheck.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define SOURCES   3
+#define ITEMS     20000 /* Messages per source */
+#define RECEIVERS 3
+
+nmqueue_t queue;
+
+/* Counters shared by all receivers */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    long            received;              /* Messages received */
+    long            errors;                /* Messages twice, out of order or of a wrong source */
+    char            seen[SOURCES*ITEMS];   /* Times every message was received */
+} consumerdata_t;
+
+consumerdata_t consumed;
+
+/* One receiving thread */
+typedef struct
+{
+    pthread_t        thread;
+    nmqueue_filter_t filter;   /* Sources it takes */
+    source_t         source;   /* Storage of a single source filter */
+    int              filtered; /* nmqueue_receive_filtered or nmqueue_receive */
+} receiverdata_t;
+
+/* Predicate of the last source */
+static int isLastSource(source_t source,
+                        void*    param)
+{
+    (void)param;
+    return source == SOURCES-1;
+}
+
+/* Entry point for sending threads, the source interleaves with the others */
+static void* producerProc(void* param)
+{
+    long source = (long)param;
+    long i;
+
+    for( i=0 ; i<ITEMS ; ++i )
+    {
+        nmqueue_send( &queue, (source_t)source, (void*)(source*ITEMS+i), 0, NULL );
+    }
+
+    return NULL;
+}
+
+/* Entry point for receiving threads, runs until aborted */
+static void* receiverProc(void* param)
+{
+    receiverdata_t*          rdata = (receiverdata_t*)param;
+    long                     last[SOURCES];
+    struct nmqueue_message_s message;
+    size_t                   count;
+    int                      i;
+
+    for( i=0 ; i<SOURCES ; ++i )
+    {
+        last[i] = -1;
+    }
+
+    for(;;)
+    {
+        long errors = 0;
+        long id;
+        int  err;
+
+        if( rdata->filtered )
+        {
+            err = nmqueue_receive_filtered( &queue, &rdata->filter, &message, 1, &count, rdata );
+        }
+        else
+        {
+            err = nmqueue_receive( &queue, &message.source, &message.data, &message.dataSize, rdata );
+        }
+        if( err != NMQUEUEERROR_NOERROR )
+        {
+            break;
+        }
+
+        /* Every receiver sees the messages of a source in order */
+        id = (long)message.data;
+        if( message.source < 0 || message.source >= SOURCES || id/ITEMS != message.source ||
+            id % ITEMS <= last[message.source] )
+        {
+            errors++;
+        }
+        else
+        {
+            last[message.source] = id % ITEMS;
+        }
+
+        if( rdata->filtered && rdata->filter.sources != NULL && message.source != rdata->source )
+        {
+            errors++;
+        }
+
+        pthread_mutex_lock( &consumed.mutex );
+        if( id >= 0 && id < SOURCES*ITEMS && consumed.seen[id]++ != 0 )
+        {
+            errors++;
+        }
+        consumed.received++;
+        consumed.errors += errors;
+        pthread_mutex_unlock( &consumed.mutex );
+    }
+
+    return NULL;
+}
+
+/* Runs a producer per source against the receivers, the first two take
+ * a single source, the last one the last source by predicate or everything */
+static int run(int mixed)
+{
+    receiverdata_t receivers[RECEIVERS];
+    pthread_t      producers[SOURCES];
+    long           received = 0;
+    long           waited;
+    long           i;
+
+    nmqueue_initialize( &queue, 16 );
+
+    consumed.received = 0;
+    consumed.errors   = 0;
+    memset( consumed.seen, 0, sizeof(consumed.seen) );
+
+    for( i=0 ; i<RECEIVERS ; ++i )
+    {
+        receivers[i].source                = (source_t)i;
+        receivers[i].filter.sources        = &receivers[i].source;
+        receivers[i].filter.sourceCount    = 1;
+        receivers[i].filter.predicate      = NULL;
+        receivers[i].filter.predicateParam = NULL;
+        receivers[i].filtered              = 1;
+    }
+    receivers[RECEIVERS-1].filter.sources   = NULL;
+    receivers[RECEIVERS-1].filter.predicate = isLastSource;
+    receivers[RECEIVERS-1].filtered         = !mixed;
+
+    for( i=0 ; i<RECEIVERS ; ++i )
+    {
+        pthread_create( &receivers[i].thread, NULL, receiverProc, &receivers[i] );
+    }
+    for( i=0 ; i<SOURCES ; ++i )
+    {
+        pthread_create( &producers[i], NULL, producerProc, (void*)i );
+    }
+    for( i=0 ; i<SOURCES ; ++i )
+    {
+        pthread_join( producers[i], NULL );
+    }
+
+    /* Wait up to 10s for the receivers */
+    for( waited=0 ; waited<10000 && received != SOURCES*ITEMS ; ++waited )
+    {
+        struct timespec pause = { 0, 1000*1000 };
+
+        pthread_mutex_lock( &consumed.mutex );
+        received = consumed.received;
+        pthread_mutex_unlock( &consumed.mutex );
+
+        nanosleep( &pause, NULL );
+    }
+
+    for( i=0 ; i<RECEIVERS ; ++i )
+    {
+        nmqueue_abort( &queue, &receivers[i] );
+        pthread_join( receivers[i].thread, NULL );
+    }
+
+    printf( "%s: %ld of %ld received, %ld errors, occupancy %lu\n",
+            mixed ? "mixed" : "filtered", consumed.received, (long)SOURCES*ITEMS,
+            consumed.errors, (unsigned long)nmqueue_occupancy( &queue ) );
+
+    nmqueue_finalize( &queue );
+
+    return consumed.received == SOURCES*ITEMS && consumed.errors == 0;
+}
+
+int main(int argc, char* argv[])
+{
+    nmqueue_filter_t         filter;
+    struct nmqueue_message_s message;
+    source_t                 source;
+    void*                    data;
+    size_t                   dataSize;
+    size_t                   count;
+    long                     i;
+
+    (void)argc;
+    (void)argv;
+
+    pthread_mutex_init( &consumed.mutex, NULL );
+
+    /* Taken slots count until the head passes them */
+    nmqueue_initialize( &queue, 16 );
+    for( i=0 ; i<5 ; ++i )
+    {
+        nmqueue_send( &queue, (source_t)(i == 4 ? 2 : i%2), (void*)i, 0, NULL );
+    }
+
+    source                = 1;
+    filter.sources        = &source;
+    filter.sourceCount    = 1;
+    filter.predicate      = NULL;
+    filter.predicateParam = NULL;
+
+    check( "filtered takes its source",
+           nmqueue_tryreceive_filtered( &queue, &filter, &message, 1, &count, NULL ) == NMQUEUEERROR_NOERROR &&
+           message.data == (void*)1 &&
+           nmqueue_tryreceive_filtered( &queue, &filter, &message, 1, &count, NULL ) == NMQUEUEERROR_NOERROR &&
+           message.data == (void*)3 &&
+           nmqueue_tryreceive_filtered( &queue, &filter, &message, 1, &count, NULL ) == NMQUEUEERROR_EMPTY );
+    check( "taken slots behind the head count", nmqueue_occupancy( &queue ) == 5 );
+
+    check( "head skips taken slots",
+           nmqueue_tryreceive( &queue, &source, &data, &dataSize, NULL ) == NMQUEUEERROR_NOERROR && data == (void*)0 &&
+           nmqueue_occupancy( &queue ) == 3 &&
+           nmqueue_tryreceive( &queue, &source, &data, &dataSize, NULL ) == NMQUEUEERROR_NOERROR && data == (void*)2 &&
+           nmqueue_occupancy( &queue ) == 1 );
+
+    filter.sources   = NULL;
+    filter.predicate = isLastSource;
+    check( "predicate",
+           nmqueue_tryreceive_filtered( &queue, &filter, &message, 1, &count, NULL ) == NMQUEUEERROR_NOERROR &&
+           message.data == (void*)4 && nmqueue_occupancy( &queue ) == 0 );
+    nmqueue_finalize( &queue );
+
+    /* Interleaved sources, one filtered receiver per source */
+    check( "filter by source", run( 0 ) );
+
+    /* Filtered receivers next to an unfiltered one */
+    check( "mixed with unfiltered receiver", run( 1 ) );
+
+    pthread_mutex_destroy( &consumed.mutex );
+
+    return checkResult();
+}
@@ -0,0 +1,229 @@
+/* Test program for message groups mixed with single messages */
+#include "src/nmqueue.h"
+#include "src/receiverthread.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+
+#define PRODUCER_COUNT 3
+#define CONSUMER_COUNT 3
+#define ITEMS          20000 /* Groups and single messages per producer */
+#define MAXPARTS       8     /* Largest group the receivers take */
+#define OVERSIZED      12    /* Parts of the groups too large for them */
+
+nmqueue_t queue;
+
+/* Counters shared by all receivers */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    long            items;                /* Received groups and single messages */
+    long            errors;               /* Split or mixed up groups */
+    long            dropped;              /* Parts seen by the drop callback */
+    long            last[PRODUCER_COUNT]; /* Last item received per producer */
+    int             ordered;              /* Check the order of each producer */
+} consumerdata_t;
+
+consumerdata_t consumed;
+
+/* Items i of a producer: every 5th is a single message, every 97th an
+ * oversized group, the others groups of 1..7 parts */
+static size_t partsOf(long i)
+{
+    if( i % 97 == 96 )
+    {
+        return OVERSIZED;
+    }
+    return i % 5 == 0 ? 0 : (size_t)(1+i%7);
+}
+
+/* Entry point for sending threads */
+static void* producerProc(void* param)
+{
+    long                     producer = (long)param;
+    struct nmqueue_message_s parts[OVERSIZED];
+    long                     i;
+
+    for( i=0 ; i<ITEMS ; ++i )
+    {
+        size_t count = partsOf( i );
+        size_t j;
+        void*  id    = (void*)(producer*ITEMS+i);
+
+        if( count == 0 )
+        {
+            nmqueue_send( &queue, 0, id, 1, NULL );
+            continue;
+        }
+
+        for( j=0 ; j<count ; ++j )
+        {
+            parts[j].source   = (source_t)j;
+            parts[j].data     = id;
+            parts[j].dataSize = count;
+            parts[j].expires  = 0;
+        }
+        nmqueue_send_group( &queue, parts, count, NULL );
+    }
+
+    return NULL;
+}
+
+/* Callback for the group receivers, every batch is one complete item */
+static void consumer(struct nmqueue_message_s* messages,
+                     size_t                    count,
+                     void*                     param)
+{
+    consumerdata_t* cdata = (consumerdata_t*)param;
+    long            id    = (long)messages[0].data;
+    long            errors = 0;
+    size_t          i;
+
+    if( count != messages[0].dataSize || count > MAXPARTS )
+    {
+        errors++;
+    }
+
+    for( i=0 ; i<count ; ++i )
+    {
+        if( (long)messages[i].data != id || messages[i].source != (source_t)i || messages[i].parts != count-i )
+        {
+            errors++;
+        }
+    }
+
+    pthread_mutex_lock( &cdata->mutex );
+    if( cdata->ordered && id % ITEMS <= cdata->last[id/ITEMS] )
+    {
+        errors++;
+    }
+    cdata->last[id/ITEMS] = id % ITEMS;
+    cdata->items++;
+    cdata->errors += errors;
+    pthread_mutex_unlock( &cdata->mutex );
+}
+
+/* Drop callback, only oversized groups are dropped */
+static void dropped(source_t source,
+                    void*    data,
+                    size_t   dataSize,
+                    int      reason,
+                    void*    param)
+{
+    consumerdata_t* cdata = (consumerdata_t*)param;
+
+    /* Called with the queue locked, the receivers hold cdata->mutex without it */
+    pthread_mutex_lock( &cdata->mutex );
+    if( reason != NMQUEUE_DROP_OVERSIZED || dataSize != OVERSIZED )
+    {
+        cdata->errors++;
+    }
+    cdata->dropped++;
+    pthread_mutex_unlock( &cdata->mutex );
+}
+
+/* Runs all producers against consumers group receivers, returns 0 on success */
+static int run(int consumers)
+{
+    receiverthread_t receivers[CONSUMER_COUNT];
+    pthread_t        producers[PRODUCER_COUNT];
+    nmqueue_drops_t  drops;
+    long             expected  = 0;
+    long             oversized = 0;
+    long             waited;
+    long             i;
+    int              failed;
+
+    for( i=0 ; i<ITEMS ; ++i )
+    {
+        if( partsOf( i ) == OVERSIZED )
+        {
+            oversized += OVERSIZED*PRODUCER_COUNT;
+        }
+        else
+        {
+            expected += PRODUCER_COUNT;
+        }
+    }
+
+    nmqueue_initialize( &queue, 32 );
+    nmqueue_set_drop( &queue, dropped, &consumed );
+
+    consumed.items   = 0;
+    consumed.errors  = 0;
+    consumed.dropped = 0;
+    consumed.ordered = consumers == 1;
+    for( i=0 ; i<PRODUCER_COUNT ; ++i )
+    {
+        consumed.last[i] = -1;
+    }
+
+    for( i=0 ; i<consumers ; ++i )
+    {
+        initializeGroupReceiver( &receivers[i], &queue, consumer, &consumed, MAXPARTS, NULL );
+    }
+    for( i=0 ; i<PRODUCER_COUNT ; ++i )
+    {
+        pthread_create( &producers[i], NULL, producerProc, (void*)i );
+    }
+    for( i=0 ; i<PRODUCER_COUNT ; ++i )
+    {
+        pthread_join( producers[i], NULL );
+    }
+
+    /* Wait up to 10s for the receivers */
+    for( waited=0 ; waited<10000 ; ++waited )
+    {
+        struct timespec pause = { 0, 1000*1000 };
+        long            items;
+
+        pthread_mutex_lock( &consumed.mutex );
+        items = consumed.items;
+        pthread_mutex_unlock( &consumed.mutex );
+
+        if( items == expected )
+        {
+            break;
+        }
+        nanosleep( &pause, NULL );
+    }
+
+    for( i=0 ; i<consumers ; ++i )
+    {
+        finalizeReceiver( &receivers[i] );
+    }
+
+    nmqueue_get_drops( &queue, &drops );
+    nmqueue_finalize( &queue );
+
+    failed = consumed.items != expected || consumed.errors != 0 ||
+             consumed.dropped != oversized || (long)drops.oversized != oversized;
+
+    printf( "%d receivers: %ld of %ld items, %ld of %ld oversized parts dropped, %ld errors %s\n",
+            consumers, consumed.items, expected, consumed.dropped, oversized, consumed.errors,
+            failed ? "FAILED" : "ok" );
+
+    return failed;
+}
+
+int main(int argc, char* argv[])
+{
+    int failed;
+
+    (void)argc;
+    (void)argv;
+
+    pthread_mutex_init( &consumed.mutex, NULL );
+
+    /* One receiver keeps the order of every producer, several must not split groups */
+    failed = run( 1 );
+    failed |= run( CONSUMER_COUNT );
+
+    pthread_mutex_destroy( &consumed.mutex );
+
+    printf( failed ? "FAILED\n" : "OK\n" );
+
+    return failed;
+}
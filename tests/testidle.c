@@ -0,0 +1,245 @@
+/* Test program for idle strategies of sending and receiving threads */
+#include "src/nmqueue.h"
+#include "src/receiverthread.h"
+#include "src/senderthread.h"
+#include "tests/testcheck.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+
+#define MESSAGES  10000
+#define BURSTS    10
+#define BATCHSIZE 16
+
+nmqueue_t queue;
+
+/* Data passed to the sending thread */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    long            available; /* Messages the source may hand out */
+    long            produced;  /* Messages handed to the sender */
+    long            polls;     /* Calls of the source */
+} producerdata_t;
+
+/* Data passed to the receiving thread */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    long            received; /* Messages received */
+    long            errors;   /* Messages out of order */
+} consumerdata_t;
+
+/* Gives the threads time to run */
+static void settle(long ms)
+{
+    struct timespec delay = { 0, 0 };
+
+    delay.tv_sec  = ms/1000;
+    delay.tv_nsec = (ms%1000)*1000*1000;
+    nanosleep( &delay, NULL );
+}
+
+/* Callback for the sending thread, hands out the available messages */
+static int producer(source_t* source,
+                    void**    data,
+                    size_t*   dataSize,
+                    void*     param)
+{
+    producerdata_t* pdata  = (producerdata_t*)param;
+    int             result = SENDERTHREAD_NODATA;
+
+    pthread_mutex_lock( &pdata->mutex );
+    pdata->polls++;
+    if( pdata->produced != pdata->available )
+    {
+        *source   = 0;
+        *data     = (void*)pdata->produced;
+        *dataSize = 0;
+
+        pdata->produced++;
+        result = SENDERTHREAD_DATA;
+    }
+    pthread_mutex_unlock( &pdata->mutex );
+
+    return result;
+}
+
+static long producerPolls(producerdata_t* pdata)
+{
+    long polls;
+
+    pthread_mutex_lock( &pdata->mutex );
+    polls = pdata->polls;
+    pthread_mutex_unlock( &pdata->mutex );
+
+    return polls;
+}
+
+/* Checks and counts one received message */
+static void receiveMessage(consumerdata_t* cdata,
+                           void*           data)
+{
+    pthread_mutex_lock( &cdata->mutex );
+    if( (long)data != cdata->received )
+    {
+        cdata->errors++;
+    }
+    cdata->received++;
+    pthread_mutex_unlock( &cdata->mutex );
+}
+
+/* Callback for the receiving thread */
+static void consumer(source_t source,
+                     void*    data,
+                     size_t   dataSize,
+                     void*    param)
+{
+    receiveMessage( (consumerdata_t*)param, data );
+}
+
+/* Callback for the batch receiving thread */
+static void batchConsumer(struct nmqueue_message_s* messages,
+                          size_t                    count,
+                          void*                     param)
+{
+    size_t i;
+
+    for( i=0 ; i<count ; ++i )
+    {
+        receiveMessage( (consumerdata_t*)param, messages[i].data );
+    }
+}
+
+static long receivedCount(consumerdata_t* cdata)
+{
+    long received;
+
+    pthread_mutex_lock( &cdata->mutex );
+    received = cdata->received;
+    pthread_mutex_unlock( &cdata->mutex );
+
+    return received;
+}
+
+/* Waits up to 5s until count messages arrived */
+static int awaitReceived(consumerdata_t* cdata,
+                         long            count)
+{
+    long waited;
+
+    for( waited=0 ; waited<5000 && receivedCount( cdata ) != count ; ++waited )
+    {
+        settle( 1 );
+    }
+
+    return receivedCount( cdata ) == count && cdata->errors == 0;
+}
+
+/* A sender idling with IDLESTRATEGY_BLOCK stops polling its source until
+ * senderthread_signal */
+static void runBlockedSender(void)
+{
+    static const idleconfig_t blockIdle = { IDLESTRATEGY_BLOCK, 0, 0, 0 };
+
+    senderthread_t   sender;
+    receiverthread_t receiver;
+    producerdata_t   pdata;
+    consumerdata_t   cdata;
+    long             polls;
+
+    pthread_mutex_init( &pdata.mutex, NULL );
+    pthread_mutex_init( &cdata.mutex, NULL );
+    pdata.available = 0;
+    pdata.produced  = 0;
+    pdata.polls     = 0;
+    cdata.received  = 0;
+    cdata.errors    = 0;
+
+    nmqueue_initialize( &queue, 64 );
+    initializeReceiver( &receiver, &queue, consumer, &cdata );
+    initializeSenderIdle( &sender, &queue, producer, &pdata, &blockIdle );
+
+    settle( 20 );
+    polls = producerPolls( &pdata );
+    settle( 50 );
+    check( "blocked sender stops polling", polls != 0 && producerPolls( &pdata ) == polls );
+
+    pthread_mutex_lock( &pdata.mutex );
+    pdata.available = 10;
+    pthread_mutex_unlock( &pdata.mutex );
+    senderthread_signal( &sender );
+    check( "blocked sender wakes on signal", awaitReceived( &cdata, 10 ) );
+
+    /* Blocked again once the source ran dry, the next signal wakes it again */
+    pthread_mutex_lock( &pdata.mutex );
+    pdata.available = 20;
+    pthread_mutex_unlock( &pdata.mutex );
+    senderthread_signal( &sender );
+    check( "woken again", awaitReceived( &cdata, 20 ) );
+
+    finalizeSender( &sender );
+    finalizeReceiver( &receiver );
+    nmqueue_finalize( &queue );
+    pthread_mutex_destroy( &pdata.mutex );
+    pthread_mutex_destroy( &cdata.mutex );
+}
+
+/* A polling receiver drains bursts with pauses long enough to back off */
+static void runPollingReceiver(const char*         name,
+                               const idleconfig_t* idle,
+                               size_t              batchSize)
+{
+    receiverthread_t receiver;
+    consumerdata_t   cdata;
+    long             message;
+
+    pthread_mutex_init( &cdata.mutex, NULL );
+    cdata.received = 0;
+    cdata.errors   = 0;
+
+    nmqueue_initialize( &queue, 256 );
+    if( batchSize != 0 )
+    {
+        initializeBatchReceiverIdle( &receiver, &queue, batchConsumer, &cdata, batchSize, idle );
+    }
+    else
+    {
+        initializeReceiverIdle( &receiver, &queue, consumer, &cdata, idle );
+    }
+
+    for( message=0 ; message<MESSAGES ; ++message )
+    {
+        if( message % (MESSAGES/BURSTS) == 0 )
+        {
+            settle( 5 );
+        }
+        nmqueue_send( &queue, 0, (void*)message, 0, NULL );
+    }
+
+    check( name, awaitReceived( &cdata, MESSAGES ) );
+
+    finalizeReceiver( &receiver );
+    nmqueue_finalize( &queue );
+    pthread_mutex_destroy( &cdata.mutex );
+}
+
+int main(int argc, char* argv[])
+{
+    static const idleconfig_t spinIdle    = { IDLESTRATEGY_SPIN, 0, 0, 0 };
+    static const idleconfig_t backoffIdle = { IDLESTRATEGY_BACKOFF, 10, 1, 1000 };
+
+    (void)argc;
+    (void)argv;
+
+    runBlockedSender();
+
+    runPollingReceiver( "spinning receiver drains", &spinIdle, 0 );
+    runPollingReceiver( "backing off receiver drains", &backoffIdle, 0 );
+    runPollingReceiver( "spinning batch receiver drains", &spinIdle, BATCHSIZE );
+    runPollingReceiver( "backing off batch receiver drains", &backoffIdle, BATCHSIZE );
+
+    return checkResult();
+}
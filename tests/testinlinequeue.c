@@ -0,0 +1,218 @@
+/* Test program for typed inline queues */
+#include "src/inlinequeue.h"
+#include "tests/testcheck.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define CAPACITY 8
+#define ELEMENTS 100000
+
+/* Element type, copied into the ring buffer */
+typedef struct
+{
+    long   sequence;
+    double value;
+    char   name[12];
+} sample_t;
+
+INLINEQUEUE_DECLARE( samplequeue, sample_t, CAPACITY )
+INLINEQUEUE_DEFINE( samplequeue, sample_t, CAPACITY )
+
+samplequeue_t queue;
+
+/* Result of one blocked receiver */
+typedef struct
+{
+    pthread_t thread;
+    int       err;    /* Result of samplequeue_receive */
+    sample_t  sample; /* Received element */
+} receiverdata_t;
+
+static void fillSample(sample_t* sample,
+                       long      sequence)
+{
+    memset( sample, 0, sizeof(sample_t) );
+    sample->sequence = sequence;
+    sample->value    = sequence*0.5;
+    sprintf( sample->name, "s%ld", sequence%100000 );
+}
+
+static int checkSample(const sample_t* sample,
+                       long            sequence)
+{
+    sample_t expected;
+
+    fillSample( &expected, sequence );
+    return memcmp( sample, &expected, sizeof(sample_t) ) == 0;
+}
+
+/* Gives threads time to block */
+static void settle(void)
+{
+    struct timespec delay = { 0, 50*1000*1000 };
+    nanosleep( &delay, NULL );
+}
+
+/* Callback for samplequeue_emplace */
+static void construct(void* slot,
+                      void* param)
+{
+    fillSample( (sample_t*)slot, *(long*)param );
+}
+
+/* Callback for samplequeue_receive_in_place */
+static void consume(void* slot,
+                    void* param)
+{
+    *(sample_t*)param = *(sample_t*)slot;
+}
+
+/* Entry point for the producer, sends ELEMENTS in batches of varying size */
+static void* producerProc(void* param)
+{
+    sample_t batch[CAPACITY+3];
+    long     next = 0;
+
+    (void)param;
+
+    while( next < ELEMENTS )
+    {
+        size_t count = 1+(size_t)(next % (CAPACITY+3));
+        size_t sent;
+        size_t i;
+
+        if( count > (size_t)(ELEMENTS-next) )
+        {
+            count = (size_t)(ELEMENTS-next);
+        }
+        for( i=0 ; i<count ; ++i )
+        {
+            fillSample( &batch[i], next+(long)i );
+        }
+
+        samplequeue_send_batch( &queue, batch, count, &sent, NULL );
+        next += (long)sent;
+    }
+
+    return NULL;
+}
+
+/* Entry point for blocked receivers, the thread id is the receiverdata_t */
+static void* receiverProc(void* param)
+{
+    receiverdata_t* rdata = (receiverdata_t*)param;
+
+    rdata->err = samplequeue_receive( &queue, &rdata->sample, rdata );
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    sample_t       sample;
+    sample_t       batch[CAPACITY];
+    receiverdata_t first;
+    receiverdata_t second;
+    pthread_t      producer;
+    size_t         count;
+    long           received;
+    long           errors;
+    long           i;
+
+    (void)argc;
+    (void)argv;
+
+    samplequeue_initialize( &queue );
+
+    /* Capacity is fixed by the type */
+    check( "capacity", queue.queue.mask+1 == CAPACITY && queue.queue.elementSize == sizeof(sample_t) );
+
+    check( "empty", samplequeue_tryreceive( &queue, &sample, NULL ) == NMQUEUEERROR_EMPTY );
+
+    for( i=0 ; i<CAPACITY ; ++i )
+    {
+        fillSample( &sample, i );
+        if( samplequeue_trysend( &queue, &sample, NULL ) != NMQUEUEERROR_NOERROR )
+        {
+            break;
+        }
+    }
+    check( "full at capacity", i == CAPACITY && samplequeue_trysend( &queue, &sample, NULL ) == NMQUEUEERROR_FULL );
+
+    errors = 0;
+    for( i=0 ; i<CAPACITY ; ++i )
+    {
+        if( samplequeue_tryreceive( &queue, &sample, NULL ) != NMQUEUEERROR_NOERROR || !checkSample( &sample, i ) )
+        {
+            errors++;
+        }
+    }
+    check( "fifo order", errors == 0 );
+
+    i = 42;
+    samplequeue_emplace( &queue, construct, &i, NULL );
+    memset( &sample, 0, sizeof(sample) );
+    samplequeue_receive_in_place( &queue, consume, &sample, NULL );
+    check( "in place", checkSample( &sample, 42 ) );
+
+    check( "empty batch", samplequeue_tryreceive_batch( &queue, batch, CAPACITY, &count, NULL ) == NMQUEUEERROR_EMPTY &&
+                          count == 0 );
+    for( i=0 ; i<3 ; ++i )
+    {
+        fillSample( &batch[i], 100+i );
+    }
+    samplequeue_send_batch( &queue, batch, 3, &count, NULL );
+    memset( batch, 0, sizeof(batch) );
+    check( "available batch", samplequeue_tryreceive_batch( &queue, batch, CAPACITY, &count, NULL ) == NMQUEUEERROR_NOERROR &&
+                              count == 3 && checkSample( &batch[0], 100 ) && checkSample( &batch[2], 102 ) );
+
+    /* Batches wrapping around the ring buffer, blocking on both sides */
+    pthread_create( &producer, NULL, producerProc, NULL );
+    received = 0;
+    errors   = 0;
+    while( received < ELEMENTS )
+    {
+        samplequeue_receive_batch( &queue, batch, 1+(size_t)(received % CAPACITY), &count, NULL );
+        for( i=0 ; i<(long)count ; ++i )
+        {
+            if( !checkSample( &batch[i], received+i ) )
+            {
+                errors++;
+            }
+        }
+        received += (long)count;
+    }
+    pthread_join( producer, NULL );
+    check( "blocking batches", received == ELEMENTS && errors == 0 );
+
+    /* Abort wakes only its target */
+    pthread_create( &first.thread, NULL, receiverProc, &first );
+    pthread_create( &second.thread, NULL, receiverProc, &second );
+    settle();
+    samplequeue_abort( &queue, &first );
+    pthread_join( first.thread, NULL );
+    check( "targeted abort", first.err == NMQUEUEERROR_ABORT );
+
+    fillSample( &sample, 7 );
+    samplequeue_send( &queue, &sample, NULL );
+    pthread_join( second.thread, NULL );
+    check( "other receiver keeps waiting", second.err == NMQUEUEERROR_NOERROR && checkSample( &second.sample, 7 ) );
+
+    /* Abort before the call is kept, a cleared one is not */
+    samplequeue_abort( &queue, &first );
+    receiverProc( &first );
+    check( "abort before receive", first.err == NMQUEUEERROR_ABORT );
+
+    samplequeue_abort( &queue, &first );
+    samplequeue_clear_abort( &queue, &first );
+    samplequeue_send( &queue, &sample, NULL );
+    receiverProc( &first );
+    check( "cleared abort", first.err == NMQUEUEERROR_NOERROR && checkSample( &first.sample, 7 ) );
+
+    samplequeue_finalize( &queue );
+
+    return checkResult();
+}
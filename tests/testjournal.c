@@ -0,0 +1,162 @@
+/* Test program consuming journal records out of order and recovering them */
+#include "src/nmqueue.h"
+#include "src/journal.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SEGMENTSIZE 4096
+#define RECORDS     200
+#define PAYLOAD     100
+#define GAP         57
+
+/* Payload of record i */
+typedef struct
+{
+    long index;
+    char fill[PAYLOAD-sizeof(long)];
+} record_t;
+
+/* Data passed to the recover callback */
+typedef struct
+{
+    void* payloads[RECORDS]; /* Recovered payloads in journal order */
+    long  count;             /* Number of recovered records */
+    long  errors;            /* Records with wrong contents */
+} recoverdata_t;
+
+static void fillRecord(record_t* record,
+                       long      index)
+{
+    memset( record, (int)(index & 0x7f), sizeof(record_t) );
+    record->index = index;
+}
+
+/* Callback for journal_recover, checks the contents of every record */
+static void recoverRecord(source_t source,
+                          void*    data,
+                          size_t   dataSize,
+                          void*    param)
+{
+    recoverdata_t* rdata  = (recoverdata_t*)param;
+    record_t*      record = (record_t*)data;
+    record_t       expected;
+
+    if( rdata->count == RECORDS || dataSize != sizeof(record_t) )
+    {
+        rdata->errors++;
+        return;
+    }
+
+    fillRecord( &expected, record->index );
+    if( memcmp( record, &expected, sizeof(record_t) ) != 0 || source != (source_t)(record->index % 4) )
+    {
+        rdata->errors++;
+    }
+
+    rdata->payloads[rdata->count++] = data;
+}
+
+int main(int argc, char* argv[])
+{
+    char          path[] = "/tmp/testjournalXXXXXX";
+    journal_t     journal;
+    recoverdata_t rdata;
+    void*         payloads[RECORDS];
+    long          i;
+    int           failed = 0;
+
+    (void)argc;
+    (void)argv;
+
+    if( mkdtemp( path ) == NULL )
+    {
+        printf( "Cannot create journal directory\n" );
+        return 1;
+    }
+
+    if( journal_open( &journal, path, SEGMENTSIZE, 1000, 0 ) != NMQUEUEERROR_NOERROR )
+    {
+        printf( "Cannot open journal\n" );
+        return 1;
+    }
+
+    for( i=0 ; i<RECORDS ; ++i )
+    {
+        record_t record;
+
+        fillRecord( &record, i );
+        journal_append( &journal, (source_t)(i % 4), &record, sizeof(record), &payloads[i] );
+    }
+
+    /* Consume everything but GAP, newest first */
+    for( i=RECORDS-1 ; i>=0 ; --i )
+    {
+        if( i != GAP )
+        {
+            journal_consume( &journal, payloads[i] );
+        }
+    }
+
+    journal_close( &journal );
+
+    /* Everything from the gap on is recovered */
+    memset( &rdata, 0, sizeof(rdata) );
+    journal_open( &journal, path, SEGMENTSIZE, 1000, 0 );
+    journal_recover( &journal, recoverRecord, &rdata );
+
+    for( i=0 ; i<rdata.count ; ++i )
+    {
+        if( ((record_t*)rdata.payloads[i])->index != GAP+i )
+        {
+            rdata.errors++;
+        }
+    }
+
+    printf( "Recovered %ld records after gap, %ld errors\n", rdata.count, rdata.errors );
+    if( rdata.count != RECORDS-GAP || rdata.errors != 0 )
+    {
+        failed = 1;
+    }
+
+    /* Consume the recovered records, odd ones first, then the gap */
+    for( i=1 ; i<rdata.count ; i+=2 )
+    {
+        journal_consume( &journal, rdata.payloads[i] );
+    }
+    for( i=rdata.count%2 == 0 ? rdata.count-2 : rdata.count-1 ; i>=0 ; i-=2 )
+    {
+        journal_consume( &journal, rdata.payloads[i] );
+    }
+
+    journal_close( &journal );
+
+    /* Nothing is left */
+    memset( &rdata, 0, sizeof(rdata) );
+    journal_open( &journal, path, SEGMENTSIZE, 1000, 0 );
+    journal_recover( &journal, recoverRecord, &rdata );
+    journal_close( &journal );
+
+    printf( "Recovered %ld records after consuming all, %ld errors\n", rdata.count, rdata.errors );
+    if( rdata.count != 0 || rdata.errors != 0 )
+    {
+        failed = 1;
+    }
+
+    /* Cleanup, the remaining segment and the offset file */
+    {
+        char command[64];
+
+        sprintf( command, "rm -rf %s", path );
+        if( system( command ) != 0 )
+        {
+            printf( "Cannot remove %s\n", path );
+        }
+    }
+
+    printf( failed ? "FAILED\n" : "OK\n" );
+
+    return failed;
+}
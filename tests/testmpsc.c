@@ -0,0 +1,164 @@
+/* Test program for the MPSC queue with many producers and a parking receiver */
+#include "src/nmqueue.h"
+#include "src/mpscqueue.h"
+#include "tests/testcheck.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+#include <sched.h>
+
+#define PRODUCER_COUNT 4
+#define ITEMS          50000 /* Messages per producer */
+#define BURST          37    /* Messages between two pauses of a producer */
+
+mpscqueue_t             queue;
+struct mpscqueue_node_s stub;
+
+/* State of the receiving thread */
+typedef struct
+{
+    long received;             /* Messages received */
+    long errors;               /* Messages out of order or of an unknown producer */
+    long last[PRODUCER_COUNT]; /* Last message received per producer */
+    int  err;                  /* Result of the last mpscqueue_receive */
+    int  done;                 /* Set once the receiver returned, accessed atomically */
+} consumerdata_t;
+
+consumerdata_t consumed;
+
+/* Entry point for sending threads. Every producer owns its nodes, pauses
+ * between bursts let the receiver park, so sends race with parking. */
+static void* producerProc(void* param)
+{
+    long                     producer = (long)param;
+    struct mpscqueue_node_s* nodes    = (struct mpscqueue_node_s*)malloc( ITEMS*sizeof(struct mpscqueue_node_s) );
+    long                     i;
+
+    for( i=0 ; i<ITEMS ; ++i )
+    {
+        if( i % BURST == 0 )
+        {
+            struct timespec pause = { 0, (long)(i % 3)*20*1000 };
+
+            if( pause.tv_nsec != 0 )
+            {
+                nanosleep( &pause, NULL );
+            }
+            else
+            {
+                sched_yield();
+            }
+        }
+        mpscqueue_send( &queue, &nodes[i], (source_t)producer, (void*)(producer*ITEMS+i), 0 );
+    }
+
+    return nodes;
+}
+
+/* Entry point for the receiving thread, runs until aborted on an empty queue */
+static void* consumerProc(void* param)
+{
+    consumerdata_t* cdata = (consumerdata_t*)param;
+
+    for(;;)
+    {
+        struct mpscqueue_node_s* node;
+        source_t                 source;
+        void*                    data;
+        size_t                   dataSize;
+        long                     id;
+
+        cdata->err = mpscqueue_receive( &queue, &source, &data, &dataSize, &node );
+        if( cdata->err != NMQUEUEERROR_NOERROR )
+        {
+            break;
+        }
+
+        id = (long)data;
+        if( source < 0 || source >= PRODUCER_COUNT || id/ITEMS != source || id % ITEMS != cdata->last[source]+1 )
+        {
+            cdata->errors++;
+        }
+        else
+        {
+            cdata->last[source] = id % ITEMS;
+        }
+        cdata->received++;
+    }
+
+    __atomic_store_n( &cdata->done, 1, __ATOMIC_RELEASE );
+
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    pthread_t                producers[PRODUCER_COUNT];
+    pthread_t                consumer;
+    void*                    nodes[PRODUCER_COUNT];
+    struct mpscqueue_node_s  node;
+    struct mpscqueue_node_s* freed;
+    source_t                 source;
+    void*                    data;
+    size_t                   dataSize;
+    long                     waited;
+    long                     i;
+
+    (void)argc;
+    (void)argv;
+
+    mpscqueue_initialize( &queue, &stub );
+
+    /* Single threaded basics */
+    check( "empty", mpscqueue_tryreceive( &queue, &source, &data, &dataSize, &freed ) == NMQUEUEERROR_EMPTY );
+    mpscqueue_send( &queue, &node, 1, (void*)&node, 0 );
+    check( "stub handed back", mpscqueue_tryreceive( &queue, &source, &data, &dataSize, &freed ) == NMQUEUEERROR_NOERROR &&
+                               source == 1 && data == &node && freed == &stub );
+    mpscqueue_abort( &queue );
+    check( "abort on empty queue", mpscqueue_receive( &queue, &source, &data, &dataSize, &freed ) == NMQUEUEERROR_ABORT );
+
+    /* Producers racing with a parking receiver */
+    for( i=0 ; i<PRODUCER_COUNT ; ++i )
+    {
+        consumed.last[i] = -1;
+    }
+    pthread_create( &consumer, NULL, consumerProc, &consumed );
+    for( i=0 ; i<PRODUCER_COUNT ; ++i )
+    {
+        pthread_create( &producers[i], NULL, producerProc, (void*)i );
+    }
+    for( i=0 ; i<PRODUCER_COUNT ; ++i )
+    {
+        pthread_join( producers[i], &nodes[i] );
+    }
+
+    /* The abort only ends the receiver once everything is received,
+     * a lost wakeup leaves it parked with messages queued */
+    mpscqueue_abort( &queue );
+    for( waited=0 ; waited<10000 && !__atomic_load_n( &consumed.done, __ATOMIC_ACQUIRE ) ; ++waited )
+    {
+        struct timespec pause = { 0, 1000*1000 };
+        nanosleep( &pause, NULL );
+    }
+    if( !__atomic_load_n( &consumed.done, __ATOMIC_ACQUIRE ) )
+    {
+        printf( "Receiver stuck after %ld of %ld messages\nFAILED\n", consumed.received, (long)PRODUCER_COUNT*ITEMS );
+        return 1;
+    }
+    pthread_join( consumer, NULL );
+
+    printf( "%ld of %ld received, %ld errors\n", consumed.received, (long)PRODUCER_COUNT*ITEMS, consumed.errors );
+    check( "every message in producer order", consumed.err == NMQUEUEERROR_ABORT &&
+                                              consumed.received == PRODUCER_COUNT*ITEMS && consumed.errors == 0 );
+
+    /* The last received node stays in the queue, the producer memory is released after finalize */
+    mpscqueue_finalize( &queue );
+    for( i=0 ; i<PRODUCER_COUNT ; ++i )
+    {
+        free( nodes[i] );
+    }
+
+    return checkResult();
+}
@@ -0,0 +1,163 @@
+/* Test program for ordered parallel receivers over a queue dropping messages */
+#include "src/nmqueue.h"
+#include "src/orderedreceiver.h"
+#include "tests/testcheck.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+#include <sched.h>
+
+#define LENGTH    64
+#define PREFILL   200    /* Messages sent before the receivers start */
+#define MESSAGES  100000 /* Messages sent while they run */
+#define RECEIVERS 4
+#define BATCH     8
+#define WINDOW    32
+
+nmqueue_t         queue;
+orderedreceiver_t receiver;
+
+/* Released results */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    long            released;  /* Results passed to dest */
+    long            errors;    /* Results out of order or ones process dropped */
+    long            last;      /* Last released message */
+    long            discarded; /* Messages process dropped, accessed atomically */
+} releasedata_t;
+
+releasedata_t released;
+
+/* Sleeps ms milliseconds */
+static void settle(long ms)
+{
+    struct timespec delay = { 0, 0 };
+
+    delay.tv_sec  = ms/1000;
+    delay.tv_nsec = (ms%1000)*1000*1000;
+    nanosleep( &delay, NULL );
+}
+
+/* Parallel callback, drops every 7th message and takes varying time for
+ * the others, so workers finish out of order */
+static int process(source_t* source,
+                   void**    data,
+                   size_t*   dataSize,
+                   void*     param)
+{
+    long message = (long)*data;
+    long work;
+
+    if( message % 7 == 0 )
+    {
+        __atomic_fetch_add( &((releasedata_t*)param)->discarded, 1, __ATOMIC_RELAXED );
+        return ORDEREDRECEIVER_DROP;
+    }
+
+    for( work=message % 3 ; work>0 ; --work )
+    {
+        sched_yield();
+    }
+
+    /* Now and then a worker falls behind and the queue overflows */
+    if( message % 5000 == 1 )
+    {
+        settle( 2 );
+    }
+
+    return ORDEREDRECEIVER_FORWARD;
+}
+
+/* Ordered callback, data is the number of the message */
+static void dest(source_t source,
+                 void*    data,
+                 size_t   dataSize,
+                 void*    param)
+{
+    releasedata_t* rdata   = (releasedata_t*)param;
+    long           message = (long)data;
+
+    pthread_mutex_lock( &rdata->mutex );
+    if( message <= rdata->last || message % 7 == 0 )
+    {
+        rdata->errors++;
+    }
+    rdata->last = message;
+    rdata->released++;
+    pthread_mutex_unlock( &rdata->mutex );
+}
+
+/* Messages accounted for by release, process or the drop counters */
+static long accounted(void)
+{
+    nmqueue_drops_t drops;
+    long            count;
+
+    nmqueue_get_drops( &queue, &drops );
+
+    pthread_mutex_lock( &released.mutex );
+    count = released.released;
+    pthread_mutex_unlock( &released.mutex );
+
+    return count+__atomic_load_n( &released.discarded, __ATOMIC_RELAXED )+(long)drops.overflow+(long)drops.expired;
+}
+
+int main(int argc, char* argv[])
+{
+    nmqueue_drops_t drops;
+    long            message = 1;
+    long            waited;
+    long            i;
+
+    (void)argc;
+    (void)argv;
+
+    pthread_mutex_init( &released.mutex, NULL );
+    nmqueue_initialize( &queue, LENGTH );
+    nmqueue_set_overflow( &queue, NMQUEUE_OVERFLOW_OVERWRITE );
+
+    /* Overflows before the receivers start, the last ones expire meanwhile */
+    for( i=0 ; i<PREFILL ; ++i, ++message )
+    {
+        nmqueue_send_ttl( &queue, 0, (void*)message, 0, message % 5 == 0 ? 1 : 0, NULL );
+    }
+    settle( 2 );
+
+    if( orderedreceiver_initialize( &receiver, &queue, RECEIVERS, BATCH, WINDOW,
+                                    process, &released, dest, &released ) != NMQUEUEERROR_NOERROR )
+    {
+        printf( "Cannot create ordered receivers\nFAILED\n" );
+        return 1;
+    }
+
+    for( i=0 ; i<MESSAGES ; ++i, ++message )
+    {
+        nmqueue_send_ttl( &queue, 0, (void*)message, 0, message % 11 == 0 ? 1 : 0, NULL );
+        sched_yield();
+    }
+
+    /* Results behind trailing drops are released by the releaser thread */
+    for( waited=0 ; waited<10000 && accounted() != PREFILL+MESSAGES ; ++waited )
+    {
+        settle( 1 );
+    }
+
+    check( "no error", orderedreceiver_error( &receiver ) == NMQUEUEERROR_NOERROR );
+    orderedreceiver_finalize( &receiver );
+
+    nmqueue_get_drops( &queue, &drops );
+    printf( "%ld released, %ld dropped by process, %lu overflowed, %lu expired\n",
+            released.released, released.discarded, drops.overflow, drops.expired );
+
+    check( "released in send order", released.errors == 0 );
+    check( "every message accounted for", accounted() == PREFILL+MESSAGES );
+    check( "drops went through the skip hook", drops.overflow != 0 && drops.expired != 0 );
+
+    nmqueue_finalize( &queue );
+    pthread_mutex_destroy( &released.mutex );
+
+    return checkResult();
+}
@@ -0,0 +1,135 @@
+/* Test program for pipelines with fused and separate stages */
+#include "src/nmqueue.h"
+#include "src/pipeline.h"
+#include "tests/testcheck.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MESSAGES 20000
+#define SOURCE   7
+
+char seen[MESSAGES+1];
+
+/* First stage, increments data */
+static int increment(source_t* source,
+                     void**    data,
+                     size_t*   dataSize,
+                     void*     param)
+{
+    *data = (void*)((long)*data+1);
+    return PIPELINE_FORWARD;
+}
+
+/* Second stage, drops odd data */
+static int dropOdd(source_t* source,
+                   void**    data,
+                   size_t*   dataSize,
+                   void*     param)
+{
+    return (long)*data % 2 != 0 ? PIPELINE_DROP : PIPELINE_FORWARD;
+}
+
+/* Last stage, replaces the source */
+static int mark(source_t* source,
+                void**    data,
+                size_t*   dataSize,
+                void*     param)
+{
+    *source = SOURCE;
+    return PIPELINE_FORWARD;
+}
+
+/* Runs MESSAGES through increment, dropOdd and mark, dropOdd fused with
+ * increment or on its own thread, mark on two threads */
+static void run(int fuse)
+{
+    pipeline_t       pipeline;
+    pipeline_stats_t stats[3];
+    nmqueue_t        output;
+    source_t         source;
+    void*            data;
+    size_t           dataSize;
+    long             errors = 0;
+    long             i;
+    char             name[64];
+
+    /* Room for all output, the input is sent before anything is received */
+    nmqueue_initialize( &output, MESSAGES );
+    pipeline_initialize( &pipeline, 256, 32 );
+    pipeline_add_stage( &pipeline, increment, NULL, 1, 0 );
+    pipeline_add_stage( &pipeline, dropOdd, NULL, 1, fuse );
+    pipeline_add_stage( &pipeline, mark, NULL, 2, 0 );
+
+    if( pipeline_start( &pipeline, &output ) != 0 )
+    {
+        check( "pipeline_start", 0 );
+        pipeline_finalize( &pipeline );
+        nmqueue_finalize( &output );
+        return;
+    }
+
+    for( i=0 ; i<MESSAGES ; ++i )
+    {
+        nmqueue_send( pipeline_input( &pipeline ), 0, (void*)i, 0, NULL );
+    }
+
+    /* Every incremented even value once, in any order behind two threads */
+    memset( seen, 0, sizeof(seen) );
+    for( i=0 ; i<MESSAGES/2 ; ++i )
+    {
+        long value;
+
+        nmqueue_receive( &output, &source, &data, &dataSize, NULL );
+        value = (long)data;
+        if( source != SOURCE || value < 1 || value > MESSAGES || value % 2 != 0 || seen[value]++ != 0 )
+        {
+            errors++;
+        }
+    }
+    sprintf( name, "%s output", fuse ? "fused" : "separate" );
+    check( name, errors == 0 && nmqueue_tryreceive( &output, &source, &data, &dataSize, NULL ) == NMQUEUEERROR_EMPTY );
+
+    for( i=0 ; i<3 ; ++i )
+    {
+        pipeline_stats( &pipeline, (size_t)i, &stats[i] );
+    }
+
+    sprintf( name, "%s drop accounting", fuse ? "fused" : "separate" );
+    check( name, stats[0].messages == MESSAGES && stats[0].dropped == 0 &&
+                 stats[1].messages == MESSAGES && stats[1].dropped == MESSAGES/2 &&
+                 stats[2].messages == MESSAGES/2 && stats[2].dropped == 0 );
+
+    /* A fused stage reports the input queue of its group */
+    errors = 0;
+    for( i=0 ; i<3 ; ++i )
+    {
+        if( stats[i].elapsed == 0 || stats[i].throughput <= 0.0 ||
+            stats[i].utilization < 0.0 || stats[i].utilization > 1.0 ||
+            stats[i].occupancy < 0.0 || stats[i].dwell < 0.0 )
+        {
+            errors++;
+        }
+    }
+    if( fuse && stats[1].occupancy != stats[0].occupancy )
+    {
+        errors++;
+    }
+    sprintf( name, "%s stats", fuse ? "fused" : "separate" );
+    check( name, errors == 0 );
+
+    pipeline_finalize( &pipeline );
+    nmqueue_finalize( &output );
+}
+
+int main(int argc, char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    run( 1 );
+    run( 0 );
+
+    return checkResult();
+}
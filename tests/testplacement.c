@@ -0,0 +1,103 @@
+/* Test program for ring buffer placement attributes */
+#include "src/nmqueue.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define LENGTH        100000
+#define HUGEPAGE_SIZE (2*1024*1024)
+
+int failed;
+
+/* Sends and receives through the ring buffer until it wrapped around
+ * three times, returns the number of lost or mixed up messages */
+static long wrapAround(nmqueue_t* queue)
+{
+    source_t source;
+    void*    data;
+    size_t   dataSize;
+    long     errors = 0;
+    long     sent   = 0;
+    long     received = 0;
+    long     i;
+
+    while( received < 3*LENGTH )
+    {
+        /* Keep up to a quarter of the queue filled, it never blocks */
+        for( i=0 ; i<LENGTH/3 && sent<3*LENGTH ; ++i, ++sent )
+        {
+            if( nmqueue_send( queue, (source_t)(sent%7), (void*)sent, 0, NULL ) != NMQUEUEERROR_NOERROR )
+            {
+                errors++;
+            }
+        }
+        while( received < (sent < 3*LENGTH ? sent-LENGTH/4 : sent) )
+        {
+            if( nmqueue_tryreceive( queue, &source, &data, &dataSize, NULL ) != NMQUEUEERROR_NOERROR ||
+                (long)data != received || source != (source_t)(received%7) )
+            {
+                errors++;
+            }
+            received++;
+        }
+    }
+
+    return errors;
+}
+
+int main(int argc, char* argv[])
+{
+    nmqueue_t      queue;
+    nmqueue_attr_t attr;
+    int            flags;
+
+    (void)argc;
+    (void)argv;
+
+    /* Every combination, attributes are applied or left out but never made up */
+    for( flags=0 ; flags<16 ; ++flags )
+    {
+        int  placement;
+        int  aligned;
+        long errors;
+
+        attr.flags    = flags;
+        attr.numaNode = 0;
+
+        if( nmqueue_initialize_attr( &queue, LENGTH, &attr ) != NMQUEUEERROR_NOERROR )
+        {
+            printf( "flags %2d initialize FAILED\n", flags );
+            failed = 1;
+            continue;
+        }
+
+        placement = nmqueue_placement( &queue );
+        aligned   = (unsigned long)queue.queue % HUGEPAGE_SIZE == 0;
+        errors    = wrapAround( &queue );
+
+        nmqueue_finalize( &queue );
+
+        printf( "flags %2d placement %2d %s, %ld errors %s\n", flags, placement,
+                aligned ? "aligned" : "unaligned", errors,
+                (placement & ~flags) == 0 && (aligned || !(placement & NMQUEUE_ATTR_HUGEPAGES)) && errors == 0 ? "ok" : "FAILED" );
+
+        /* Huge pages are only reported for an aligned ring buffer */
+        if( (placement & ~flags) != 0 || (!aligned && (placement & NMQUEUE_ATTR_HUGEPAGES)) || errors != 0 )
+        {
+            failed = 1;
+        }
+    }
+
+    /* Without attributes the ring buffer comes from malloc */
+    nmqueue_initialize( &queue, LENGTH );
+    if( nmqueue_placement( &queue ) != 0 || wrapAround( &queue ) != 0 )
+    {
+        failed = 1;
+    }
+    printf( "no attributes placement %d %s\n", nmqueue_placement( &queue ), failed ? "FAILED" : "ok" );
+    nmqueue_finalize( &queue );
+
+    printf( failed ? "FAILED\n" : "OK\n" );
+
+    return failed;
+}
@@ -0,0 +1,117 @@
+/* Test program for overflow policies, time to live and the drop counters */
+#include "src/nmqueue.h"
+#include "tests/testcheck.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#define LENGTH 4 /* Three usable slots */
+
+nmqueue_t queue;
+
+/* Messages passed to the drop callback */
+typedef struct
+{
+    long count;          /* Dropped messages */
+    long reasons[3];     /* Dropped messages per NMQUEUE_DROP_* reason */
+    long data[LENGTH*2]; /* Data of the dropped messages in drop order */
+} dropdata_t;
+
+dropdata_t dropped;
+
+/* Drop callback, records data and reason */
+static void drop(source_t source,
+                 void*    data,
+                 size_t   dataSize,
+                 int      reason,
+                 void*    param)
+{
+    dropdata_t* ddata = (dropdata_t*)param;
+
+    if( ddata->count < LENGTH*2 )
+    {
+        ddata->data[ ddata->count ] = (long)data;
+    }
+    ddata->reasons[ reason ]++;
+    ddata->count++;
+}
+
+/* Takes the next message without blocking, checks its data */
+static int receiveNext(long data)
+{
+    source_t source;
+    void*    receivedData;
+    size_t   dataSize;
+
+    return nmqueue_tryreceive( &queue, &source, &receivedData, &dataSize, NULL ) == NMQUEUEERROR_NOERROR &&
+           receivedData == (void*)data;
+}
+
+/* Checks the drop counters */
+static int drops(unsigned long overflow,
+                 unsigned long expired,
+                 unsigned long rejected)
+{
+    nmqueue_drops_t counters;
+
+    nmqueue_get_drops( &queue, &counters );
+
+    return counters.overflow == overflow && counters.expired == expired && counters.rejected == rejected;
+}
+
+int main(int argc, char* argv[])
+{
+    struct timespec delay = { 0, 2*1000*1000 };
+    source_t        source;
+    void*           data;
+    size_t          dataSize;
+    long            sent;
+    long            i;
+
+    (void)argc;
+    (void)argv;
+
+    nmqueue_initialize( &queue, LENGTH );
+    nmqueue_set_drop( &queue, drop, &dropped );
+
+    /* A full queue rejects the new message and keeps the old ones */
+    nmqueue_set_overflow( &queue, NMQUEUE_OVERFLOW_REJECT );
+    for( i=1 ; i<LENGTH ; ++i )
+    {
+        nmqueue_send( &queue, 0, (void*)i, 0, NULL );
+    }
+    check( "rejected when full", nmqueue_send( &queue, 0, (void*)9, 0, NULL ) == NMQUEUEERROR_FULL );
+    check( "rejected again", nmqueue_send( &queue, 0, (void*)9, 0, NULL ) == NMQUEUEERROR_FULL );
+    check( "queued ones kept", receiveNext( 1 ) && receiveNext( 2 ) && receiveNext( 3 ) );
+    check( "rejects counted", drops( 0, 0, 2 ) && dropped.count == 0 );
+
+    /* The oldest message makes room for the new one */
+    nmqueue_set_overflow( &queue, NMQUEUE_OVERFLOW_OVERWRITE );
+    for( i=1, sent=0 ; i<=LENGTH+1 ; ++i )
+    {
+        sent += nmqueue_send( &queue, 0, (void*)i, 0, NULL ) == NMQUEUEERROR_NOERROR;
+    }
+    check( "overwrite never fails", sent == LENGTH+1 );
+    check( "oldest overwritten", dropped.count == 2 && dropped.data[0] == 1 && dropped.data[1] == 2 &&
+                                 dropped.reasons[NMQUEUE_DROP_OVERFLOW] == 2 );
+    check( "newest kept", receiveNext( 3 ) && receiveNext( 4 ) && receiveNext( 5 ) );
+    check( "overflow counted", drops( 2, 0, 2 ) );
+
+    /* An expired message is dropped on receive, the ones behind it are not */
+    nmqueue_send_ttl( &queue, 0, (void*)6, 0, 1000, NULL );
+    nmqueue_send_ttl( &queue, 0, (void*)7, 0, 1, NULL );
+    nmqueue_send_ttl( &queue, 0, (void*)8, 0, 0, NULL );
+    nanosleep( &delay, NULL );
+    check( "expired dropped", receiveNext( 8 ) );
+    check( "expired reported", dropped.count == 4 && dropped.data[2] == 6 && dropped.data[3] == 7 &&
+                               dropped.reasons[NMQUEUE_DROP_EXPIRED] == 2 );
+    nmqueue_send_ttl( &queue, 0, (void*)9, 0, 1, NULL );
+    nanosleep( &delay, NULL );
+    check( "only expired left", nmqueue_tryreceive( &queue, &source, &data, &dataSize, NULL ) == NMQUEUEERROR_EMPTY );
+    check( "counters", drops( 2, 3, 2 ) && dropped.count == 5 );
+
+    nmqueue_finalize( &queue );
+
+    return checkResult();
+}
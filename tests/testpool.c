@@ -0,0 +1,141 @@
+/* Test program for a receiver pool growing under load and shrinking when idle */
+#include "src/nmqueue.h"
+#include "src/receiverpool.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+
+#define MESSAGES     3000
+#define MINRECEIVERS 1
+#define MAXRECEIVERS 4
+
+nmqueue_t queue;
+
+/* Counters shared by all receivers */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    long            received; /* Messages received */
+} consumerdata_t;
+
+consumerdata_t consumed;
+
+/* Sleeps ms milliseconds */
+static void settle(long ms)
+{
+    struct timespec delay = { 0, 0 };
+
+    delay.tv_sec  = ms/1000;
+    delay.tv_nsec = (ms%1000)*1000*1000;
+    nanosleep( &delay, NULL );
+}
+
+/* Callback for the pool receivers, slow enough for one receiver to fall behind */
+static void consumer(source_t source,
+                     void*    data,
+                     size_t   dataSize,
+                     void*    param)
+{
+    consumerdata_t* cdata = (consumerdata_t*)param;
+
+    settle( 1 );
+
+    pthread_mutex_lock( &cdata->mutex );
+    cdata->received++;
+    pthread_mutex_unlock( &cdata->mutex );
+}
+
+static long receivedCount(void)
+{
+    long received;
+
+    pthread_mutex_lock( &consumed.mutex );
+    received = consumed.received;
+    pthread_mutex_unlock( &consumed.mutex );
+
+    return received;
+}
+
+/* Entry point for the sending thread */
+static void* producerProc(void* param)
+{
+    long i;
+
+    (void)param;
+
+    for( i=0 ; i<MESSAGES ; ++i )
+    {
+        nmqueue_send( &queue, 0, (void*)i, 0, NULL );
+    }
+
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    receiverpoolconfig_t config;
+    receiverpool_t       pool;
+    pthread_t            producer;
+    size_t               largest = 0;
+    size_t               size;
+    long                 waited;
+    int                  failed;
+
+    (void)argc;
+    (void)argv;
+
+    config.minReceivers   = MINRECEIVERS;
+    config.maxReceivers   = MAXRECEIVERS;
+    config.highOccupancy  = 16;
+    config.lowOccupancy   = 0;
+    config.highDwell      = 0;
+    config.sampleInterval = 10*1000;
+    config.spawnSamples   = 2;
+    config.retireSamples  = 5;
+
+    consumed.received = 0;
+    pthread_mutex_init( &consumed.mutex, NULL );
+    nmqueue_initialize( &queue, 256 );
+
+    if( receiverpool_initialize( &pool, &queue, consumer, &consumed, &config ) != 0 )
+    {
+        printf( "Cannot create receiver pool\n" );
+        return 1;
+    }
+
+    /* The queue stays full until enough receivers run */
+    pthread_create( &producer, NULL, producerProc, NULL );
+    for( waited=0 ; waited<20000 && receivedCount() != MESSAGES ; ++waited )
+    {
+        size = receiverpool_size( &pool );
+        if( size > largest )
+        {
+            largest = size;
+        }
+        settle( 1 );
+    }
+    pthread_join( producer, NULL );
+
+    /* Idle again, back to the minimum */
+    for( waited=0 ; waited<5000 && receiverpool_size( &pool ) != MINRECEIVERS ; ++waited )
+    {
+        settle( 1 );
+    }
+    size = receiverpool_size( &pool );
+
+    receiverpool_finalize( &pool );
+    nmqueue_finalize( &queue );
+    pthread_mutex_destroy( &consumed.mutex );
+
+    failed = consumed.received != MESSAGES || largest != MAXRECEIVERS || size != MINRECEIVERS;
+
+    printf( "%ld of %d received, grew to %lu receivers, shrank to %lu %s\n",
+            consumed.received, MESSAGES, (unsigned long)largest, (unsigned long)size,
+            failed ? "FAILED" : "ok" );
+
+    printf( failed ? "FAILED\n" : "OK\n" );
+
+    return failed;
+}
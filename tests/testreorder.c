@@ -0,0 +1,193 @@
+/* Test program for the reorder buffer with out of order completion and skips */
+#include "src/nmqueue.h"
+#include "src/reorderbuffer.h"
+#include "tests/testcheck.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+#include <sched.h>
+
+#define CAPACITY     16
+#define FIRST        1
+#define SEQUENCES    100000
+#define WORKER_COUNT 4
+
+reorderbuffer_t buffer;
+
+/* Released results */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    long            released; /* Results passed to dest */
+    long            errors;   /* Results out of order or skipped ones */
+    uint64_t        last;     /* Last released sequence number */
+} releasedata_t;
+
+releasedata_t released;
+
+uint64_t nextSequence = FIRST; /* Next sequence number taken by a worker, atomic */
+
+/* Skipped before the workers start, mostly far beyond the window */
+static int skippedAhead(uint64_t sequence)
+{
+    return sequence % 97 == 0;
+}
+
+/* Skipped by the worker taking it */
+static int skippedByWorker(uint64_t sequence)
+{
+    return sequence % 13 == 0;
+}
+
+/* Callback of the reorder buffer, data is the sequence number */
+static void dest(source_t source,
+                 void*    data,
+                 size_t   dataSize,
+                 void*    param)
+{
+    releasedata_t* rdata    = (releasedata_t*)param;
+    uint64_t       sequence = (uint64_t)(size_t)data;
+
+    pthread_mutex_lock( &rdata->mutex );
+    if( (rdata->released != 0 && sequence <= rdata->last) || skippedAhead( sequence ) || skippedByWorker( sequence ) )
+    {
+        rdata->errors++;
+    }
+    rdata->last = sequence;
+    rdata->released++;
+    pthread_mutex_unlock( &rdata->mutex );
+}
+
+static long releasedCount(void)
+{
+    long count;
+
+    pthread_mutex_lock( &released.mutex );
+    count = released.released;
+    pthread_mutex_unlock( &released.mutex );
+
+    return count;
+}
+
+/* Entry point for worker threads, complete sequence numbers after a
+ * varying amount of work, so they finish out of order */
+static void* workerProc(void* param)
+{
+    (void)param;
+
+    for(;;)
+    {
+        uint64_t sequence = __atomic_fetch_add( &nextSequence, 1, __ATOMIC_RELAXED );
+        int      work;
+
+        if( sequence >= FIRST+SEQUENCES )
+        {
+            break;
+        }
+
+        if( skippedAhead( sequence ) )
+        {
+            continue;
+        }
+
+        for( work=(int)(sequence*7 % 5) ; work>0 ; --work )
+        {
+            sched_yield();
+        }
+
+        if( skippedByWorker( sequence ) )
+        {
+            reorderbuffer_skip( &buffer, sequence );
+        }
+        else if( reorderbuffer_complete( &buffer, sequence, 0, (void*)(size_t)sequence, 0 ) != NMQUEUEERROR_NOERROR )
+        {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/* Entry point for the thread releasing results made releasable by skips */
+static void* runProc(void* param)
+{
+    (void)param;
+
+    reorderbuffer_run( &buffer );
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    pthread_t workers[WORKER_COUNT];
+    pthread_t runner;
+    long      expected = 0;
+    long      waited;
+    uint64_t  sequence;
+    long      i;
+
+    (void)argc;
+    (void)argv;
+
+    pthread_mutex_init( &released.mutex, NULL );
+
+    /* Out of order completion within the window, released at once */
+    reorderbuffer_initialize( &buffer, CAPACITY, FIRST, dest, &released );
+    reorderbuffer_complete( &buffer, FIRST+2, 0, (void*)(size_t)(FIRST+2), 0 );
+    reorderbuffer_complete( &buffer, FIRST+1, 0, (void*)(size_t)(FIRST+1), 0 );
+    check( "held back until the gap closes", releasedCount() == 0 );
+    reorderbuffer_complete( &buffer, FIRST, 0, (void*)(size_t)FIRST, 0 );
+    check( "released in order", releasedCount() == 3 && released.errors == 0 && released.last == FIRST+2 );
+    reorderbuffer_abort( &buffer );
+    check( "abort beyond the window", reorderbuffer_complete( &buffer, FIRST+3+CAPACITY, 0, NULL, 0 ) == NMQUEUEERROR_ABORT );
+    reorderbuffer_finalize( &buffer );
+
+    /* Workers racing through the sequence numbers */
+    released.released = 0;
+    released.errors   = 0;
+    reorderbuffer_initialize( &buffer, CAPACITY, FIRST, dest, &released );
+
+    /* Descending, so the sorted ranges are inserted in front */
+    for( sequence=FIRST+SEQUENCES-1 ; sequence>=FIRST ; --sequence )
+    {
+        if( skippedAhead( sequence ) && reorderbuffer_skip( &buffer, sequence ) != NMQUEUEERROR_NOERROR )
+        {
+            check( "skip beyond the window", 0 );
+        }
+        if( !skippedAhead( sequence ) && !skippedByWorker( sequence ) )
+        {
+            expected++;
+        }
+    }
+
+    pthread_create( &runner, NULL, runProc, NULL );
+    for( i=0 ; i<WORKER_COUNT ; ++i )
+    {
+        pthread_create( &workers[i], NULL, workerProc, NULL );
+    }
+    for( i=0 ; i<WORKER_COUNT ; ++i )
+    {
+        pthread_join( workers[i], NULL );
+    }
+
+    /* Results behind trailing skips are left to the runner */
+    for( waited=0 ; waited<5000 && releasedCount() != expected ; ++waited )
+    {
+        struct timespec pause = { 0, 1000*1000 };
+        nanosleep( &pause, NULL );
+    }
+
+    reorderbuffer_abort( &buffer );
+    pthread_join( runner, NULL );
+
+    printf( "%ld of %ld results released, %ld errors, %lu skipped ranges left\n",
+            released.released, expected, released.errors, (unsigned long)buffer.skipCount );
+    check( "skips beyond the window", released.released == expected && released.errors == 0 && buffer.skipCount == 0 );
+
+    reorderbuffer_finalize( &buffer );
+    pthread_mutex_destroy( &released.mutex );
+
+    return checkResult();
+}
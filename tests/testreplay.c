@@ -0,0 +1,168 @@
+/* Test program recording bursty traffic and replaying it */
+#include "src/nmqueue.h"
+#include "src/receiverthread.h"
+#include "src/senderthread.h"
+
+#include "tools/trafficrecord.h"
+#include "tools/trafficreplay.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RECORDING "testreplay.rec"
+#define BURSTS    200
+#define BURSTSIZE 100
+
+nmqueue_t queue;
+
+/* Data passed to the sending thread */
+typedef struct
+{
+    long sent;  /* Number of sent messages */
+    long count; /* Number of messages to be send */
+} producerdata_t;
+
+/* Data passed to the receiving thread */
+typedef struct
+{
+    volatile long count; /* Number of received messages */
+} consumerdata_t;
+
+/* Callback for sending thread, sends bursts of BURSTSIZE messages every ms */
+int producer(source_t* source,
+             void**    data,
+             size_t*   dataSize,
+             void*     param)
+{
+    producerdata_t* pdata = (producerdata_t*)param;
+
+    if( pdata->sent == pdata->count )
+    {
+        return SENDERTHREAD_NODATA;
+    }
+
+    if( pdata->sent % BURSTSIZE == 0 )
+    {
+        struct timespec pause = { 0, 1000*1000 };
+        nanosleep( &pause, NULL );
+    }
+
+    *source   = (source_t)(pdata->sent % 4);
+    *data     = &pdata->sent;
+    *dataSize = sizeof(pdata->sent);
+
+    pdata->sent++;
+
+    return SENDERTHREAD_DATA;
+}
+
+/* Callback for receiving thread */
+void consumer(source_t source,
+              void*    data,
+              size_t   dataSize,
+              void*    param)
+{
+    ((consumerdata_t*)param)->count++;
+}
+
+int main()
+{
+    static const idleconfig_t producerIdle = { IDLESTRATEGY_BACKOFF, 0, 1, 1000 };
+
+    trafficrecord_t               record;
+    senderthread_t                sender;
+    receiverthread_t              receiver;
+    producerdata_t                pdata;
+    consumerdata_t                cdata;
+    struct trafficrecord_entry_s* entries;
+    size_t                        count;
+    trafficreplay_stats_t         stats;
+    int                           err;
+
+    if( (err=nmqueue_initialize(&queue,1024)) != NMQUEUEERROR_NOERROR )
+    {
+        printf("Failed to initialize nmqueue: %s\n",nmqueue_error_to_string(err));
+        return 1;
+    }
+
+    /* Record */
+    if( (err=trafficrecord_start( &record, &queue, RECORDING, TRAFFICRECORD_PAYLOAD, 64*1024 )) != NMQUEUEERROR_NOERROR )
+    {
+        printf("Failed to start recording: %s\n",nmqueue_error_to_string(err));
+        return 1;
+    }
+
+    pdata.sent  = 0;
+    pdata.count = BURSTS*BURSTSIZE;
+    cdata.count = 0;
+
+    initializeReceiver( &receiver, &queue, consumer, &cdata );
+    initializeSenderIdle( &sender, &queue, producer, &pdata, &producerIdle );
+
+    while( cdata.count != BURSTS*BURSTSIZE )
+    {
+        sched_yield();
+    }
+
+    finalizeSender( &sender );
+    finalizeReceiver( &receiver );
+
+    if( (err=trafficrecord_stop( &record )) != NMQUEUEERROR_NOERROR )
+    {
+        printf("Failed to write recording: %s\n",nmqueue_error_to_string(err));
+        return 1;
+    }
+    printf("Recorded %lu messages, dropped %lu\n", record.recorded, record.dropped);
+
+    /* Replay */
+    if( (err=trafficrecord_load( RECORDING, &entries, &count )) != NMQUEUEERROR_NOERROR )
+    {
+        printf("Failed to load recording: %s\n",nmqueue_error_to_string(err));
+        return 1;
+    }
+
+    if( count != record.recorded )
+    {
+        printf("Invalid recording, %lu entries instead of %lu\n", (unsigned long)count, record.recorded);
+    }
+
+    printf("Replay at original speed:\n");
+    trafficreplay_run( &queue, entries, count, 2, 2, 1.0, &stats );
+    trafficreplay_print( stdout, &stats );
+
+    printf("Replay at maximum speed:\n");
+    trafficreplay_run( &queue, entries, count, 2, 2, 0.0, &stats );
+    trafficreplay_print( stdout, &stats );
+
+    trafficrecord_free( entries, count );
+
+    /* An interrupted recording loses only its last record */
+    {
+        struct trafficrecord_entry_s* truncated;
+        size_t                        truncatedCount;
+        FILE*                         file = fopen( RECORDING, "rb" );
+        long                          size;
+
+        fseek( file, 0, SEEK_END );
+        size = ftell( file );
+        fclose( file );
+
+        if( truncate( RECORDING, size-1 ) != 0 ||
+            trafficrecord_load( RECORDING, &truncated, &truncatedCount ) != NMQUEUEERROR_NOERROR ||
+            truncatedCount != count-1 )
+        {
+            printf("Truncated recording not loaded\n");
+            remove( RECORDING );
+            return 1;
+        }
+        trafficrecord_free( truncated, truncatedCount );
+    }
+
+    remove( RECORDING );
+
+    nmqueue_finalize(&queue);
+
+    return 0;
+}
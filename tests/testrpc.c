@@ -0,0 +1,175 @@
+/* Test program comparing request/reply slots with a semaphore per call */
+#include "src/nmqueue.h"
+#include "src/receiverthread.h"
+#include "src/rpc.h"
+
+#include "tools/measureutil.h"
+#include "tools/tscclock.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <semaphore.h>
+#include <pthread.h>
+
+#define CALLERS 4
+#define CALLS   50000
+
+nmqueue_t queue;
+rpc_t     rpc;
+
+/* Request of the semaphore variant, allocated per call */
+typedef struct
+{
+    sem_t done;  /* Posted once reply is set */
+    long  value; /* Request value */
+    long  reply; /* Reply value */
+} semrequest_t;
+
+/* Data passed to calling threads */
+typedef struct
+{
+    int      slots;  /* Use rpc slots instead of semaphores */
+    long     errors; /* Wrong or missing replies */
+    int64_t* delta;  /* Array: Round trip time of each call in ns */
+} callerdata_t;
+
+/* Callback for the serving thread, rpc variant: replies value+1 */
+void rpcServer(source_t source,
+               void*    data,
+               size_t   dataSize,
+               void*    param)
+{
+    struct rpc_slot_s* slot  = (struct rpc_slot_s*)data;
+    long               value = (long)slot->data;
+
+    /* Requests from source 1 are never answered, to exercise the timeout */
+    if( source == 1 )
+    {
+        return;
+    }
+
+    rpc_reply( &rpc, slot, source, (void*)(value+1), 0 );
+}
+
+/* Callback for the serving thread, semaphore variant */
+void semServer(source_t source,
+               void*    data,
+               size_t   dataSize,
+               void*    param)
+{
+    semrequest_t* request = (semrequest_t*)data;
+
+    request->reply = request->value+1;
+    sem_post( &request->done );
+}
+
+/* Entry point for calling threads */
+void* callerProc(void* param)
+{
+    callerdata_t* cdata = (callerdata_t*)param;
+    long          i;
+
+    for( i=0 ; i<CALLS ; ++i )
+    {
+        uint64_t start = tscclock_ticks();
+
+        if( cdata->slots )
+        {
+            source_t replySource;
+            void*    replyData;
+            size_t   replySize;
+
+            if( rpc_call( &rpc, 0, (void*)i, 0, 0, &replySource, &replyData, &replySize, cdata ) != NMQUEUEERROR_NOERROR ||
+                (long)replyData != i+1 )
+            {
+                cdata->errors++;
+            }
+        }
+        else
+        {
+            semrequest_t* request = (semrequest_t*)malloc( sizeof(semrequest_t) );
+
+            sem_init( &request->done, 0, 0 );
+            request->value = i;
+            nmqueue_send( &queue, 0, request, sizeof(semrequest_t), cdata );
+            while( sem_wait( &request->done ) != 0 );
+            if( request->reply != i+1 )
+            {
+                cdata->errors++;
+            }
+            sem_destroy( &request->done );
+            free( request );
+        }
+
+        cdata->delta[i] = (int64_t)tscclock_ticks_to_ns( tscclock_ticks()-start );
+    }
+
+    return NULL;
+}
+
+/* Runs CALLERS threads doing CALLS round trips each */
+void testrpc(int slots)
+{
+    receiverthread_t server;
+    pthread_t        threads[CALLERS];
+    callerdata_t     cdata[CALLERS];
+    int64_t*         deltas = (int64_t*)malloc( CALLERS*CALLS*sizeof(int64_t) );
+    long             errors = 0;
+    int              i;
+
+    nmqueue_initialize( &queue, 1024 );
+    if( slots )
+    {
+        rpc_initialize( &rpc, &queue, CALLERS );
+    }
+
+    initializeReceiver( &server, &queue, slots ? rpcServer : semServer, NULL );
+
+    for( i=0 ; i<CALLERS ; ++i )
+    {
+        cdata[i].slots  = slots;
+        cdata[i].errors = 0;
+        cdata[i].delta  = deltas+i*CALLS;
+        pthread_create( &threads[i], NULL, callerProc, &cdata[i] );
+    }
+
+    for( i=0 ; i<CALLERS ; ++i )
+    {
+        pthread_join( threads[i], NULL );
+        errors += cdata[i].errors;
+    }
+
+    printf("%-10s round trip %li ns +- %li, %li errors\n", slots ? "rpc slots" : "semaphore",
+           (long)mu_mean( deltas, CALLERS*CALLS ), (long)mu_deviation( deltas, CALLERS*CALLS ), errors);
+
+    /* A request which is never answered times out, its slot stays taken */
+    if( slots )
+    {
+        source_t replySource;
+        void*    replyData;
+        size_t   replySize;
+        int      result = rpc_call( &rpc, 1, NULL, 0, 1000, &replySource, &replyData, &replySize, &rpc );
+
+        printf("Unanswered call: %s\n", nmqueue_error_to_string( result ));
+    }
+
+    finalizeReceiver( &server );
+
+    if( slots )
+    {
+        rpc_finalize( &rpc );
+    }
+    nmqueue_finalize( &queue );
+
+    free( deltas );
+}
+
+int main()
+{
+    tscclock_initialize();
+
+    testrpc( 0 );
+    testrpc( 1 );
+
+    return 0;
+}
@@ -0,0 +1,124 @@
+/* Test program for nmqueue_select and its abort paths */
+#include "src/nmqueue.h"
+#include "tests/testcheck.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+
+#define QUEUES 2
+
+nmqueue_t         queues[QUEUES];
+nmqueue_t*        queueList[QUEUES] = { &queues[0], &queues[1] };
+nmqueue_waitset_t waitset;
+
+/* Result of one selecting thread */
+typedef struct
+{
+    pthread_t thread;
+    int       err;    /* Result of nmqueue_select */
+    size_t    index;  /* Queue it returned from */
+    void*     data;   /* Received data */
+} selectdata_t;
+
+/* Entry point for selecting threads, the thread id is the selectdata_t */
+static void* selectProc(void* param)
+{
+    selectdata_t* sdata = (selectdata_t*)param;
+    source_t      source;
+    size_t        dataSize;
+
+    sdata->err = nmqueue_select( &waitset, queueList, QUEUES, 1, &sdata->index,
+                                 &source, &sdata->data, &dataSize, sdata );
+    return NULL;
+}
+
+/* Gives selecting threads time to block */
+static void settle(void)
+{
+    struct timespec delay = { 0, 50*1000*1000 };
+    nanosleep( &delay, NULL );
+}
+
+int main(int argc, char* argv[])
+{
+    selectdata_t first;
+    selectdata_t second;
+    source_t     source;
+    void*        data;
+    size_t       dataSize;
+    size_t       index;
+    int          i;
+
+    (void)argc;
+    (void)argv;
+
+    for( i=0 ; i<QUEUES ; ++i )
+    {
+        nmqueue_initialize( &queues[i], 16 );
+    }
+    nmqueue_waitset_initialize( &waitset );
+    for( i=0 ; i<QUEUES ; ++i )
+    {
+        nmqueue_waitset_attach( &waitset, &queues[i] );
+    }
+
+    /* Priority picks the first queue with a message */
+    nmqueue_send( &queues[1], 1, (void*)1, 0, NULL );
+    nmqueue_send( &queues[0], 0, (void*)0, 0, NULL );
+    check( "priority order",
+           nmqueue_select( &waitset, queueList, QUEUES, 1, &index, &source, &data, &dataSize, NULL ) == NMQUEUEERROR_NOERROR && index == 0 &&
+           nmqueue_select( &waitset, queueList, QUEUES, 1, &index, &source, &data, &dataSize, NULL ) == NMQUEUEERROR_NOERROR && index == 1 );
+
+    /* A send wakes a blocked select */
+    pthread_create( &first.thread, NULL, selectProc, &first );
+    settle();
+    nmqueue_send( &queues[1], 1, (void*)&first, 0, NULL );
+    pthread_join( first.thread, NULL );
+    check( "send wakes select", first.err == NMQUEUEERROR_NOERROR && first.index == 1 && first.data == &first );
+
+    /* Waitset abort of a blocked thread, the other one stays blocked */
+    pthread_create( &first.thread, NULL, selectProc, &first );
+    pthread_create( &second.thread, NULL, selectProc, &second );
+    settle();
+    nmqueue_waitset_abort( &waitset, &first );
+    pthread_join( first.thread, NULL );
+    check( "waitset abort wakes its thread", first.err == NMQUEUEERROR_ABORT );
+
+    nmqueue_send( &queues[0], 0, (void*)&second, 0, NULL );
+    pthread_join( second.thread, NULL );
+    check( "other selector keeps waiting", second.err == NMQUEUEERROR_NOERROR && second.data == &second );
+
+    /* Queue abort of a blocked thread */
+    pthread_create( &first.thread, NULL, selectProc, &first );
+    settle();
+    nmqueue_abort( &queues[1], &first );
+    pthread_join( first.thread, NULL );
+    check( "queue abort wakes select", first.err == NMQUEUEERROR_ABORT && first.index == 1 );
+
+    /* Abort before select is kept for the next call */
+    nmqueue_waitset_abort( &waitset, &first );
+    selectProc( &first );
+    check( "waitset abort before select", first.err == NMQUEUEERROR_ABORT );
+
+    nmqueue_abort( &queues[0], &first );
+    selectProc( &first );
+    check( "queue abort before select", first.err == NMQUEUEERROR_ABORT && first.index == 0 );
+
+    /* A cleared abort does not hit the next select */
+    nmqueue_waitset_abort( &waitset, &first );
+    nmqueue_waitset_clear_abort( &waitset, &first );
+    nmqueue_send( &queues[0], 0, (void*)&first, 0, NULL );
+    selectProc( &first );
+    check( "cleared abort", first.err == NMQUEUEERROR_NOERROR && first.data == &first );
+
+    for( i=0 ; i<QUEUES ; ++i )
+    {
+        nmqueue_waitset_detach( &waitset, &queues[i] );
+        nmqueue_finalize( &queues[i] );
+    }
+    nmqueue_waitset_finalize( &waitset );
+
+    return checkResult();
+}
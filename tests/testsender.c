@@ -0,0 +1,226 @@
+/* Test program checking that batch senders lose no message on finalize
+ * and drop only the messages the queue rejects */
+#include "src/nmqueue.h"
+#include "src/receiverthread.h"
+#include "src/senderthread.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+
+#define BATCHSIZE 64
+
+nmqueue_t queue;
+int       failed;
+
+/* Data passed to the sending thread */
+typedef struct
+{
+    long produced; /* Messages handed to the sender */
+    long pace;     /* Pause in µs before every message, 0 for none */
+    long limit;    /* Messages produced before running out, 0 for no limit */
+} producerdata_t;
+
+/* Data passed to the receiving thread */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    long            received; /* Messages received */
+    long            errors;   /* Messages out of order */
+    long            next;     /* Next message expected */
+    int             gaps;     /* Messages may be missing, only the order is checked */
+} consumerdata_t;
+
+/* Callback for the sending thread, runs out of data after limit messages */
+static int producer(source_t* source,
+                    void**    data,
+                    size_t*   dataSize,
+                    void*     param)
+{
+    producerdata_t* pdata = (producerdata_t*)param;
+
+    if( pdata->limit != 0 && pdata->produced == pdata->limit )
+    {
+        return SENDERTHREAD_NODATA;
+    }
+
+    if( pdata->pace != 0 )
+    {
+        struct timespec pause = { 0, pdata->pace*1000 };
+        nanosleep( &pause, NULL );
+    }
+
+    *source   = 0;
+    *data     = (void*)pdata->produced;
+    *dataSize = 0;
+
+    pdata->produced++;
+
+    return SENDERTHREAD_DATA;
+}
+
+/* Callback for the receiving thread, messages arrive in order */
+static void consumer(source_t source,
+                     void*    data,
+                     size_t   dataSize,
+                     void*    param)
+{
+    consumerdata_t* cdata = (consumerdata_t*)param;
+
+    pthread_mutex_lock( &cdata->mutex );
+    if( (long)data < cdata->next || (!cdata->gaps && (long)data != cdata->next) )
+    {
+        cdata->errors++;
+    }
+    cdata->next = (long)data+1;
+    cdata->received++;
+    pthread_mutex_unlock( &cdata->mutex );
+}
+
+static long receivedCount(consumerdata_t* cdata)
+{
+    long received;
+
+    pthread_mutex_lock( &cdata->mutex );
+    received = cdata->received;
+    pthread_mutex_unlock( &cdata->mutex );
+
+    return received;
+}
+
+/* Gives the threads time to run */
+static void settle(long ms)
+{
+    struct timespec delay = { 0, 0 };
+
+    delay.tv_sec  = ms/1000;
+    delay.tv_nsec = (ms%1000)*1000*1000;
+    nanosleep( &delay, NULL );
+}
+
+/* Runs one sender until finalize and checks every produced message arrives */
+static void run(const char*   name,
+                size_t        length,
+                unsigned long flushLatency,
+                long          pace)
+{
+    senderthread_t   sender;
+    receiverthread_t receiver;
+    producerdata_t   pdata;
+    consumerdata_t   cdata;
+    long             waited;
+    long             early;
+
+    pdata.produced = 0;
+    pdata.pace     = pace;
+    pdata.limit    = 0;
+    cdata.received = 0;
+    cdata.errors   = 0;
+    cdata.next     = 0;
+    cdata.gaps     = 0;
+    pthread_mutex_init( &cdata.mutex, NULL );
+
+    nmqueue_initialize( &queue, length );
+    initializeReceiver( &receiver, &queue, consumer, &cdata );
+    initializeBatchSender( &sender, &queue, producer, &pdata, BATCHSIZE, flushLatency, NULL );
+
+    settle( 100 );
+    early = receivedCount( &cdata );
+
+    finalizeSender( &sender );
+
+    for( waited=0 ; waited<5000 && receivedCount( &cdata ) != pdata.produced ; ++waited )
+    {
+        settle( 1 );
+    }
+
+    finalizeReceiver( &receiver );
+    nmqueue_finalize( &queue );
+    pthread_mutex_destroy( &cdata.mutex );
+
+    printf( "%-32s %ld produced, %ld received, %ld before finalize, %ld errors %s\n",
+            name, pdata.produced, cdata.received, early, cdata.errors,
+            cdata.received == pdata.produced && cdata.errors == 0 && early != 0 ? "ok" : "FAILED" );
+
+    if( cdata.received != pdata.produced || cdata.errors != 0 || early == 0 )
+    {
+        failed = 1;
+    }
+}
+
+/* Sends limit messages to a small rejecting queue, checks that a rejected
+ * message drops only itself and the rest of its batch arrives */
+static void runReject(const char* name,
+                      long        limit)
+{
+    senderthread_t   sender;
+    receiverthread_t receiver;
+    producerdata_t   pdata;
+    consumerdata_t   cdata;
+    nmqueue_drops_t  drops;
+    long             waited;
+    int              ok;
+
+    pdata.produced = 0;
+    pdata.pace     = 0;
+    pdata.limit    = limit;
+    cdata.received = 0;
+    cdata.errors   = 0;
+    cdata.next     = 0;
+    cdata.gaps     = 1;
+    pthread_mutex_init( &cdata.mutex, NULL );
+
+    nmqueue_initialize( &queue, 8 );
+    nmqueue_set_overflow( &queue, NMQUEUE_OVERFLOW_REJECT );
+    initializeReceiver( &receiver, &queue, consumer, &cdata );
+    initializeBatchSender( &sender, &queue, producer, &pdata, BATCHSIZE, 1000*1000, NULL );
+
+    for( waited=0 ; waited<5000 ; ++waited )
+    {
+        nmqueue_get_drops( &queue, &drops );
+        if( receivedCount( &cdata )+(long)drops.rejected == limit )
+        {
+            break;
+        }
+        settle( 1 );
+    }
+
+    finalizeSender( &sender );
+    finalizeReceiver( &receiver );
+    nmqueue_get_drops( &queue, &drops );
+    nmqueue_finalize( &queue );
+    pthread_mutex_destroy( &cdata.mutex );
+
+    ok = cdata.received+(long)drops.rejected == limit && drops.rejected != 0 && cdata.errors == 0;
+
+    printf( "%-32s %ld produced, %ld received, %lu rejected, %ld errors %s\n",
+            name, pdata.produced, cdata.received, drops.rejected, cdata.errors, ok ? "ok" : "FAILED" );
+
+    if( !ok )
+    {
+        failed = 1;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    /* Batches never fill up, only the latency bound sends them before finalize */
+    run( "latency bound", 1024, 2000, 100 );
+
+    /* Sender mostly blocked on a full queue when finalize aborts it */
+    run( "aborted partial batch", 8, 1000*1000, 0 );
+
+    /* Large queue, the batch is partly filled at finalize */
+    run( "partial batch", 64*1024, 1000*1000*1000, 0 );
+
+    /* Batches larger than the queue, most of each one is rejected */
+    runReject( "rejected messages", 100000 );
+
+    printf( failed ? "FAILED\n" : "OK\n" );
+
+    return failed;
+}
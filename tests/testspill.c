@@ -0,0 +1,221 @@
+/* Test program for the spill file overflow policy */
+#include "src/nmqueue.h"
+#include "tests/testcheck.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LENGTH     8
+#define SPILLSIZE  (4*4096)
+#define GROUPSIZE  3
+#define LARGEGROUP 5
+
+char      path[] = "/tmp/testspillXXXXXX";
+nmqueue_t queue;
+
+/* Queue of LENGTH slots spilling to path */
+static int setup(void)
+{
+    nmqueue_initialize( &queue, LENGTH );
+    return nmqueue_set_spill( &queue, path, SPILLSIZE, NULL, NULL, NULL ) == NMQUEUEERROR_NOERROR;
+}
+
+/* Payload of message index with size bytes, released by the queue or the receiver */
+static void* payloadOf(long   index,
+                       size_t size)
+{
+    char*  payload = (char*)malloc( size );
+    size_t i;
+
+    for( i=0 ; i<size ; ++i )
+    {
+        payload[i] = (char)(index+i);
+    }
+    return payload;
+}
+
+/* Checks and frees a received payload */
+static int checkPayload(long   index,
+                        void*  data,
+                        size_t dataSize,
+                        size_t size)
+{
+    int    ok = dataSize == size;
+    size_t i;
+
+    for( i=0 ; ok && i<size ; ++i )
+    {
+        ok = ((char*)data)[i] == (char)(index+i);
+    }
+    free( data );
+
+    return ok;
+}
+
+/* Sends a single message with payload, source is its index */
+static int sendIndexed(long   index,
+                       size_t size)
+{
+    return nmqueue_send( &queue, (source_t)index, payloadOf( index, size ), size, NULL );
+}
+
+/* Receives a single message with payload, returns 1 if it is index */
+static int receiveIndexed(long   index,
+                          size_t size)
+{
+    source_t source;
+    void*    data;
+    size_t   dataSize;
+
+    return nmqueue_tryreceive( &queue, &source, &data, &dataSize, NULL ) == NMQUEUEERROR_NOERROR &&
+           source == (source_t)index && checkPayload( index, data, dataSize, size );
+}
+
+/* Sends a group of parts messages, source is the index of the first part */
+static int sendGroup(long   index,
+                     size_t parts,
+                     size_t size)
+{
+    struct nmqueue_message_s messages[LARGEGROUP];
+    size_t                   i;
+    int                      err;
+
+    for( i=0 ; i<parts ; ++i )
+    {
+        messages[i].source   = (source_t)index;
+        messages[i].data     = payloadOf( index+(long)i, size );
+        messages[i].dataSize = size;
+        messages[i].expires  = 0;
+    }
+
+    err = nmqueue_send_group( &queue, messages, parts, NULL );
+
+    /* Payloads of a rejected group stay with the sender */
+    if( err != NMQUEUEERROR_NOERROR )
+    {
+        for( i=0 ; i<parts ; ++i )
+        {
+            free( messages[i].data );
+        }
+    }
+
+    return err;
+}
+
+/* Receives a group, returns 1 if it is complete and starts at index */
+static int receiveGroup(long   index,
+                        size_t parts,
+                        size_t size)
+{
+    struct nmqueue_message_s messages[LARGEGROUP];
+    size_t                   count;
+    size_t                   i;
+    int                      ok;
+
+    if( nmqueue_tryreceive_group( &queue, messages, LARGEGROUP, &count, NULL ) != NMQUEUEERROR_NOERROR )
+    {
+        return 0;
+    }
+
+    ok = count == parts;
+    for( i=0 ; i<count ; ++i )
+    {
+        ok = checkPayload( index+(long)i, messages[i].data, messages[i].dataSize, size ) &&
+             messages[i].source == (source_t)index && messages[i].parts == count-i && ok;
+    }
+
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    nmqueue_drops_t drops;
+    source_t        source;
+    void*           data;
+    size_t          dataSize;
+    long            errors;
+    long            groups;
+    long            i;
+    long            j;
+    int             fd;
+
+    (void)argc;
+    (void)argv;
+
+    /* Spill file name, the queue truncates and removes it */
+    fd = mkstemp( path );
+    if( fd < 0 )
+    {
+        printf( "Cannot create spill file\n" );
+        return 1;
+    }
+    close( fd );
+
+    /* Messages beyond the ring buffer are spilled and read back in order */
+    check( "set spill", setup() );
+    errors = 0;
+    for( i=0 ; i<100 ; ++i )
+    {
+        errors += sendIndexed( i, 24 ) != NMQUEUEERROR_NOERROR;
+    }
+    nmqueue_get_drops( &queue, &drops );
+    check( "ring buffer full, rest spilled", errors == 0 && nmqueue_occupancy( &queue ) == LENGTH-1 && drops.spilled == 100-(LENGTH-1) );
+
+    for( i=0 ; i<100 ; ++i )
+    {
+        errors += !receiveIndexed( i, 24 );
+    }
+    check( "read back order", errors == 0 && nmqueue_tryreceive( &queue, &source, &data, &dataSize, NULL ) == NMQUEUEERROR_EMPTY );
+    nmqueue_finalize( &queue );
+
+    /* Payloads of varying size wrap around the spill file many times */
+    setup();
+    errors = 0;
+    for( i=0 ; i<200 ; ++i )
+    {
+        for( j=0 ; j<30 ; ++j )
+        {
+            errors += sendIndexed( i*30+j, 1+(size_t)((i*30+j)%200) ) != NMQUEUEERROR_NOERROR;
+        }
+        for( j=0 ; j<30 ; ++j )
+        {
+            errors += !receiveIndexed( i*30+j, 1+(size_t)((i*30+j)%200) );
+        }
+    }
+    check( "wrap around", errors == 0 );
+    nmqueue_finalize( &queue );
+
+    /* Groups are spilled and read back as a whole */
+    setup();
+    errors = 0;
+    for( i=0 ; i<20 ; ++i )
+    {
+        errors += sendGroup( i*GROUPSIZE, GROUPSIZE, 16 ) != NMQUEUEERROR_NOERROR;
+    }
+    for( i=0 ; i<20 ; ++i )
+    {
+        errors += !receiveGroup( i*GROUPSIZE, GROUPSIZE, 16 );
+    }
+    check( "groups read back whole", errors == 0 );
+    nmqueue_finalize( &queue );
+
+    /* A group not fitting into the spill file leaves nothing of it behind */
+    setup();
+    errors = 0;
+    for( groups=0 ; sendGroup( groups*LARGEGROUP, LARGEGROUP, 1000 ) == NMQUEUEERROR_NOERROR ; ++groups );
+    nmqueue_get_drops( &queue, &drops );
+    check( "full spill file rejects", groups > 2 && drops.rejected == 1 );
+
+    errors += sendIndexed( -1, 8 ) != NMQUEUEERROR_NOERROR;
+    for( i=0 ; i<groups ; ++i )
+    {
+        errors += !receiveGroup( i*LARGEGROUP, LARGEGROUP, 1000 );
+    }
+    errors += !receiveIndexed( -1, 8 );
+    check( "rewind on full", errors == 0 && nmqueue_tryreceive( &queue, &source, &data, &dataSize, NULL ) == NMQUEUEERROR_EMPTY );
+    nmqueue_finalize( &queue );
+
+    return checkResult();
+}
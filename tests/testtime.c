@@ -6,6 +6,7 @@
 
 #include "tools/measureutil.h"
 #include "tools/timespecutil.h"
+#include "tools/tscclock.h"
 
 #include <stdlib.h>
 #include <semaphore.h>
@@ -25,8 +26,8 @@ typedef struct
     source_t source; /* Unique source id for each sending threads */
     size_t   index;  /* Number of sent messages */
     size_t   count;  /* Number of message to be send */
-    int64_t* start;  /* Array: Time point where each message was sent */
-    int64_t* delta;  /* Array: Time it took for each message to be send */
+    int64_t* start;  /* Array: Time point in ns where each message was sent */
+    int64_t* delta;  /* Array: Time in ns it took for each message to be send */
     struct timespec senddelta; /* Time between two sends */
 } producerdata_t;
 
@@ -41,6 +42,9 @@ producerdata_t* producerData;
 /* Data array for all receiving threads */
 consumerdata_t* consumerData;
 
+/* Idle strategy of the sending threads once all messages are sent */
+static const idleconfig_t producerIdle = { IDLESTRATEGY_SPINYIELD, 0, 0, 0 };
+
 /* Callback called by the sending thread */
 int producer(source_t* source,
              void**    data,
@@ -70,20 +74,12 @@ int producer(source_t* source,
         *dataSize = pdata->index;
 
         /* Set time sent point */
-        {
-            struct timespec starttime;
-            clock_gettime( CLOCK_MONOTONIC, &starttime );
-            pdata->start[pdata->index] = timespec_to_us( starttime );
-        }
+        pdata->start[pdata->index] = (int64_t)tscclock_ns();
 
         pdata->index++;
 
         return 0;
     }
-    else
-    {
-        sched_yield();
-    }
 
     return 1;
 }
@@ -94,12 +90,10 @@ void consumer(source_t source,
               size_t   dataSize,
               void*    param)
 {
-    struct timespec stoptime;
     consumerdata_t* cdata = (consumerdata_t*)param;
 
     /* Set time received-time sent */
-    clock_gettime( CLOCK_MONOTONIC, &stoptime );
-    producerData[source].delta[dataSize] = timespec_to_us( stoptime )-producerData[source].start[dataSize];
+    producerData[source].delta[dataSize] = (int64_t)tscclock_ns()-producerData[source].start[dataSize];
 
     /* Count received message */
     cdata->count++;
@@ -155,7 +149,7 @@ void testnm(unsigned int n, /*< n sending threads */
     /* Create sending threads */
     for( i=0 ; i<n ; ++i )
     {
-        initializeSender( &senders[i], &queue, producer, &producerData[i] );
+        initializeSenderIdle( &senders[i], &queue, producer, &producerData[i], &producerIdle );
     }
 
     /* Create receiving threads */
@@ -167,19 +161,16 @@ void testnm(unsigned int n, /*< n sending threads */
     /* Run test */
     started = 1;
     {
-        struct timespec starttime;
-        struct timespec stoptime;
+        uint64_t starttime;
         int64_t delta;
-        clock_gettime( CLOCK_MONOTONIC, &starttime );
+        starttime = tscclock_ticks();
 
         do
         {
             sched_yield();
         } while(getTotalConsumed(m)<n*count);
 
-        clock_gettime( CLOCK_MONOTONIC, &stoptime );
-
-        delta = timespec_to_us( stoptime )-timespec_to_us( starttime );
+        delta = (int64_t)( tscclock_ticks_to_ns( tscclock_ticks()-starttime )/1000 );
 
         printf("Total time consumed %li µs\n", (long int)delta);
     }
@@ -197,7 +188,7 @@ void testnm(unsigned int n, /*< n sending threads */
         int64_t devDelta  = 0;
         meanDelta = mu_mean( producerData[i].delta, producerData[i].count );
         devDelta  = mu_deviation( producerData[i].delta, producerData[i].count);
-        printf("Message send time average %i delta %li µs +- %li\n", i, (long int)meanDelta, (long int)devDelta );
+        printf("Message send time average %i delta %li ns +- %li\n", i, (long int)meanDelta, (long int)devDelta );
     }
     
     for( i=0 ; i<n ; ++i )
@@ -228,6 +219,11 @@ void testnm(unsigned int n, /*< n sending threads */
 
 int main()
 {
+    if( !tscclock_initialize() )
+    {
+        printf("No invariant TSC, timing with clock_gettime\n");
+    }
+
     {
         int err;
         if( (err=nmqueue_initialize(&queue,1024)) != NMQUEUEERROR_NOERROR)
@@ -239,6 +235,37 @@ int main()
     testnm (1, 1, 1000000, 0 );
     testnm( 2, 2, 1000000, 0 );
 
+    /* Same with each sender limited to a share of the ring buffer */
+    if( nmqueue_set_credits( &queue, 2, 256 ) == NMQUEUEERROR_NOERROR )
+    {
+        testnm( 2, 2, 1000000, 0 );
+    }
+
     nmqueue_finalize(&queue);
+
+    /* Same with a prefaulted, locked ring buffer on huge pages where available */
+    {
+        nmqueue_attr_t attr;
+        int            err;
+
+        attr.flags    = NMQUEUE_ATTR_HUGEPAGES|NMQUEUE_ATTR_PREFAULT|NMQUEUE_ATTR_LOCK;
+        attr.numaNode = 0;
+
+        if( (err=nmqueue_initialize_attr(&queue,1024,&attr)) != NMQUEUEERROR_NOERROR)
+        {
+            printf("Failed to initialize nmqueue: %s\n",nmqueue_error_to_string(err));
+            return 1;
+        }
+
+        printf("Ring buffer with%s huge pages,%s prefaulted,%s locked\n",
+               nmqueue_placement(&queue) & NMQUEUE_ATTR_HUGEPAGES ? "" : "out",
+               nmqueue_placement(&queue) & NMQUEUE_ATTR_PREFAULT ? "" : " not",
+               nmqueue_placement(&queue) & NMQUEUE_ATTR_LOCK ? "" : " not");
+
+        testnm( 1, 1, 1000000, 0 );
+
+        nmqueue_finalize(&queue);
+    }
+
     return 0;
 }
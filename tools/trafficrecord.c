@@ -0,0 +1,303 @@
+#include "trafficrecord.h"
+#include "tscclock.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char trafficMagic[8] = { 'N', 'M', 'Q', 'T', 'R', 'A', 'F', '1' };
+
+/* On disk record header, followed by the payload with TRAFFICRECORD_PAYLOAD */
+struct trafficrecord_header_s
+{
+    uint64_t timestamp;
+    int32_t  source;
+    uint32_t dataSize;
+};
+
+/* Entry point for the writer thread */
+/* Writes handed over buffers until shutdown */
+static void* writerProc(void* recordT)
+{
+    trafficrecord_t* record = (trafficrecord_t*)recordT;
+
+    pthread_mutex_lock( &record->mutex );
+
+    for(;;)
+    {
+        while( !record->pending && !record->terminated )
+        {
+            pthread_cond_wait( &record->pendingCond, &record->mutex );
+        }
+
+        if( !record->pending )
+        {
+            break;
+        }
+
+        /* The tap only touches the active buffer */
+        {
+            int other = !record->active;
+
+            pthread_mutex_unlock( &record->mutex );
+            if( fwrite( record->buffers[other], 1, record->fill[other], record->file ) != record->fill[other] )
+            {
+                record->failed = 1;
+            }
+            record->fill[other] = 0;
+            pthread_mutex_lock( &record->mutex );
+        }
+
+        record->pending = 0;
+    }
+
+    pthread_mutex_unlock( &record->mutex );
+
+    return NULL;
+}
+
+/* Queue tap, appends one record to the active buffer */
+static void recordTap(const struct nmqueue_message_s* message,
+                      void*                           param)
+{
+    trafficrecord_t*              record  = (trafficrecord_t*)param;
+    size_t                        payload = (record->flags & TRAFFICRECORD_PAYLOAD) ? message->dataSize : 0;
+    size_t                        size    = sizeof(struct trafficrecord_header_s)+payload;
+    struct trafficrecord_header_s header;
+
+    if( size > record->bufferSize )
+    {
+        record->dropped++;
+        return;
+    }
+
+    /* Hand the full buffer to the writer, drop if it is still busy */
+    if( record->fill[record->active]+size > record->bufferSize )
+    {
+        pthread_mutex_lock( &record->mutex );
+        if( record->pending )
+        {
+            pthread_mutex_unlock( &record->mutex );
+            record->dropped++;
+            return;
+        }
+        record->active  = !record->active;
+        record->pending = 1;
+        pthread_cond_signal( &record->pendingCond );
+        pthread_mutex_unlock( &record->mutex );
+    }
+
+    header.timestamp = tscclock_ns();
+    header.source    = message->source;
+    header.dataSize  = (uint32_t)message->dataSize;
+
+    memcpy( record->buffers[record->active]+record->fill[record->active], &header, sizeof(header) );
+    memcpy( record->buffers[record->active]+record->fill[record->active]+sizeof(header), message->data, payload );
+    record->fill[record->active] += size;
+    record->recorded++;
+}
+
+int trafficrecord_start(trafficrecord_t* record,
+                        nmqueue_t*       queue,
+                        const char*      fileName,
+                        int              flags,
+                        size_t           bufferSize)
+{
+    uint32_t fileFlags[2];
+
+    /* Timestamps are taken in the tap, under the queue lock */
+    tscclock_initialize();
+
+    record->queue      = queue;
+    record->flags      = flags;
+    record->bufferSize = bufferSize;
+    record->fill[0]    = 0;
+    record->fill[1]    = 0;
+    record->active     = 0;
+    record->pending    = 0;
+    record->recorded   = 0;
+    record->dropped    = 0;
+    record->terminated = 0;
+    record->failed     = 0;
+    record->buffers[0] = (char*)malloc( bufferSize );
+    record->buffers[1] = (char*)malloc( bufferSize );
+
+    if( record->buffers[0] == NULL || record->buffers[1] == NULL )
+    {
+        free( record->buffers[0] );
+        free( record->buffers[1] );
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+
+    fileFlags[0] = flags;
+    fileFlags[1] = 0;
+
+    record->file = fopen( fileName, "wb" );
+    if( record->file == NULL ||
+        fwrite( trafficMagic, sizeof(trafficMagic), 1, record->file ) != 1 ||
+        fwrite( fileFlags, sizeof(fileFlags), 1, record->file ) != 1 )
+    {
+        if( record->file != NULL )
+        {
+            fclose( record->file );
+        }
+        free( record->buffers[0] );
+        free( record->buffers[1] );
+        return NMQUEUEERROR_IO;
+    }
+
+    if( pthread_mutex_init( &record->mutex, NULL ) != 0 )
+    {
+        fclose( record->file );
+        free( record->buffers[0] );
+        free( record->buffers[1] );
+        return NMQUEUEERROR_MUTEX_INITIALIZE_FAILED;
+    }
+
+    if( pthread_cond_init( &record->pendingCond, NULL ) != 0 )
+    {
+        pthread_mutex_destroy( &record->mutex );
+        fclose( record->file );
+        free( record->buffers[0] );
+        free( record->buffers[1] );
+        return NMQUEUEERROR_CONDVAR_INITIALIZE_FAILED;
+    }
+
+    if( pthread_create( &record->writer, NULL, writerProc, record ) != 0 )
+    {
+        pthread_cond_destroy( &record->pendingCond );
+        pthread_mutex_destroy( &record->mutex );
+        fclose( record->file );
+        free( record->buffers[0] );
+        free( record->buffers[1] );
+        return NMQUEUEERROR_OUTOFMEMORY;
+    }
+
+    nmqueue_set_tap( queue, recordTap, record );
+
+    return NMQUEUEERROR_NOERROR;
+}
+
+int trafficrecord_stop(trafficrecord_t* record)
+{
+    nmqueue_set_tap( record->queue, NULL, NULL );
+
+    pthread_mutex_lock( &record->mutex );
+    record->terminated = 1;
+    pthread_cond_signal( &record->pendingCond );
+    pthread_mutex_unlock( &record->mutex );
+
+    pthread_join( record->writer, NULL );
+
+    /* Writer wrote the pending buffer, the active one is left */
+    if( fwrite( record->buffers[record->active], 1, record->fill[record->active], record->file ) != record->fill[record->active] )
+    {
+        record->failed = 1;
+    }
+    if( fclose( record->file ) != 0 )
+    {
+        record->failed = 1;
+    }
+
+    pthread_cond_destroy( &record->pendingCond );
+    pthread_mutex_destroy( &record->mutex );
+
+    free( record->buffers[0] );
+    free( record->buffers[1] );
+
+    return record->failed ? NMQUEUEERROR_IO : NMQUEUEERROR_NOERROR;
+}
+
+int trafficrecord_load(const char*                    fileName,
+                       struct trafficrecord_entry_s** entries,
+                       size_t*                        count)
+{
+    FILE*                         file;
+    char                          magic[8];
+    uint32_t                      fileFlags[2];
+    size_t                        capacity = 0;
+    struct trafficrecord_header_s header;
+    int                           err = NMQUEUEERROR_NOERROR;
+
+    *entries = NULL;
+    *count   = 0;
+
+    file = fopen( fileName, "rb" );
+    if( file == NULL ||
+        fread( magic, sizeof(magic), 1, file ) != 1 ||
+        memcmp( magic, trafficMagic, sizeof(magic) ) != 0 ||
+        fread( fileFlags, sizeof(fileFlags), 1, file ) != 1 )
+    {
+        if( file != NULL )
+        {
+            fclose( file );
+        }
+        return NMQUEUEERROR_IO;
+    }
+
+    while( fread( &header, sizeof(header), 1, file ) == 1 )
+    {
+        struct trafficrecord_entry_s* entry;
+
+        if( *count == capacity )
+        {
+            struct trafficrecord_entry_s* grown;
+
+            capacity = capacity*2+1024;
+            grown    = (struct trafficrecord_entry_s*)realloc( *entries, capacity*sizeof(struct trafficrecord_entry_s) );
+            if( grown == NULL )
+            {
+                err = NMQUEUEERROR_OUTOFMEMORY;
+                break;
+            }
+            *entries = grown;
+        }
+
+        entry            = &(*entries)[*count];
+        entry->timestamp = header.timestamp;
+        entry->source    = header.source;
+        entry->dataSize  = header.dataSize;
+        entry->data      = NULL;
+
+        if( fileFlags[0] & TRAFFICRECORD_PAYLOAD )
+        {
+            entry->data = malloc( header.dataSize+1 );
+            if( entry->data == NULL )
+            {
+                err = NMQUEUEERROR_OUTOFMEMORY;
+                break;
+            }
+            /* Truncated last record, the ones before are kept */
+            if( fread( entry->data, 1, header.dataSize, file ) != header.dataSize )
+            {
+                free( entry->data );
+                break;
+            }
+        }
+
+        (*count)++;
+    }
+
+    fclose( file );
+
+    if( err != NMQUEUEERROR_NOERROR )
+    {
+        trafficrecord_free( *entries, *count );
+        *entries = NULL;
+        *count   = 0;
+    }
+
+    return err;
+}
+
+void trafficrecord_free(struct trafficrecord_entry_s* entries,
+                        size_t                        count)
+{
+    size_t i;
+
+    for( i=0 ; i<count ; ++i )
+    {
+        free( entries[i].data );
+    }
+    free( entries );
+}
@@ -0,0 +1,93 @@
+#ifndef _TRAFFICRECORD_HEADER_
+#define _TRAFFICRECORD_HEADER_
+
+#include "src/nmqueue.h"
+
+#include <stdio.h>
+#include <inttypes.h>
+
+/*! Record flags */
+#define TRAFFICRECORD_PAYLOAD 1 /*!< Record dataSize bytes of payload, data must point to them */
+
+/*! Recorded message, as loaded by trafficrecord_load */
+struct trafficrecord_entry_s
+{
+    uint64_t timestamp; /*!< CLOCK_MONOTONIC time in ns the message entered the queue */
+    source_t source;    /*!< Source of the message */
+    size_t   dataSize;  /*!< Size of the message */
+    void*    data;      /*!< Recorded payload or NULL */
+};
+
+/*! Traffic recorder, captures messages entering one queue into a file.
+ *  The tap appends to one of two buffers, a writer thread writes the
+ *  other one, so the queue lock never waits for file I/O. */
+typedef struct
+{
+    FILE*           file;          /*!< Recording */
+    int             flags;         /*!< TRAFFICRECORD_* */
+    nmqueue_t*      queue;         /*!< Recorded queue */
+    char*           buffers[2];    /*!< Double buffer */
+    size_t          fill[2];       /*!< Bytes used in each buffer */
+    size_t          bufferSize;    /*!< Size of each buffer */
+    int             active;        /*!< Buffer appended to by the tap */
+    int             pending;       /*!< Set while the other buffer waits to be written */
+    unsigned long   recorded;      /*!< Recorded messages */
+    unsigned long   dropped;       /*!< Messages not recorded because the writer fell behind */
+    pthread_t       writer;        /*!< Writer thread */
+    pthread_mutex_t mutex;         /*!< Protects pending and terminated */
+    pthread_cond_t  pendingCond;   /*!< Signaled when pending changes */
+    int             terminated;    /*!< Indicates the writer should shutdown */
+    int             failed;        /*!< Set once writing the file failed */
+} trafficrecord_t;
+
+/*!
+ * \brief Start recording a queue.
+ * 
+ * Installs a tap on queue, see nmqueue_set_tap. Only one recorder per queue.
+ * 
+ * \param record     Pointer to an uninitialized trafficrecord_t
+ * \param queue      Pointer to an initialized nmqueue_t
+ * \param fileName   Recording to create
+ * \param flags      TRAFFICRECORD_* or 0
+ * \param bufferSize Size of each of the two buffers
+ * \return           Error code, NMQUEUEERROR_NOERROR on success
+ */
+int trafficrecord_start(trafficrecord_t* record,
+                        nmqueue_t*       queue,
+                        const char*      fileName,
+                        int              flags,
+                        size_t           bufferSize);
+
+/*!
+ * \brief Stop recording and close the file.
+ * 
+ * \param record Pointer to a started trafficrecord_t
+ * \return       Error code, NMQUEUEERROR_IO if writing the file failed
+ */
+int trafficrecord_stop(trafficrecord_t* record);
+
+/*!
+ * \brief Load a recording.
+ * 
+ * A truncated last record, as left by an interrupted recording, is
+ * skipped.
+ * 
+ * \param fileName Recording
+ * \param entries  Reference to an array, allocated, release with trafficrecord_free
+ * \param count    Reference to a size_t, number of entries
+ * \return         Error code, NMQUEUEERROR_NOERROR on success
+ */
+int trafficrecord_load(const char*                    fileName,
+                       struct trafficrecord_entry_s** entries,
+                       size_t*                        count);
+
+/*!
+ * \brief Release a loaded recording.
+ * 
+ * \param entries Array returned by trafficrecord_load
+ * \param count   Number of entries
+ */
+void trafficrecord_free(struct trafficrecord_entry_s* entries,
+                        size_t                        count);
+
+#endif
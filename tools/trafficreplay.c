@@ -0,0 +1,285 @@
+#include "trafficreplay.h"
+#include "measureutil.h"
+#include "tscclock.h"
+
+#include "src/senderthread.h"
+#include "src/receiverthread.h"
+
+#include <stdlib.h>
+#include <time.h>
+#include <sched.h>
+
+/* State of one replayed message, passed as message data */
+typedef struct
+{
+    const struct trafficrecord_entry_s* entry;   /* Recorded message */
+    int64_t                             due;     /* Scheduled send time */
+    int64_t                             sent;    /* Actual send time */
+    int64_t                             latency; /* Receive time-sent */
+} replaymessage_t;
+
+/* Data passed to sending threads */
+typedef struct
+{
+    replaymessage_t** messages; /* Messages of the sources assigned to this thread */
+    size_t            count;    /* Number of messages */
+    size_t            index;    /* Next message */
+} replaysender_t;
+
+/* Data passed to receiving threads */
+typedef struct
+{
+    volatile long     count;        /* Received messages */
+    int64_t           lastTime;     /* Time of the last receive */
+    replaymessage_t** byPayload;    /* Messages with a recorded payload, sorted by its address */
+    size_t            payloadCount; /* Entries of byPayload */
+} replayreceiver_t;
+
+/* Idle strategy of the sending threads once all messages are sent */
+static const idleconfig_t replayIdle = { IDLESTRATEGY_BACKOFF, 100, 1, 1000 };
+
+/* Time in ns of the TSC clock, on the CLOCK_MONOTONIC time line */
+static int64_t replayNow(void)
+{
+    return (int64_t)tscclock_ns();
+}
+
+/* Callback for sending threads, returns the next message once due */
+static int replayProducer(source_t* source,
+                          void**    data,
+                          size_t*   dataSize,
+                          void*     param)
+{
+    replaysender_t*  sender = (replaysender_t*)param;
+    replaymessage_t* message;
+    int64_t          now;
+
+    if( sender->index == sender->count )
+    {
+        return SENDERTHREAD_NODATA;
+    }
+
+    message = sender->messages[sender->index];
+
+    /* Sleep while far from due, spin for the rest */
+    while( (now=replayNow()) < message->due )
+    {
+        int64_t remaining = message->due-now;
+
+        if( remaining > 100*1000 )
+        {
+            struct timespec delay;
+            delay.tv_sec  = (remaining-50*1000)/(1000*1000*1000);
+            delay.tv_nsec = (remaining-50*1000)%(1000*1000*1000);
+            nanosleep( &delay, NULL );
+        }
+    }
+
+    message->sent = now;
+
+    /* The recorded payload if there is one, receivers look the message up by it */
+    *source   = message->entry->source;
+    *data     = message->entry->data != NULL ? message->entry->data : (void*)message;
+    *dataSize = message->entry->dataSize;
+
+    sender->index++;
+
+    return SENDERTHREAD_DATA;
+}
+
+/* Orders messages by the address of their recorded payload */
+static int comparePayload(const void* left,
+                          const void* right)
+{
+    uintptr_t l = (uintptr_t)(*(replaymessage_t* const*)left)->entry->data;
+    uintptr_t r = (uintptr_t)(*(replaymessage_t* const*)right)->entry->data;
+    return l < r ? -1 : l > r;
+}
+
+/* Finds a payload address in byPayload */
+static int findPayload(const void* key,
+                       const void* element)
+{
+    uintptr_t l = (uintptr_t)*(void* const*)key;
+    uintptr_t r = (uintptr_t)(*(replaymessage_t* const*)element)->entry->data;
+    return l < r ? -1 : l > r;
+}
+
+/* Callback for receiving threads */
+static void replayConsumer(source_t source,
+                           void*    data,
+                           size_t   dataSize,
+                           void*    param)
+{
+    replayreceiver_t* receiver = (replayreceiver_t*)param;
+    int64_t           now      = replayNow();
+    replaymessage_t** found    = (replaymessage_t**)bsearch( &data, receiver->byPayload, receiver->payloadCount,
+                                                             sizeof(replaymessage_t*), findPayload );
+    replaymessage_t*  message  = found != NULL ? *found : (replaymessage_t*)data;
+
+    message->latency   = now-message->sent;
+    receiver->lastTime = now;
+    receiver->count++;
+}
+
+static int compareLatency(const void* left,
+                          const void* right)
+{
+    int64_t l = *(const int64_t*)left;
+    int64_t r = *(const int64_t*)right;
+    return l < r ? -1 : l > r;
+}
+
+/* Total number of received messages */
+static size_t replayReceived(replayreceiver_t* receivers,
+                             size_t            count)
+{
+    size_t i;
+    size_t received = 0;
+
+    for( i=0 ; i<count ; ++i )
+    {
+        received += receivers[i].count;
+    }
+    return received;
+}
+
+int trafficreplay_run(nmqueue_t*                          queue,
+                      const struct trafficrecord_entry_s* entries,
+                      size_t                              count,
+                      size_t                              senders,
+                      size_t                              receivers,
+                      double                              speed,
+                      trafficreplay_stats_t*              stats)
+{
+    replaymessage_t*  messages       = (replaymessage_t*)malloc( count*sizeof(replaymessage_t) );
+    replaymessage_t** order          = (replaymessage_t**)malloc( count*sizeof(replaymessage_t*) );
+    replaymessage_t** byPayload      = (replaymessage_t**)malloc( count*sizeof(replaymessage_t*) );
+    int64_t*          latencies      = (int64_t*)malloc( count*sizeof(int64_t) );
+    replaysender_t*   senderData     = (replaysender_t*)malloc( senders*sizeof(replaysender_t) );
+    replayreceiver_t* receiverData   = (replayreceiver_t*)malloc( receivers*sizeof(replayreceiver_t) );
+    senderthread_t*   senderThreads  = (senderthread_t*)malloc( senders*sizeof(senderthread_t) );
+    receiverthread_t* receiverThreads= (receiverthread_t*)malloc( receivers*sizeof(receiverthread_t) );
+    int64_t           start;
+    int64_t           stop = 0;
+    int64_t           lag  = 0;
+    size_t            payloadCount = 0;
+    size_t            i;
+    size_t            next;
+
+    if( messages == NULL || order == NULL || byPayload == NULL || latencies == NULL || senderData == NULL ||
+        receiverData == NULL || senderThreads == NULL || receiverThreads == NULL || count == 0 )
+    {
+        free( messages ); free( order ); free( byPayload ); free( latencies ); free( senderData );
+        free( receiverData ); free( senderThreads ); free( receiverThreads );
+        return 1;
+    }
+
+    tscclock_initialize();
+
+    /* Schedule relative to a common start point */
+    start = replayNow()+10*1000*1000;
+
+    for( i=0 ; i<count ; ++i )
+    {
+        messages[i].entry   = &entries[i];
+        messages[i].due     = speed > 0 ? start+(int64_t)((entries[i].timestamp-entries[0].timestamp)/speed) : start;
+        messages[i].sent    = 0;
+        messages[i].latency = 0;
+
+        if( entries[i].data != NULL )
+        {
+            byPayload[payloadCount++] = &messages[i];
+        }
+    }
+
+    qsort( byPayload, payloadCount, sizeof(replaymessage_t*), comparePayload );
+
+    /* Assign sources to sending threads, keeping recorded order per thread */
+    next = 0;
+    for( i=0 ; i<senders ; ++i )
+    {
+        size_t j;
+
+        senderData[i].messages = &order[next];
+        senderData[i].index    = 0;
+        senderData[i].count    = 0;
+
+        for( j=0 ; j<count ; ++j )
+        {
+            if( (size_t)entries[j].source%senders == i )
+            {
+                order[next++] = &messages[j];
+                senderData[i].count++;
+            }
+        }
+    }
+
+    for( i=0 ; i<receivers ; ++i )
+    {
+        receiverData[i].count        = 0;
+        receiverData[i].lastTime     = 0;
+        receiverData[i].byPayload    = byPayload;
+        receiverData[i].payloadCount = payloadCount;
+        initializeReceiver( &receiverThreads[i], queue, replayConsumer, &receiverData[i] );
+    }
+
+    for( i=0 ; i<senders ; ++i )
+    {
+        initializeSenderIdle( &senderThreads[i], queue, replayProducer, &senderData[i], &replayIdle );
+    }
+
+    while( replayReceived( receiverData, receivers ) < count )
+    {
+        struct timespec delay = { 0, 1000*1000 };
+        nanosleep( &delay, NULL );
+    }
+
+    for( i=0 ; i<senders ; ++i )
+    {
+        finalizeSender( &senderThreads[i] );
+    }
+
+    for( i=0 ; i<receivers ; ++i )
+    {
+        finalizeReceiver( &receiverThreads[i] );
+        if( receiverData[i].lastTime > stop )
+        {
+            stop = receiverData[i].lastTime;
+        }
+    }
+
+    for( i=0 ; i<count ; ++i )
+    {
+        latencies[i] = messages[i].latency;
+        lag         += messages[i].sent-messages[i].due;
+    }
+
+    stats->messages    = count;
+    stats->duration    = stop-start;
+    stats->meanLatency = mu_mean( latencies, count );
+    stats->devLatency  = mu_deviation( latencies, count );
+    stats->meanLag     = lag/(int64_t)count;
+
+    qsort( latencies, count, sizeof(int64_t), compareLatency );
+
+    stats->medianLatency = latencies[count/2];
+    stats->p99Latency    = latencies[count*99/100];
+    stats->maxLatency    = latencies[count-1];
+
+    free( messages ); free( order ); free( byPayload ); free( latencies ); free( senderData );
+    free( receiverData ); free( senderThreads ); free( receiverThreads );
+
+    return 0;
+}
+
+void trafficreplay_print(FILE*                        file,
+                         const trafficreplay_stats_t* stats)
+{
+    fprintf( file, "Replayed %lu messages in %li µs\n",
+             (unsigned long)stats->messages, (long int)(stats->duration/1000) );
+    fprintf( file, "Latency mean %li ns +- %li, median %li ns, p99 %li ns, max %li ns\n",
+             (long int)stats->meanLatency, (long int)stats->devLatency,
+             (long int)stats->medianLatency, (long int)stats->p99Latency, (long int)stats->maxLatency );
+    fprintf( file, "Send lag behind schedule mean %li ns\n", (long int)stats->meanLag );
+}
@@ -0,0 +1,55 @@
+#ifndef _TRAFFICREPLAY_HEADER_
+#define _TRAFFICREPLAY_HEADER_
+
+#include "tools/trafficrecord.h"
+
+/*! Statistics of a replay, latencies are from send to receive in ns */
+typedef struct
+{
+    size_t   messages;      /*!< Replayed messages */
+    uint64_t duration;      /*!< Time from the first send to the last receive in ns */
+    int64_t  meanLatency;   /*!< Mean latency */
+    int64_t  devLatency;    /*!< Standard deviation of the latency */
+    int64_t  medianLatency; /*!< 50th percentile */
+    int64_t  p99Latency;    /*!< 99th percentile */
+    int64_t  maxLatency;    /*!< Maximum latency */
+    int64_t  meanLag;       /*!< Mean delay of the sends behind the recorded schedule */
+} trafficreplay_stats_t;
+
+/*!
+ * \brief Replay a recording through a queue.
+ * 
+ * Entries are distributed over senders sending threads by source, so the
+ * order of every source is kept. Each message is sent at its recorded time
+ * relative to the first entry divided by speed, a speed of 0 sends as fast
+ * as possible. Recorded payloads are sent as data with their size.
+ * receivers receiving threads consume the messages.
+ * The queue must not be used by anyone else during the replay.
+ * 
+ * \param queue     Pointer to an initialized nmqueue_t
+ * \param entries   Recording, see trafficrecord_load
+ * \param count     Number of entries
+ * \param senders   Number of sending threads, not 0
+ * \param receivers Number of receiving threads, not 0
+ * \param speed     Time scale, 1 for original speed, 0 for maximum speed
+ * \param stats     Reference to trafficreplay_stats_t
+ * \return          0 on success, 1 on error
+ */
+int trafficreplay_run(nmqueue_t*                          queue,
+                      const struct trafficrecord_entry_s* entries,
+                      size_t                              count,
+                      size_t                              senders,
+                      size_t                              receivers,
+                      double                              speed,
+                      trafficreplay_stats_t*              stats);
+
+/*!
+ * \brief Print replay statistics.
+ * 
+ * \param file  Output
+ * \param stats Statistics of trafficreplay_run
+ */
+void trafficreplay_print(FILE*                        file,
+                         const trafficreplay_stats_t* stats);
+
+#endif
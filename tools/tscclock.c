@@ -0,0 +1,160 @@
+#include "tscclock.h"
+
+#include <time.h>
+#include <pthread.h>
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define TSCCLOCK_X86
+#include <cpuid.h>
+#endif
+
+/* Calibration samples, the tightest bracket is kept */
+#define TSCCLOCK_SAMPLES 5
+
+/* Calibration interval in ns */
+#define TSCCLOCK_INTERVAL (20*1000*1000)
+
+static pthread_once_t calibrated = PTHREAD_ONCE_INIT;
+
+static volatile int useTsc   = 0; /* Set once calibrated on an invariant TSC */
+static uint64_t     baseTsc  = 0; /* TSC at baseNs */
+static uint64_t     baseNs   = 0; /* CLOCK_MONOTONIC in ns at baseTsc */
+static uint64_t     nsPerTsc = 0; /* ns per tick, fixed point with 32 fraction bits */
+
+/* CLOCK_MONOTONIC in ns */
+static uint64_t monotonicNs(void)
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t)now.tv_sec*1000*1000*1000+now.tv_nsec;
+}
+
+#ifdef TSCCLOCK_X86
+
+/* Time stamp counter */
+static uint64_t readTsc(void)
+{
+    uint32_t low;
+    uint32_t high;
+    __asm__ __volatile__( "rdtsc" : "=a"(low), "=d"(high) );
+    return ((uint64_t)high<<32) | low;
+}
+
+/* Checks cpuid for a TSC with constant rate in all power states */
+static int invariantTsc(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if( __get_cpuid( 0x80000000, &eax, &ebx, &ecx, &edx ) == 0 || eax < 0x80000007 )
+    {
+        return 0;
+    }
+    __get_cpuid( 0x80000007, &eax, &ebx, &ecx, &edx );
+
+    return ( edx & (1<<8) ) != 0;
+}
+
+/* Reads TSC and CLOCK_MONOTONIC as close together as possible */
+static void samplePair(uint64_t* tsc,
+                       uint64_t* ns)
+{
+    uint64_t best = (uint64_t)-1;
+    int      i;
+
+    for( i=0 ; i<TSCCLOCK_SAMPLES ; ++i )
+    {
+        uint64_t before = readTsc();
+        uint64_t now    = monotonicNs();
+        uint64_t after  = readTsc();
+
+        if( after-before < best )
+        {
+            best = after-before;
+            *tsc = before+(after-before)/2;
+            *ns  = now;
+        }
+    }
+}
+
+#endif
+
+/* Converts TSC ticks to ns, split to avoid overflowing 64 bits */
+static uint64_t tscToNs(uint64_t ticks)
+{
+    return (ticks>>32)*nsPerTsc + (((ticks & 0xffffffffu)*nsPerTsc)>>32);
+}
+
+static void calibrate(void)
+{
+#ifdef TSCCLOCK_X86
+    uint64_t        startTsc, startNs;
+    uint64_t        stopTsc, stopNs;
+    struct timespec interval;
+
+    if( !invariantTsc() )
+    {
+        return;
+    }
+
+    samplePair( &startTsc, &startNs );
+
+    interval.tv_sec  = 0;
+    interval.tv_nsec = TSCCLOCK_INTERVAL;
+    while( nanosleep( &interval, &interval ) != 0 );
+
+    samplePair( &stopTsc, &stopNs );
+
+    if( stopTsc <= startTsc || stopNs <= startNs )
+    {
+        return;
+    }
+
+    nsPerTsc = ( (stopNs-startNs)<<32 )/(stopTsc-startTsc);
+    baseTsc  = stopTsc;
+    baseNs   = stopNs;
+
+    /* Publish after the calibration values */
+    __sync_synchronize();
+    useTsc = 1;
+#endif
+}
+
+int tscclock_initialize(void)
+{
+    pthread_once( &calibrated, calibrate );
+    return useTsc;
+}
+
+uint64_t tscclock_ticks(void)
+{
+#ifdef TSCCLOCK_X86
+    if( useTsc )
+    {
+        return readTsc();
+    }
+#endif
+    return monotonicNs();
+}
+
+uint64_t tscclock_ticks_to_ns(uint64_t ticks)
+{
+    return useTsc ? tscToNs( ticks ) : ticks;
+}
+
+uint64_t tscclock_ns(void)
+{
+#ifdef TSCCLOCK_X86
+    if( useTsc )
+    {
+        /* TSC values before the calibration (other cores) count as base */
+        uint64_t tsc = readTsc();
+        return baseNs + ( tsc > baseTsc ? tscToNs( tsc-baseTsc ) : 0 );
+    }
+#endif
+    return monotonicNs();
+}
+
+uint64_t tscclock_us(void)
+{
+    return tscclock_ns()/1000;
+}
@@ -0,0 +1,50 @@
+#ifndef _TSCCLOCK_HEADER_
+#define _TSCCLOCK_HEADER_
+
+#include <inttypes.h>
+
+/*
+ * Low overhead timestamps from the time stamp counter, calibrated against
+ * CLOCK_MONOTONIC. Without an invariant TSC (or on other architectures)
+ * all functions fall back to clock_gettime( CLOCK_MONOTONIC ).
+ */
+
+/*!
+ * \brief Calibrates the clock, safe to call more than once and from any thread.
+ *
+ * Takes about 20ms on the first call. Until then tscclock_* use the fallback.
+ *
+ * \return 1 if the TSC is used, 0 for the fallback
+ */
+int tscclock_initialize(void);
+
+/*!
+ * \brief Raw clock ticks, only meaningful as difference passed to tscclock_ticks_to_ns.
+ *
+ * \return TSC value, or CLOCK_MONOTONIC in ns for the fallback
+ */
+uint64_t tscclock_ticks(void);
+
+/*!
+ * \brief Converts a difference of tscclock_ticks values to ns.
+ *
+ * \param ticks Difference of two tscclock_ticks values
+ * \return      Nanoseconds
+ */
+uint64_t tscclock_ticks_to_ns(uint64_t ticks);
+
+/*!
+ * \brief Current time in ns, on the CLOCK_MONOTONIC time line.
+ *
+ * \return CLOCK_MONOTONIC time in ns
+ */
+uint64_t tscclock_ns(void);
+
+/*!
+ * \brief Current time in µs, on the CLOCK_MONOTONIC time line.
+ *
+ * \return CLOCK_MONOTONIC time in µs, truncated
+ */
+uint64_t tscclock_us(void);
+
+#endif